@@ -36,8 +36,12 @@
 #error "Unknown byte order"
 #endif
 
+#ifndef FIRMWARE_DIRECTORY
 #define FIRMWARE_DIRECTORY "/vendor/etc/firmware/%s"
+#endif
+#ifndef BT_CONFIG_DIRECTORY
 #define BT_CONFIG_DIRECTORY "/vendor/etc/firmware/%s"
+#endif
 #define PATCH_DATA_FIELD_MAX_SIZE 252
 #define RTK_VENDOR_CONFIG_MAGIC 0x8723ab55
 #define MAX_PATCH_SIZE_24K (1024 * 24) // 24K
@@ -87,6 +91,7 @@ struct rtk_bt_vendor_config {
 #define CONFIG_MAC_OFFSET_GEN_3PLUS (0x44) // MAC's OFFSET in config/efuse for rtk generation 3+ bluetooth chip
 #define CONFIG_MAC_OFFSET_GEN_4PLUS (0x30) // MAC's OFFSET in config/efuse for rtk generation 4+ bluetooth chip
 
+#define HCI_EVT_CMD_CMPL_NUM_PKTS_OFFSET (2) // Num_HCI_Command_Packets's offset in COMMAND Completed Event
 #define HCI_EVT_CMD_CMPL_OPCODE_OFFSET (3) // opcode's offset in COMMAND Completed Event
 #define HCI_EVT_CMD_CMPL_STATUS_OFFSET (5) // status's offset in COMMAND Completed Event
 
@@ -157,6 +162,9 @@ typedef struct {
     uint8_t patch_frag_idx;  /* Current patch fragment index */
     uint8_t patch_frag_len;  /* Patch fragment length */
     uint8_t patch_frag_tail; /* Last patch fragment length */
+    uint8_t patch_frag_sent; /* Patch fragments sent so far */
+    uint8_t patch_frag_inflight; /* Patch fragments sent but not acked */
+    uint8_t patch_credits;   /* controller Num_HCI_Command_Packets at the last ack */
     uint8_t hw_flow_cntrl;   /* Uart flow control, bit7:set, bit0:enable */
     uint16_t vid;            /* usb vendor id */
     uint16_t pid;            /* usb product id */
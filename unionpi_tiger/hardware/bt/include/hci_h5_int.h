@@ -46,6 +46,12 @@
 #define HCI_READ_LMP_VERSION 0x1001
 #define HCI_VENDOR_RESET 0x0C03
 #define HCI_VENDOR_FORCE_RESET_AND_PATCHABLE 0xFC66
+// coex, heartbeat and rtkbt service vendor commands
+#define HCI_VENDOR_SET_PROFILE_REPORT_COMMAND 0xFC19
+#define HCI_VENDOR_COEX_INFO 0xFC1B
+#define HCI_VENDOR_ADD_BITPOOL_FW 0xFC51
+#define HCI_VENDOR_MAILBOX_CMD 0xFC8F
+#define HCI_CMD_VNDR_HEARTBEAT 0xFC94
 
 void ms_delay(uint32_t timeout);
 
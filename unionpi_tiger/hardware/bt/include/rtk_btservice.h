@@ -33,6 +33,8 @@ typedef struct Rtk_Service_Data {
 
 void RTK_btservice_destroyed(void);
 void Rtk_Service_Vendorcmd_Hook(Rtk_Service_Data *RtkData, int client_sock);
+void Rtk_Service_Cmd_Complete(void *p_mem);
+void Rtk_Service_Cmd_Credits_Notify(void);
 int RTK_btservice_init(void);
 
 #endif
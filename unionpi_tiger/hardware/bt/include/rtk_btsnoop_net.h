@@ -62,5 +62,9 @@ void set_rtk_btsnoop_net_dump(bool btsnoop_net_dump);
 bool get_rtk_btsnoop_net_dump(void);
 void set_rtk_btsnoop_save_log(bool btsnoop_save_log);
 char *get_rtk_btsnoop_path(void);
+void set_rtk_btsnoop_max_file_size(uint64_t max_file_size);
+void set_rtk_btsnoop_rotate_interval(uint32_t rotate_interval);
+void set_rtk_btsnoop_max_files(uint32_t max_files);
+uint32_t get_rtk_btsnoop_drops(void);
 
 #endif
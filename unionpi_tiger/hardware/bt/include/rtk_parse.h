@@ -149,5 +149,6 @@ struct rtp_header {
 
 void hw_process_event(HC_BT_HDR *p_buf);
 void rtk_vendor_cmd_to_fw(uint16_t opcode, uint8_t parameter_len, uint8_t *parameter, tINT_CMD_CBACK p_cback);
+void rtk_vendor_cmd_xmit(uint16_t opcode, uint8_t parameter_len, uint8_t *parameter);
 
 #endif /* RTK_PARSE_H */
@@ -191,6 +191,10 @@ int userial_vendor_usb_open(void);
 
 void userial_recv_rawdata_hook(unsigned char *buffer, unsigned int total_length);
 
+uint8_t userial_vendor_get_cmd_credits(void);
+
+int userial_vendor_take_cmd_credit(void);
+
 #define RTK_HANDLE_EVENT
 #define RTK_HANDLE_CMD
 #endif /* USERIAL_VENDOR_H */
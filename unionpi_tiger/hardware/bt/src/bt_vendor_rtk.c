@@ -31,6 +31,7 @@
 #include "bt_vendor_rtk.h"
 
 #include <string.h>
+#include <strings.h>
 #include <utils/Log.h>
 
 #include "upio.h"
@@ -75,7 +76,9 @@ bool rtkbt_auto_restart = false;
 **  Local type definitions
 ******************************************************************************/
 #define DEVICE_NODE_MAX_LEN 512
+#ifndef RTKBT_CONF_FILE
 #define RTKBT_CONF_FILE "/vendor/etc/bluetooth/rtkbt.conf"
+#endif
 #define USB_DEVICE_DIR "/sys/bus/usb/devices"
 #define DEBUG_SCAN_USB FALSE
 
@@ -239,6 +242,7 @@ static void load_rtkbt_conf(void)
     int line_num = 0;
     char line[1024];
     char *lineptr = NULL;
+    char transtype = RTKBT_TRANS_H5;
 
     (void)memset_s(rtkbt_device_node, sizeof(rtkbt_device_node), 0, sizeof(rtkbt_device_node));
     FILE *fp = fopen(RTKBT_CONF_FILE, "rt");
@@ -268,14 +272,17 @@ static void load_rtkbt_conf(void)
         *split = '\0';
         if (!strcmp(rtk_trim(line_ptr), "BtDeviceNode")) {
             (void)strcpy_s(rtkbt_device_node, sizeof(rtkbt_device_node), rtk_trim(split + 1));
+        } else if (!strcmp(rtk_trim(line_ptr), "BtUartTransport")) {
+            if (!strcasecmp(rtk_trim(split + 1), "h4")) {
+                transtype = RTKBT_TRANS_H4;
+            }
         }
     }
 
     (void)fclose(fp);
 
     /* default H5 (Uart) */
-    rtkbt_transtype |= RTKBT_TRANS_H5;
-    rtkbt_transtype |= RTKBT_TRANS_UART;
+    rtkbt_transtype = transtype | RTKBT_TRANS_UART;
 }
 
 static void rtkbt_stack_conf_cleanup(void)
@@ -340,6 +347,12 @@ static void load_rtkbt_stack_conf(void)
             if (!strcmp(rtk_trim(split + 1), "true")) {
                 set_rtk_btsnoop_save_log (true);
             }
+        } else if (!strcmp(rtk_trim(line_ptr), "BtSnoopMaxFileSize")) {
+            set_rtk_btsnoop_max_file_size(strtoull(rtk_trim(split + 1), &endptr, 0));
+        } else if (!strcmp(rtk_trim(line_ptr), "BtSnoopRotateInterval")) {
+            set_rtk_btsnoop_rotate_interval(strtoul(rtk_trim(split + 1), &endptr, 0));
+        } else if (!strcmp(rtk_trim(line_ptr), "BtSnoopMaxFiles")) {
+            set_rtk_btsnoop_max_files(strtoul(rtk_trim(split + 1), &endptr, 0));
         } else if (!strcmp(rtk_trim(line_ptr), "BtCoexLogOutput")) {
             ret_coex_log_onoff = strtol(rtk_trim(split + 1), &endptr, 0);
             set_coex_log_onoff(ret_coex_log_onoff);
@@ -132,6 +132,42 @@ static patch_info patch_table[] = {
     {LMP_SUBVERSION_NONE, HCI_VERSION_MASK_ALL, HCI_REVISION_MASK_ALL, CHIP_TYPE_MASK_ALL, PROJECT_ID_MASK_ALL,
      "rtl_none_fw", "rtl_none_config", CONFIG_MAC_OFFSET_GEN_1_2, MAX_PATCH_SIZE_24K}};
 
+/*
+ * The merged patch+config image is kept across BT on/off cycles. It is
+ * reused as long as the chip, the local bd address and the firmware/config
+ * files (size and mtime) are unchanged.
+ */
+typedef struct {
+    const patch_info *patch;
+    uint8_t eversion;
+    uint8_t chip_type;
+    uint8_t bd_addr[BD_ADDR_LEN];
+    time_t fw_mtime;
+    off_t fw_size;
+    time_t config_mtime;
+    off_t config_size;
+    time_t extra_mtime;
+    off_t extra_size;
+} rtk_patch_cache_key_t;
+
+typedef struct {
+    bool valid;
+    rtk_patch_cache_key_t key;
+    uint8_t *total_buf;
+    unsigned int total_len;
+    uint32_t baudrate;
+    uint8_t hw_flow_cntrl;
+    uint8_t heartbeat;
+} rtk_patch_cache_t;
+
+static rtk_patch_cache_t rtk_patch_cache;
+
+/* Max patch fragments in flight, further limited by the controller's command credits. */
+#define RTK_PATCH_DL_MAX_INFLIGHT 4
+
+static uint64_t hw_cfg_start_ms;
+static uint64_t hw_cfg_dl_start_ms;
+
 // signature: realtech
 static const uint8_t RTK_EPATCH_SIGNATURE[8] = {0x52, 0x65, 0x61, 0x6C, 0x74, 0x65, 0x63, 0x68};
 // Extension Section IGNATURE:0x77FD0451
@@ -995,6 +1031,97 @@ static uint32_t rtk_get_bt_config(unsigned char **config_buf, uint32_t *config_b
     return filelen;
 }
 
+static uint64_t hw_cfg_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static void rtk_patch_cache_stat(const char *short_name, time_t *mtime, off_t *size)
+{
+    char file_name[PATH_MAX] = {0};
+    struct stat st;
+
+    (void)sprintf_s(file_name, sizeof(file_name), FIRMWARE_DIRECTORY, short_name);
+    if (stat(file_name, &st) == 0) {
+        *mtime = st.st_mtime;
+        *size = st.st_size;
+    }
+}
+
+static void rtk_patch_cache_make_key(const patch_info *patch, rtk_patch_cache_key_t *key)
+{
+    struct stat st;
+
+    (void)memset_s(key, sizeof(*key), 0, sizeof(*key));
+    key->patch = patch;
+    key->eversion = hw_cfg_cb.eversion;
+    key->chip_type = hw_cfg_cb.chip_type;
+    (void)memcpy_s(key->bd_addr, sizeof(key->bd_addr), get_vnd_local_bd_addr(), BD_ADDR_LEN);
+    rtk_patch_cache_stat(patch->patch_name, &key->fw_mtime, &key->fw_size);
+    rtk_patch_cache_stat(patch->config_name, &key->config_mtime, &key->config_size);
+    if (stat(EXTRA_CONFIG_FILE, &st) == 0) {
+        key->extra_mtime = st.st_mtime;
+        key->extra_size = st.st_size;
+    }
+}
+
+static bool rtk_patch_cache_lookup(const rtk_patch_cache_key_t *key)
+{
+    if (!rtk_patch_cache.valid || memcmp(&rtk_patch_cache.key, key, sizeof(*key)) != 0) {
+        return false;
+    }
+
+    hw_cfg_cb.total_buf = rtk_patch_cache.total_buf;
+    hw_cfg_cb.total_len = rtk_patch_cache.total_len;
+    hw_cfg_cb.baudrate = rtk_patch_cache.baudrate;
+    hw_cfg_cb.hw_flow_cntrl = rtk_patch_cache.hw_flow_cntrl;
+    hw_cfg_cb.heartbeat = rtk_patch_cache.heartbeat;
+    hw_cfg_cb.dl_fw_flag = 1;
+    HILOGI("use cached fw&config image, total_len = 0x%x", hw_cfg_cb.total_len);
+    return true;
+}
+
+static void rtk_patch_cache_store(const rtk_patch_cache_key_t *key)
+{
+    if (!hw_cfg_cb.dl_fw_flag || hw_cfg_cb.total_len == 0 || hw_cfg_cb.total_len > hw_cfg_cb.max_patch_size) {
+        return;
+    }
+
+    if (rtk_patch_cache.valid && rtk_patch_cache.total_buf != hw_cfg_cb.total_buf) {
+        free(rtk_patch_cache.total_buf);
+    }
+    (void)memcpy_s(&rtk_patch_cache.key, sizeof(rtk_patch_cache.key), key, sizeof(*key));
+    rtk_patch_cache.total_buf = hw_cfg_cb.total_buf;
+    rtk_patch_cache.total_len = hw_cfg_cb.total_len;
+    rtk_patch_cache.baudrate = hw_cfg_cb.baudrate;
+    rtk_patch_cache.hw_flow_cntrl = hw_cfg_cb.hw_flow_cntrl;
+    rtk_patch_cache.heartbeat = hw_cfg_cb.heartbeat;
+    rtk_patch_cache.valid = true;
+
+    // only the merged image is needed from now on
+    if (hw_cfg_cb.fw_len > 0) {
+        free(hw_cfg_cb.fw_buf);
+        hw_cfg_cb.fw_len = 0;
+    }
+    if (hw_cfg_cb.config_len > 0) {
+        free(hw_cfg_cb.config_buf);
+        hw_cfg_cb.config_len = 0;
+    }
+}
+
+/* The merged image belongs to the cache once stored, only free it otherwise. */
+static void rtk_release_total_buf(void)
+{
+    if (hw_cfg_cb.total_len && !(rtk_patch_cache.valid && hw_cfg_cb.total_buf == rtk_patch_cache.total_buf)) {
+        free(hw_cfg_cb.total_buf);
+    }
+    hw_cfg_cb.total_buf = NULL;
+    hw_cfg_cb.total_len = 0;
+}
+
 static int hci_download_patch_h4(HC_BT_HDR *p_buf, int index, uint8_t *data, int len)
 {
     int retval = FALSE;
@@ -1012,6 +1139,69 @@ static int hci_download_patch_h4(HC_BT_HDR *p_buf, int index, uint8_t *data, int
     return retval;
 }
 
+/*
+ * Keep up to min(controller credits, RTK_PATCH_DL_MAX_INFLIGHT) fragments in
+ * flight. The last fragment is only sent once every earlier one is acked, its
+ * command complete ends the download.
+ */
+static int hci_download_patch_window(HC_BT_HDR *p_buf)
+{
+    uint8_t window = hw_cfg_cb.patch_credits;
+    uint8_t index;
+    uint8_t frag;
+    int is_proceeding = TRUE;
+
+    if (window > RTK_PATCH_DL_MAX_INFLIGHT) {
+        window = RTK_PATCH_DL_MAX_INFLIGHT;
+    } else if (window == 0) {
+        window = 1;
+    }
+
+    while (hw_cfg_cb.patch_frag_sent < hw_cfg_cb.patch_frag_cnt && hw_cfg_cb.patch_frag_inflight < window) {
+        frag = hw_cfg_cb.patch_frag_sent;
+        index = frag ? ((frag - 1) % 0x7f + 1) : 0;
+        if (frag == hw_cfg_cb.patch_frag_cnt - 1) {
+            if (hw_cfg_cb.patch_frag_inflight) {
+                break;
+            }
+            BTVNDDBG("HW_CFG_DL_FW_PATCH: send last fw fragment");
+            index |= 0x80;
+            hw_cfg_cb.patch_frag_len = hw_cfg_cb.patch_frag_tail;
+        } else {
+            index &= 0x7F;
+            hw_cfg_cb.patch_frag_len = PATCH_DATA_FIELD_MAX_SIZE;
+        }
+
+        if (p_buf == NULL) {
+            p_buf = (HC_BT_HDR *)bt_vendor_cbacks->alloc(BT_HC_HDR_SIZE + HCI_CMD_MAX_LEN);
+            if (p_buf == NULL) {
+                HILOGE("%s buffer alloc fail!", __func__);
+                return hw_cfg_cb.patch_frag_inflight ? TRUE : FALSE;
+            }
+            p_buf->event = MSG_STACK_TO_HC_HCI_CMD;
+            p_buf->offset = 0;
+            p_buf->len = 0;
+            p_buf->layer_specific = 0;
+        }
+
+        is_proceeding = hci_download_patch_h4(p_buf, index,
+                                              hw_cfg_cb.total_buf + (frag * PATCH_DATA_FIELD_MAX_SIZE),
+                                              hw_cfg_cb.patch_frag_len);
+        if (is_proceeding == FALSE) {
+            return FALSE;
+        }
+        p_buf = NULL;
+        hw_cfg_cb.patch_frag_sent++;
+        hw_cfg_cb.patch_frag_inflight++;
+    }
+
+    // nothing could be sent with this event, wait for further acks
+    if (p_buf != NULL) {
+        bt_vendor_cbacks->dealloc(p_buf);
+    }
+    return is_proceeding;
+}
+
 /*******************************************************************************
 **
 ** Function         hw_config_cback
@@ -1034,6 +1224,7 @@ void hw_config_cback(void *p_evt_buf)
     patch_info *prtk_patch_file_info = NULL;
     uint32_t host_baudrate = 0;
     bool rtkbt_auto_restart_onoff = get_rtkbt_auto_restart();
+    rtk_patch_cache_key_t cache_key;
 
 #if (USE_CONTROLLER_BDADDR == TRUE)
 #endif
@@ -1214,21 +1405,25 @@ void hw_config_cback(void *p_evt_buf)
                     break;
                 }
                 hw_cfg_cb.max_patch_size = prtk_patch_file_info->max_patch_size;
-                hw_cfg_cb.config_len =
-                    rtk_get_bt_config(&hw_cfg_cb.config_buf, &hw_cfg_cb.baudrate, prtk_patch_file_info->config_name,
-                                      prtk_patch_file_info->mac_offset);
-                if (hw_cfg_cb.config_len == 0) {
-                    HILOGE("Get Config file fail, just use efuse settings");
-                }
-                rtk_update_altsettings(prtk_patch_file_info, hw_cfg_cb.config_buf, &(hw_cfg_cb.config_len));
+                rtk_patch_cache_make_key(prtk_patch_file_info, &cache_key);
+                if (!rtk_patch_cache_lookup(&cache_key)) {
+                    hw_cfg_cb.config_len = rtk_get_bt_config(&hw_cfg_cb.config_buf, &hw_cfg_cb.baudrate,
+                                                             prtk_patch_file_info->config_name,
+                                                             prtk_patch_file_info->mac_offset);
+                    if (hw_cfg_cb.config_len == 0) {
+                        HILOGE("Get Config file fail, just use efuse settings");
+                    }
+                    rtk_update_altsettings(prtk_patch_file_info, hw_cfg_cb.config_buf, &(hw_cfg_cb.config_len));
 
-                hw_cfg_cb.fw_len = rtk_get_bt_firmware(&hw_cfg_cb.fw_buf, prtk_patch_file_info->patch_name);
-                if (hw_cfg_cb.fw_len < 0) {
-                    HILOGE("Get BT firmware fail");
-                    hw_cfg_cb.fw_len = 0;
-                } else {
-                    hw_cfg_cb.project_id_mask = prtk_patch_file_info->project_id_mask;
-                    rtk_get_bt_final_patch(&hw_cfg_cb);
+                    hw_cfg_cb.fw_len = rtk_get_bt_firmware(&hw_cfg_cb.fw_buf, prtk_patch_file_info->patch_name);
+                    if (hw_cfg_cb.fw_len < 0) {
+                        HILOGE("Get BT firmware fail");
+                        hw_cfg_cb.fw_len = 0;
+                    } else {
+                        hw_cfg_cb.project_id_mask = prtk_patch_file_info->project_id_mask;
+                        rtk_get_bt_final_patch(&hw_cfg_cb);
+                        rtk_patch_cache_store(&cache_key);
+                    }
                 }
                 BTVNDDBG("Check total_len(0x%08x) max_patch_size(0x%08x)", hw_cfg_cb.total_len,
                          hw_cfg_cb.max_patch_size);
@@ -1304,11 +1499,18 @@ void hw_config_cback(void *p_evt_buf)
                     iIndexRx = *((uint8_t *)(p_mem + 1) + HCI_EVT_CMD_CMPL_STATUS_OFFSET + 1);
                     BTVNDDBG("bt vendor lib: HW_CFG_DL_FW_PATCH status:%i, iIndexRx:%i", status, iIndexRx);
                     hw_cfg_cb.patch_frag_idx++;
+                    if (hw_cfg_cb.patch_frag_inflight) {
+                        hw_cfg_cb.patch_frag_inflight--;
+                    }
+                    // the event the stack saw has its credits rewritten to 1, take the controller's count
+                    hw_cfg_cb.patch_credits = userial_vendor_get_cmd_credits();
 
                     if (iIndexRx & 0x80) {
                         BTVNDDBG("vendor lib fwcfg completed");
-                        free(hw_cfg_cb.total_buf);
-                        hw_cfg_cb.total_len = 0;
+                        HILOGI("bt bring-up %llums, patch download %llums, %d fragments",
+                               (unsigned long long)(hw_cfg_now_ms() - hw_cfg_start_ms),
+                               (unsigned long long)(hw_cfg_now_ms() - hw_cfg_dl_start_ms), hw_cfg_cb.patch_frag_cnt);
+                        rtk_release_total_buf();
 
                         bt_vendor_cbacks->dealloc(p_buf);
                         bt_vendor_cbacks->init_cb(BTC_OP_RESULT_SUCCESS);
@@ -1320,21 +1522,11 @@ void hw_config_cback(void *p_evt_buf)
                     }
                 }
 
-                if (hw_cfg_cb.patch_frag_idx < hw_cfg_cb.patch_frag_cnt) {
-                    iIndexRx = hw_cfg_cb.patch_frag_idx ? ((hw_cfg_cb.patch_frag_idx - 1) % 0x7f + 1) : 0;
-                    if (hw_cfg_cb.patch_frag_idx == hw_cfg_cb.patch_frag_cnt - 1) {
-                        BTVNDDBG("HW_CFG_DL_FW_PATCH: send last fw fragment");
-                        iIndexRx |= 0x80;
-                        hw_cfg_cb.patch_frag_len = hw_cfg_cb.patch_frag_tail;
-                    } else {
-                        iIndexRx &= 0x7F;
-                        hw_cfg_cb.patch_frag_len = PATCH_DATA_FIELD_MAX_SIZE;
-                    }
+                if (hw_cfg_cb.patch_frag_sent == 0) {
+                    hw_cfg_dl_start_ms = hw_cfg_now_ms();
+                    hw_cfg_cb.patch_credits = userial_vendor_get_cmd_credits();
                 }
-
-                is_proceeding = hci_download_patch_h4(
-                    p_buf, iIndexRx, hw_cfg_cb.total_buf + (hw_cfg_cb.patch_frag_idx * PATCH_DATA_FIELD_MAX_SIZE),
-                    hw_cfg_cb.patch_frag_len);
+                is_proceeding = hci_download_patch_window(p_buf);
                 break;
 
             default:
@@ -1364,10 +1556,7 @@ void hw_config_cback(void *p_evt_buf)
             hw_cfg_cb.fw_len = 0;
         }
 
-        if (hw_cfg_cb.total_len) {
-            free(hw_cfg_cb.total_buf);
-            hw_cfg_cb.total_len = 0;
-        }
+        rtk_release_total_buf();
         hw_cfg_cb.state = 0;
     }
 }
@@ -1390,6 +1579,7 @@ void hw_config_start(char transtype)
     (void)memset_s(&hw_cfg_cb, sizeof(bt_hw_cfg_cb_t), 0, sizeof(bt_hw_cfg_cb_t));
     hw_cfg_cb.dl_fw_flag = 1;
     hw_cfg_cb.chip_type = CHIPTYPE_NONE;
+    hw_cfg_start_ms = hw_cfg_now_ms();
     BTVNDDBG("RTKBT_RELEASE_NAME: %s", RTKBT_RELEASE_NAME);
     BTVNDDBG("\nRealtek libbt-vendor_uart Version %s \n", RTK_VERSION);
     HC_BT_HDR *p_buf = NULL;
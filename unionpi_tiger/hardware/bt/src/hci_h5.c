@@ -1338,6 +1338,40 @@ static uint8_t h5_complete_rx_pkt(tHCI_H5_CB *h5)
     return pkt_type;
 }
 
+/**
+ * Unslip a run of bytes which contains no delimiter and no escape byte.
+ * The run is appended to the rx skb with a single copy instead of byte by byte.
+ *
+ * @param h5 realtek h5 struct
+ * @param data point to the first byte of the run
+ * @param count num of data available
+ * @return num of bytes consumed
+ */
+static int h5_unslip_run(tHCI_H5_CB *h5, const uint8_t *data, int count)
+{
+    uint8_t *hdr = (uint8_t *)skb_get_data(h5->rx_skb);
+    int limit = (count < (int)h5->rx_count) ? count : (int)h5->rx_count;
+    int run = 0;
+    int i;
+
+    while (run < limit && data[run] != 0xc0 && data[run] != 0xdb) {
+        run++;
+    }
+    if (run == 0) {
+        return 0;
+    }
+
+    (void)memcpy_s(skb_put(h5->rx_skb, run), run, data, run);
+    // Check Pkt Header's CRC enable bit
+    if (H5_HDR_CRC(hdr) && h5->rx_state != H5_W4_CRC) {
+        for (i = 0; i < run; i++) {
+            h5_crc_update(&h5->message_crc, data[i]);
+        }
+    }
+    h5->rx_count -= run;
+    return run;
+}
+
 /**
  * Parse the receive data in h5 proto.
  *
@@ -1362,6 +1396,11 @@ static bool h5_recv(tHCI_H5_CB *h5, uint8_t *data, int count)
                 skb_free(&h5->rx_skb);
                 h5->rx_state = H5_W4_PKT_START;
                 h5->rx_count = 0;
+            } else if (h5->rx_esc_state == H5_ESCSTATE_NOESC && *ptr != 0xdb) {
+                int run = h5_unslip_run(h5, ptr, temp);
+                ptr += run;
+                temp -= run;
+                continue;
             } else {
                 h5_unslip_one_byte(h5, *ptr);
             }
@@ -74,8 +74,33 @@
 
 #define HCICMD_REPLY_TIMEOUT_VALUE 8000 // ms
 
+/* upper bound of vendor commands handed to the controller without a reply */
+#define RTK_SERVICE_MAX_INFLIGHT 4
+#define RTK_SERVICE_OPCODE_STATS_NUM 16
+#define RTK_SERVICE_STATS_DUMP_INTERVAL 256
+
+#define HCI_EVT_CMD_STATUS_CODE 0x0F
+#define HCI_EVT_CMD_CMPL_OPCODE 3
+#define HCI_EVT_CMD_STATUS_OPCODE 4
+
 typedef void (*tTIMER_HANDLE_CBACK)(union sigval sigval_value);
 
+typedef struct Rtk_Inflight_Cmd {
+    uint8_t in_use;
+    uint16_t opcode;
+    int client_sock;
+    uint64_t send_us;
+    void (*complete_cback)(void *);
+} Rtk_Inflight_Cmd;
+
+typedef struct Rtk_Opcode_Stats {
+    uint16_t opcode;
+    uint32_t count;
+    uint32_t timeouts;
+    uint64_t total_us;
+    uint64_t max_us;
+} Rtk_Opcode_Stats;
+
 typedef struct Rtk_Btservice_Info {
     int socketfd;
     int sig_fd[2];
@@ -84,14 +109,17 @@ typedef struct Rtk_Btservice_Info {
     int current_client_sock;
     int epoll_fd;
     int autopair_fd;
-    sem_t cmdqueue_sem;
-    sem_t cmdsend_sem;
+    pthread_cond_t cmdqueue_cond;
     timer_t timer_hcicmd_reply;
     RT_LIST_HEAD cmdqueue_list;
+    RT_LIST_HEAD cmdqueue_prio_list;
     pthread_mutex_t cmdqueue_mutex;
     volatile uint8_t cmdqueue_thread_running;
     volatile uint8_t epoll_thread_running;
-    void (*current_complete_cback)(HC_BT_HDR *);
+    uint8_t inflight_num;
+    Rtk_Inflight_Cmd inflight[RTK_SERVICE_MAX_INFLIGHT];
+    Rtk_Opcode_Stats opcode_stats[RTK_SERVICE_OPCODE_STATS_NUM];
+    uint32_t completed_num;
 } Rtk_Btservice_Info;
 
 typedef struct Rtk_Queue_Data {
@@ -171,8 +199,8 @@ static int OsStopTimer(timer_t timerid)
 
 static void init_cmdqueue_hash(Rtk_Btservice_Info *rtk_info)
 {
-    RT_LIST_HEAD *head = &rtk_info->cmdqueue_list;
-    ListInitializeHeader(head);
+    ListInitializeHeader(&rtk_info->cmdqueue_list);
+    ListInitializeHeader(&rtk_info->cmdqueue_prio_list);
 }
 
 static void delete_cmdqueue_from_hash(Rtkqueuedata *desc)
@@ -185,24 +213,200 @@ static void delete_cmdqueue_from_hash(Rtkqueuedata *desc)
     }
 }
 
-static void flush_cmdqueue_hash(Rtk_Btservice_Info *rtk_info)
+static void flush_cmdqueue_list(RT_LIST_HEAD *head)
 {
-    RT_LIST_HEAD *head = &rtk_info->cmdqueue_list;
     RT_LIST_ENTRY *iter = NULL, *temp = NULL;
     Rtkqueuedata *desc = NULL;
 
-    pthread_mutex_lock(&rtk_info->cmdqueue_mutex);
     LIST_FOR_EACH_SAFELY(iter, temp, head)
     {
         desc = LIST_ENTRY(iter, Rtkqueuedata, list);
+        if (desc->parameter_len > 0) {
+            free(desc->parameter);
+        }
         delete_cmdqueue_from_hash(desc);
     }
+}
+
+static void flush_cmdqueue_hash(Rtk_Btservice_Info *rtk_info)
+{
+    pthread_mutex_lock(&rtk_info->cmdqueue_mutex);
+    flush_cmdqueue_list(&rtk_info->cmdqueue_prio_list);
+    flush_cmdqueue_list(&rtk_info->cmdqueue_list);
     pthread_mutex_unlock(&rtk_info->cmdqueue_mutex);
 }
 
+static uint64_t rtk_service_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* replies to these are routed to the coex command slot by hw_process_event */
+static int rtk_service_is_coex_opcode(uint16_t opcode)
+{
+    switch (opcode) {
+        case HCI_VENDOR_COEX_INFO:
+        case HCI_VENDOR_SET_PROFILE_REPORT_COMMAND:
+        case HCI_VENDOR_ADD_BITPOOL_FW:
+        case HCI_VENDOR_MAILBOX_CMD:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// coex and heartbeat opcodes are scheduled ahead of diagnostic commands
+static int rtk_service_is_prio_opcode(uint16_t opcode)
+{
+    return opcode == HCI_CMD_VNDR_HEARTBEAT || rtk_service_is_coex_opcode(opcode);
+}
+
+static void rtk_service_stats_dump(void)
+{
+    int i;
+    Rtk_Opcode_Stats *stats = NULL;
+
+    for (i = 0; i < RTK_SERVICE_OPCODE_STATS_NUM; i++) {
+        stats = &rtk_btservice->opcode_stats[i];
+        if (stats->count == 0 && stats->timeouts == 0) {
+            continue;
+        }
+        HILOGD("%s opcode:0x%04x cnt:%u avg:%llu us max:%llu us timeout:%u", __func__, stats->opcode, stats->count,
+               (unsigned long long)(stats->count ? stats->total_us / stats->count : 0),
+               (unsigned long long)stats->max_us, stats->timeouts);
+    }
+}
+
+/* must be called with cmdqueue_mutex held */
+static void rtk_service_stats_update(uint16_t opcode, uint64_t rtt_us, int timeout)
+{
+    int i;
+    Rtk_Opcode_Stats *stats = NULL;
+
+    for (i = 0; i < RTK_SERVICE_OPCODE_STATS_NUM; i++) {
+        stats = &rtk_btservice->opcode_stats[i];
+        if (stats->opcode == opcode && (stats->count != 0 || stats->timeouts != 0)) {
+            break;
+        }
+        if (stats->count == 0 && stats->timeouts == 0) {
+            stats->opcode = opcode;
+            break;
+        }
+    }
+    if (i == RTK_SERVICE_OPCODE_STATS_NUM) {
+        return;
+    }
+
+    if (timeout) {
+        stats->timeouts++;
+        return;
+    }
+    stats->count++;
+    stats->total_us += rtt_us;
+    if (rtt_us > stats->max_us) {
+        stats->max_us = rtt_us;
+    }
+    if ((++rtk_btservice->completed_num % RTK_SERVICE_STATS_DUMP_INTERVAL) == 0) {
+        rtk_service_stats_dump();
+    }
+}
+
+/* must be called with cmdqueue_mutex held */
+static Rtk_Inflight_Cmd *rtk_service_find_inflight(uint16_t opcode, int match_opcode)
+{
+    int i;
+    Rtk_Inflight_Cmd *cmd = NULL;
+    Rtk_Inflight_Cmd *oldest = NULL;
+
+    for (i = 0; i < RTK_SERVICE_MAX_INFLIGHT; i++) {
+        cmd = &rtk_btservice->inflight[i];
+        if (!cmd->in_use || (match_opcode && cmd->opcode != opcode)) {
+            continue;
+        }
+        if (oldest == NULL || cmd->send_us < oldest->send_us) {
+            oldest = cmd;
+        }
+    }
+    return oldest;
+}
+
+/* must be called with cmdqueue_mutex held */
+static int rtk_service_can_send(void)
+{
+    if (rtk_btservice->inflight_num >= RTK_SERVICE_MAX_INFLIGHT) {
+        return 0;
+    }
+    if (ListIsEmpty(&rtk_btservice->cmdqueue_prio_list) && ListIsEmpty(&rtk_btservice->cmdqueue_list)) {
+        return 0;
+    }
+    /* same credits the stack's commands use, given back by the next Command Complete/Status */
+    return userial_vendor_take_cmd_credit();
+}
+
+/* must be called with cmdqueue_mutex held */
+static Rtkqueuedata *rtk_service_dequeue_cmd(void)
+{
+    RT_LIST_ENTRY *iter = ListGetTop(&(rtk_btservice->cmdqueue_prio_list));
+    Rtkqueuedata *desc = NULL;
+
+    if (iter == NULL) {
+        iter = ListGetTop(&(rtk_btservice->cmdqueue_list));
+    }
+    if (iter) {
+        desc = LIST_ENTRY(iter, Rtkqueuedata, list);
+        ListDeleteNode(&desc->list);
+    }
+    return desc;
+}
+
+static int hcicmd_start_reply_timer(int msec);
+static int hcicmd_stop_reply_timer(void);
+
+/* must be called with cmdqueue_mutex held */
+static void hcicmd_rearm_reply_timer(void)
+{
+    Rtk_Inflight_Cmd *oldest = rtk_service_find_inflight(0, 0);
+    uint64_t elapsed_ms;
+
+    if (oldest == NULL) {
+        hcicmd_stop_reply_timer();
+        return;
+    }
+    elapsed_ms = (rtk_service_now_us() - oldest->send_us) / 1000ULL;
+    if (elapsed_ms >= HCICMD_REPLY_TIMEOUT_VALUE) {
+        hcicmd_start_reply_timer(1);
+    } else {
+        hcicmd_start_reply_timer(HCICMD_REPLY_TIMEOUT_VALUE - (int)elapsed_ms);
+    }
+}
+
 static void hcicmd_reply_timeout_handler(void) // (union sigval sigev_value)
 {
-    Rtk_Service_Send_Hwerror_Event();
+    Rtk_Inflight_Cmd *oldest = NULL;
+    uint16_t opcode = 0;
+    int expired = 0;
+
+    pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
+    oldest = rtk_service_find_inflight(0, 0);
+    if (oldest != NULL &&
+        rtk_service_now_us() - oldest->send_us >= (uint64_t)HCICMD_REPLY_TIMEOUT_VALUE * 1000ULL) {
+        expired = 1;
+        opcode = oldest->opcode;
+        rtk_service_stats_update(opcode, 0, 1);
+        oldest->in_use = 0;
+        rtk_btservice->inflight_num--;
+        pthread_cond_signal(&rtk_btservice->cmdqueue_cond);
+    }
+    hcicmd_rearm_reply_timer();
+    pthread_mutex_unlock(&rtk_btservice->cmdqueue_mutex);
+
+    if (expired) {
+        HILOGE("%s, Opcode:%x no reply in %d ms", __func__, opcode, HCICMD_REPLY_TIMEOUT_VALUE);
+        Rtk_Service_Send_Hwerror_Event();
+    }
 }
 
 static int hcicmd_alloc_reply_timer(void)
@@ -218,9 +422,9 @@ static int hcicmd_free_reply_timer(void)
     return OsFreeTimer(rtk_btservice->timer_hcicmd_reply);
 }
 
-static int hcicmd_start_reply_timer(void)
+static int hcicmd_start_reply_timer(int msec)
 {
-    return OsStartTimer(rtk_btservice->timer_hcicmd_reply, HCICMD_REPLY_TIMEOUT_VALUE, 1);
+    return OsStartTimer(rtk_btservice->timer_hcicmd_reply, msec, 0);
 }
 
 static int hcicmd_stop_reply_timer(void)
@@ -254,7 +458,6 @@ void Rtk_Service_Vendorcmd_Hook(Rtk_Service_Data *RtkData, int client_sock)
         return;
     }
 
-    pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
     rtkqueue_data = (Rtkqueuedata *)malloc(sizeof(Rtkqueuedata));
     if (rtkqueue_data == NULL) {
         HILOGE("rtkqueue_data: allocate error");
@@ -270,23 +473,75 @@ void Rtk_Service_Vendorcmd_Hook(Rtk_Service_Data *RtkData, int client_sock)
     rtkqueue_data->client_sock = client_sock;
     rtkqueue_data->complete_cback = RtkData->complete_cback;
 
-    ListAddToTail(&(rtkqueue_data->list), &(rtk_btservice->cmdqueue_list));
-    sem_post(&rtk_btservice->cmdqueue_sem);
+    pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
+    if (rtk_service_is_prio_opcode(rtkqueue_data->opcode)) {
+        ListAddToTail(&(rtkqueue_data->list), &(rtk_btservice->cmdqueue_prio_list));
+    } else {
+        ListAddToTail(&(rtkqueue_data->list), &(rtk_btservice->cmdqueue_list));
+    }
+    pthread_cond_signal(&rtk_btservice->cmdqueue_cond);
     pthread_mutex_unlock(&rtk_btservice->cmdqueue_mutex);
 }
 
 static void Rtk_Service_Cmd_Event_Cback(HC_BT_HDR *p_mem)
 {
-    if (p_mem != NULL) {
-        if (rtk_btservice->current_complete_cback != NULL) {
-            (*rtk_btservice->current_complete_cback)(p_mem);
-        } else {
-            HILOGE("%s current_complete_cback is not exist!", __func__);
-        }
-        rtk_btservice->current_complete_cback = NULL;
-        hcicmd_stop_reply_timer();
-        sem_post(&rtk_btservice->cmdsend_sem);
+    uint8_t *p = NULL;
+    uint16_t opcode;
+    Rtk_Inflight_Cmd *inflight = NULL;
+    Rtk_Inflight_Cmd cmd;
+
+    if (p_mem == NULL) {
+        return;
+    }
+
+    p = (uint8_t *)(p_mem + 1);
+    if (p[0] == HCI_EVT_CMD_STATUS_CODE) {
+        opcode = (uint16_t)(p[HCI_EVT_CMD_STATUS_OPCODE] | (p[HCI_EVT_CMD_STATUS_OPCODE + 1] << 8L));
+    } else {
+        opcode = (uint16_t)(p[HCI_EVT_CMD_CMPL_OPCODE] | (p[HCI_EVT_CMD_CMPL_OPCODE + 1] << 8L));
+    }
+
+    (void)memset_s(&cmd, sizeof(cmd), 0, sizeof(cmd));
+    pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
+    inflight = rtk_service_find_inflight(opcode, 1);
+    if (inflight != NULL) {
+        cmd = *inflight;
+        inflight->in_use = 0;
+        rtk_btservice->inflight_num--;
+        rtk_service_stats_update(cmd.opcode, rtk_service_now_us() - cmd.send_us, 0);
+    }
+    hcicmd_rearm_reply_timer();
+    pthread_cond_signal(&rtk_btservice->cmdqueue_cond);
+    pthread_mutex_unlock(&rtk_btservice->cmdqueue_mutex);
+
+    if (inflight == NULL) {
+        HILOGD("%s, Opcode:%x was not sent by the service", __func__, opcode);
+    } else if (cmd.complete_cback != NULL) {
+        rtk_btservice->current_client_sock = cmd.client_sock;
+        cmd.complete_cback(p_mem);
+    } else {
+        HILOGE("%s complete_cback is not exist!", __func__);
+    }
+}
+
+/* The controller granted command credits, to the stack's commands or ours. */
+void Rtk_Service_Cmd_Credits_Notify(void)
+{
+    if (!rtk_btservice) {
+        return;
+    }
+    pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
+    pthread_cond_signal(&rtk_btservice->cmdqueue_cond);
+    pthread_mutex_unlock(&rtk_btservice->cmdqueue_mutex);
+}
+
+/* Vendor command replies that did not go through the coex command slot. */
+void Rtk_Service_Cmd_Complete(void *p_mem)
+{
+    if (!rtk_btservice) {
+        return;
     }
+    Rtk_Service_Cmd_Event_Cback((HC_BT_HDR *)p_mem);
 }
 
 static void Rtk_Service_Send_Hwerror_Event(void)
@@ -304,41 +559,56 @@ static void Rtk_Service_Send_Hwerror_Event(void)
 
 static void *cmdready_thread(void)
 {
-    while (rtk_btservice->cmdqueue_thread_running) {
-        sem_wait(&rtk_btservice->cmdqueue_sem);
-        sem_wait(&rtk_btservice->cmdsend_sem);
-
-        if (rtk_btservice->cmdqueue_thread_running != 0) {
-            pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
-            RT_LIST_ENTRY *iter = ListGetTop(&(rtk_btservice->cmdqueue_list));
-            Rtkqueuedata *desc = NULL;
-            if (iter) {
-                desc = LIST_ENTRY(iter, Rtkqueuedata, list);
-                if (desc) {
-                    ListDeleteNode(&desc->list);
-                }
-            }
+    int i;
+    uint8_t inflight_num;
+    Rtkqueuedata *desc = NULL;
+    Rtk_Inflight_Cmd *slot = NULL;
 
+    while (rtk_btservice->cmdqueue_thread_running) {
+        pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
+        while (rtk_btservice->cmdqueue_thread_running && !rtk_service_can_send()) {
+            pthread_cond_wait(&rtk_btservice->cmdqueue_cond, &rtk_btservice->cmdqueue_mutex);
+        }
+        if (rtk_btservice->cmdqueue_thread_running == 0) {
             pthread_mutex_unlock(&rtk_btservice->cmdqueue_mutex);
+            break;
+        }
 
-            if (desc) {
-                if (desc->opcode == 0xfc77) {
-                    rtk_btservice->autopair_fd = desc->client_sock;
-                }
-
-                if (desc->opcode != 0xfc94) {
-                    HILOGD("%s, transmit_command Opcode:%x", __func__, desc->opcode);
-                }
-                rtk_btservice->current_client_sock = desc->client_sock;
-                rtk_btservice->current_complete_cback = desc->complete_cback;
-                rtk_vendor_cmd_to_fw(desc->opcode, desc->parameter_len, desc->parameter, Rtk_Service_Cmd_Event_Cback);
-                hcicmd_start_reply_timer();
-                if (desc->parameter_len > 0) {
-                    free(desc->parameter);
-                }
+        desc = rtk_service_dequeue_cmd();
+        for (i = 0; i < RTK_SERVICE_MAX_INFLIGHT; i++) {
+            if (!rtk_btservice->inflight[i].in_use) {
+                slot = &rtk_btservice->inflight[i];
+                break;
             }
-            free(desc);
         }
+        slot->in_use = 1;
+        slot->opcode = desc->opcode;
+        slot->client_sock = desc->client_sock;
+        slot->complete_cback = desc->complete_cback;
+        slot->send_us = rtk_service_now_us();
+        inflight_num = ++rtk_btservice->inflight_num;
+        if (inflight_num == 1) {
+            hcicmd_start_reply_timer(HCICMD_REPLY_TIMEOUT_VALUE);
+        }
+        pthread_mutex_unlock(&rtk_btservice->cmdqueue_mutex);
+
+        if (desc->opcode == 0xfc77) {
+            rtk_btservice->autopair_fd = desc->client_sock;
+        }
+
+        if (desc->opcode != HCI_CMD_VNDR_HEARTBEAT) {
+            HILOGD("%s, transmit_command Opcode:%x inflight:%d", __func__, desc->opcode, inflight_num);
+        }
+        if (rtk_service_is_coex_opcode(desc->opcode)) {
+            /* shares its opcode with the coex commands, so it has to wait for their slot */
+            rtk_vendor_cmd_to_fw(desc->opcode, desc->parameter_len, desc->parameter, Rtk_Service_Cmd_Event_Cback);
+        } else {
+            rtk_vendor_cmd_xmit(desc->opcode, desc->parameter_len, desc->parameter);
+        }
+        if (desc->parameter_len > 0) {
+            free(desc->parameter);
+        }
+        free(desc);
     }
     pthread_exit(0);
 }
@@ -607,10 +877,11 @@ int RTK_btservice_thread_start(void)
 void RTK_btservice_thread_stop(void)
 {
     rtk_btservice->epoll_thread_running = 0;
+    pthread_mutex_lock(&rtk_btservice->cmdqueue_mutex);
     rtk_btservice->cmdqueue_thread_running = 0;
+    pthread_cond_broadcast(&rtk_btservice->cmdqueue_cond);
+    pthread_mutex_unlock(&rtk_btservice->cmdqueue_mutex);
     RTK_btservice_send_close_signal();
-    sem_post(&rtk_btservice->cmdqueue_sem);
-    sem_post(&rtk_btservice->cmdsend_sem);
     pthread_join(rtk_btservice->cmdreadythd, NULL);
     pthread_join(rtk_btservice->epollthd, NULL);
     close(rtk_btservice->epoll_fd);
@@ -629,14 +900,11 @@ int RTK_btservice_init(void)
     }
 
     rtk_btservice->current_client_sock = -1;
-    rtk_btservice->current_complete_cback = NULL;
     rtk_btservice->autopair_fd = -1;
     hcicmd_alloc_reply_timer();
 
-    sem_init(&rtk_btservice->cmdqueue_sem, 0, 0);
-    sem_init(&rtk_btservice->cmdsend_sem, 0, 1);
-
     pthread_mutex_init(&rtk_btservice->cmdqueue_mutex, NULL);
+    pthread_cond_init(&rtk_btservice->cmdqueue_cond, NULL);
     init_cmdqueue_hash(rtk_btservice);
     if (bt_vendor_cbacks == NULL) {
         HILOGE("%s bt_vendor_cbacks is NULL!", __func__);
@@ -679,10 +947,10 @@ void RTK_btservice_destroyed(void)
     rtk_btservice->socketfd = -1;
     close(rtk_btservice->sig_fd[0]);
     close(rtk_btservice->sig_fd[1]);
-    sem_destroy(&rtk_btservice->cmdqueue_sem);
-    sem_destroy(&rtk_btservice->cmdsend_sem);
     flush_cmdqueue_hash(rtk_btservice);
     hcicmd_free_reply_timer();
+    rtk_service_stats_dump();
+    pthread_cond_destroy(&rtk_btservice->cmdqueue_cond);
     pthread_mutex_destroy(&rtk_btservice->cmdqueue_mutex);
     rtk_btservice->autopair_fd = -1;
     rtk_btservice->current_client_sock = -1;
@@ -17,6 +17,9 @@
  ******************************************************************************/
 #define LOG_TAG "rtk_btsnoop_net"
 #include <unistd.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
 #include "bt_vendor_rtk.h"
 #include "rtk_btsnoop_net.h"
 
@@ -65,6 +68,48 @@ static int hci_btsnoop_fd = -1;
 // Epoch in microseconds since 01/01/0000.
 static const uint64_t BTSNOOP_EPOCH_DELTA = 0x00dcddb30f2f8000ULL;
 
+/*
+ * Snoop records are produced on the HCI data path and written to disk by a
+ * dedicated writer thread. Producers reserve a slot in a bounded lock-free
+ * ring (per-slot sequence numbers, multi-producer / single-consumer), the
+ * writer drains contiguous committed slots and coalesces them with writev().
+ * When the ring is full the record is dropped and accounted in the btsnoop
+ * "cumulative drops" field of the next record that makes it to the file.
+ */
+#define BTSNOOP_FILE_HEADER_LEN 16
+#define BTSNOOP_RECORD_HEADER_LEN 24
+#define BTSNOOP_RING_SLOTS 512
+#define BTSNOOP_RING_MASK (BTSNOOP_RING_SLOTS - 1)
+#define BTSNOOP_SLOT_DATA_MAX 1100
+#define BTSNOOP_WRITEV_BATCH 64
+#define BTSNOOP_FLUSH_INTERVAL_MS 50
+#define BTSNOOP_DEFAULT_MAX_FILE_SIZE (16 * 1024 * 1024)
+#define BTSNOOP_DEFAULT_MAX_FILES 3
+
+typedef struct {
+    atomic_uint seq;
+    uint32_t len;
+    uint8_t buf[BTSNOOP_RECORD_HEADER_LEN + BTSNOOP_SLOT_DATA_MAX];
+} rtk_btsnoop_slot_t;
+
+static rtk_btsnoop_slot_t *btsnoop_ring = NULL;
+static atomic_uint btsnoop_ring_head;
+static unsigned int btsnoop_ring_tail;
+static atomic_uint btsnoop_drops;
+static atomic_bool btsnoop_ring_valid;
+
+static pthread_t btsnoop_writer_thread;
+static bool btsnoop_writer_valid = false;
+static bool btsnoop_writer_running = false;
+static pthread_cond_t btsnoop_writer_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t btsnoop_max_file_size = BTSNOOP_DEFAULT_MAX_FILE_SIZE;
+static uint32_t btsnoop_rotate_interval = 0;
+static uint32_t btsnoop_max_files = BTSNOOP_DEFAULT_MAX_FILES;
+static uint64_t btsnoop_file_size = 0;
+static time_t btsnoop_file_open_time = 0;
+static uint64_t btsnoop_records_written = 0;
+
 char *get_rtk_btsnoop_path(void)
 {
     char *path = rtk_btsnoop_path;
@@ -76,6 +121,26 @@ void set_rtk_btsnoop_save_log(bool btsnoop_save_log)
     rtk_btsnoop_save_log = btsnoop_save_log;
 }
 
+void set_rtk_btsnoop_max_file_size(uint64_t max_file_size)
+{
+    btsnoop_max_file_size = max_file_size;
+}
+
+void set_rtk_btsnoop_rotate_interval(uint32_t rotate_interval)
+{
+    btsnoop_rotate_interval = rotate_interval;
+}
+
+void set_rtk_btsnoop_max_files(uint32_t max_files)
+{
+    btsnoop_max_files = max_files;
+}
+
+uint32_t get_rtk_btsnoop_drops(void)
+{
+    return atomic_load_explicit(&btsnoop_drops, memory_order_relaxed);
+}
+
 void set_rtk_btsnoop_net_dump(bool btsnoop_net_dump)
 {
     rtk_btsnoop_dump = btsnoop_net_dump;
@@ -114,6 +179,159 @@ static uint64_t rtk_btsnoop_timestamp(void)
     return timestamp;
 }
 
+static void rtk_btsnoop_put_be32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24L);
+    p[1] = (uint8_t)(value >> 16L);
+    p[2L] = (uint8_t)(value >> 8L);
+    p[3L] = (uint8_t)value;
+}
+
+static int rtk_btsnoop_create_file(void)
+{
+    int fd = open(rtk_btsnoop_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (fd == -1) {
+        HILOGE("%s unable to open '%s': %s", __func__, rtk_btsnoop_path, strerror(errno));
+        return -1;
+    }
+
+    write(fd, "btsnoop\0\0\0\0\1\0\0\x3\xea", BTSNOOP_FILE_HEADER_LEN);
+    btsnoop_file_size = BTSNOOP_FILE_HEADER_LEN;
+    btsnoop_file_open_time = time(NULL);
+    return fd;
+}
+
+static bool rtk_btsnoop_need_rotate(void)
+{
+    if (btsnoop_max_file_size != 0 && btsnoop_file_size >= btsnoop_max_file_size) {
+        return true;
+    }
+    if (btsnoop_rotate_interval != 0 && (time(NULL) - btsnoop_file_open_time) >= (time_t)btsnoop_rotate_interval) {
+        return true;
+    }
+    return false;
+}
+
+/* Shift <path>.1 .. <path>.N-1 up by one, move <path> to <path>.1, then start a new <path>. */
+static void rtk_btsnoop_rotate(void)
+{
+    char from_path[PATH_MAX];
+    char to_path[PATH_MAX];
+    uint32_t i;
+
+    if (hci_btsnoop_fd != -1) {
+        close(hci_btsnoop_fd);
+        hci_btsnoop_fd = -1;
+    }
+
+    for (i = btsnoop_max_files - 1; btsnoop_max_files > 1 && i > 0; i--) {
+        if (i == 1) {
+            (void)snprintf_s(from_path, PATH_MAX, PATH_MAX - 1, "%s", rtk_btsnoop_path);
+        } else {
+            (void)snprintf_s(from_path, PATH_MAX, PATH_MAX - 1, "%s.%u", rtk_btsnoop_path, i - 1);
+        }
+        (void)snprintf_s(to_path, PATH_MAX, PATH_MAX - 1, "%s.%u", rtk_btsnoop_path, i);
+        if (rename(from_path, to_path) != 0 && errno != ENOENT) {
+            HILOGE("%s unable to rename '%s' to '%s': %s", __func__, from_path, to_path, strerror(errno));
+        }
+    }
+
+    hci_btsnoop_fd = rtk_btsnoop_create_file();
+    HILOGD("%s btsnoop log rotated, records %llu, drops %u", __func__, (unsigned long long)btsnoop_records_written,
+           get_rtk_btsnoop_drops());
+}
+
+static void rtk_btsnoop_writev(const struct iovec *iov, int count, size_t bytes)
+{
+    ssize_t ret;
+
+    if (hci_btsnoop_fd == -1) {
+        return;
+    }
+    RTK_NO_INTR(ret = writev(hci_btsnoop_fd, iov, count));
+    if (ret < 0 || (size_t)ret != bytes) {
+        HILOGE("%s short write %zd/%zu: %s", __func__, ret, bytes, strerror(errno));
+    }
+}
+
+/* Write out every committed record, returns the number of records consumed. */
+static int rtk_btsnoop_drain(void)
+{
+    struct iovec iov[BTSNOOP_WRITEV_BATCH];
+    int total = 0;
+
+    for (;;) {
+        unsigned int tail = btsnoop_ring_tail;
+        size_t bytes = 0;
+        int count = 0;
+        int i;
+
+        while (count < BTSNOOP_WRITEV_BATCH) {
+            rtk_btsnoop_slot_t *slot = &btsnoop_ring[(tail + count) & BTSNOOP_RING_MASK];
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + count + 1) {
+                break;
+            }
+            iov[count].iov_base = slot->buf;
+            iov[count].iov_len = slot->len;
+            bytes += slot->len;
+            count++;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        rtk_btsnoop_writev(iov, count, bytes);
+
+        for (i = 0; i < count; i++) {
+            atomic_store_explicit(&btsnoop_ring[(tail + i) & BTSNOOP_RING_MASK].seq, tail + i + BTSNOOP_RING_SLOTS,
+                                  memory_order_release);
+        }
+        btsnoop_ring_tail = tail + count;
+        btsnoop_file_size += bytes;
+        btsnoop_records_written += count;
+        total += count;
+
+        if (rtk_btsnoop_need_rotate()) {
+            rtk_btsnoop_rotate();
+        }
+    }
+
+    return total;
+}
+
+static void *rtk_btsnoop_writer_fn(void *context)
+{
+    struct timespec ts;
+
+    RTK_UNUSED(context);
+    prctl(PR_SET_NAME, (unsigned long)"rtk_btsnoop_wr", 0, 0, 0);
+
+    pthread_mutex_lock(&btsnoop_log_lock);
+    while (btsnoop_writer_running) {
+        pthread_mutex_unlock(&btsnoop_log_lock);
+        rtk_btsnoop_drain();
+        if (btsnoop_rotate_interval != 0 && rtk_btsnoop_need_rotate()) {
+            rtk_btsnoop_rotate();
+        }
+        pthread_mutex_lock(&btsnoop_log_lock);
+        if (!btsnoop_writer_running) {
+            break;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += BTSNOOP_FLUSH_INTERVAL_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec += 1;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&btsnoop_writer_cond, &btsnoop_log_lock, &ts);
+    }
+    pthread_mutex_unlock(&btsnoop_log_lock);
+
+    rtk_btsnoop_drain();
+    return NULL;
+}
+
 void rtk_btsnoop_open(void)
 {
     pthread_mutex_init(&btsnoop_log_lock, NULL);
@@ -121,6 +339,7 @@ void rtk_btsnoop_open(void)
     uint64_t timestamp;
     uint32_t usec;
     uint8_t sec, hour, minus, day;
+    unsigned int i;
 
     if (hci_btsnoop_fd != -1) {
         HILOGE("%s btsnoop log file is already open.", __func__);
@@ -151,18 +370,55 @@ void rtk_btsnoop_open(void)
         }
     }
 
-    hci_btsnoop_fd =
-        open(rtk_btsnoop_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    hci_btsnoop_fd = rtk_btsnoop_create_file();
     if (hci_btsnoop_fd == -1) {
-        HILOGE("%s unable to open '%s': %s", __func__, rtk_btsnoop_path, strerror(errno));
         return;
     }
 
-    write(hci_btsnoop_fd, "btsnoop\0\0\0\0\1\0\0\x3\xea", 16L);
+    /* The ring outlives open/close so a late producer never touches freed memory. */
+    if (btsnoop_ring == NULL) {
+        btsnoop_ring = calloc(BTSNOOP_RING_SLOTS, sizeof(rtk_btsnoop_slot_t));
+        if (btsnoop_ring == NULL) {
+            HILOGE("%s unable to allocate btsnoop ring", __func__);
+            close(hci_btsnoop_fd);
+            hci_btsnoop_fd = -1;
+            return;
+        }
+    }
+    for (i = 0; i < BTSNOOP_RING_SLOTS; i++) {
+        atomic_store_explicit(&btsnoop_ring[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store_explicit(&btsnoop_ring_head, 0, memory_order_relaxed);
+    atomic_store_explicit(&btsnoop_drops, 0, memory_order_relaxed);
+    btsnoop_ring_tail = 0;
+    btsnoop_records_written = 0;
+
+    btsnoop_writer_running = true;
+    btsnoop_writer_valid = (pthread_create(&btsnoop_writer_thread, NULL, rtk_btsnoop_writer_fn, NULL) == 0);
+    if (!btsnoop_writer_valid) {
+        HILOGE("%s pthread_create failed: %s", __func__, strerror(errno));
+        btsnoop_writer_running = false;
+        close(hci_btsnoop_fd);
+        hci_btsnoop_fd = -1;
+        return;
+    }
+    atomic_store_explicit(&btsnoop_ring_valid, true, memory_order_release);
 }
 
 void rtk_btsnoop_close(void)
 {
+    atomic_store_explicit(&btsnoop_ring_valid, false, memory_order_release);
+    if (btsnoop_writer_valid) {
+        pthread_mutex_lock(&btsnoop_log_lock);
+        btsnoop_writer_running = false;
+        pthread_cond_signal(&btsnoop_writer_cond);
+        pthread_mutex_unlock(&btsnoop_log_lock);
+        pthread_join(btsnoop_writer_thread, NULL);
+        btsnoop_writer_valid = false;
+        HILOGD("%s btsnoop records %llu, drops %u", __func__, (unsigned long long)btsnoop_records_written,
+               get_rtk_btsnoop_drops());
+    }
+
     pthread_mutex_destroy(&btsnoop_log_lock);
     if (hci_btsnoop_fd != -1) {
         close(hci_btsnoop_fd);
@@ -170,20 +426,13 @@ void rtk_btsnoop_close(void)
     hci_btsnoop_fd = -1;
 }
 
-static void rtk_btsnoop_write(const void *data, size_t length)
-{
-    if (hci_btsnoop_fd != -1) {
-        write(hci_btsnoop_fd, data, length);
-    }
-}
-
 static void rtk_btsnoop_write_packet(serial_data_type_t type, const uint8_t *packet, bool is_received)
 {
+    rtk_btsnoop_slot_t *slot = NULL;
     int length_he = 0;
-    int length;
-    int flags;
-    int drops = 0;
-    pthread_mutex_lock(&btsnoop_log_lock);
+    uint32_t incl_len;
+    uint32_t flags = 0;
+    unsigned int pos;
     switch (type) {
         case HCI_COMMAND_PKT:
             length_he = packet[2L] + 4L;
@@ -202,35 +451,50 @@ static void rtk_btsnoop_write_packet(serial_data_type_t type, const uint8_t *pac
             flags = 3L;
             break;
         default:
-            break;
+            return;
+    }
+
+    /* Reserve a slot without blocking, drop the record if the writer is behind. */
+    pos = atomic_load_explicit(&btsnoop_ring_head, memory_order_relaxed);
+    for (;;) {
+        slot = &btsnoop_ring[pos & BTSNOOP_RING_MASK];
+        int diff = (int)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&btsnoop_ring_head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&btsnoop_drops, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&btsnoop_ring_head, memory_order_relaxed);
+        }
     }
 
     uint64_t timestamp = rtk_btsnoop_timestamp();
-    uint32_t time_hi = timestamp >> 32L;
-    uint32_t time_lo = timestamp & 0xFFFFFFFF;
-
-    length = htonl(length_he);
-    flags = htonl(flags);
-    drops = htonl(drops);
-    time_hi = htonl(time_hi);
-    time_lo = htonl(time_lo);
-
-    rtk_btsnoop_write(&length, 4L);
-    rtk_btsnoop_write(&length, 4L);
-    rtk_btsnoop_write(&flags, 4L);
-    rtk_btsnoop_write(&drops, 4L);
-    rtk_btsnoop_write(&time_hi, 4L);
-    rtk_btsnoop_write(&time_lo, 4L);
-    rtk_btsnoop_write(&type, 1);
-    rtk_btsnoop_write(packet, length_he - 1);
-    pthread_mutex_unlock(&btsnoop_log_lock);
+    uint8_t *p = slot->buf;
+
+    /* Oversized packets are truncated, original length is preserved in the record. */
+    incl_len = ((uint32_t)length_he > BTSNOOP_SLOT_DATA_MAX) ? BTSNOOP_SLOT_DATA_MAX : (uint32_t)length_he;
+    rtk_btsnoop_put_be32(p, (uint32_t)length_he);
+    rtk_btsnoop_put_be32(p + 4L, incl_len);
+    rtk_btsnoop_put_be32(p + 8L, flags);
+    rtk_btsnoop_put_be32(p + 12L, get_rtk_btsnoop_drops());
+    rtk_btsnoop_put_be32(p + 16L, (uint32_t)(timestamp >> 32L));
+    rtk_btsnoop_put_be32(p + 20L, (uint32_t)(timestamp & 0xFFFFFFFF));
+    p[BTSNOOP_RECORD_HEADER_LEN] = (uint8_t)type;
+    (void)memcpy_s(p + BTSNOOP_RECORD_HEADER_LEN + 1, BTSNOOP_SLOT_DATA_MAX - 1, packet, incl_len - 1);
+    slot->len = BTSNOOP_RECORD_HEADER_LEN + incl_len;
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
 }
 
 void rtk_btsnoop_capture(const HC_BT_HDR *p_buf, bool is_rcvd)
 {
     const uint8_t *p = (const uint8_t *)(p_buf + 1) + p_buf->offset;
 
-    if (hci_btsnoop_fd == -1) {
+    if (!atomic_load_explicit(&btsnoop_ring_valid, memory_order_acquire)) {
         return;
     }
 
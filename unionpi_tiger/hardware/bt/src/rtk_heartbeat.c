@@ -64,8 +64,6 @@ static uint16_t nextSeqNum = 1;
 static uint16_t cleanupFlag = 0;
 static pthread_mutex_t heartbeat_mutex;
 
-#define HCI_CMD_VNDR_HEARTBEAT 0xFC94
-
 static char *rtk_trim(char *str)
 {
     char *str_tmp = str;
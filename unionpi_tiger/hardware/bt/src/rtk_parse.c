@@ -63,10 +63,10 @@
 #include "bt_list.h"
 #include "hardware_uart.h"
 #include "rtk_parse.h"
+#include "rtk_btservice.h"
 
 #define RTK_COEX_VERSION "3.0"
 #define HCI_EVT_CMD_CMPL_OPCODE 3
-#define HCI_CMD_VNDR_HEARTBEAT 0xFC94
 
 char invite_req[] = "INVITE_REQ";
 char invite_rsp[] = "INVITE_RSP";
@@ -96,10 +96,6 @@ char bt_leave[] = "BT_LEAVE";
 
 // vendor cmd to fw
 #define HCI_VENDOR_ENABLE_PROFILE_REPORT_COMMAND (0x0018 | HCI_GRP_VENDOR_SPECIFIC)
-#define HCI_VENDOR_SET_PROFILE_REPORT_COMMAND (0x0019 | HCI_GRP_VENDOR_SPECIFIC)
-#define HCI_VENDOR_MAILBOX_CMD (0x008F | HCI_GRP_VENDOR_SPECIFIC)
-
-#define HCI_VENDOR_ADD_BITPOOL_FW (0x0051 | HCI_GRP_VENDOR_SPECIFIC)
 
 // subcmd to fw for HCI_VENDOR_MAILBOX_CMD
 #define HCI_VENDOR_SUB_CMD_WIFI_CHANNEL_AND_BANDWIDTH_CMD 0x11
@@ -763,19 +759,17 @@ void check_rtk_prof(void)
     }
 }
 
-void rtk_vendor_cmd_to_fw(uint16_t opcode, uint8_t parameter_len, uint8_t *parameter, tINT_CMD_CBACK p_cback)
+static HC_BT_HDR *rtk_vendor_cmd_alloc(uint16_t opcode, uint8_t parameter_len, uint8_t *parameter)
 {
     HC_BT_HDR *p_buf = NULL;
 
-    check_rtk_prof();
-
     if (bt_vendor_cbacks) {
         p_buf = (HC_BT_HDR *)bt_vendor_cbacks->alloc(BT_HC_HDR_SIZE + HCI_CMD_PREAMBLE_SIZE + parameter_len);
     }
 
     if (p_buf == NULL) {
         HILOGE("rtk_vendor_cmd_to_fw: HC_BT_HDR alloc error");
-        return;
+        return NULL;
     }
     (void)memset_s(p_buf, (BT_HC_HDR_SIZE + HCI_CMD_PREAMBLE_SIZE + parameter_len), 0,
                    (BT_HC_HDR_SIZE + HCI_CMD_PREAMBLE_SIZE + parameter_len));
@@ -792,6 +786,19 @@ void rtk_vendor_cmd_to_fw(uint16_t opcode, uint8_t parameter_len, uint8_t *param
     if (parameter_len > 0) {
         memcpy_s(p, parameter_len, parameter, parameter_len);
     }
+    return p_buf;
+}
+
+void rtk_vendor_cmd_to_fw(uint16_t opcode, uint8_t parameter_len, uint8_t *parameter, tINT_CMD_CBACK p_cback)
+{
+    HC_BT_HDR *p_buf = NULL;
+
+    check_rtk_prof();
+
+    p_buf = rtk_vendor_cmd_alloc(opcode, parameter_len, parameter);
+    if (p_buf == NULL) {
+        return;
+    }
     if (bt_vendor_cbacks) {
         pthread_mutex_lock(&rtk_prof.coex_mutex);
         if (!coex_cmd_send) {
@@ -820,6 +827,22 @@ void rtk_vendor_cmd_to_fw(uint16_t opcode, uint8_t parameter_len, uint8_t *param
     return;
 }
 
+/*
+ * Send a vendor command without going through the single outstanding coex
+ * command slot. The reply is handed to rtk_btservice by hw_process_event,
+ * which matches it by opcode, so the caller does its own flow control.
+ */
+void rtk_vendor_cmd_xmit(uint16_t opcode, uint8_t parameter_len, uint8_t *parameter)
+{
+    HC_BT_HDR *p_buf = rtk_vendor_cmd_alloc(opcode, parameter_len, parameter);
+
+    if (p_buf == NULL) {
+        return;
+    }
+    RtkLogMsg("begin transmit_command Opcode:%x", opcode);
+    bt_vendor_cbacks->xmit_cb(opcode, p_buf);
+}
+
 void rtk_notify_profileinfo_to_fw(void)
 {
     RT_LIST_HEAD *head = NULL;
@@ -2216,7 +2239,7 @@ static void rtk_handle_cmd_complete_evt(uint8_t *p, uint8_t len)
             break;
         }
 
-        case 0xfc1b:
+        case HCI_VENDOR_COEX_INFO:
             RtkLogMsg("received cmd complete event for fc1b");
             poweroff_allowed = 1;
             break;
@@ -2759,7 +2782,7 @@ void rtk_set_bt_on(uint8_t bt_on)
     RtkLogMsg("bt stack is init");
     rtk_prof.bt_on = bt_on;
     uint8_t ttmp[1] = {1};
-    rtk_vendor_cmd_to_fw(0xfc1b, 1, ttmp, NULL);
+    rtk_vendor_cmd_to_fw(HCI_VENDOR_COEX_INFO, 1, ttmp, NULL);
 }
 
 static rtk_parse_manager_t parse_interface = {
@@ -2803,13 +2826,16 @@ void hw_process_event(HC_BT_HDR *p_buf)
             break;
 #endif
 
-        case 0xfc1b:
-        case HCI_CMD_VNDR_HEARTBEAT:
+        case HCI_VENDOR_COEX_INFO:
         case HCI_VENDOR_SET_PROFILE_REPORT_COMMAND:
         case HCI_VENDOR_ADD_BITPOOL_FW:
         case HCI_VENDOR_MAILBOX_CMD:
             rtk_cmd_complete_cback(p_buf);
             break;
+
+        default:
+            Rtk_Service_Cmd_Complete(p_buf);
+            break;
     }
 
     HILOGD("%s, Complete", __FUNCTION__);
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <sys/eventfd.h>
 #include <poll.h>
+#include <stdatomic.h>
 #include <sys/socket.h>
 #include <termios.h>
 #include <utils/Log.h>
@@ -113,9 +114,47 @@ typedef struct {
 
 #ifdef CONFIG_SCO_OVER_HCI
 uint16_t btui_msbc_h2[] = {0x0801, 0x3801, 0xc801, 0xf801};
+/*
+ * sco data from the controller goes through a single producer (uart receive
+ * thread) / single consumer (sco receive thread) ring of fixed size frames.
+ */
+#define SCO_RING_FRAMES 32
+#define SCO_RING_MASK (SCO_RING_FRAMES - 1)
+#define SCO_FRAME_MAX_LEN 240
+#define SCO_PCM_FRAME_LEN 240
+#define SCO_MSBC_FRAME_US 7500  // 120 samples at 16kHz
+#define SCO_CVSD_FRAME_US 15000 // 120 samples at 8kHz
+#define SCO_JITTER_TARGET_FRAMES 3
+#define SCO_JITTER_MAX_FRAMES 6
+
+typedef struct {
+    uint8_t data[SCO_FRAME_MAX_LEN];
+    uint64_t enqueue_us;
+} sco_frame_t;
+
+typedef struct {
+    sco_frame_t frames[SCO_RING_FRAMES];
+    atomic_uint head; // written by the producer only
+    atomic_uint tail; // written by the consumer only
+    /* reset requests from the producer, applied by the consumer */
+    atomic_uint reset_head;
+    atomic_uint reset_gen;
+    unsigned int reset_ack; // consumer only
+} sco_ring_t;
+
+/* Per call statistics, reset when the receive path starts. */
+typedef struct {
+    uint32_t frames_in;
+    uint32_t frames_out;
+    uint32_t overflow_drops; // ring full on enqueue
+    uint32_t latency_drops;  // backlog trimmed back to the jitter target
+    uint32_t underruns;      // concealed frames
+    uint64_t latency_sum_us;
+    uint32_t latency_max_us;
+} sco_stats_t;
+
 typedef struct {
     pthread_mutex_t sco_recv_mutex;
-    pthread_cond_t sco_recv_cond;
     pthread_mutex_t sco_send_mutex;
     pthread_t thread_socket_sco_id;
     pthread_t thread_recv_sco_id;
@@ -125,8 +164,8 @@ typedef struct {
     bool thread_recv_sco_running;
     bool thread_send_sco_running;
     uint16_t voice_settings;
-    RTB_QUEUE_HEAD *recv_sco_data;
-    RTB_QUEUE_HEAD *send_sco_data;
+    sco_ring_t recv_ring;
+    sco_stats_t stats;
     unsigned char enc_data[480];
     unsigned int current_pos;
     uint16_t sco_packet_len;
@@ -165,12 +204,49 @@ static serial_data_type_t coex_current_type = 0;
 static unsigned char coex_resvered_buffer[2048] = {0};
 static int coex_resvered_length = 0;
 
+/*
+ * UART receive ring. 16KB holds ~50ms of traffic at UART_TARGET_BAUD_RATE,
+ * reads go straight into it and packets are framed in place.
+ */
+#define UART_RX_RING_SIZE (16 * 1024)
+#define UART_RX_MIN_READ 2048
+#define UART_RX_STATS_INTERVAL 8192
+typedef struct {
+    unsigned char buf[UART_RX_RING_SIZE];
+    unsigned int start; // first byte not yet forwarded
+    unsigned int end;   // one past the last byte read from the uart
+} userial_rx_ring_t;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t wrap_copies;
+    uint64_t wrap_bytes;
+    uint64_t latency_us; // read return to packets forwarded, summed
+    uint32_t latency_max_us;
+} userial_rx_stats_t;
+
+static userial_rx_ring_t uart_rx_ring;
+static userial_rx_stats_t uart_rx_stats;
+/* Num_HCI_Command_Packets as sent by the controller, before it is patched for the stack */
+static atomic_uint ctrl_cmd_credits = 1;
+/*
+ * Commands the controller takes right now, shared by the stack and rtkbt service:
+ * the last Num_HCI_Command_Packets less the commands written since. The service
+ * reserves its credit before handing the command over, the write then uses it up.
+ */
+static pthread_mutex_t ctrl_cmd_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t ctrl_cmd_free = 1;
+static uint8_t ctrl_cmd_reserved;
+
 #ifdef RTK_HANDLE_EVENT
-static int received_packet_state = RTKBT_PACKET_IDLE;
-static unsigned int received_packet_bytes_need = 0;
-static serial_data_type_t recv_packet_current_type = 0;
-static unsigned char received_resvered_header[2048] = {0};
-static int received_resvered_length = 0;
+#define RX_H4_ACL_LEN_LO 3
+#define RX_H4_ACL_LEN_HI 4
+#define RX_H4_EVT_LEN 2
+#define RX_H4_SCO_LEN 3
+#define RX_EVT_CC_CREDITS 2
+#define RX_EVT_CS_CREDITS 3
 static rtkbt_version_t rtkbt_version;
 static rtkbt_lescn_t rtkbt_adv_con;
 #endif
@@ -304,21 +380,17 @@ void userial_vendor_init(char *bt_device_node)
     coex_current_type = 0;
     coex_resvered_length = 0;
 
-#ifdef RTK_HANDLE_EVENT
-    // reset handle event gloable variables
-    received_packet_state = RTKBT_PACKET_IDLE;
-    received_packet_bytes_need = 0;
-    recv_packet_current_type = 0;
-    received_resvered_length = 0;
-#endif
+    // reset uart receive ring
+    uart_rx_ring.start = 0;
+    uart_rx_ring.end = 0;
+    (void)memset_s(&uart_rx_stats, sizeof(uart_rx_stats), 0, sizeof(uart_rx_stats));
 
 #ifdef CONFIG_SCO_OVER_HCI
-    sco_cb.recv_sco_data = RtbQueueInit();
-    sco_cb.send_sco_data = RtbQueueInit();
+    atomic_init(&sco_cb.recv_ring.head, 0);
+    atomic_init(&sco_cb.recv_ring.tail, 0);
     pthread_mutex_init(&sco_cb.sco_recv_mutex, NULL);
-    pthread_cond_init(&sco_cb.sco_recv_cond, NULL);
     pthread_mutex_init(&sco_cb.sco_send_mutex, NULL);
-    (void)memset_s(&sco_cb.sbc_enc, sizeofo(sbc_t), 0, sizeof(sbc_t));
+    (void)memset_s(&sco_cb.sbc_enc, sizeof(sbc_t), 0, sizeof(sbc_t));
     sbc_init_msbc(&sco_cb.sbc_enc, 0L);
     sco_cb.sbc_enc.endian = SBC_LE;
     (void)memset_s(&sco_cb.sbc_dec, sizeof(sbc_t), 0, sizeof(sbc_t));
@@ -741,8 +813,29 @@ static void userial_enqueue_coex_rawdata(unsigned char *buffer, int length, bool
     }
 }
 
+static void userial_cmd_credit_used(void)
+{
+    pthread_mutex_lock(&ctrl_cmd_lock);
+    if (ctrl_cmd_reserved > 0) {
+        ctrl_cmd_reserved--;
+    } else if (ctrl_cmd_free > 0) {
+        ctrl_cmd_free--;
+    }
+    pthread_mutex_unlock(&ctrl_cmd_lock);
+}
+
+static void userial_cmd_credit_granted(uint8_t num_pkts)
+{
+    pthread_mutex_lock(&ctrl_cmd_lock);
+    // reserved commands are not written yet, so the controller has not counted them
+    ctrl_cmd_free = (num_pkts > ctrl_cmd_reserved) ? (num_pkts - ctrl_cmd_reserved) : 0;
+    pthread_mutex_unlock(&ctrl_cmd_lock);
+    atomic_store_explicit(&ctrl_cmd_credits, num_pkts, memory_order_relaxed);
+}
+
 static void userial_send_cmd_to_controller(unsigned char *recv_buffer, int total_length)
 {
+    userial_cmd_credit_used();
     char rtkbt_transtype_send_cmd = get_rtkbt_transtype();
     if (rtkbt_transtype_send_cmd & RTKBT_TRANS_H4) {
         h4_int_transmit_data(recv_buffer, total_length);
@@ -1009,69 +1102,213 @@ static void userial_coex_handler(void *context)
 
 #ifdef CONFIG_SCO_OVER_HCI
 // receive sco encode or non-encode data over hci, we need to decode msbc data to pcm, and send it to sco audio hal
+static uint64_t userial_sco_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static unsigned int userial_sco_ring_depth(void)
+{
+    return atomic_load_explicit(&sco_cb.recv_ring.head, memory_order_acquire) -
+           atomic_load_explicit(&sco_cb.recv_ring.tail, memory_order_relaxed);
+}
+
+/* Producer side, called from the uart receive thread only. */
+static void userial_sco_ring_push(const uint8_t *data, uint16_t length)
+{
+    sco_ring_t *ring = &sco_cb.recv_ring;
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    sco_frame_t *frame;
+
+    if (head - tail >= SCO_RING_FRAMES) {
+        sco_cb.stats.overflow_drops++;
+        return;
+    }
+    frame = &ring->frames[head & SCO_RING_MASK];
+    (void)memcpy_s(frame->data, sizeof(frame->data), data, length);
+    frame->enqueue_us = userial_sco_now_us();
+    sco_cb.stats.frames_in++;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/* Consumer side, called from the sco receive thread only. */
+static sco_frame_t *userial_sco_ring_peek(void)
+{
+    sco_ring_t *ring = &sco_cb.recv_ring;
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+        return NULL;
+    }
+    return &ring->frames[tail & SCO_RING_MASK];
+}
+
+static void userial_sco_ring_pop(void)
+{
+    sco_ring_t *ring = &sco_cb.recv_ring;
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+/* Drop the oldest frames until no more than depth frames are queued. */
+static void userial_sco_ring_trim(unsigned int depth)
+{
+    while (userial_sco_ring_depth() > depth) {
+        userial_sco_ring_pop();
+        sco_cb.stats.latency_drops++;
+    }
+}
+
+/*
+ * Consumer side: drop everything queued. Also used once the sco receive
+ * thread has been joined, when nobody else can be consuming.
+ */
+static void userial_sco_ring_reset(void)
+{
+    sco_ring_t *ring = &sco_cb.recv_ring;
+
+    atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->head, memory_order_acquire), memory_order_release);
+    ring->reset_ack = atomic_load_explicit(&ring->reset_gen, memory_order_acquire);
+}
+
+/*
+ * Producer side: the uart thread must not touch tail, so it only records
+ * how far the ring has to be dropped and the consumer applies it.
+ */
+static void userial_sco_ring_request_reset(void)
+{
+    sco_ring_t *ring = &sco_cb.recv_ring;
+
+    atomic_store_explicit(&ring->reset_head, atomic_load_explicit(&ring->head, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&ring->reset_gen, 1, memory_order_release);
+}
+
+/* Consumer side, apply a reset requested by the producer. */
+static void userial_sco_ring_sync(void)
+{
+    sco_ring_t *ring = &sco_cb.recv_ring;
+    unsigned int gen = atomic_load_explicit(&ring->reset_gen, memory_order_acquire);
+    unsigned int tail, target;
+
+    if (gen == ring->reset_ack) {
+        return;
+    }
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    target = atomic_load_explicit(&ring->reset_head, memory_order_relaxed);
+    if ((int)(target - tail) > 0) {
+        atomic_store_explicit(&ring->tail, target, memory_order_release);
+    }
+    ring->reset_ack = gen;
+}
+
+static void userial_sco_stats_dump(void)
+{
+    uint64_t frames = sco_cb.stats.frames_out ? sco_cb.stats.frames_out : 1;
+
+    HILOGD("sco call: in %u, out %u, underruns %u, overflow drops %u, latency drops %u, "
+           "latency avg %lluus max %uus",
+           sco_cb.stats.frames_in, sco_cb.stats.frames_out, sco_cb.stats.underruns, sco_cb.stats.overflow_drops,
+           sco_cb.stats.latency_drops, (unsigned long long)(sco_cb.stats.latency_sum_us / frames),
+           sco_cb.stats.latency_max_us);
+}
+
+/*
+ * Playout is paced by the sco frame interval instead of by packet arrival.
+ * The receive ring acts as a jitter buffer: playout starts once
+ * SCO_JITTER_TARGET_FRAMES are queued, a backlog beyond SCO_JITTER_MAX_FRAMES
+ * is dropped back to the target, and an empty ring is concealed by repeating
+ * the last frame once, then playing silence.
+ */
 static void *userial_recv_sco_thread(void *arg)
 {
     RTK_UNUSED(arg);
-    RTK_BUFFER *skb_sco_data;
-    unsigned char dec_data[480];
-    unsigned char pcm_data[960];
-    int index = 0;
-    uint8_t *p_data = NULL;
-    int res = 0;
+    sco_frame_t *frame;
+    unsigned char pcm_data[SCO_PCM_FRAME_LEN];
+    unsigned char last_pcm[SCO_PCM_FRAME_LEN];
+    bool last_valid = false;
+    uint32_t interval_us = sco_cb.msbc_used ? SCO_MSBC_FRAME_US : SCO_CVSD_FRAME_US;
+    uint32_t latency_us;
+    struct timespec next;
     size_t writen = 0;
+    int res = 0;
     prctl(PR_SET_NAME, (unsigned long)"userial_recv_sco_thread", 0, 0, 0);
-    pthread_mutex_lock(&sco_cb.sco_recv_mutex);
-#define RTBGETQUEUELEN_60 60
-    while (RtbGetQueueLen(sco_cb.recv_sco_data) > RTBGETQUEUELEN_60) {
-        RTK_BUFFER *sco_data = RtbDequeueHead(sco_cb.recv_sco_data);
-        if (sco_data) {
-            RtbFree(sco_data);
-        }
-    }
-    pthread_mutex_unlock(&sco_cb.sco_recv_mutex);
 
+    // whatever was queued before the audio path opened is stale
+    userial_sco_ring_sync();
+    userial_sco_ring_trim(SCO_JITTER_TARGET_FRAMES);
     HILOGE("userial_recv_sco_thread start");
+    while (sco_cb.thread_recv_sco_running && userial_sco_ring_depth() < SCO_JITTER_TARGET_FRAMES) {
+        usleep(interval_us);
+        userial_sco_ring_sync();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
     while (sco_cb.thread_recv_sco_running) {
-        pthread_mutex_lock(&sco_cb.sco_recv_mutex);
-        while (RtbQueueIsEmpty(sco_cb.recv_sco_data) && sco_cb.thread_sco_running) {
-            pthread_cond_wait(&sco_cb.sco_recv_cond, &sco_cb.sco_recv_mutex);
+        next.tv_nsec += (long)interval_us * 1000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec += 1;
+            next.tv_nsec -= 1000000000L;
         }
-        pthread_mutex_unlock(&sco_cb.sco_recv_mutex);
-        skb_sco_data = RtbDequeueHead(sco_cb.recv_sco_data);
-        if (!skb_sco_data) {
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        userial_sco_ring_sync();
+        if (userial_sco_ring_depth() > SCO_JITTER_MAX_FRAMES) {
+            userial_sco_ring_trim(SCO_JITTER_TARGET_FRAMES);
+        }
+
+        frame = userial_sco_ring_peek();
+        if (!frame) {
+            sco_cb.stats.underruns++;
+            if (!last_valid) {
+                (void)memset_s(last_pcm, sizeof(last_pcm), 0, sizeof(last_pcm));
+            }
+            last_valid = false;
+            Skt_Send_noblock(sco_cb.data_fd, last_pcm, SCO_PCM_FRAME_LEN);
             continue;
         }
-        p_data = skb_sco_data->Data;
+
+        latency_us = (uint32_t)(userial_sco_now_us() - frame->enqueue_us);
+        sco_cb.stats.latency_sum_us += latency_us;
+        if (latency_us > sco_cb.stats.latency_max_us) {
+            sco_cb.stats.latency_max_us = latency_us;
+        }
 
         if (!sco_cb.msbc_used) {
-            res = Skt_Send_noblock(sco_cb.data_fd, p_data, sco_cb.sco_packet_len);
+            (void)memcpy_s(last_pcm, sizeof(last_pcm), frame->data, sco_cb.sco_packet_len);
+            last_valid = true;
+            res = Skt_Send_noblock(sco_cb.data_fd, frame->data, sco_cb.sco_packet_len);
             if (res < 0) {
                 HILOGE("userial_recv_sco_thread, send noblock error");
             }
         } else {
 #define SBC_DECODE_PARAMETER_2 2
 #define SBC_DECODE_PARAMETER_58 58
-#define SBC_DECODE_PARAMETER_240 240
-            res = sbc_decode(&sco_cb.sbc_dec, (p_data + SBC_DECODE_PARAMETER_2), SBC_DECODE_PARAMETER_58, dec_data,
-                             SBC_DECODE_PARAMETER_240, &writen);
+            res = sbc_decode(&sco_cb.sbc_dec, (frame->data + SBC_DECODE_PARAMETER_2), SBC_DECODE_PARAMETER_58,
+                             pcm_data, SCO_PCM_FRAME_LEN, &writen);
             if (res > 0) {
-#define MEMCPY_S_240 240
-                memcpy_s(&pcm_data[MEMCPY_S_240 * index], MEMCPY_S_240, dec_data, MEMCPY_S_240);
-
-#define INDEX_4 4
-                index = (index + 1) % INDEX_4;
-                if (index == 0) {
-#define SKT_SEND_NOBLOCK_960 960
-                    Skt_Send_noblock(sco_cb.data_fd, pcm_data, SKT_SEND_NOBLOCK_960);
-                }
+                (void)memcpy_s(last_pcm, sizeof(last_pcm), pcm_data, SCO_PCM_FRAME_LEN);
+                last_valid = true;
             } else {
                 HILOGE("msbc decode fail!");
+                if (!last_valid) {
+                    (void)memset_s(last_pcm, sizeof(last_pcm), 0, sizeof(last_pcm));
+                }
+                last_valid = false;
             }
+            Skt_Send_noblock(sco_cb.data_fd, last_pcm, SCO_PCM_FRAME_LEN);
         }
-        RtbFree(skb_sco_data);
+        userial_sco_ring_pop();
+        sco_cb.stats.frames_out++;
     }
     HILOGE("userial_recv_sco_thread exit");
-    RtbEmptyQueue(sco_cb.recv_sco_data);
+    userial_sco_stats_dump();
+    userial_sco_ring_reset();
     return NULL;
 }
 
@@ -1181,7 +1418,6 @@ static void userial_sco_recv_socket_stop()
     pthread_mutex_lock(&sco_cb.sco_recv_mutex);
     if (sco_cb.thread_recv_sco_running) {
         sco_cb.thread_recv_sco_running = false;
-        pthread_cond_signal(&sco_cb.sco_recv_cond);
     } else {
         pthread_mutex_unlock(&sco_cb.sco_recv_mutex);
         return;
@@ -1207,7 +1443,7 @@ static void userial_sco_socket_stop()
         close(sco_cb.data_fd);
         sco_cb.data_fd = -1;
     }
-    RtbEmptyQueue(sco_cb.recv_sco_data);
+    userial_sco_ring_reset();
 }
 
 static void userial_sco_ctrl_skt_handle()
@@ -1241,6 +1477,7 @@ static void userial_sco_ctrl_skt_handle()
             pthread_attr_t thread_attr;
             pthread_attr_init(&thread_attr);
             pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
+            (void)memset_s(&sco_cb.stats, sizeof(sco_cb.stats), 0, sizeof(sco_cb.stats));
             sco_cb.thread_recv_sco_running = true;
             if (pthread_create(&sco_cb.thread_recv_sco_id, &thread_attr, userial_recv_sco_thread, NULL) != 0) {
                 HILOGE("pthread_create : %s", strerror(errno));
@@ -1674,12 +1911,14 @@ static void userial_recv_H4_rawdata(void *context)
                     userial_handle_cmd(&h4_read_buffer[1], h4_read_length);
 #endif
                     if (rtkbt_transtype_recv_H4_rawdata & RTKBT_TRANS_H4) {
+                        userial_cmd_credit_used();
                         h4_int_transmit_data(h4_read_buffer, (h4_read_length + 1));
                     } else {
                         opcode = *(uint16_t *)&h4_read_buffer[1];
                         if (opcode == HCI_VSC_H5_INIT) {
                             h5_int_interface->h5_send_sync_cmd(opcode, NULL, h4_read_length);
                         } else {
+                            userial_cmd_credit_used();
                             transmitted_length =
                                 h5_int_interface->h5_send_cmd(type, &h4_read_buffer[1], h4_read_length);
                         }
@@ -1800,7 +2039,7 @@ static void userial_handle_event(unsigned char *recv_buffer, int total_length)
                     HILOGE("pthread_create : %s", strerror(errno));
                 }
 
-                RtbEmptyQueue(sco_cb.recv_sco_data);
+                userial_sco_ring_request_reset();
                 if (!(sco_cb.voice_settings & 0x0003)) {
                     sco_cb.sco_packet_len = SCO_PACKET_LEN_240; // every 5 cvsd packets form a sco pcm data
                     sco_cb.msbc_used = false;
@@ -1819,7 +2058,8 @@ static void userial_handle_event(unsigned char *recv_buffer, int total_length)
             if ((*((uint16_t *)&p_data[P_DATA_3])) == sco_cb.sco_handle) {
                 sco_cb.sco_handle = 0;
                 sco_cb.msbc_used = false;
-                RtbEmptyQueue(sco_cb.recv_sco_data);
+                sco_cb.current_pos = 0;
+                userial_sco_ring_request_reset();
                 if (sco_cb.thread_sco_running) {
                     sco_cb.thread_sco_running = false;
                     unsigned char close_signal = 1;
@@ -1842,7 +2082,6 @@ static void userial_enqueue_recv_sco_data(unsigned char *recv_buffer, int total_
     uint16_t sco_handle;
     uint8_t sco_length;
     uint8_t *p_data = recv_buffer;
-    RTK_BUFFER *skb_sco_data;
     int i;
     sco_handle = *((uint16_t *)p_data);
     uint16_t current_pos = sco_cb.current_pos;
@@ -1856,13 +2095,7 @@ static void userial_enqueue_recv_sco_data(unsigned char *recv_buffer, int total_
             if ((sco_packet_len - current_pos) <= sco_length) {
                 (void)memcpy_s(&sco_cb.enc_data[current_pos], (sco_packet_len - current_pos), p_data,
                                (sco_packet_len - current_pos));
-                skb_sco_data = RtbAllocate(sco_packet_len, 0);
-                (void)memcpy_s(skb_sco_data->Data, sco_packet_len, sco_cb.enc_data, sco_packet_len);
-                RtbAddTail(skb_sco_data, sco_packet_len);
-                pthread_mutex_lock(&sco_cb.sco_recv_mutex);
-                RtbQueueTail(sco_cb.recv_sco_data, skb_sco_data);
-                pthread_cond_signal(&sco_cb.sco_recv_cond);
-                pthread_mutex_unlock(&sco_cb.sco_recv_mutex);
+                userial_sco_ring_push(sco_cb.enc_data, sco_packet_len);
 
                 sco_cb.current_pos = 0;
                 p_data += (sco_packet_len - current_pos);
@@ -1877,15 +2110,7 @@ static void userial_enqueue_recv_sco_data(unsigned char *recv_buffer, int total_
         // if use cvsd codec
         if (!sco_cb.msbc_used) {
             for (i = 0; i < (sco_length / sco_packet_len); i++) {
-                skb_sco_data = RtbAllocate(sco_packet_len, 0);
-                (void)memcpy_s(skb_sco_data->Data, sco_packet_len, p_data + i * sco_packet_len, sco_packet_len);
-                RtbAddTail(skb_sco_data, sco_packet_len);
-                RtbQueueTail(sco_cb.recv_sco_data, skb_sco_data);
-            }
-            if ((sco_length / sco_packet_len)) {
-                pthread_mutex_lock(&sco_cb.sco_recv_mutex);
-                pthread_cond_signal(&sco_cb.sco_recv_cond);
-                pthread_mutex_unlock(&sco_cb.sco_recv_mutex);
+                userial_sco_ring_push(p_data + i * sco_packet_len, sco_packet_len);
             }
 
             i = (sco_length % sco_packet_len);
@@ -1906,14 +2131,7 @@ static void userial_enqueue_recv_sco_data(unsigned char *recv_buffer, int total_
                     sco_cb.current_pos = sco_length - i;
                     return;
                 } else {
-                    (void)memcpy_s(sco_cb.enc_data, sco_packet_len, &p_data[i], sco_packet_len); // complete msbc data
-                    skb_sco_data = RtbAllocate(sco_packet_len, 0);
-                    (void)memcpy_s(skb_sco_data->Data, sco_packet_len, sco_cb.enc_data, sco_packet_len);
-                    RtbAddTail(skb_sco_data, sco_packet_len);
-                    pthread_mutex_lock(&sco_cb.sco_recv_mutex);
-                    RtbQueueTail(sco_cb.recv_sco_data, skb_sco_data);
-                    pthread_cond_signal(&sco_cb.sco_recv_cond);
-                    pthread_mutex_unlock(&sco_cb.sco_recv_mutex);
+                    userial_sco_ring_push(&p_data[i], sco_packet_len); // complete msbc data
 
                     sco_cb.current_pos = 0;
                     i += (sco_packet_len - 1);
@@ -1924,139 +2142,87 @@ static void userial_enqueue_recv_sco_data(unsigned char *recv_buffer, int total_
 }
 #endif
 
-static int userial_handle_recv_data(unsigned char *recv_buffer, unsigned int total_length)
+/* Length of the complete H4 packet at data (type byte included), 0 if more bytes are needed. */
+static unsigned int userial_h4_packet_length(const unsigned char *data, unsigned int length)
 {
-    serial_data_type_t type = 0;
-    unsigned char *p_data = recv_buffer;
-    unsigned int length = total_length;
-    uint8_t event;
+    serial_data_type_t type = data[0];
+    unsigned int preamble = hci_preamble_sizes[HCI_PACKET_TYPE_TO_INDEX(type)];
+    unsigned int payload;
 
-    if (!length) {
-        HILOGE("%s, length is 0, return immediately", __func__);
-        return total_length;
+    if (length < 1 + preamble) {
+        return 0;
     }
-    switch (received_packet_state) {
-        case RTKBT_PACKET_IDLE:
-            received_packet_bytes_need = 1;
-            while (length) {
-                type = p_data[0];
-                length--;
-                p_data++;
-                if (type < DATA_TYPE_ACL || type > DATA_TYPE_EVENT) {
-                    HILOGE("%s invalid data type: %d", __func__, type);
-                    assert((type > DATA_TYPE_COMMAND) && (type <= DATA_TYPE_EVENT));
-                    if (!length) {
-                        return total_length;
-                    }
-
-                    continue;
-                }
-                break;
-            }
-            recv_packet_current_type = type;
-            received_packet_state = RTKBT_PACKET_TYPE;
-            // fall through
-            __attribute__((fallthrough));
-
-        case RTKBT_PACKET_TYPE:
-            received_packet_bytes_need = hci_preamble_sizes[HCI_PACKET_TYPE_TO_INDEX(recv_packet_current_type)];
-            received_resvered_length = 0;
-            received_packet_state = RTKBT_PACKET_HEADER;
-            // fall through
-            __attribute__((fallthrough));
-
-        case RTKBT_PACKET_HEADER:
-            if (length >= received_packet_bytes_need) {
-                (void)memcpy_s(&received_resvered_header[received_resvered_length], received_packet_bytes_need, p_data,
-                               received_packet_bytes_need);
-                received_resvered_length += received_packet_bytes_need;
-                length -= received_packet_bytes_need;
-                p_data += received_packet_bytes_need;
-            } else {
-                (void)memcpy_s(&received_resvered_header[received_resvered_length], length, p_data, length);
-                received_resvered_length += length;
-                received_packet_bytes_need -= length;
-                length = 0;
-                return total_length;
-            }
-            received_packet_state = RTKBT_PACKET_CONTENT;
-
-#define RESVERED_2 2
-#define RESVERED_4 4
-            if (recv_packet_current_type == DATA_TYPE_ACL) {
-                received_packet_bytes_need = *(uint16_t *)&received_resvered_header[RESVERED_2];
-            } else if (recv_packet_current_type == DATA_TYPE_EVENT) {
-                received_packet_bytes_need = received_resvered_header[1];
-            } else {
-                received_packet_bytes_need = received_resvered_header[RESVERED_2];
-            }
-            // fall through
-            __attribute__((fallthrough));
-
-        case RTKBT_PACKET_CONTENT:
-            if (recv_packet_current_type == DATA_TYPE_EVENT) {
-                event = received_resvered_header[0];
+    if (type == DATA_TYPE_ACL) {
+        payload = data[RX_H4_ACL_LEN_LO] | (data[RX_H4_ACL_LEN_HI] << 8);
+    } else if (type == DATA_TYPE_EVENT) {
+        payload = data[RX_H4_EVT_LEN];
+    } else {
+        payload = data[RX_H4_SCO_LEN];
+    }
+    if (length < 1 + preamble + payload) {
+        return 0;
+    }
+    return 1 + preamble + payload;
+}
 
-                if (event == HCI_COMMAND_COMPLETE_EVT) {
-                    if (received_resvered_length == RESVERED_2) {
-                        if (length >= 1) {
-                            *p_data = 1;
-                        }
-                    }
-                } else if (event == HCI_COMMAND_STATUS_EVT) {
-                    if (received_resvered_length < RESVERED_4) {
-                        unsigned int act_len = RESVERED_4 - received_resvered_length;
-                        if (length >= act_len) {
-                            *(p_data + act_len - 1) = 1;
-                        }
-                    }
-                }
-            }
-            if (length >= received_packet_bytes_need) {
-                (void)memcpy_s(&received_resvered_header[received_resvered_length], received_packet_bytes_need, p_data,
-                               received_packet_bytes_need);
-                length -= received_packet_bytes_need;
-                p_data += received_packet_bytes_need;
-                received_resvered_length += received_packet_bytes_need;
-                received_packet_bytes_need = 0;
-            } else {
-                (void)memcpy_s(&received_resvered_header[received_resvered_length], length, p_data, length);
-                received_resvered_length += length;
-                received_packet_bytes_need -= length;
-                length = 0;
-                return total_length;
+static void userial_dispatch_recv_packet(serial_data_type_t type, unsigned char *packet, unsigned int length)
+{
+    switch (type) {
+        case DATA_TYPE_EVENT:
+            // report a single command credit to the stack, patched before the packet is forwarded
+            if (packet[0] == HCI_COMMAND_COMPLETE_EVT && length > RX_EVT_CC_CREDITS) {
+                userial_cmd_credit_granted(packet[RX_EVT_CC_CREDITS]);
+                packet[RX_EVT_CC_CREDITS] = 1;
+                Rtk_Service_Cmd_Credits_Notify();
+            } else if (packet[0] == HCI_COMMAND_STATUS_EVT && length > RX_EVT_CS_CREDITS) {
+                userial_cmd_credit_granted(packet[RX_EVT_CS_CREDITS]);
+                packet[RX_EVT_CS_CREDITS] = 1;
+                Rtk_Service_Cmd_Credits_Notify();
             }
-            received_packet_state = RTKBT_PACKET_END;
-            // fall through
-            __attribute__((fallthrough));
-
-        case RTKBT_PACKET_END:
-            switch (recv_packet_current_type) {
-                case DATA_TYPE_EVENT:
-                    userial_handle_event(received_resvered_header, received_resvered_length);
-                    break;
+            userial_handle_event(packet, length);
+            break;
 #ifdef CONFIG_SCO_OVER_HCI
-                case DATA_TYPE_SCO:
-                    userial_enqueue_recv_sco_data(received_resvered_header, received_resvered_length);
-                    break;
+        case DATA_TYPE_SCO:
+            userial_enqueue_recv_sco_data(packet, length);
+            break;
 #endif
-                default:
+        default:
 
-                    break;
-            }
             break;
+    }
+}
 
-        default:
+/*
+ * Frame the H4 packets in place and hand them out as views into the buffer.
+ * Returns the number of bytes covered by complete packets, the trailing
+ * partial packet (if any) stays in the buffer until more bytes arrive.
+ */
+static unsigned int userial_handle_recv_data(unsigned char *recv_buffer, unsigned int total_length)
+{
+    unsigned int consumed = 0;
+
+    while (consumed < total_length) {
+        unsigned char *p_data = recv_buffer + consumed;
+        serial_data_type_t type = p_data[0];
+        unsigned int packet_length;
+
+        if (type < DATA_TYPE_ACL || type > DATA_TYPE_EVENT) {
+            HILOGE("%s invalid data type: %d", __func__, type);
+            assert((type > DATA_TYPE_COMMAND) && (type <= DATA_TYPE_EVENT));
+            consumed++;
+            continue;
+        }
 
+        packet_length = userial_h4_packet_length(p_data, total_length - consumed);
+        if (packet_length == 0) {
             break;
+        }
+        userial_dispatch_recv_packet(type, p_data + 1, packet_length - 1);
+        uart_rx_stats.packets++;
+        consumed += packet_length;
     }
 
-    received_packet_state = RTKBT_PACKET_IDLE;
-    received_packet_bytes_need = 0;
-    recv_packet_current_type = 0;
-    received_resvered_length = 0;
-
-    return (total_length - length);
+    return consumed;
 }
 #endif
 
@@ -2074,10 +2240,8 @@ static void h5_data_ready_cb(serial_data_type_t type, unsigned int total_length)
     uint16_t transmitted_length = 0;
     unsigned int real_length = length;
 #ifdef RTK_HANDLE_EVENT
-    unsigned int read_length = 0;
-    do {
-        read_length += userial_handle_recv_data(buffer + read_length, real_length - read_length);
-    } while (vnd_userial.thread_running && read_length < total_length);
+    // h5 hands over one complete packet at a time
+    (void)userial_handle_recv_data(buffer, real_length);
 #endif
 
     while (length > 0) {
@@ -2106,18 +2270,70 @@ static void h5_data_ready_cb(serial_data_type_t type, unsigned int total_length)
     return;
 }
 
+/* Move the trailing partial packet to the front of the ring, the only copy on the receive path. */
+static void userial_rx_ring_compact(void)
+{
+    unsigned int pending = uart_rx_ring.end - uart_rx_ring.start;
+
+    if (uart_rx_ring.start == 0) {
+        return;
+    }
+    if (pending) {
+        (void)memmove_s(uart_rx_ring.buf, UART_RX_RING_SIZE, uart_rx_ring.buf + uart_rx_ring.start, pending);
+        uart_rx_stats.wrap_copies++;
+        uart_rx_stats.wrap_bytes += pending;
+    }
+    uart_rx_ring.start = 0;
+    uart_rx_ring.end = pending;
+}
+
+static void userial_rx_stats_dump(void)
+{
+    uint64_t reads = uart_rx_stats.reads ? uart_rx_stats.reads : 1;
+
+    HILOGD("uart rx: reads %llu, bytes %llu, bytes/read %llu, packets %llu, wrap copies %llu (%llu bytes), "
+           "latency avg %lluus max %uus",
+           (unsigned long long)uart_rx_stats.reads, (unsigned long long)uart_rx_stats.bytes,
+           (unsigned long long)(uart_rx_stats.bytes / reads), (unsigned long long)uart_rx_stats.packets,
+           (unsigned long long)uart_rx_stats.wrap_copies, (unsigned long long)uart_rx_stats.wrap_bytes,
+           (unsigned long long)(uart_rx_stats.latency_us / reads), uart_rx_stats.latency_max_us);
+}
+
+static void userial_rx_stats_update(const struct timespec *start, ssize_t bytes_read)
+{
+    struct timespec now;
+    uint32_t latency_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    latency_us = (uint32_t)((now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L);
+    uart_rx_stats.reads++;
+    uart_rx_stats.bytes += bytes_read;
+    uart_rx_stats.latency_us += latency_us;
+    if (latency_us > uart_rx_stats.latency_max_us) {
+        uart_rx_stats.latency_max_us = latency_us;
+    }
+    if ((uart_rx_stats.reads % UART_RX_STATS_INTERVAL) == 0) {
+        userial_rx_stats_dump();
+    }
+}
+
 // This recv data from driver which is sent or recv by the controller. The data type have ACL/SCO/EVENT
 //  direction CONTROLLER -----> BT HOST
-static void userial_recv_uart_rawdata(unsigned char *buffer, unsigned int total_length)
+// Only complete packets are forwarded, a partial packet waits in the ring for the rest of its bytes.
+static void userial_recv_uart_rawdata(void)
 {
-    unsigned int length = total_length;
+    unsigned char *buffer = uart_rx_ring.buf + uart_rx_ring.start;
+    unsigned int total_length = uart_rx_ring.end - uart_rx_ring.start;
+    unsigned int length;
     uint16_t transmitted_length = 0;
 #ifdef RTK_HANDLE_EVENT
-    unsigned int read_length = 0;
-    do {
-        read_length += userial_handle_recv_data(buffer + read_length, total_length - read_length);
-    } while (read_length < total_length);
+    total_length = userial_handle_recv_data(buffer, total_length);
+    if (total_length == 0 && uart_rx_ring.start == 0 && uart_rx_ring.end == UART_RX_RING_SIZE) {
+        HILOGE("%s no packet boundary in %d bytes, flush", __func__, UART_RX_RING_SIZE);
+        total_length = UART_RX_RING_SIZE;
+    }
 #endif
+    length = total_length;
     while (length > 0 && vnd_userial.thread_running) {
         ssize_t ret;
         RTK_NO_INTR(ret = write(vnd_userial.uart_fd[1], buffer + transmitted_length, length));
@@ -2139,9 +2355,36 @@ done:;
     if (total_length) {
         userial_enqueue_coex_rawdata(buffer, total_length, true);
     }
+
+    uart_rx_ring.start += total_length;
+    if (uart_rx_ring.start == uart_rx_ring.end) {
+        uart_rx_ring.start = 0;
+        uart_rx_ring.end = 0;
+    }
     return;
 }
 
+/* Command credits last granted by the controller, the stack only ever sees 1. */
+uint8_t userial_vendor_get_cmd_credits(void)
+{
+    return (uint8_t)atomic_load_explicit(&ctrl_cmd_credits, memory_order_relaxed);
+}
+
+/* Reserve one of the shared command credits for a command handed to the stack, 0 if none is free. */
+int userial_vendor_take_cmd_credit(void)
+{
+    int taken = 0;
+
+    pthread_mutex_lock(&ctrl_cmd_lock);
+    if (ctrl_cmd_free > 0) {
+        ctrl_cmd_free--;
+        ctrl_cmd_reserved++;
+        taken = 1;
+    }
+    pthread_mutex_unlock(&ctrl_cmd_lock);
+    return taken;
+}
+
 void userial_recv_rawdata_hook(unsigned char *buffer, unsigned int total_length)
 {
     uint16_t transmitted_length = 0;
@@ -2215,8 +2458,10 @@ static void *userial_recv_uart_thread(void *arg)
     pfd[1].events = POLLIN | POLLHUP | POLLERR | POLLRDHUP;
     pfd[1].fd = vnd_userial.fd;
     int ret;
-    unsigned char read_buffer[2056] = {0};
+    unsigned char *read_buffer;
+    size_t read_size;
     ssize_t bytes_read;
+    struct timespec read_time;
     char rtkbt_transtype_recv_uart_thread = get_rtkbt_transtype();
 #define RET_2 2
 #define RET_500 500
@@ -2228,11 +2473,17 @@ static void *userial_recv_uart_thread(void *arg)
         // exit signal is always at first index
         if (pfd[0].revents && !vnd_userial.thread_running) {
             HILOGE("receive exit signal and stop thread ");
+            userial_rx_stats_dump();
             return NULL;
         }
 
         if (pfd[1].revents & POLLIN) {
-            RTK_NO_INTR(bytes_read = read(vnd_userial.fd, read_buffer, sizeof(read_buffer)));
+            if (UART_RX_RING_SIZE - uart_rx_ring.end < UART_RX_MIN_READ) {
+                userial_rx_ring_compact();
+            }
+            read_buffer = uart_rx_ring.buf + uart_rx_ring.end;
+            read_size = UART_RX_RING_SIZE - uart_rx_ring.end;
+            RTK_NO_INTR(bytes_read = read(vnd_userial.fd, read_buffer, read_size));
             if (!bytes_read) {
                 continue;
             }
@@ -2240,12 +2491,15 @@ static void *userial_recv_uart_thread(void *arg)
                 HILOGE("%s, read fail, error : %s", __func__, strerror(errno));
                 continue;
             }
+            clock_gettime(CLOCK_MONOTONIC, &read_time);
 
             if (rtkbt_transtype_recv_uart_thread & RTKBT_TRANS_H5) {
                 h5_int_interface->h5_recv_msg(read_buffer, bytes_read);
             } else {
-                userial_recv_uart_rawdata(read_buffer, bytes_read);
+                uart_rx_ring.end += bytes_read;
+                userial_recv_uart_rawdata();
             }
+            userial_rx_stats_update(&read_time, bytes_read);
         }
 
         if (pfd[1].revents & (POLLERR | POLLHUP)) {
@@ -2260,6 +2514,7 @@ static void *userial_recv_uart_thread(void *arg)
         }
     }
     vnd_userial.thread_uart_id = (pthread_t)-1;
+    userial_rx_stats_dump();
     HILOGD("%s exit", __func__);
     return NULL;
 }
@@ -0,0 +1,658 @@
+/*
+ * Copyright (c) 2022 Unionman Technology Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs libbt_vendor against rtk_fake_controller over a pseudo-terminal.
+ *
+ * The test plays the part of the bluetooth stack: it brings the controller
+ * up through BT_OP_INIT (H5 link establishment, version reads, patch
+ * download), then streams ACL packets through the HCI channel, which the
+ * fake controller echoes back. It reports bring-up time, throughput,
+ * link-layer retransmissions and CPU time per MB moved, and fails if the
+ * bring-up fails or an echoed packet does not match what was sent.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bt_hci_bdroid.h"
+#include "bt_vendor_lib.h"
+#include "rtk_fake_controller.h"
+
+#ifndef RTKBT_TEST_DIR
+#define RTKBT_TEST_DIR "/data/local/tmp/rtkbt_test"
+#endif
+
+#define TEST_FW_NAME "rtl8822cs_fw"
+#define TEST_CONFIG_NAME "rtl8822cs_config"
+#define TEST_DEFAULT_FW_DIR "/vendor/etc/firmware"
+
+#define TEST_INIT_TIMEOUT_S 15
+#define TEST_ACL_HANDLE 0x0001
+#define TEST_ACL_MAX 1021
+#define TEST_PENDING_OPCODES 8
+#define TEST_PATH_LEN 256
+#define TEST_COPY_CHUNK 4096
+
+#define H4_CMD 0x01
+#define H4_ACL 0x02
+#define H4_SCO 0x03
+#define H4_EVT 0x04
+
+#define EVT_CMD_COMPLETE 0x0e
+#define EVT_CMD_STATUS 0x0f
+
+extern const bt_vendor_interface_t BLUETOOTH_VENDOR_LIB_INTERFACE;
+
+typedef struct {
+    const char *fw_dir;
+    int transport;
+    int seconds;
+    int acl_len;
+    int window;
+    fake_ctrl_cfg_t ctrl;
+} test_opts_t;
+
+typedef struct {
+    int hci_fd;
+    pthread_mutex_t lock;
+    pthread_mutex_t write_lock;
+    pthread_cond_t cond;
+    int init_done;
+    int init_result;
+    volatile int running;
+    uint16_t pending_opcode[TEST_PENDING_OPCODES];
+    uint32_t acl_sent;
+    uint32_t acl_echoed;
+    uint32_t acl_mismatch;
+    uint64_t echo_bytes;
+} test_ctx_t;
+
+static test_ctx_t test_ctx;
+
+static uint64_t test_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static uint64_t test_cpu_us(int who)
+{
+    struct rusage ru;
+
+    if (getrusage(who, &ru) != 0) {
+        return 0;
+    }
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL +
+           (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+static int test_write_full(int fd, const uint8_t *buf, size_t len)
+{
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = write(fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= (size_t)ret;
+    }
+    return 0;
+}
+
+static int test_read_full(int fd, uint8_t *buf, size_t len)
+{
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = read(fd, buf, len);
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= (size_t)ret;
+    }
+    return 0;
+}
+
+static void test_init_cb(bt_op_result_t result)
+{
+    pthread_mutex_lock(&test_ctx.lock);
+    test_ctx.init_done = 1;
+    test_ctx.init_result = result;
+    pthread_cond_broadcast(&test_ctx.cond);
+    pthread_mutex_unlock(&test_ctx.lock);
+}
+
+static void *test_alloc(int size)
+{
+    return malloc(size);
+}
+
+static void test_dealloc(void *buf)
+{
+    free(buf);
+}
+
+static void test_pending_add(uint16_t opcode)
+{
+    int i;
+
+    pthread_mutex_lock(&test_ctx.lock);
+    for (i = 0; i < TEST_PENDING_OPCODES; i++) {
+        if (test_ctx.pending_opcode[i] == 0) {
+            test_ctx.pending_opcode[i] = opcode;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&test_ctx.lock);
+}
+
+static int test_pending_take(uint16_t opcode)
+{
+    int i;
+    int found = 0;
+
+    pthread_mutex_lock(&test_ctx.lock);
+    for (i = 0; i < TEST_PENDING_OPCODES; i++) {
+        if (test_ctx.pending_opcode[i] == opcode) {
+            test_ctx.pending_opcode[i] = 0;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&test_ctx.lock);
+    return found;
+}
+
+/* vendor lib -> controller commands, sent on the HCI channel like the stack does */
+static size_t test_xmit_cb(uint16_t opcode, void *p_buf)
+{
+    HC_BT_HDR *p_msg = (HC_BT_HDR *)p_buf;
+    uint8_t type = H4_CMD;
+    int ret;
+
+    test_pending_add(opcode);
+    pthread_mutex_lock(&test_ctx.write_lock);
+    ret = test_write_full(test_ctx.hci_fd, &type, 1);
+    if (ret == 0) {
+        ret = test_write_full(test_ctx.hci_fd, p_msg->data + p_msg->offset, p_msg->len);
+    }
+    pthread_mutex_unlock(&test_ctx.write_lock);
+    free(p_buf);
+    return ret == 0;
+}
+
+static const bt_vendor_callbacks_t test_cbacks = {
+    sizeof(bt_vendor_callbacks_t), test_init_cb, test_alloc, test_dealloc, test_xmit_cb,
+};
+
+static void test_fill_acl(uint8_t *payload, int len, uint32_t seq)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        payload[i] = (uint8_t)(seq * 31 + i);
+    }
+}
+
+static void test_handle_event(uint8_t *evt, uint8_t plen)
+{
+    HC_BT_HDR *p_msg = NULL;
+    uint16_t opcode;
+
+    if (evt[0] == EVT_CMD_COMPLETE && plen >= 3) {
+        opcode = (uint16_t)(evt[3] | (evt[4] << 8));
+    } else if (evt[0] == EVT_CMD_STATUS && plen >= 4) {
+        opcode = (uint16_t)(evt[4] | (evt[5] << 8));
+    } else {
+        return;
+    }
+    if (!test_pending_take(opcode)) {
+        return;
+    }
+
+    p_msg = (HC_BT_HDR *)malloc(BT_HC_HDR_SIZE + 2 + plen);
+    if (p_msg == NULL) {
+        return;
+    }
+    p_msg->event = MSG_HC_TO_STACK_HCI_EVT;
+    p_msg->len = (uint16_t)(2 + plen);
+    p_msg->offset = 0;
+    p_msg->layer_specific = 0;
+    (void)memcpy(p_msg->data, evt, 2 + plen);
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_OP_EVENT_CALLBACK, p_msg);
+    free(p_msg);
+}
+
+static void test_handle_acl(const uint8_t *hdr, const uint8_t *payload, uint16_t len)
+{
+    uint8_t expect[TEST_ACL_MAX];
+    uint32_t seq;
+
+    pthread_mutex_lock(&test_ctx.lock);
+    seq = test_ctx.acl_echoed++;
+    test_ctx.echo_bytes += 4U + len;
+    test_fill_acl(expect, len, seq);
+    if ((uint16_t)((hdr[0] | (hdr[1] << 8)) & 0x0fff) != TEST_ACL_HANDLE || memcmp(expect, payload, len) != 0) {
+        test_ctx.acl_mismatch++;
+    }
+    pthread_cond_broadcast(&test_ctx.cond);
+    pthread_mutex_unlock(&test_ctx.lock);
+}
+
+static void *test_reader_thread(void *arg)
+{
+    uint8_t type;
+    uint8_t hdr[4];
+    uint8_t buf[4 + 65535];
+    uint16_t len;
+
+    (void)arg;
+    while (test_ctx.running) {
+        if (test_read_full(test_ctx.hci_fd, &type, 1) != 0) {
+            break;
+        }
+        if (type == H4_EVT) {
+            if (test_read_full(test_ctx.hci_fd, buf, 2) != 0 || test_read_full(test_ctx.hci_fd, buf + 2, buf[1]) != 0) {
+                break;
+            }
+            test_handle_event(buf, buf[1]);
+        } else if (type == H4_ACL) {
+            if (test_read_full(test_ctx.hci_fd, hdr, 4) != 0) {
+                break;
+            }
+            len = (uint16_t)(hdr[2] | (hdr[3] << 8));
+            if (len > TEST_ACL_MAX || test_read_full(test_ctx.hci_fd, buf, len) != 0) {
+                break;
+            }
+            test_handle_acl(hdr, buf, len);
+        } else if (type == H4_SCO) {
+            if (test_read_full(test_ctx.hci_fd, hdr, 3) != 0 || test_read_full(test_ctx.hci_fd, buf, hdr[2]) != 0) {
+                break;
+            }
+        } else {
+            fprintf(stderr, "unexpected hci packet type 0x%02x\n", type);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int test_copy_file(const char *dir, const char *name)
+{
+    char src[TEST_PATH_LEN];
+    char dst[TEST_PATH_LEN];
+    uint8_t buf[TEST_COPY_CHUNK];
+    ssize_t n;
+    int in_fd;
+    int out_fd;
+    int ret = 0;
+
+    (void)snprintf(src, sizeof(src), "%s/%s", dir, name);
+    (void)snprintf(dst, sizeof(dst), "%s/%s", RTKBT_TEST_DIR, name);
+    in_fd = open(src, O_RDONLY);
+    if (in_fd < 0) {
+        fprintf(stderr, "unable to open %s: %s\n", src, strerror(errno));
+        return -1;
+    }
+    out_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        fprintf(stderr, "unable to create %s: %s\n", dst, strerror(errno));
+        close(in_fd);
+        return -1;
+    }
+    while ((n = read(in_fd, buf, sizeof(buf))) > 0) {
+        if (test_write_full(out_fd, buf, (size_t)n) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+    close(in_fd);
+    close(out_fd);
+    return (n < 0) ? -1 : ret;
+}
+
+static int test_prepare_dir(const test_opts_t *opts, const char *tty)
+{
+    FILE *fp = NULL;
+
+    if (mkdir(RTKBT_TEST_DIR, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "unable to create %s: %s\n", RTKBT_TEST_DIR, strerror(errno));
+        return -1;
+    }
+    if (test_copy_file(opts->fw_dir, TEST_FW_NAME) != 0 || test_copy_file(opts->fw_dir, TEST_CONFIG_NAME) != 0) {
+        return -1;
+    }
+
+    fp = fopen(RTKBT_TEST_DIR "/rtkbt.conf", "w");
+    if (fp == NULL) {
+        fprintf(stderr, "unable to write rtkbt.conf: %s\n", strerror(errno));
+        return -1;
+    }
+    fprintf(fp, "BtDeviceNode=%s\n", tty);
+    fprintf(fp, "BtUartTransport=%s\n", opts->transport == FAKE_CTRL_TRANS_H4 ? "h4" : "h5");
+    fprintf(fp, "RtkBtsnoopDump=false\n");
+    fprintf(fp, "RtkBtAutoRestart=false\n");
+    fclose(fp);
+    return 0;
+}
+
+static int test_open_pty(char *name, size_t name_len)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, name, name_len) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int test_wait_init(void)
+{
+    struct timespec deadline;
+    int ret = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += TEST_INIT_TIMEOUT_S;
+    pthread_mutex_lock(&test_ctx.lock);
+    while (!test_ctx.init_done && ret == 0) {
+        ret = pthread_cond_timedwait(&test_ctx.cond, &test_ctx.lock, &deadline);
+    }
+    ret = test_ctx.init_done ? (test_ctx.init_result == BTC_OP_RESULT_SUCCESS ? 0 : -1) : -1;
+    pthread_mutex_unlock(&test_ctx.lock);
+    return ret;
+}
+
+static void test_stream_acl(const test_opts_t *opts)
+{
+    uint8_t pkt[1 + 4 + TEST_ACL_MAX];
+    uint64_t end_us = test_now_us() + (uint64_t)opts->seconds * 1000000ULL;
+    uint32_t seq;
+
+    pkt[0] = H4_ACL;
+    pkt[1] = TEST_ACL_HANDLE & 0xff;
+    pkt[2] = (TEST_ACL_HANDLE >> 8) & 0x0f;
+    pkt[3] = (uint8_t)(opts->acl_len & 0xff);
+    pkt[4] = (uint8_t)(opts->acl_len >> 8);
+
+    while (test_now_us() < end_us) {
+        pthread_mutex_lock(&test_ctx.lock);
+        while (test_ctx.acl_sent - test_ctx.acl_echoed >= (uint32_t)opts->window && test_now_us() < end_us) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 10000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&test_ctx.cond, &test_ctx.lock, &ts);
+        }
+        seq = test_ctx.acl_sent++;
+        pthread_mutex_unlock(&test_ctx.lock);
+
+        test_fill_acl(pkt + 5, opts->acl_len, seq);
+        pthread_mutex_lock(&test_ctx.write_lock);
+        (void)test_write_full(test_ctx.hci_fd, pkt, 5U + (size_t)opts->acl_len);
+        pthread_mutex_unlock(&test_ctx.write_lock);
+    }
+
+    // give the tail of the window a chance to come back
+    end_us = test_now_us() + 1000000ULL;
+    pthread_mutex_lock(&test_ctx.lock);
+    while (test_ctx.acl_echoed < test_ctx.acl_sent && test_now_us() < end_us) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec++;
+        pthread_cond_timedwait(&test_ctx.cond, &test_ctx.lock, &ts);
+    }
+    pthread_mutex_unlock(&test_ctx.lock);
+}
+
+static void test_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-t h4|h5] [-f fw_dir] [-s seconds] [-l acl_len] [-w window]\n"
+            "          [-c cmd_credits] [-d drop_ppm] [-b bit_error_ppm] [-n] [-r seed]\n"
+            "  -b  bit errors per million line bits in H5 frames sent to host\n"
+            "  -n  disable the H5 data integrity check (crc)\n",
+            prog);
+}
+
+static int test_parse_opts(int argc, char **argv, test_opts_t *opts)
+{
+    int c;
+
+    (void)memset(opts, 0, sizeof(*opts));
+    opts->fw_dir = TEST_DEFAULT_FW_DIR;
+    opts->transport = FAKE_CTRL_TRANS_H5;
+    opts->seconds = 5;
+    opts->acl_len = TEST_ACL_MAX;
+    opts->window = 8;
+    opts->ctrl.lmp_subversion = 0x8822;
+    opts->ctrl.hci_revision = 0x000c;
+    opts->ctrl.eversion = 0x01;
+    opts->ctrl.cmd_credits = 4;
+    opts->ctrl.use_crc = 1;
+
+    while ((c = getopt(argc, argv, "t:f:s:l:w:c:d:b:nr:")) != -1) {
+        switch (c) {
+            case 't':
+                opts->transport = (strcmp(optarg, "h4") == 0) ? FAKE_CTRL_TRANS_H4 : FAKE_CTRL_TRANS_H5;
+                break;
+            case 'f':
+                opts->fw_dir = optarg;
+                break;
+            case 's':
+                opts->seconds = atoi(optarg);
+                break;
+            case 'l':
+                opts->acl_len = atoi(optarg);
+                break;
+            case 'w':
+                opts->window = atoi(optarg);
+                break;
+            case 'c':
+                opts->ctrl.cmd_credits = (uint8_t)atoi(optarg);
+                break;
+            case 'd':
+                opts->ctrl.drop_ppm = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                opts->ctrl.bit_error_ppm = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                opts->ctrl.use_crc = 0;
+                break;
+            case 'r':
+                opts->ctrl.seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                test_usage(argv[0]);
+                return -1;
+        }
+    }
+    if (opts->acl_len <= 0 || opts->acl_len > TEST_ACL_MAX || opts->window <= 0 || opts->seconds <= 0) {
+        test_usage(argv[0]);
+        return -1;
+    }
+    // H4 has no link layer to recover from line errors
+    if (opts->transport == FAKE_CTRL_TRANS_H4) {
+        opts->ctrl.drop_ppm = 0;
+        opts->ctrl.bit_error_ppm = 0;
+    }
+    opts->ctrl.transport = opts->transport;
+    return 0;
+}
+
+static pid_t test_start_controller(int master_fd, int *stop_fd, int *result_fd, const fake_ctrl_cfg_t *cfg)
+{
+    int stop_pipe[2];
+    int result_pipe[2];
+    fake_ctrl_stats_t stats;
+    pid_t pid;
+
+    if (pipe(stop_pipe) != 0 || pipe(result_pipe) != 0) {
+        return -1;
+    }
+    pid = fork();
+    if (pid == 0) {
+        close(stop_pipe[1]);
+        close(result_pipe[0]);
+        (void)fake_ctrl_run(master_fd, stop_pipe[0], cfg, &stats);
+        (void)test_write_full(result_pipe[1], (const uint8_t *)&stats, sizeof(stats));
+        _exit(0);
+    }
+    close(stop_pipe[0]);
+    close(result_pipe[1]);
+    *stop_fd = stop_pipe[1];
+    *result_fd = result_pipe[0];
+    return pid;
+}
+
+static void test_report(const test_opts_t *opts, uint64_t init_us, uint64_t run_us, uint64_t cpu_us,
+                        uint64_t ctrl_cpu_us, const fake_ctrl_stats_t *stats)
+{
+    double mb = (double)(test_ctx.echo_bytes * 2) / (1024.0 * 1024.0);
+    double secs = (double)run_us / 1000000.0;
+
+    printf("transport          : %s%s\n", opts->transport == FAKE_CTRL_TRANS_H4 ? "h4" : "h5",
+           (opts->transport == FAKE_CTRL_TRANS_H5 && !opts->ctrl.use_crc) ? " (no crc)" : "");
+    printf("bring-up           : %.1f ms, %u commands, %u patch fragments, %u in the first window\n",
+           (double)init_us / 1000.0, stats->commands, stats->patch_frags, stats->patch_window);
+    printf("acl                : %u sent, %u echoed, %u mismatched, %d bytes each\n", test_ctx.acl_sent,
+           test_ctx.acl_echoed, test_ctx.acl_mismatch, opts->acl_len);
+    printf("throughput         : %.2f MB/s (both directions)\n", secs > 0 ? mb / secs : 0.0);
+    printf("line bytes         : %llu to controller, %llu to host\n", (unsigned long long)stats->rx_bytes,
+           (unsigned long long)stats->tx_bytes);
+    printf("retransmits        : host %u, controller %u, bad frames %u\n", stats->host_retrans,
+           stats->ctrl_retrans, stats->rx_bad_frames);
+    printf("injected           : %u drops, %u bit errors\n", stats->injected_drops, stats->injected_bit_errors);
+    printf("cpu per MB         : vendor lib %.2f ms, fake controller %.2f ms\n",
+           mb > 0 ? (double)cpu_us / 1000.0 / mb : 0.0, mb > 0 ? (double)ctrl_cpu_us / 1000.0 / mb : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    test_opts_t opts;
+    fake_ctrl_stats_t stats;
+    char tty[TEST_PATH_LEN];
+    unsigned char bdaddr[6] = {0x00, 0xe0, 0x4c, 0x88, 0x22, 0x01};
+    int fds[HCI_MAX_CHANNEL];
+    pthread_t reader;
+    uint64_t start_us;
+    uint64_t init_us = 0;
+    uint64_t run_us = 0;
+    uint64_t cpu_start;
+    uint64_t cpu_us = 0;
+    int master_fd, stop_fd, result_fd;
+    int ret = 1;
+    pid_t pid;
+
+    if (test_parse_opts(argc, argv, &opts) != 0) {
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    master_fd = test_open_pty(tty, sizeof(tty));
+    if (master_fd < 0) {
+        fprintf(stderr, "unable to open a pseudo-terminal: %s\n", strerror(errno));
+        return 1;
+    }
+    if (test_prepare_dir(&opts, tty) != 0) {
+        return 1;
+    }
+    pid = test_start_controller(master_fd, &stop_fd, &result_fd, &opts.ctrl);
+    if (pid < 0) {
+        fprintf(stderr, "unable to start the fake controller: %s\n", strerror(errno));
+        return 1;
+    }
+    close(master_fd);
+
+    pthread_mutex_init(&test_ctx.lock, NULL);
+    pthread_mutex_init(&test_ctx.write_lock, NULL);
+    pthread_cond_init(&test_ctx.cond, NULL);
+
+    start_us = test_now_us();
+    if (BLUETOOTH_VENDOR_LIB_INTERFACE.init(&test_cbacks, bdaddr) != 0 ||
+        BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_OP_HCI_CHANNEL_OPEN, &fds) != 1) {
+        fprintf(stderr, "unable to open the hci channel on %s\n", tty);
+        goto stop_controller;
+    }
+    test_ctx.hci_fd = fds[HCI_CMD];
+    test_ctx.running = 1;
+    pthread_create(&reader, NULL, test_reader_thread, NULL);
+
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_OP_INIT, NULL);
+    if (test_wait_init() != 0) {
+        fprintf(stderr, "controller bring-up failed\n");
+        goto close_channel;
+    }
+    init_us = test_now_us() - start_us;
+
+    cpu_start = test_cpu_us(RUSAGE_SELF);
+    start_us = test_now_us();
+    test_stream_acl(&opts);
+    run_us = test_now_us() - start_us;
+    cpu_us = test_cpu_us(RUSAGE_SELF) - cpu_start;
+    ret = (test_ctx.acl_echoed == 0 || test_ctx.acl_mismatch != 0) ? 1 : 0;
+
+close_channel:
+    test_ctx.running = 0;
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_OP_HCI_CHANNEL_CLOSE, NULL);
+    BLUETOOTH_VENDOR_LIB_INTERFACE.close();
+    pthread_join(reader, NULL);
+
+stop_controller:
+    close(stop_fd);
+    (void)memset(&stats, 0, sizeof(stats));
+    (void)test_read_full(result_fd, (uint8_t *)&stats, sizeof(stats));
+    waitpid(pid, NULL, 0);
+    // with more than one credit the patch download has to pipeline, the last fragment always goes alone
+    if (ret == 0 && opts.ctrl.cmd_credits > 1 && stats.patch_frags > 2 && stats.patch_window < 2) {
+        fprintf(stderr, "patch download did not pipeline: %u fragments before the first ack, %u credits\n",
+                stats.patch_window, opts.ctrl.cmd_credits);
+        ret = 1;
+    }
+    if (ret == 0) {
+        test_report(&opts, init_us, run_us, cpu_us, test_cpu_us(RUSAGE_CHILDREN), &stats);
+    }
+    printf("result             : %s\n", ret == 0 ? "PASS" : "FAIL");
+    return ret;
+}
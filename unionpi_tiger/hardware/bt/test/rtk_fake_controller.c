@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) 2022 Unionman Technology Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scripted RTL8822CS stand-in for the controller end of the UART.
+ *
+ * It answers the bring-up sequence of hardware_uart.c (read local version,
+ * read rom version, baudrate update, patch download), echoes every ACL
+ * packet back to the host and, in H5 mode, runs the three-wire link layer
+ * (sync/config, sequence numbers, acks, crc, go-back-N retransmission) with
+ * optional frame drops and bit errors.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rtk_fake_controller.h"
+
+#define FAKE_RX_CHUNK 4096
+#define FAKE_PKT_MAX 1100
+#define FAKE_FRAME_MAX (4 + FAKE_PKT_MAX + 2)
+#define FAKE_TXQ_NUM 64
+#define FAKE_POLL_MS 20
+#define FAKE_PATCH_HOLD_MAX 16
+#define FAKE_PATCH_HOLD_MS 200
+
+#define FAKE_H5_WINDOW 4
+#define FAKE_H5_RETRANS_MS 100
+
+#define PKT_ACK 0x00
+#define PKT_CMD 0x01
+#define PKT_ACL 0x02
+#define PKT_SCO 0x03
+#define PKT_EVT 0x04
+#define PKT_LINK_CTL 0x0f
+
+#define EVT_CMD_COMPLETE 0x0e
+
+#define OP_READ_LOCAL_VERSION 0x1001
+#define OP_READ_ROM_VERSION 0xfc6d
+#define OP_READ_CHIP_TYPE 0xfc61
+#define OP_DOWNLOAD_FW_PATCH 0xfc20
+
+#define SLIP_DELIM 0xc0
+#define SLIP_ESC 0xdb
+#define SLIP_ESC_DELIM 0xdc
+#define SLIP_ESC_ESC 0xdd
+
+#define PPM 1000000U
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    uint8_t data[FAKE_PKT_MAX];
+} fake_pkt_t;
+
+typedef struct {
+    int fd;
+    const fake_ctrl_cfg_t *cfg;
+    fake_ctrl_stats_t *stats;
+    uint32_t rand_state;
+
+    // H4 reassembly
+    uint8_t h4_buf[FAKE_PKT_MAX + 1];
+    uint32_t h4_len;
+
+    // H5 receive
+    uint8_t frame[FAKE_FRAME_MAX];
+    uint32_t frame_len;
+    uint8_t in_frame;
+    uint8_t esc;
+
+    // H5 link
+    uint8_t crc;
+    uint8_t rx_expect;
+    uint8_t tx_acked;
+    uint8_t ack_pending;
+    uint64_t last_progress_ms;
+
+    // outgoing packets; in H5 the first 'unacked' of them are on the wire
+    fake_pkt_t txq[FAKE_TXQ_NUM];
+    uint32_t txq_head;
+    uint32_t txq_count;
+    uint32_t unacked;
+
+    // command completes of the first patch fragments, held back to see how many the host pipelines
+    uint8_t patch_hold_idx[FAKE_PATCH_HOLD_MAX];
+    uint32_t patch_held;
+    uint8_t patch_released;
+    uint64_t patch_hold_ms;
+} fake_ctrl_t;
+
+static const uint16_t fake_crc_table[] = {0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+                                          0x8408, 0x9489, 0xa50a, 0xb58b, 0xc60c, 0xd68d, 0xe70e, 0xf78f};
+
+static uint64_t fake_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static uint32_t fake_rand(fake_ctrl_t *fc)
+{
+    uint32_t x = fc->rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    fc->rand_state = x;
+    return x;
+}
+
+static int fake_chance(fake_ctrl_t *fc, uint32_t ppm)
+{
+    return ppm != 0 && (fake_rand(fc) % PPM) < ppm;
+}
+
+static uint16_t fake_crc_update(uint16_t crc, uint8_t d)
+{
+    crc = (crc >> 4) ^ fake_crc_table[(crc ^ d) & 0x000f];
+    crc = (crc >> 4) ^ fake_crc_table[(crc ^ (d >> 4)) & 0x000f];
+    return crc;
+}
+
+static uint16_t fake_bit_rev16(uint16_t x)
+{
+    uint16_t r = 0;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        r = (uint16_t)((r << 1) | ((x >> i) & 1));
+    }
+    return r;
+}
+
+static int fake_write(fake_ctrl_t *fc, const uint8_t *buf, size_t len)
+{
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = write(fc->fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return -1;
+        }
+        fc->stats->tx_bytes += (uint64_t)ret;
+        buf += ret;
+        len -= (size_t)ret;
+    }
+    return 0;
+}
+
+static void fake_h5_send_frame(fake_ctrl_t *fc, uint8_t type, const uint8_t *data, uint16_t len, int reliable,
+                               uint8_t seq)
+{
+    uint8_t hdr[4];
+    uint8_t out[2 * FAKE_FRAME_MAX + 2];
+    uint8_t raw[FAKE_FRAME_MAX];
+    uint32_t raw_len = 0;
+    uint32_t out_len = 0;
+    uint16_t crc = 0xffff;
+    uint32_t i;
+
+    hdr[0] = (uint8_t)(fc->rx_expect << 3);
+    if (reliable) {
+        hdr[0] |= (uint8_t)(0x80 | seq);
+    }
+    if (fc->crc) {
+        hdr[0] |= 0x40;
+    }
+    hdr[1] = (uint8_t)(((len << 4) & 0xff) | type);
+    hdr[2] = (uint8_t)(len >> 4);
+    hdr[3] = (uint8_t)~(hdr[0] + hdr[1] + hdr[2]);
+    fc->ack_pending = 0;
+
+    (void)memcpy(raw, hdr, sizeof(hdr));
+    raw_len = sizeof(hdr);
+    if (len > 0) {
+        (void)memcpy(raw + raw_len, data, len);
+        raw_len += len;
+    }
+    if (fc->crc) {
+        for (i = 0; i < raw_len; i++) {
+            crc = fake_crc_update(crc, raw[i]);
+        }
+        crc = fake_bit_rev16(crc);
+        raw[raw_len++] = (uint8_t)(crc >> 8);
+        raw[raw_len++] = (uint8_t)(crc & 0xff);
+    }
+
+    if (fake_chance(fc, fc->cfg->drop_ppm)) {
+        fc->stats->injected_drops++;
+        return;
+    }
+    if (fc->cfg->bit_error_ppm != 0) {
+        for (i = 0; i < raw_len * 8; i++) {
+            if (fake_chance(fc, fc->cfg->bit_error_ppm)) {
+                raw[i / 8] ^= (uint8_t)(1U << (i % 8));
+                fc->stats->injected_bit_errors++;
+            }
+        }
+    }
+
+    out[out_len++] = SLIP_DELIM;
+    for (i = 0; i < raw_len; i++) {
+        if (raw[i] == SLIP_DELIM) {
+            out[out_len++] = SLIP_ESC;
+            out[out_len++] = SLIP_ESC_DELIM;
+        } else if (raw[i] == SLIP_ESC) {
+            out[out_len++] = SLIP_ESC;
+            out[out_len++] = SLIP_ESC_ESC;
+        } else {
+            out[out_len++] = raw[i];
+        }
+    }
+    out[out_len++] = SLIP_DELIM;
+    (void)fake_write(fc, out, out_len);
+}
+
+static fake_pkt_t *fake_txq_at(fake_ctrl_t *fc, uint32_t idx)
+{
+    return &fc->txq[(fc->txq_head + idx) % FAKE_TXQ_NUM];
+}
+
+static uint32_t fake_txq_space(const fake_ctrl_t *fc)
+{
+    return FAKE_TXQ_NUM - fc->txq_count;
+}
+
+static void fake_h5_pump(fake_ctrl_t *fc)
+{
+    fake_pkt_t *pkt = NULL;
+
+    while (fc->unacked < FAKE_H5_WINDOW && fc->unacked < fc->txq_count) {
+        pkt = fake_txq_at(fc, fc->unacked);
+        fake_h5_send_frame(fc, pkt->type, pkt->data, pkt->len, 1, (uint8_t)((fc->tx_acked + fc->unacked) & 0x07));
+        if (fc->unacked == 0) {
+            fc->last_progress_ms = fake_now_ms();
+        }
+        fc->unacked++;
+    }
+}
+
+static void fake_send_pkt(fake_ctrl_t *fc, uint8_t type, const uint8_t *data, uint16_t len)
+{
+    fake_pkt_t *pkt = NULL;
+    uint8_t h4_type = type;
+
+    if (fc->cfg->transport == FAKE_CTRL_TRANS_H4) {
+        (void)fake_write(fc, &h4_type, 1);
+        (void)fake_write(fc, data, len);
+        return;
+    }
+
+    if (fake_txq_space(fc) == 0) {
+        return;
+    }
+    pkt = fake_txq_at(fc, fc->txq_count);
+    pkt->type = type;
+    pkt->len = len;
+    (void)memcpy(pkt->data, data, len);
+    fc->txq_count++;
+    fake_h5_pump(fc);
+}
+
+static void fake_h5_process_ack(fake_ctrl_t *fc, uint8_t ack)
+{
+    int progressed = 0;
+
+    while (fc->unacked > 0 && fc->tx_acked != ack) {
+        fc->txq_head = (fc->txq_head + 1) % FAKE_TXQ_NUM;
+        fc->txq_count--;
+        fc->unacked--;
+        fc->tx_acked = (fc->tx_acked + 1) & 0x07;
+        progressed = 1;
+    }
+    if (progressed) {
+        fc->last_progress_ms = fake_now_ms();
+    }
+}
+
+static void fake_h5_check_retrans(fake_ctrl_t *fc)
+{
+    uint32_t i;
+    uint32_t resend = fc->unacked;
+    fake_pkt_t *pkt = NULL;
+
+    if (resend == 0 || fake_now_ms() - fc->last_progress_ms < FAKE_H5_RETRANS_MS) {
+        return;
+    }
+    for (i = 0; i < resend; i++) {
+        pkt = fake_txq_at(fc, i);
+        fake_h5_send_frame(fc, pkt->type, pkt->data, pkt->len, 1, (uint8_t)((fc->tx_acked + i) & 0x07));
+    }
+    fc->stats->ctrl_retrans += resend;
+    fc->last_progress_ms = fake_now_ms();
+}
+
+static void fake_cmd_complete(fake_ctrl_t *fc, uint16_t opcode, const uint8_t *ret, uint8_t ret_len)
+{
+    uint8_t evt[3 + 2 + 255];
+
+    evt[0] = EVT_CMD_COMPLETE;
+    evt[1] = (uint8_t)(3 + ret_len);
+    evt[2] = fc->cfg->cmd_credits;
+    evt[3] = (uint8_t)(opcode & 0xff);
+    evt[4] = (uint8_t)(opcode >> 8);
+    if (ret_len > 0) {
+        (void)memcpy(evt + 5, ret, ret_len);
+    }
+    fake_send_pkt(fc, PKT_EVT, evt, (uint16_t)(5 + ret_len));
+}
+
+static void fake_patch_release(fake_ctrl_t *fc)
+{
+    uint8_t ret[2] = {0, 0};
+    uint32_t i;
+
+    fc->stats->patch_window = fc->patch_held;
+    fc->patch_released = 1;
+    for (i = 0; i < fc->patch_held; i++) {
+        ret[1] = fc->patch_hold_idx[i];
+        fake_cmd_complete(fc, OP_DOWNLOAD_FW_PATCH, ret, sizeof(ret));
+    }
+}
+
+static void fake_patch_hold(fake_ctrl_t *fc, uint8_t index)
+{
+    if (fc->patch_held == 0) {
+        fc->patch_hold_ms = fake_now_ms();
+    }
+    fc->patch_hold_idx[fc->patch_held++] = index;
+    if (fc->patch_held >= fc->cfg->cmd_credits || fc->patch_held >= FAKE_PATCH_HOLD_MAX || (index & 0x80)) {
+        fake_patch_release(fc);
+    }
+}
+
+static void fake_handle_cmd(fake_ctrl_t *fc, const uint8_t *data, uint16_t len)
+{
+    uint16_t opcode;
+    uint8_t ret[16];
+
+    if (len < 3) {
+        return;
+    }
+    opcode = (uint16_t)(data[0] | (data[1] << 8));
+    fc->stats->commands++;
+    (void)memset(ret, 0, sizeof(ret));
+
+    switch (opcode) {
+        case OP_READ_LOCAL_VERSION:
+            ret[1] = 0x08; // hci_version
+            ret[2] = (uint8_t)(fc->cfg->hci_revision & 0xff);
+            ret[3] = (uint8_t)(fc->cfg->hci_revision >> 8);
+            ret[4] = 0x08; // lmp_version
+            ret[5] = 0x5d; // manufacturer: Realtek
+            ret[6] = 0x00;
+            ret[7] = (uint8_t)(fc->cfg->lmp_subversion & 0xff);
+            ret[8] = (uint8_t)(fc->cfg->lmp_subversion >> 8);
+            fake_cmd_complete(fc, opcode, ret, 9);
+            break;
+        case OP_READ_ROM_VERSION:
+            ret[1] = fc->cfg->eversion;
+            fake_cmd_complete(fc, opcode, ret, 2);
+            break;
+        case OP_READ_CHIP_TYPE:
+            fake_cmd_complete(fc, opcode, ret, 6);
+            break;
+        case OP_DOWNLOAD_FW_PATCH:
+            fc->stats->patch_frags++;
+            ret[1] = (len > 3) ? data[3] : 0;
+            if (!fc->patch_released) {
+                fake_patch_hold(fc, ret[1]);
+                break;
+            }
+            fake_cmd_complete(fc, opcode, ret, 2);
+            break;
+        default:
+            fake_cmd_complete(fc, opcode, ret, 1);
+            break;
+    }
+}
+
+static void fake_handle_hci(fake_ctrl_t *fc, uint8_t type, const uint8_t *data, uint16_t len)
+{
+    switch (type) {
+        case PKT_CMD:
+            fake_handle_cmd(fc, data, len);
+            break;
+        case PKT_ACL:
+            fc->stats->acl_echo_pkts++;
+            fc->stats->acl_echo_bytes += len;
+            fake_send_pkt(fc, PKT_ACL, data, len);
+            break;
+        default:
+            break;
+    }
+}
+
+static uint32_t fake_h4_packet_length(const uint8_t *buf, uint32_t len)
+{
+    switch (buf[0]) {
+        case PKT_CMD:
+            return len < 4 ? 0 : 4U + buf[3];
+        case PKT_ACL:
+            return len < 5 ? 0 : 5U + (uint32_t)(buf[3] | (buf[4] << 8));
+        case PKT_SCO:
+            return len < 4 ? 0 : 4U + buf[3];
+        default:
+            return 1;
+    }
+}
+
+static void fake_h4_recv(fake_ctrl_t *fc, const uint8_t *data, uint32_t len)
+{
+    uint32_t pkt_len;
+
+    while (len > 0) {
+        fc->h4_buf[fc->h4_len++] = *data++;
+        len--;
+        pkt_len = fake_h4_packet_length(fc->h4_buf, fc->h4_len);
+        if (pkt_len > sizeof(fc->h4_buf)) {
+            fc->stats->rx_bad_frames++;
+            fc->h4_len = 0;
+        } else if (pkt_len != 0 && fc->h4_len == pkt_len) {
+            if (pkt_len > 1) {
+                fake_handle_hci(fc, fc->h4_buf[0], fc->h4_buf + 1, (uint16_t)(pkt_len - 1));
+            } else {
+                fc->stats->rx_bad_frames++;
+            }
+            fc->h4_len = 0;
+        }
+    }
+}
+
+static void fake_h5_link_reset(fake_ctrl_t *fc)
+{
+    fc->crc = 0;
+    fc->rx_expect = 0;
+    fc->tx_acked = 0;
+    fc->ack_pending = 0;
+    fc->txq_head = 0;
+    fc->txq_count = 0;
+    fc->unacked = 0;
+}
+
+static void fake_h5_link_ctl(fake_ctrl_t *fc, const uint8_t *data, uint16_t len)
+{
+    static const uint8_t sync_rsp[] = {0x02, 0x7d};
+    uint8_t conf_rsp[] = {0x04, 0x7b, 0x00};
+
+    if (len < 2) {
+        return;
+    }
+    if (data[0] == 0x01 && data[1] == 0x7e) {
+        fake_h5_link_reset(fc);
+        fake_h5_send_frame(fc, PKT_LINK_CTL, sync_rsp, sizeof(sync_rsp), 0, 0);
+    } else if (data[0] == 0x03 && data[1] == 0xfc) {
+        conf_rsp[2] = FAKE_H5_WINDOW | (fc->cfg->use_crc ? 0x10 : 0x00);
+        fake_h5_send_frame(fc, PKT_LINK_CTL, conf_rsp, sizeof(conf_rsp), 0, 0);
+        fc->crc = fc->cfg->use_crc;
+    }
+}
+
+static void fake_h5_frame(fake_ctrl_t *fc)
+{
+    uint8_t *hdr = fc->frame;
+    uint16_t payload_len;
+    uint16_t crc = 0xffff;
+    uint32_t i;
+    uint8_t seq;
+
+    if (fc->frame_len < 4 || (uint8_t)~(hdr[0] + hdr[1] + hdr[2]) != hdr[3]) {
+        fc->stats->rx_bad_frames++;
+        return;
+    }
+    payload_len = (uint16_t)(((hdr[1] >> 4) & 0x0f) + (hdr[2] << 4));
+    if (hdr[0] & 0x40) {
+        if (fc->frame_len != 4U + payload_len + 2U) {
+            fc->stats->rx_bad_frames++;
+            return;
+        }
+        for (i = 0; i < 4U + payload_len; i++) {
+            crc = fake_crc_update(crc, fc->frame[i]);
+        }
+        if (fake_bit_rev16(crc) != (uint16_t)((fc->frame[4 + payload_len] << 8) | fc->frame[5 + payload_len])) {
+            fc->stats->rx_bad_frames++;
+            return;
+        }
+    } else if (fc->frame_len != 4U + payload_len) {
+        fc->stats->rx_bad_frames++;
+        return;
+    }
+
+    if (fake_chance(fc, fc->cfg->drop_ppm)) {
+        fc->stats->injected_drops++;
+        if (hdr[0] & 0x80) {
+            fc->stats->host_retrans++;
+        }
+        return;
+    }
+
+    if ((hdr[1] & 0x0f) == PKT_LINK_CTL) {
+        fake_h5_link_ctl(fc, hdr + 4, payload_len);
+        return;
+    }
+
+    fake_h5_process_ack(fc, (hdr[0] >> 3) & 0x07);
+    if (hdr[0] & 0x80) {
+        seq = hdr[0] & 0x07;
+        fc->ack_pending = 1;
+        // a reply needs a queue slot; refusing the frame makes the host resend it later
+        if (seq != fc->rx_expect || fake_txq_space(fc) == 0) {
+            fc->stats->host_retrans++;
+            return;
+        }
+        fc->rx_expect = (fc->rx_expect + 1) & 0x07;
+        fake_handle_hci(fc, hdr[1] & 0x0f, hdr + 4, payload_len);
+    }
+    fake_h5_pump(fc);
+}
+
+static void fake_h5_recv(fake_ctrl_t *fc, const uint8_t *data, uint32_t len)
+{
+    uint8_t c;
+
+    while (len > 0) {
+        c = *data++;
+        len--;
+        if (c == SLIP_DELIM) {
+            if (fc->in_frame && fc->frame_len > 0) {
+                fake_h5_frame(fc);
+            }
+            fc->in_frame = 1;
+            fc->frame_len = 0;
+            fc->esc = 0;
+            continue;
+        }
+        if (!fc->in_frame) {
+            continue;
+        }
+        if (fc->esc) {
+            fc->esc = 0;
+            c = (c == SLIP_ESC_DELIM) ? SLIP_DELIM : (c == SLIP_ESC_ESC) ? SLIP_ESC : c;
+        } else if (c == SLIP_ESC) {
+            fc->esc = 1;
+            continue;
+        }
+        if (fc->frame_len >= sizeof(fc->frame)) {
+            fc->stats->rx_bad_frames++;
+            fc->in_frame = 0;
+            continue;
+        }
+        fc->frame[fc->frame_len++] = c;
+    }
+}
+
+int fake_ctrl_run(int line_fd, int stop_fd, const fake_ctrl_cfg_t *cfg, fake_ctrl_stats_t *stats)
+{
+    static fake_ctrl_t fc;
+    struct pollfd pfd[2];
+    uint8_t buf[FAKE_RX_CHUNK];
+    ssize_t ret;
+
+    (void)memset(&fc, 0, sizeof(fc));
+    (void)memset(stats, 0, sizeof(*stats));
+    fc.fd = line_fd;
+    fc.cfg = cfg;
+    fc.stats = stats;
+    fc.rand_state = cfg->seed ? cfg->seed : 0x2545f491;
+
+    pfd[0].fd = line_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = stop_fd;
+    pfd[1].events = POLLIN;
+
+    for (;;) {
+        ret = poll(pfd, 2, FAKE_POLL_MS);
+        if (ret < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (pfd[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            break;
+        }
+        if (ret > 0 && (pfd[0].revents & POLLIN)) {
+            ret = read(line_fd, buf, sizeof(buf));
+            if (ret > 0) {
+                stats->rx_bytes += (uint64_t)ret;
+                if (cfg->transport == FAKE_CTRL_TRANS_H4) {
+                    fake_h4_recv(&fc, buf, (uint32_t)ret);
+                } else {
+                    fake_h5_recv(&fc, buf, (uint32_t)ret);
+                }
+            }
+        }
+        // a host that does not fill the window still gets its acks
+        if (fc.patch_held != 0 && !fc.patch_released && fake_now_ms() - fc.patch_hold_ms >= FAKE_PATCH_HOLD_MS) {
+            fake_patch_release(&fc);
+        }
+        if (cfg->transport == FAKE_CTRL_TRANS_H5) {
+            fake_h5_check_retrans(&fc);
+            if (fc.ack_pending) {
+                fake_h5_send_frame(&fc, PKT_ACK, NULL, 0, 0, 0);
+            }
+        }
+    }
+    return 0;
+}
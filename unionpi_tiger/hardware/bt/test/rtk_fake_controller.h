@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2022 Unionman Technology Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RTK_FAKE_CONTROLLER_H
+#define RTK_FAKE_CONTROLLER_H
+
+#include <stdint.h>
+
+#define FAKE_CTRL_TRANS_H4 0
+#define FAKE_CTRL_TRANS_H5 1
+
+typedef struct {
+    int transport;          // FAKE_CTRL_TRANS_H4 or FAKE_CTRL_TRANS_H5
+    uint16_t lmp_subversion; // reported by Read Local Version
+    uint16_t hci_revision;
+    uint8_t eversion;        // reported by Read ROM Version, chip_id = eversion + 1
+    uint8_t cmd_credits;     // Num_HCI_Command_Packets in every command complete
+    uint8_t use_crc;         // advertise data integrity check in H5 config response
+    uint32_t drop_ppm;       // H5 frames dropped per million, both directions
+    uint32_t bit_error_ppm;  // bits flipped per million in H5 frames sent to host (line BER)
+    uint32_t seed;
+} fake_ctrl_cfg_t;
+
+typedef struct {
+    uint64_t rx_bytes;      // bytes read from the host side of the line
+    uint64_t tx_bytes;      // bytes written to the host side of the line
+    uint32_t commands;
+    uint32_t patch_frags;
+    uint32_t patch_window;  // patch fragments received before the first patch command complete
+    uint64_t acl_echo_bytes;
+    uint32_t acl_echo_pkts;
+    uint32_t host_retrans;  // reliable frames from host not accepted on first delivery
+    uint32_t ctrl_retrans;  // reliable frames resent by the fake controller
+    uint32_t rx_bad_frames; // header checksum or crc mismatch
+    uint32_t injected_drops;
+    uint32_t injected_bit_errors;
+} fake_ctrl_stats_t;
+
+/*
+ * Serve the controller side of a UART on line_fd until stop_fd becomes
+ * readable or hangs up. The statistics are filled in before returning.
+ */
+int fake_ctrl_run(int line_fd, int stop_fd, const fake_ctrl_cfg_t *cfg, fake_ctrl_stats_t *stats);
+
+#endif
@@ -40,6 +40,8 @@
 #include "../frame_provider/decoder/utils/vdec.h"
 #include "../common/media_clock/switch/amports_gate.h"
 #include <linux/delay.h>
+#include <linux/sched/clock.h>
+#include <media/v4l2-mem2mem.h>
 #include "aml_vcodec_adapt.h"
 #include <linux/crc32.h>
 
@@ -53,6 +55,10 @@
 #define PTS_OUTSIDE	(1)
 #define SYNC_OUTSIDE	(2)
 
+/* frames queued in the vdec input before a decode returns -EAGAIN */
+#define VDEC_INPUT_MAX_FRAMES	(600)
+#define VBUF_WRITE_TIMEOUT_MS	(3000)
+
 //#define DATA_DEBUG
 
 static int def_4k_vstreambuf_sizeM =
@@ -109,6 +115,57 @@ static struct stream_buf_s bufs[BUF_MAX_NUM] = {
 
 extern int aml_set_vfm_path, aml_set_vdec_type;
 extern bool aml_set_vfm_enable, aml_set_vdec_type_enable;
+extern bool input_nonblock;
+extern int input_low_level, input_wait_ms;
+
+static int input_low_percent(void)
+{
+	return clamp(input_low_level, 0, 100);
+}
+
+static void vdec_input_unblock(struct aml_vdec_adapt *ada_ctx, bool timeout)
+{
+	struct aml_input_stat *stat = &ada_ctx->ctx->input_stat;
+	u64 ns;
+
+	if (atomic_cmpxchg(&ada_ctx->blocked, 1, 0) != 1)
+		return;
+
+	ns = local_clock() - ada_ctx->block_start;
+	stat->blocked_ns += ns;
+	if (ns > stat->max_ns)
+		stat->max_ns = ns;
+	if (timeout)
+		stat->timeouts++;
+	else
+		stat->wakeups++;
+
+	if (!ada_ctx->nonblock) {
+		wake_up_interruptible(&ada_ctx->wq);
+		return;
+	}
+
+	if (!timeout)
+		del_timer(&ada_ctx->wait_timer);
+	/* job_ready() held the context back while it was blocked. */
+	v4l2_m2m_try_schedule(ada_ctx->ctx->m2m_ctx);
+}
+
+/* vdec_input space_notify, called as the decoder consumes frames. */
+static void vdec_input_space_notify(void *priv)
+{
+	struct aml_vdec_adapt *ada_ctx = priv;
+
+	if (atomic_read(&ada_ctx->blocked))
+		vdec_input_unblock(ada_ctx, false);
+}
+
+static void vdec_input_wait_timeout(struct timer_list *t)
+{
+	struct aml_vdec_adapt *ada_ctx = from_timer(ada_ctx, t, wait_timer);
+
+	vdec_input_unblock(ada_ctx, true);
+}
 
 static void set_default_params(struct aml_vdec_adapt *vdec)
 {
@@ -521,6 +578,9 @@ static int vdec_ports_init(struct aml_vdec_adapt *ada_ctx)
 
 	set_vdec_properity(vdec, ada_ctx);
 
+	vdec_input_set_space_notify(&vdec->input, vdec_input_space_notify,
+		ada_ctx, VDEC_INPUT_MAX_FRAMES * input_low_percent() / 100);
+
 	/* init hw and gate*/
 	ret = enable_hardware(vdec->port);
 	if (ret < 0) {
@@ -576,6 +636,10 @@ int video_decoder_init(struct aml_vdec_adapt *vdec)
 	/* sets configure data */
 	set_default_params(vdec);
 
+	init_waitqueue_head(&vdec->wq);
+	atomic_set(&vdec->blocked, 0);
+	timer_setup(&vdec->wait_timer, vdec_input_wait_timeout, 0);
+
 	/* init the buffer work space and connect vdec.*/
 	ret = vdec_ports_init(vdec);
 	if (ret < 0) {
@@ -591,6 +655,11 @@ int video_decoder_release(struct aml_vdec_adapt *vdec)
 	int ret = -1;
 	struct stream_port_s *port = &vdec->port;
 
+	if (vdec->vdec)
+		vdec_input_clear_space_notify(&vdec->vdec->input);
+	del_timer_sync(&vdec->wait_timer);
+	atomic_set(&vdec->blocked, 0);
+
 	ret = vdec_ports_release(port);
 	if (ret < 0) {
 		v4l_dbg(vdec->ctx, V4L_DEBUG_CODEC_ERROR, "vdec ports release fail.\n");
@@ -607,11 +676,25 @@ out:
 	return ret;
 }
 
+/*
+ * Bytes a blocked stream write waits for: the buffer has to drain to
+ * input_low_level percent, so the writer is not woken for every few
+ * bytes the decoder consumes.
+ */
+static u32 vbuf_wait_space(struct stream_buf_s *pbuf, u32 count)
+{
+	u32 size = stbuf_canusesize(pbuf);
+	u32 space = size - size / 100 * input_low_percent();
+
+	return min(max(space, count), size);
+}
+
 int vdec_vbuf_write(struct aml_vdec_adapt *ada_ctx,
 	const char *buf, unsigned int count)
 {
 	int ret = -1;
-	int try_cnt = 100;
+	ulong timeout = jiffies + msecs_to_jiffies(VBUF_WRITE_TIMEOUT_MS);
+	struct aml_input_stat *stat = &ada_ctx->ctx->input_stat;
 	struct stream_port_s *port = &ada_ctx->port;
 	struct vdec_s *vdec = ada_ctx->vdec;
 	struct stream_buf_s *pbuf = NULL;
@@ -628,15 +711,33 @@ int vdec_vbuf_write(struct aml_vdec_adapt *ada_ctx,
 			return r;
 	}*/
 
-	do {
+	for (;;) {
+		u64 start, ns;
+
 		if (vdec->port_flag & PORT_FLAG_DRM)
 			ret = drm_write(ada_ctx->filp, pbuf, buf, count);
 		else
 			ret = esparser_write(ada_ctx->filp, pbuf, buf, count);
 
-		if (ret == -EAGAIN)
-			msleep(30);
-	} while (ret == -EAGAIN && try_cnt--);
+		if (ret != -EAGAIN || time_after(jiffies, timeout))
+			break;
+
+		/*
+		 * woken by the read pointer moving, see stbuf_notify_space().
+		 * Stream mode has no per context notify to requeue on, so it
+		 * still waits here whatever input_nonblock says.
+		 */
+		start = local_clock();
+		if (stbuf_wait_space(pbuf, vbuf_wait_space(pbuf, count)))
+			stat->timeouts++;
+		else
+			stat->wakeups++;
+		ns = local_clock() - start;
+		stat->blocks++;
+		stat->blocked_ns += ns;
+		if (ns > stat->max_ns)
+			stat->max_ns = ns;
+	}
 
 	if (slow_input) {
 		v4l_dbg(ada_ctx->ctx, V4L_DEBUG_CODEC_PRINFO,
@@ -657,7 +758,52 @@ bool vdec_input_full(struct aml_vdec_adapt *ada_ctx)
 {
 	struct vdec_s *vdec = ada_ctx->vdec;
 
-	return (vdec->input.have_frame_num > 600) ? true : false;
+	return (vdec->input.have_frame_num > VDEC_INPUT_MAX_FRAMES) ?
+		true : false;
+}
+
+/*
+ * Called by the decode worker when a decode returned -EAGAIN. By
+ * default (input_nonblock) it returns -EAGAIN at once, the worker
+ * leaves the src buffer queued and job_ready() holds the context
+ * back so other contexts get the m2m device until the drain wakes it.
+ * input_nonblock=0 keeps the old behaviour of sleeping in the shared
+ * worker until the decoder drained the input to input_low_level
+ * percent. input_wait_ms bounds both in case no wakeup comes.
+ */
+int vdec_input_wait(struct aml_vdec_adapt *ada_ctx)
+{
+	struct aml_input_stat *stat = &ada_ctx->ctx->input_stat;
+
+	ada_ctx->nonblock = input_nonblock;
+	ada_ctx->block_start = local_clock();
+	atomic_set(&ada_ctx->blocked, 1);
+	stat->blocks++;
+
+	/* the decoder may have drained it before blocked was seen. */
+	if (!vdec_input_full(ada_ctx)) {
+		vdec_input_unblock(ada_ctx, false);
+		return 0;
+	}
+
+	if (ada_ctx->nonblock) {
+		stat->requeues++;
+		mod_timer(&ada_ctx->wait_timer,
+			jiffies + msecs_to_jiffies(input_wait_ms));
+		return -EAGAIN;
+	}
+
+	wait_event_interruptible_timeout(ada_ctx->wq,
+		!atomic_read(&ada_ctx->blocked),
+		msecs_to_jiffies(input_wait_ms));
+	vdec_input_unblock(ada_ctx, true);
+
+	return 0;
+}
+
+bool vdec_input_blocked(struct aml_vdec_adapt *ada_ctx)
+{
+	return ada_ctx->nonblock && atomic_read(&ada_ctx->blocked);
 }
 
 int vdec_vframe_write(struct aml_vdec_adapt *ada_ctx,
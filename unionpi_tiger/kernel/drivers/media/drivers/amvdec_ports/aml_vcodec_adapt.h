@@ -42,6 +42,10 @@ struct aml_vdec_adapt {
 	int video_type;
 	char *recv_name;
 	int vfm_path;
+	atomic_t blocked;
+	bool nonblock;
+	u64 block_start;
+	struct timer_list wait_timer;
 };
 
 int video_decoder_init(struct aml_vdec_adapt *ada_ctx);
@@ -59,6 +63,10 @@ int vdec_vframe_write_with_dma(struct aml_vdec_adapt *ada_ctx,
 
 bool vdec_input_full(struct aml_vdec_adapt *ada_ctx);
 
+int vdec_input_wait(struct aml_vdec_adapt *ada_ctx);
+
+bool vdec_input_blocked(struct aml_vdec_adapt *ada_ctx);
+
 void aml_decoder_flush(struct aml_vdec_adapt *ada_ctx);
 
 int aml_codec_reset(struct aml_vdec_adapt *ada_ctx, int *flag);
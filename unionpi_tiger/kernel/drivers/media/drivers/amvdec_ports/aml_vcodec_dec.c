@@ -614,22 +614,18 @@ void trans_vframe_to_user(struct aml_vcodec_ctx *ctx, struct vdec_v4l2_buffer *f
 	ctx->decoded_frame_cnt++;
 }
 
-static int get_display_buffer(struct aml_vcodec_ctx *ctx, struct vdec_v4l2_buffer **out)
+static int get_display_buffers(struct aml_vcodec_ctx *ctx,
+	struct vdec_disp_fbs *fbs)
 {
 	int ret = -1;
 
 	v4l_dbg(ctx, V4L_DEBUG_CODEC_EXINFO, "%s\n", __func__);
 
-	ret = vdec_if_get_param(ctx, GET_PARAM_DISP_FRAME_BUFFER, out);
+	fbs->num = 0;
+	ret = vdec_if_get_param(ctx, GET_PARAM_DISP_FRAME_BUFFERS, fbs);
 	if (ret) {
 		v4l_dbg(ctx, V4L_DEBUG_CODEC_ERROR,
-			"Cannot get param : GET_PARAM_DISP_FRAME_BUFFER\n");
-		return -1;
-	}
-
-	if (!*out) {
-		v4l_dbg(ctx, V4L_DEBUG_CODEC_ERROR,
-			"No display frame buffer\n");
+			"Cannot get param : GET_PARAM_DISP_FRAME_BUFFERS\n");
 		return -1;
 	}
 
@@ -894,6 +890,9 @@ static void aml_vdec_worker(struct work_struct *work)
 		aml_vdec_flush_decoder(ctx);
 
 		goto out;
+	} else if (ret == -EAGAIN) {
+		/* the input is full, src_buf stays queued for the retry. */
+		vdec_input_wait(ctx->ada_ctx);
 	}
 
 	v4l2_m2m_job_finish(dev->m2m_dev_dec, ctx->m2m_ctx);
@@ -960,19 +959,27 @@ void wait_vcodec_ending(struct aml_vcodec_ctx *ctx)
 	ctx->v4l_codec_dpb_ready = false;
 }
 
+/*
+ * The vfm queues frames in batches with one wakeup, so take all that
+ * are ready; the wakeups of frames already taken find the que empty.
+ */
 void try_to_capture(struct aml_vcodec_ctx *ctx)
 {
-	int ret = 0;
-	struct vdec_v4l2_buffer *fb = NULL;
+	int ret = 0, i;
+	struct vdec_disp_fbs fbs;
 
-	ret = get_display_buffer(ctx, &fb);
-	if (ret) {
-		v4l_dbg(ctx, V4L_DEBUG_CODEC_ERROR,
-			"the que have no disp buf,ret: %d\n", ret);
-		return;
-	}
+	do {
+		ret = get_display_buffers(ctx, &fbs);
+		if (ret)
+			return;
+
+		for (i = 0; i < fbs.num; i++)
+			trans_vframe_to_user(ctx, fbs.fb[i]);
+	} while (fbs.num == VDEC_DISP_BATCH);
 
-	trans_vframe_to_user(ctx, fb);
+	if (!fbs.num)
+		v4l_dbg(ctx, V4L_DEBUG_CODEC_EXINFO,
+			"the que have no disp buf.\n");
 }
 EXPORT_SYMBOL_GPL(try_to_capture);
 
@@ -2404,6 +2411,10 @@ static int m2mops_vdec_job_ready(void *m2m_priv)
 		ctx->state > AML_STATE_FLUSHED)
 		return 0;
 
+	/* yield to other contexts until the full input drains. */
+	if (ctx->drv_handle && vdec_input_blocked(ctx->ada_ctx))
+		return 0;
+
 	return 1;
 }
 
@@ -60,6 +60,18 @@ struct vdec_v4l2_buffer {
 	u32	status;
 };
 
+/**
+ * struct vdec_disp_fbs  - display frame buffers of one capture wakeup
+ * @fb		: the buffers, in display order
+ * @num		: used number of fb
+ */
+#define VDEC_DISP_BATCH	(8)
+
+struct vdec_disp_fbs {
+	struct vdec_v4l2_buffer *fb[VDEC_DISP_BATCH];
+	int num;
+};
+
 
 /**
  * struct aml_video_dec_buf - Private data related to each VB2 buffer.
@@ -30,6 +30,8 @@
 #include <media/videobuf2-dma-contig.h>
 #include <linux/kthread.h>
 #include <linux/compat.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "aml_vcodec_drv.h"
 #include "aml_vcodec_dec.h"
@@ -51,6 +53,10 @@
 
 bool param_sets_from_ucode = 1;
 bool enable_drm_mode;
+bool vfq_stat;
+bool input_nonblock = true;
+int input_low_level = 80;
+int input_wait_ms = 100;
 
 static int fops_vcodec_open(struct file *file)
 {
@@ -84,6 +90,8 @@ static int fops_vcodec_open(struct file *file)
 	mutex_init(&ctx->lock);
 	spin_lock_init(&ctx->slock);
 	init_completion(&ctx->comp);
+	vfq_stat_reset(&ctx->vfq_stat[0]);
+	vfq_stat_reset(&ctx->vfq_stat[1]);
 
 	ctx->param_sets_from_ucode = param_sets_from_ucode ? 1 : 0;
 
@@ -416,6 +424,137 @@ static const struct v4l2_file_operations aml_vcodec_fops = {
 	.mmap		= v4l2_m2m_fop_mmap,
 };
 
+/*
+ * vfq occupancy of every open decoder, tracked for queues set up
+ * while the vfq_stat parameter is on. Writing anything resets it.
+ */
+static int vfq_stat_show(struct seq_file *m, void *v)
+{
+	static const char * const names[] = {"vf_que", "recycle"};
+	struct aml_vcodec_dev *dev = m->private;
+	struct aml_vcodec_ctx *ctx;
+	int i;
+
+	seq_printf(m, "vfq_stat %s, queue size %d\n",
+		vfq_stat ? "on" : "off", POOL_SIZE);
+	mutex_lock(&dev->dev_mutex);
+	list_for_each_entry(ctx, &dev->ctx_list, list) {
+		for (i = 0; i < ARRAY_SIZE(names); i++) {
+			struct vfq_stat_s *s = &ctx->vfq_stat[i];
+
+			if (!s->push && !s->pop)
+				continue;
+			seq_printf(m, "ctx %d %-8s high %2d low %2d push %u pop %u empty %u full %u batch %u\n",
+				ctx->id, names[i], s->high, s->low, s->push,
+				s->pop, s->empty, s->full, s->batch_max);
+		}
+	}
+	mutex_unlock(&dev->dev_mutex);
+
+	return 0;
+}
+
+static int vfq_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, vfq_stat_show, inode->i_private);
+}
+
+static ssize_t vfq_stat_write(struct file *file, const char __user *buf,
+	size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct aml_vcodec_dev *dev = m->private;
+	struct aml_vcodec_ctx *ctx;
+
+	mutex_lock(&dev->dev_mutex);
+	list_for_each_entry(ctx, &dev->ctx_list, list) {
+		vfq_stat_reset(&ctx->vfq_stat[0]);
+		vfq_stat_reset(&ctx->vfq_stat[1]);
+	}
+	mutex_unlock(&dev->dev_mutex);
+
+	return count;
+}
+
+static const struct file_operations vfq_stat_fops = {
+	.open		= vfq_stat_open,
+	.read		= seq_read,
+	.write		= vfq_stat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Decodes held back by a full input, per open decoder. Writing
+ * anything resets the counters.
+ */
+static int input_stat_show(struct seq_file *m, void *v)
+{
+	struct aml_vcodec_dev *dev = m->private;
+	struct aml_vcodec_ctx *ctx;
+
+	seq_printf(m, "input %s, low level %d%%, wait %d ms\n",
+		input_nonblock ? "non-blocking" : "blocking",
+		input_low_level, input_wait_ms);
+	mutex_lock(&dev->dev_mutex);
+	list_for_each_entry(ctx, &dev->ctx_list, list) {
+		struct aml_input_stat *s = &ctx->input_stat;
+
+		seq_printf(m, "ctx %d blocks %u wakeups %u timeouts %u requeues %u blocked %llu us max %llu us\n",
+			ctx->id, s->blocks, s->wakeups, s->timeouts,
+			s->requeues, div_u64(s->blocked_ns, NSEC_PER_USEC),
+			div_u64(s->max_ns, NSEC_PER_USEC));
+	}
+	mutex_unlock(&dev->dev_mutex);
+
+	return 0;
+}
+
+static int input_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, input_stat_show, inode->i_private);
+}
+
+static ssize_t input_stat_write(struct file *file, const char __user *buf,
+	size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct aml_vcodec_dev *dev = m->private;
+	struct aml_vcodec_ctx *ctx;
+
+	mutex_lock(&dev->dev_mutex);
+	list_for_each_entry(ctx, &dev->ctx_list, list)
+		memset(&ctx->input_stat, 0, sizeof(ctx->input_stat));
+	mutex_unlock(&dev->dev_mutex);
+
+	return count;
+}
+
+static const struct file_operations input_stat_fops = {
+	.open		= input_stat_open,
+	.read		= seq_read,
+	.write		= input_stat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void aml_vcodec_debugfs_init(struct aml_vcodec_dev *dev)
+{
+	dev->debugfs_root = debugfs_create_dir("aml_vcodec", NULL);
+	if (IS_ERR_OR_NULL(dev->debugfs_root)) {
+		dev->debugfs_root = NULL;
+		return;
+	}
+
+	if (!debugfs_create_file("vfq", 0644, dev->debugfs_root, dev,
+		&vfq_stat_fops) ||
+		!debugfs_create_file("input", 0644, dev->debugfs_root, dev,
+		&input_stat_fops)) {
+		debugfs_remove_recursive(dev->debugfs_root);
+		dev->debugfs_root = NULL;
+	}
+}
+
 static int aml_vcodec_probe(struct platform_device *pdev)
 {
 	struct aml_vcodec_dev *dev;
@@ -498,6 +637,8 @@ static int aml_vcodec_probe(struct platform_device *pdev)
 	v4l_dbg(0, V4L_DEBUG_CODEC_PRINFO,
 		"decoder registered as /dev/video%d\n", vfd_dec->num);
 
+	aml_vcodec_debugfs_init(dev);
+
 	return 0;
 
 err_dec_reg:
@@ -524,6 +665,8 @@ static int aml_vcodec_dec_remove(struct platform_device *pdev)
 {
 	struct aml_vcodec_dev *dev = platform_get_drvdata(pdev);
 
+	debugfs_remove_recursive(dev->debugfs_root);
+
 	flush_workqueue(dev->decode_workqueue);
 	destroy_workqueue(dev->decode_workqueue);
 
@@ -623,6 +766,17 @@ module_param(param_sets_from_ucode, bool, 0644);
 EXPORT_SYMBOL(enable_drm_mode);
 module_param(enable_drm_mode, bool, 0644);
 
+module_param(vfq_stat, bool, 0644);
+
+EXPORT_SYMBOL(input_nonblock);
+module_param(input_nonblock, bool, 0644);
+
+EXPORT_SYMBOL(input_low_level);
+module_param(input_low_level, int, 0644);
+
+EXPORT_SYMBOL(input_wait_ms);
+module_param(input_wait_ms, int, 0644);
+
 MODULE_LICENSE("GPL v2");
 MODULE_DESCRIPTION("AML video codec V4L2 decoder driver");
 
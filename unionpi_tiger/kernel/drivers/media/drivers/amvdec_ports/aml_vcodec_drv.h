@@ -28,6 +28,7 @@
 #include <media/videobuf2-core.h>
 #include <linux/amlogic/media/vfm/vframe.h>
 #include "aml_vcodec_util.h"
+#include "aml_vcodec_vfq.h"
 
 #define AML_VCODEC_DRV_NAME	"aml_vcodec_drv"
 #define AML_VCODEC_DEC_NAME	"aml-vcodec-dec"
@@ -359,6 +360,20 @@ struct v4l_buff_pool {
 	u32 in, out;
 };
 
+/*
+ * Input backpressure of one context, see vdec_input_block(). Only
+ * the side that clears the blocked state accounts the time, a reset
+ * from debugfs may race it and lose a count.
+ */
+struct aml_input_stat {
+	u32 blocks;	/* decodes that found the input full */
+	u32 wakeups;	/* unblocked by the decoder consuming input */
+	u32 timeouts;	/* unblocked by the input_wait_ms fallback */
+	u32 requeues;	/* src buffers left queued by a non-blocking decode */
+	u64 blocked_ns;
+	u64 max_ns;
+};
+
 enum aml_thread_type {
 	AML_THREAD_OUTPUT,
 	AML_THREAD_CAPTURE,
@@ -423,6 +438,8 @@ struct aml_vdec_thread {
  * @reset_flag: reset mode includes lightly and normal mode.
  * @decoded_frame_cnt: the capture buffer deque number to be count.
  * @buf_used_count: means that decode allocate how many buffs from v4l.
+ * @vfq_stat: occupancy of the vfm frame and recycle queues, see vfq_stat.
+ * @input_stat: time and count of decodes held back by a full input.
  */
 struct aml_vcodec_ctx {
 	int				id;
@@ -468,6 +485,8 @@ struct aml_vcodec_ctx {
 	int				reset_flag;
 	int				decoded_frame_cnt;
 	int				buf_used_count;
+	struct vfq_stat_s		vfq_stat[2];
+	struct aml_input_stat		input_stat;
 };
 
 /**
@@ -507,6 +526,7 @@ struct aml_vcodec_ctx {
  * @pm: power management control
  * @dec_capability: used to identify decode capability, ex: 4k
  * @enc_capability: used to identify encode capability
+ * @debugfs_root: aml_vcodec debugfs directory
  */
 struct aml_vcodec_dev {
 	struct v4l2_device v4l2_dev;
@@ -543,6 +563,7 @@ struct aml_vcodec_dev {
 	struct aml_vcodec_pm pm;
 	unsigned int dec_capability;
 	unsigned int enc_capability;
+	struct dentry *debugfs_root;
 };
 
 static inline struct aml_vcodec_ctx *fh_to_ctx(struct v4l2_fh *fh)
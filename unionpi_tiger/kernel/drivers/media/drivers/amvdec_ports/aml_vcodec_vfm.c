@@ -149,6 +149,11 @@ static int video_receiver_event_fun(int type, void *data, void *private_data)
 
 		vfq_init(&vfm->vf_que, POOL_SIZE + 1, &vfm->pool[0]);
 		vfq_init(&vfm->vf_que_recycle, POOL_SIZE + 1, &vfm->pool_recycle[0]);
+		if (vfq_stat) {
+			vfq_set_stat(&vfm->vf_que, &vfm->ctx->vfq_stat[0]);
+			vfq_set_stat(&vfm->vf_que_recycle,
+				&vfm->ctx->vfq_stat[1]);
+		}
 
 		break;
 	}
@@ -161,22 +166,34 @@ static int video_receiver_event_fun(int type, void *data, void *private_data)
 	}
 
 	case VFRAME_EVENT_PROVIDER_VFRAME_READY: {
-		if (vfq_level(&vfm->vf_que) > POOL_SIZE - 1)
-			ret = -1;
+		struct vframe_s *vfs[POOL_SIZE];
+		int room = POOL_SIZE - vfq_level(&vfm->vf_que);
+		int n = 0;
 
-		if (!vf_peek(vfm->recv_name))
+		if (room <= 0) {
+			v4l_dbg(vfm->ctx, V4L_DEBUG_CODEC_ERROR, "receiver vf err.\n");
 			ret = -1;
+			break;
+		}
 
-		vfm->vf = vf_get(vfm->recv_name);
-		if (!vfm->vf)
-			ret = -1;
+		/*
+		 * take every frame the decoder has ready, so frames that
+		 * came in back to back cost one barrier pair and one
+		 * capture wakeup. A later event may then find none.
+		 */
+		while (n < room && vf_peek(vfm->recv_name)) {
+			vfs[n] = vf_get(vfm->recv_name);
+			if (!vfs[n])
+				break;
+			vfm->vf = vfs[n++];
+		}
 
-		if (ret < 0) {
-			v4l_dbg(vfm->ctx, V4L_DEBUG_CODEC_ERROR, "receiver vf err.\n");
+		if (!n) {
+			ret = -1;
 			break;
 		}
 
-		vfq_push(&vfm->vf_que, vfm->vf);
+		vfq_push_batch(&vfm->vf_que, vfs, n);
 
 		if (vfm->ada_ctx->vfm_path == FRAME_BASE_PATH_V4L_VIDEO) {
 			vf_notify_receiver(vfm->prov_name,
@@ -218,6 +235,54 @@ struct vframe_s *get_video_frame(struct vcodec_vfm_s *vfm)
 		return vfq_pop(&vfm->vf_que);
 }
 
+int get_video_frames(struct vcodec_vfm_s *vfm, struct vframe_s **vfs, int n)
+{
+	if (vfm->ada_ctx->vfm_path == FRAME_BASE_PATH_V4L_VIDEO)
+		return vfq_pop_batch(&vfm->vf_que_recycle, vfs, n);
+	else
+		return vfq_pop_batch(&vfm->vf_que, vfs, n);
+}
+
+/*
+ * The batch form of the decoders' GET_PARAM_DISP_FRAME_BUFFER: up to
+ * n display frames and their v4l buffers, returns how many. A frame
+ * without a buffer is dropped like the single frame path does and the
+ * next one is taken in its place, so fewer than n means the que is
+ * empty.
+ */
+int get_video_fbs(struct vcodec_vfm_s *vfm,
+	struct vdec_v4l2_buffer **fbs, int n)
+{
+	struct vframe_s *vfs[VDEC_DISP_BATCH];
+	struct vdec_v4l2_buffer *fb;
+	int i, num, out = 0;
+
+	if (n > VDEC_DISP_BATCH)
+		n = VDEC_DISP_BATCH;
+
+	while (out < n) {
+		num = get_video_frames(vfm, vfs, n - out);
+		if (!num)
+			break;
+
+		for (i = 0; i < num; i++) {
+			atomic_set(&vfs[i]->use_cnt, 1);
+
+			fb = (struct vdec_v4l2_buffer *)vfs[i]->v4l_mem_handle;
+			if (!fb) {
+				v4l_dbg(vfm->ctx, V4L_DEBUG_CODEC_ERROR,
+					"the vframe is avalid.\n");
+				continue;
+			}
+			fb->vf_handle = (unsigned long)vfs[i];
+			fb->status = FB_ST_DISPLAY;
+			fbs[out++] = fb;
+		}
+	}
+
+	return out;
+}
+
 int vcodec_vfm_init(struct vcodec_vfm_s *vfm)
 {
 	int ret;
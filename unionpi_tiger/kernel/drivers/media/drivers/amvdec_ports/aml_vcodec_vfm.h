@@ -44,6 +44,9 @@ struct vcodec_vfm_s {
 	bool vfm_initialized;
 };
 
+/* track the vfm queue occupancy, module param of aml_vcodec_dec_drv.c */
+extern bool vfq_stat;
+
 int vcodec_vfm_init(struct vcodec_vfm_s *vfm);
 
 void vcodec_vfm_release(struct vcodec_vfm_s *vfm);
@@ -52,6 +55,11 @@ struct vframe_s *peek_video_frame(struct vcodec_vfm_s *vfm);
 
 struct vframe_s *get_video_frame(struct vcodec_vfm_s *vfm);
 
+int get_video_frames(struct vcodec_vfm_s *vfm, struct vframe_s **vfs, int n);
+
+int get_video_fbs(struct vcodec_vfm_s *vfm,
+	struct vdec_v4l2_buffer **fbs, int n);
+
 int get_fb_from_queue(struct aml_vcodec_ctx *ctx, struct vdec_v4l2_buffer **out_fb);
 int put_fb_to_queue(struct aml_vcodec_ctx *ctx, struct vdec_v4l2_buffer *in_fb);
 
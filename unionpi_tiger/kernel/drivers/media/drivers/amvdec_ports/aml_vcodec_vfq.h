@@ -21,8 +21,24 @@
 #define __AML_VCODEC_VFQ_H_
 
 #include <linux/types.h>
+#include <linux/string.h>
 #include <asm/barrier.h>
 
+/*
+ * Occupancy telemetry of one queue. The producer only writes high,
+ * push and full, the consumer only low, pop and empty, so no locking
+ * is needed; a reset from debugfs may race a writer and lose a count.
+ */
+struct vfq_stat_s {
+	int high;	/* highest level after a push */
+	int low;	/* lowest level a pop found, -1: no pop yet */
+	u32 push;
+	u32 pop;
+	u32 empty;	/* pops on an empty queue */
+	u32 full;	/* frames a push had no room for */
+	u32 batch_max;	/* most frames moved by one batch call */
+};
+
 struct vfq_s {
 	int rp;
 	int wp;
@@ -30,6 +46,7 @@ struct vfq_s {
 	int pre_rp;
 	int pre_wp;
 	struct vframe_s **pool;
+	struct vfq_stat_s *stat;	/* optional, NULL: not tracked */
 };
 
 static inline void vfq_lookup_start(struct vfq_s *q)
@@ -48,6 +65,7 @@ static inline void vfq_init(struct vfq_s *q, u32 size, struct vframe_s **pool)
 	q->rp = q->wp = 0;
 	q->size = size;
 	q->pool = pool;
+	q->stat = NULL;
 }
 
 static inline bool vfq_empty(struct vfq_s *q)
@@ -55,6 +73,60 @@ static inline bool vfq_empty(struct vfq_s *q)
 	return q->rp == q->wp;
 }
 
+static inline int vfq_level(struct vfq_s *q)
+{
+	int level = q->wp - q->rp;
+
+	if (level < 0)
+		level += q->size;
+
+	return level;
+}
+
+static inline void vfq_stat_reset(struct vfq_stat_s *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->low = -1;
+}
+
+static inline void vfq_set_stat(struct vfq_s *q, struct vfq_stat_s *s)
+{
+	q->stat = s;
+}
+
+static inline void vfq_stat_push(struct vfq_s *q, int n)
+{
+	struct vfq_stat_s *s = q->stat;
+	int level;
+
+	if (!s)
+		return;
+	level = vfq_level(q);
+	s->push += n;
+	if (level > s->high)
+		s->high = level;
+	if (n > s->batch_max)
+		s->batch_max = n;
+}
+
+/* level is what the pop found, before it took n frames */
+static inline void vfq_stat_pop(struct vfq_s *q, int level, int n)
+{
+	struct vfq_stat_s *s = q->stat;
+
+	if (!s)
+		return;
+	if (!n) {
+		s->empty++;
+		return;
+	}
+	s->pop += n;
+	if (s->low < 0 || level < s->low)
+		s->low = level;
+	if (n > s->batch_max)
+		s->batch_max = n;
+}
+
 static inline void vfq_push(struct vfq_s *q, struct vframe_s *vf)
 {
 	int wp = q->wp;
@@ -68,6 +140,43 @@ static inline void vfq_push(struct vfq_s *q, struct vframe_s *vf)
 	smp_wmb();
 
 	q->wp = (wp == (q->size - 1)) ? 0 : (wp + 1);
+
+	vfq_stat_push(q, 1);
+}
+
+/*
+ * Queue up to n frames behind one barrier pair instead of one pair
+ * per frame. Returns how many fitted, the ring keeps one slot free.
+ */
+static inline int vfq_push_batch(struct vfq_s *q,
+	struct vframe_s **vfs, int n)
+{
+	int wp = q->wp;
+	int room = q->size - 1 - vfq_level(q);
+	int i;
+
+	if (n > room) {
+		if (q->stat)
+			q->stat->full += n - room;
+		n = room;
+	}
+	if (n <= 0)
+		return 0;
+
+	smp_mb();
+
+	for (i = 0; i < n; i++) {
+		q->pool[wp] = vfs[i];
+		wp = (wp == (q->size - 1)) ? 0 : (wp + 1);
+	}
+
+	smp_wmb();
+
+	q->wp = wp;
+
+	vfq_stat_push(q, n);
+
+	return n;
 }
 
 static inline struct vframe_s *vfq_pop(struct vfq_s *q)
@@ -75,8 +184,12 @@ static inline struct vframe_s *vfq_pop(struct vfq_s *q)
 	struct vframe_s *vf;
 	int rp;
 
-	if (vfq_empty(q))
+	if (vfq_empty(q)) {
+		vfq_stat_pop(q, 0, 0);
 		return NULL;
+	}
+
+	vfq_stat_pop(q, vfq_level(q), 1);
 
 	rp = q->rp;
 
@@ -93,19 +206,40 @@ static inline struct vframe_s *vfq_pop(struct vfq_s *q)
 	return vf;
 }
 
-static inline struct vframe_s *vfq_peek(struct vfq_s *q)
+/* take up to n frames behind one barrier pair, returns how many */
+static inline int vfq_pop_batch(struct vfq_s *q,
+	struct vframe_s **vfs, int n)
 {
-	return (vfq_empty(q)) ? NULL : q->pool[q->rp];
-}
+	int level = vfq_level(q);
+	int rp = q->rp;
+	int i;
 
-static inline int vfq_level(struct vfq_s *q)
-{
-	int level = q->wp - q->rp;
+	if (n > level)
+		n = level;
+	if (n <= 0) {
+		vfq_stat_pop(q, 0, 0);
+		return 0;
+	}
 
-	if (level < 0)
-		level += q->size;
+	smp_rmb();
 
-	return level;
+	for (i = 0; i < n; i++) {
+		vfs[i] = q->pool[rp];
+		rp = (rp == (q->size - 1)) ? 0 : (rp + 1);
+	}
+
+	smp_mb();
+
+	q->rp = rp;
+
+	vfq_stat_pop(q, level, n);
+
+	return n;
+}
+
+static inline struct vframe_s *vfq_peek(struct vfq_s *q)
+{
+	return (vfq_empty(q)) ? NULL : q->pool[q->rp];
 }
 
 #endif /* __AML_VCODEC_VFQ_H_ */
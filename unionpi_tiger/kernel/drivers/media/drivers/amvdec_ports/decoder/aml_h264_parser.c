@@ -635,39 +635,24 @@ static const char *h264_nal_unit_name(int nal_type)
 	return h264_nal_type_name[nal_type];
 }
 
-static int decode_extradata_ps(u8 *data, int size, struct h264_param_sets *ps)
+static int decode_extradata_ps(const u8 *nal, u32 nal_len,
+	u8 **rbsp_buf, u32 buf_size, struct h264_param_sets *ps)
 {
 	int ret = 0;
 	struct get_bits_context gb;
-	u32 src_len, rbsp_size = 0;
-	u8 *rbsp_buf = NULL;
-	int ref_idc, nalu_pos;
+	u32 rbsp_size = 0;
+	int ref_idc;
 	u32 nal_type;
-	u8 *p = data;
-	u32 len = size;
-
-	nalu_pos = find_start_code(p, len);
-	if (nalu_pos < 0)
-		return -1;
-
-	src_len = calc_nal_len(p + nalu_pos, size - nalu_pos);
-	rbsp_buf = nal_unit_extract_rbsp(p + nalu_pos, src_len, &rbsp_size);
-	if (rbsp_buf == NULL)
-		return -ENOMEM;
+	u8 hdr = nal_len ? nal[0] : 0;
 
-	ret = init_get_bits8(&gb, rbsp_buf, rbsp_size);
-	if (ret < 0)
-		goto out;
-
-	if (get_bits1(&gb) != 0) {
-		ret = -1;
+	if (hdr & 0x80) {
 		v4l_dbg(0, V4L_DEBUG_CODEC_ERROR,
 			"invalid h264 data,return!\n");
-		goto out;
+		return -1;
 	}
 
-	ref_idc	 = get_bits(&gb, 2);
-	nal_type = get_bits(&gb, 5);
+	ref_idc	 = (hdr >> 5) & 0x3;
+	nal_type = hdr & 0x1f;
 
 	v4l_dbg(0, V4L_DEBUG_CODEC_PARSER,
 		"nal_unit_type: %d(%s), nal_ref_idc: %d\n",
@@ -675,9 +660,25 @@ static int decode_extradata_ps(u8 *data, int size, struct h264_param_sets *ps)
 
 	switch (nal_type) {
 	case H264_NAL_SPS:
+		/* one scratch for all the nal units of this buffer */
+		if (*rbsp_buf == NULL) {
+			*rbsp_buf = vmalloc(buf_size +
+				AV_INPUT_BUFFER_PADDING_SIZE);
+			if (*rbsp_buf == NULL)
+				return -ENOMEM;
+		}
+
+		rbsp_size = nal_unit_unescape_rbsp(nal, nal_len, *rbsp_buf);
+		memset(*rbsp_buf + rbsp_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+		ret = init_get_bits8(&gb, *rbsp_buf, rbsp_size);
+		if (ret < 0)
+			return ret;
+
+		skip_bits(&gb, 8);
 		ret = aml_h264_parser_sps(&gb, &ps->sps);
 		if (ret < 0)
-			goto out;
+			return ret;
 		ps->sps_parsed = true;
 		break;
 	/*case H264_NAL_PPS:
@@ -693,38 +694,35 @@ static int decode_extradata_ps(u8 *data, int size, struct h264_param_sets *ps)
 		break;
 	}
 
-out:
-	vfree(rbsp_buf);
-
 	return ret;
 }
 
 int h264_decode_extradata_ps(u8 *buf, int size, struct h264_param_sets *ps)
 {
-	int ret = 0, i = 0, j = 0;
-	u8 *p = buf;
-	int len = size;
-
-	for (i = 4; i < size; i++) {
-		j = find_start_code(p, len);
-		if (j > 0) {
-			len = size - (p - buf);
-			ret = decode_extradata_ps(p, len, ps);
-			if (ret) {
-				v4l_dbg(0, V4L_DEBUG_CODEC_ERROR,
-					"parse extra data failed. err: %d\n", ret);
-				return ret;
-			}
-
-			if (ps->sps_parsed)
-				break;
+	int ret = 0;
+	struct nal_iter it;
+	const u8 *nal;
+	u32 nal_len;
+	u8 *rbsp_buf = NULL;
 
-			p += j;
+	/*
+	 * Walk the nal units in one pass, only the parameter sets are
+	 * unescaped and no unit is longer than the buffer itself.
+	 */
+	nal_iter_init(&it, buf, size);
+	while ((nal = nal_iter_next(&it, &nal_len)) != NULL) {
+		ret = decode_extradata_ps(nal, nal_len, &rbsp_buf, size, ps);
+		if (ret) {
+			v4l_dbg(0, V4L_DEBUG_CODEC_ERROR,
+				"parse extra data failed. err: %d\n", ret);
+			break;
 		}
-		p++;
+
+		if (ps->sps_parsed)
+			break;
 	}
 
+	vfree(rbsp_buf);
+
 	return ret;
 }
-
-
@@ -1192,48 +1192,32 @@ static const char *hevc_nal_unit_name(int nal_type)
 /**
 * Parse NAL units of found picture and decode some basic information.
 *
-* @param s parser context.
-* @param avctx codec context.
-* @param buf buffer with field/frame data.
-* @param buf_size size of the buffer.
+* @param nal nal unit, header included, start code not.
+* @param nal_len size of the nal unit.
+* @param rbsp_buf scratch, allocated with buf_size on first use.
+* @param ps parsed parameter sets.
 */
-static int decode_extradata_ps(u8 *data, int size, struct h265_param_sets *ps)
+static int decode_extradata_ps(const u8 *nal, u32 nal_len,
+	u8 **rbsp_buf, u32 buf_size, struct h265_param_sets *ps)
 {
 	int ret = 0;
 	struct get_bits_context gb;
-	u32 src_len, rbsp_size = 0;
-	u8 *rbsp_buf = NULL;
-	int nalu_pos, nuh_layer_id, temporal_id;
+	u32 rbsp_size = 0;
+	int nuh_layer_id, temporal_id;
 	u32 nal_type;
-	u8 *p = data;
-	u32 len = size;
-
-	nalu_pos = find_start_code(p, len);
-	if (nalu_pos < 0)
-		return -1;
+	u8 hdr0 = nal_len > 0 ? nal[0] : 0;
+	u8 hdr1 = nal_len > 1 ? nal[1] : 0;
 
-	src_len = calc_nal_len(p + nalu_pos, size - nalu_pos);
-	rbsp_buf = nal_unit_extract_rbsp(p + nalu_pos, src_len, &rbsp_size);
-	if (rbsp_buf == NULL)
-		return -ENOMEM;
-
-	ret = init_get_bits8(&gb, rbsp_buf, rbsp_size);
-	if (ret < 0)
-		goto out;
-
-	if (get_bits1(&gb) != 0) {
-		ret = -1;
+	if (hdr0 & 0x80) {
 		v4l_dbg(0, V4L_DEBUG_CODEC_ERROR, "invalid data, return!\n");
-		goto out;
+		return -1;
 	}
 
-	nal_type	= get_bits(&gb, 6);
-	nuh_layer_id	= get_bits(&gb, 6);
-	temporal_id	= get_bits(&gb, 3) - 1;
-	if (temporal_id < 0) {
-		ret = -1;
-		goto out;
-	}
+	nal_type	= (hdr0 >> 1) & 0x3f;
+	nuh_layer_id	= ((hdr0 & 0x1) << 5) | (hdr1 >> 3);
+	temporal_id	= (hdr1 & 0x7) - 1;
+	if (temporal_id < 0)
+		return -1;
 
 	/*pr_info("nal_unit_type: %d(%s), nuh_layer_id: %d, temporal_id: %d\n",
 		nal_type, hevc_nal_unit_name(nal_type),
@@ -1241,16 +1225,34 @@ static int decode_extradata_ps(u8 *data, int size, struct h265_param_sets *ps)
 
 	switch (nal_type) {
 	case HEVC_NAL_VPS:
-		ret = ff_hevc_parse_vps(&gb, &ps->vps);
-		if (ret < 0)
-			goto out;
-		ps->vps_parsed = true;
-		break;
 	case HEVC_NAL_SPS:
-		ret = ff_hevc_parse_sps(&gb, &ps->sps);
+		/* one scratch for all the nal units of this buffer */
+		if (*rbsp_buf == NULL) {
+			*rbsp_buf = vmalloc(buf_size +
+				AV_INPUT_BUFFER_PADDING_SIZE);
+			if (*rbsp_buf == NULL)
+				return -ENOMEM;
+		}
+
+		rbsp_size = nal_unit_unescape_rbsp(nal, nal_len, *rbsp_buf);
+		memset(*rbsp_buf + rbsp_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+		ret = init_get_bits8(&gb, *rbsp_buf, rbsp_size);
 		if (ret < 0)
-			goto out;
-		ps->sps_parsed = true;
+			return ret;
+
+		skip_bits(&gb, 16);
+		if (nal_type == HEVC_NAL_VPS) {
+			ret = ff_hevc_parse_vps(&gb, &ps->vps);
+			if (ret < 0)
+				return ret;
+			ps->vps_parsed = true;
+		} else {
+			ret = ff_hevc_parse_sps(&gb, &ps->sps);
+			if (ret < 0)
+				return ret;
+			ps->sps_parsed = true;
+		}
 		break;
 	/*case HEVC_NAL_PPS:
 		ret = ff_hevc_decode_nal_pps(&gb, NULL, ps);
@@ -1264,36 +1266,34 @@ static int decode_extradata_ps(u8 *data, int size, struct h265_param_sets *ps)
 		break;
 	}
 
-out:
-	vfree(rbsp_buf);
-
 	return ret;
 }
 
 int h265_decode_extradata_ps(u8 *buf, int size, struct h265_param_sets *ps)
 {
-	int ret = 0, i = 0, j = 0;
-	u8 *p = buf;
-	int len = size;
-
-	for (i = 4; i < size; i++) {
-		j = find_start_code(p, len);
-		if (j > 0) {
-			len = size - (p - buf);
-			ret = decode_extradata_ps(p, len, ps);
-			if (ret) {
-				v4l_dbg(0, V4L_DEBUG_CODEC_ERROR, "parse extra data failed. err: %d\n", ret);
-				return ret;
-			}
-
-			if (ps->sps_parsed)
-				break;
+	int ret = 0;
+	struct nal_iter it;
+	const u8 *nal;
+	u32 nal_len;
+	u8 *rbsp_buf = NULL;
 
-			p += j;
+	/*
+	 * Walk the nal units in one pass, only the parameter sets are
+	 * unescaped and no unit is longer than the buffer itself.
+	 */
+	nal_iter_init(&it, buf, size);
+	while ((nal = nal_iter_next(&it, &nal_len)) != NULL) {
+		ret = decode_extradata_ps(nal, nal_len, &rbsp_buf, size, ps);
+		if (ret) {
+			v4l_dbg(0, V4L_DEBUG_CODEC_ERROR, "parse extra data failed. err: %d\n", ret);
+			break;
 		}
-		p++;
+
+		if (ps->sps_parsed)
+			break;
 	}
 
+	vfree(rbsp_buf);
+
 	return ret;
 }
-
@@ -580,6 +580,11 @@ static void vdec_hevc_get_vf(struct vdec_hevc_inst *inst, struct vdec_v4l2_buffe
 	//swap_uv(fb->base_c.vaddr, fb->base_c.size);
 }
 
+static void vdec_hevc_get_vfs(struct vdec_hevc_inst *inst, struct vdec_disp_fbs *out)
+{
+	out->num = get_video_fbs(&inst->vfm, out->fb, VDEC_DISP_BATCH);
+}
+
 static int vdec_write_nalu(struct vdec_hevc_inst *inst,
 	u8 *buf, u32 size, u64 ts)
 {
@@ -593,28 +598,25 @@ static int vdec_write_nalu(struct vdec_hevc_inst *inst,
 
 static bool monitor_res_change(struct vdec_hevc_inst *inst, u8 *buf, u32 size)
 {
-	int ret = 0, i = 0, j = 0;
-	u8 *p = buf;
-	int len = size;
-	u32 type;
-
-	for (i = 4; i < size; i++) {
-		j = find_start_code(p, len);
-		if (j > 0) {
-			len = size - (p - buf);
-			type = HEVC_NAL_TYPE(p[j]);
-			if (type != HEVC_NAL_AUD &&
-				(type > HEVC_NAL_PPS || type < HEVC_NAL_VPS))
+	int ret = 0;
+	struct nal_iter it;
+	const u8 *nal;
+	u32 nal_len, type;
+
+	nal_iter_init(&it, buf, size);
+	while ((nal = nal_iter_next(&it, &nal_len)) != NULL) {
+		type = HEVC_NAL_TYPE(nal[0]);
+		if (type != HEVC_NAL_AUD &&
+			(type > HEVC_NAL_PPS || type < HEVC_NAL_VPS))
+			break;
+
+		if (type == HEVC_NAL_SPS) {
+			u8 *p = (u8 *)nal - 3;
+
+			ret = parse_stream_cpu(inst, p, size - (p - buf));
+			if (ret)
 				break;
-
-			if (type == HEVC_NAL_SPS) {
-				ret = parse_stream_cpu(inst, p, len);
-				if (ret)
-					break;
-			}
-			p += j;
 		}
-		p++;
 	}
 
 	if (!ret && (inst->vsi->cur_pic.coded_width !=
@@ -715,6 +717,10 @@ static int vdec_hevc_get_param(unsigned long h_vdec,
 		vdec_hevc_get_vf(inst, out);
 		break;
 
+	case GET_PARAM_DISP_FRAME_BUFFERS:
+		vdec_hevc_get_vfs(inst, out);
+		break;
+
 	case GET_PARAM_FREE_FRAME_BUFFER:
 		ret = vdec_hevc_get_fb(inst, out);
 		break;
@@ -464,6 +464,11 @@ static void vdec_mpeg12_get_vf(struct vdec_mpeg12_inst *inst, struct vdec_v4l2_b
 	//swap_uv(fb->base_c.va, fb->base_c.size);
 }
 
+static void vdec_mpeg12_get_vfs(struct vdec_mpeg12_inst *inst, struct vdec_disp_fbs *out)
+{
+	out->num = get_video_fbs(&inst->vfm, out->fb, VDEC_DISP_BATCH);
+}
+
 static int vdec_write_nalu(struct vdec_mpeg12_inst *inst,
 	u8 *buf, u32 size, u64 ts)
 {
@@ -529,6 +534,10 @@ static int vdec_mpeg12_get_param(unsigned long h_vdec,
 		vdec_mpeg12_get_vf(inst, out);
 		break;
 
+	case GET_PARAM_DISP_FRAME_BUFFERS:
+		vdec_mpeg12_get_vfs(inst, out);
+		break;
+
 	case GET_PARAM_FREE_FRAME_BUFFER:
 		ret = vdec_mpeg12_get_fb(inst, out);
 		break;
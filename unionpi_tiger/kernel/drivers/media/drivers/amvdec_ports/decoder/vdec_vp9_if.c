@@ -612,6 +612,11 @@ static void vdec_vp9_get_vf(struct vdec_vp9_inst *inst, struct vdec_v4l2_buffer
 	//swap_uv(fb->base_c.vaddr, fb->base_c.size);
 }
 
+static void vdec_vp9_get_vfs(struct vdec_vp9_inst *inst, struct vdec_disp_fbs *out)
+{
+	out->num = get_video_fbs(&inst->vfm, out->fb, VDEC_DISP_BATCH);
+}
+
 static void add_prefix_data(struct vp9_superframe_split *s,
 	u8 **out, u32 *out_size)
 {
@@ -832,6 +837,10 @@ static int vdec_vp9_get_param(unsigned long h_vdec,
 		vdec_vp9_get_vf(inst, out);
 		break;
 
+	case GET_PARAM_DISP_FRAME_BUFFERS:
+		vdec_vp9_get_vfs(inst, out);
+		break;
+
 	case GET_PARAM_FREE_FRAME_BUFFER:
 		ret = vdec_vp9_get_fb(inst, out);
 		break;
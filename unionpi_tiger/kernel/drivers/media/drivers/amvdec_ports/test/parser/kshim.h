@@ -0,0 +1,59 @@
+/*
+ * Kernel definitions the amvdec_ports parsers need, so they build as
+ * plain userspace code for parser_test.c. Included ahead of everything
+ * with -include, the linux/ headers next to it only pull this in.
+ */
+#ifndef PARSER_TEST_KSHIM_H
+#define PARSER_TEST_KSHIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define printk printf
+#define pr_info printf
+#define pr_err printf
+#define KERN_INFO ""
+#define KERN_ERR ""
+
+#define vmalloc malloc
+#define vzalloc(n) calloc(1, n)
+#define vfree free
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define min_t(t, a, b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+
+/* aml_vcodec_drv.h drags in v4l2, only v4l_dbg() is used */
+#define _AML_VCODEC_DRV_H_
+#define V4L_DEBUG_CODEC_ERROR	(0)
+#define V4L_DEBUG_CODEC_PRINFO	(1 << 0)
+#define V4L_DEBUG_CODEC_PARSER	(1 << 6)
+extern int parser_test_verbose;
+#define v4l_dbg(h, flags, fmt, args...)				\
+	do {							\
+		if (parser_test_verbose)			\
+			printf(fmt, ##args);			\
+	} while (0)
+
+#endif
@@ -0,0 +1,655 @@
+/*
+* Copyright (C) 2017 Amlogic, Inc. All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+* more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+* Description: check the one pass nal scanner and rbsp unescape of
+* ../../utils/common.c against the byte wise calc_nal_len() and
+* vmalloc per nal extract they replaced, run the h264/hevc parameter
+* set parsers over generated and given streams and time both paths.
+*
+* Build:
+*	SRC="../../utils/common.c ../../utils/golomb.c \
+*		../../decoder/aml_h264_parser.c ../../decoder/aml_hevc_parser.c"
+*	gcc -O2 -I. -include kshim.h -o parser_test parser_test.c $SRC
+* or as a libFuzzer target:
+*	clang -O1 -g -DFUZZ -fsanitize=fuzzer,address -I. -include kshim.h \
+*		-o parser_fuzz parser_test.c $SRC
+*
+* Usage: parser_test [-v] [-s seed] [-n rounds] [file...]
+* Files are raw annex-b elementary streams, they are checked the same
+* way as the generated ones.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../utils/common.h"
+#include "../../decoder/aml_h264_parser.h"
+#include "../../decoder/aml_hevc_parser.h"
+
+#define MAX_NALS	4096
+#define MAX_BUF		(1 << 20)
+#define ALIGN_PAD	8
+
+int parser_test_verbose;
+
+struct ref_nal {
+	int off;
+	int len;
+};
+
+static u32 rnd_state = 1;
+
+static u32 rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the h26x_decode_extradata_ps() loop before the nal iterator */
+static int ref_scan(const u8 *buf, int size, struct ref_nal *out, int max)
+{
+	const u8 *p = buf;
+	int n = 0;
+
+	while (p < buf + size && n < max) {
+		int len = size - (p - buf);
+		int j = find_start_code((u8 *)p, len);
+
+		if (j > 0) {
+			out[n].off = p + j - buf;
+			out[n].len = calc_nal_len((u8 *)p + j, len - j);
+			n++;
+			p += j;
+		}
+		p++;
+	}
+
+	return n;
+}
+
+/* the nal_unit_extract_rbsp() before it was built on the unescape */
+static u8 *ref_extract_rbsp(const u8 *src, u32 src_len, u32 *dst_len)
+{
+	u8 *dst;
+	u32 i, len;
+
+	dst = malloc(src_len + AV_INPUT_BUFFER_PADDING_SIZE);
+	if (!dst)
+		return NULL;
+
+	i = len = 0;
+	while (i < 2 && i < src_len)
+		dst[len++] = src[i++];
+
+	while (i + 2 < src_len)
+	if (!src[i] && !src[i + 1] && src[i + 2] == 3) {
+		dst[len++] = src[i++];
+		dst[len++] = src[i++];
+		i++;
+	} else
+		dst[len++] = src[i++];
+
+	while (i < src_len)
+		dst[len++] = src[i++];
+
+	memset(dst + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+	*dst_len = len;
+
+	return dst;
+}
+
+static int check_buf(const u8 *buf, int size, const char *name)
+{
+	static struct ref_nal ref[MAX_NALS];
+	struct nal_iter it;
+	const u8 *nal;
+	u32 nal_len;
+	int n, i = 0, err = 0;
+
+	n = ref_scan(buf, size, ref, MAX_NALS);
+	nal_iter_init(&it, buf, size);
+	while ((nal = nal_iter_next(&it, &nal_len)) != NULL && i < MAX_NALS) {
+		u8 *a, *b, *c;
+		u32 a_len, b_len, c_len;
+
+		if (i >= n || ref[i].off != nal - buf ||
+			ref[i].len != (int)nal_len) {
+			printf("%s: nal %d at %d/%d len %d/%u\n", name, i,
+				i < n ? ref[i].off : -1, (int)(nal - buf),
+				i < n ? ref[i].len : -1, nal_len);
+			return 1;
+		}
+
+		a = ref_extract_rbsp(nal, nal_len, &a_len);
+		b = nal_unit_extract_rbsp(nal, nal_len, &b_len);
+		c = malloc(nal_len + AV_INPUT_BUFFER_PADDING_SIZE);
+		if (!a || !b || !c) {
+			free(a);
+			free(b);
+			free(c);
+			return 1;
+		}
+		memcpy(c, nal, nal_len);
+		c_len = nal_unit_unescape_rbsp(c, nal_len, c);
+		if (a_len != b_len || a_len != c_len ||
+			memcmp(a, b, a_len + AV_INPUT_BUFFER_PADDING_SIZE) ||
+			memcmp(a, c, a_len)) {
+			printf("%s: nal %d rbsp %u/%u/%u differs\n",
+				name, i, a_len, b_len, c_len);
+			err = 1;
+		}
+		free(a);
+		free(b);
+		free(c);
+		if (err)
+			return err;
+		i++;
+	}
+	if (i != n) {
+		printf("%s: %d nal units, expected %d\n", name, i, n);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* every alignment, so the word loop sees the head and tail paths */
+static int check_aligned(const u8 *buf, int size, const char *name)
+{
+	u8 *tmp = malloc(size + ALIGN_PAD);
+	int a, ret = 0;
+
+	if (!tmp)
+		return 1;
+	for (a = 0; a < 4 && !ret; a++) {
+		memcpy(tmp + a, buf, size);
+		ret = check_buf(tmp + a, size, name);
+	}
+	free(tmp);
+
+	return ret;
+}
+
+static void parse_ps(const u8 *buf, int size)
+{
+	struct h264_param_sets *ps4 = calloc(1, sizeof(*ps4));
+	struct h265_param_sets *ps5 = calloc(1, sizeof(*ps5));
+	u8 *tmp = malloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+
+	if (ps4 && ps5 && tmp) {
+		memcpy(tmp, buf, size);
+		h264_decode_extradata_ps(tmp, size, ps4);
+		memcpy(tmp, buf, size);
+		h265_decode_extradata_ps(tmp, size, ps5);
+	}
+	free(ps4);
+	free(ps5);
+	free(tmp);
+}
+
+#ifdef FUZZ
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+	if (size > MAX_BUF)
+		return 0;
+	if (check_buf(data, size, "fuzz"))
+		abort();
+	parse_ps(data, size);
+
+	return 0;
+}
+#else
+
+//bitstream writer
+struct bw {
+	u8 *buf;
+	int cap;
+	int bits;
+};
+
+static void bw_put(struct bw *w, u32 v, int n)
+{
+	while (n--) {
+		int byte = w->bits >> 3;
+
+		if (byte >= w->cap)
+			return;
+		if ((w->bits & 7) == 0)
+			w->buf[byte] = 0;
+		if ((v >> n) & 1)
+			w->buf[byte] |= 0x80 >> (w->bits & 7);
+		w->bits++;
+	}
+}
+
+static void bw_ue(struct bw *w, u32 v)
+{
+	int n = av_log2(v + 1);
+
+	bw_put(w, 0, n);
+	bw_put(w, v + 1, n + 1);
+}
+
+static int bw_trailing(struct bw *w)
+{
+	bw_put(w, 1, 1);
+	while (w->bits & 7)
+		bw_put(w, 0, 1);
+
+	return w->bits >> 3;
+}
+
+/* start code and emulation prevention around an rbsp */
+static int put_nal(u8 *dst, const u8 *rbsp, int len, int long_sc)
+{
+	int i, n = 0, zeros = 0;
+
+	if (long_sc)
+		dst[n++] = 0;
+	dst[n++] = 0;
+	dst[n++] = 0;
+	dst[n++] = 1;
+	for (i = 0; i < len; i++) {
+		if (zeros >= 2 && rbsp[i] <= 3) {
+			dst[n++] = 3;
+			zeros = 0;
+		}
+		dst[n++] = rbsp[i];
+		zeros = rbsp[i] ? 0 : zeros + 1;
+	}
+
+	return n;
+}
+
+static int gen_h264_sps(u8 *rbsp, int cap, int mb_w, int mb_h)
+{
+	struct bw w = {rbsp, cap, 0};
+
+	bw_put(&w, 0x67, 8);	/* nal_ref_idc 3, SPS */
+	bw_put(&w, 100, 8);	/* High */
+	bw_put(&w, 0, 8);
+	bw_put(&w, 40, 8);
+	bw_ue(&w, 0);		/* sps_id */
+	bw_ue(&w, 1);		/* chroma_format_idc */
+	bw_ue(&w, 0);		/* bit_depth_luma_minus8 */
+	bw_ue(&w, 0);
+	bw_put(&w, 0, 1);	/* qpprime_y_zero_transform_bypass */
+	bw_put(&w, 0, 1);	/* seq_scaling_matrix_present */
+	bw_ue(&w, 0);		/* log2_max_frame_num_minus4 */
+	bw_ue(&w, 0);		/* poc_type */
+	bw_ue(&w, 2);		/* log2_max_poc_lsb_minus4 */
+	bw_ue(&w, 4);		/* max_num_ref_frames */
+	bw_put(&w, 0, 1);	/* gaps_in_frame_num_allowed */
+	bw_ue(&w, mb_w - 1);
+	bw_ue(&w, mb_h - 1);
+	bw_put(&w, 1, 1);	/* frame_mbs_only */
+	bw_put(&w, 1, 1);	/* direct_8x8_inference */
+	bw_put(&w, 0, 1);	/* frame_cropping */
+	bw_put(&w, 0, 1);	/* vui_parameters_present */
+
+	return bw_trailing(&w);
+}
+
+static void put_ptl(struct bw *w)
+{
+	int i;
+
+	bw_put(w, 0, 2);	/* profile_space */
+	bw_put(w, 0, 1);	/* tier */
+	bw_put(w, 1, 5);	/* Main */
+	for (i = 0; i < 32; i++)
+		bw_put(w, i == 1 || i == 2, 1);
+	bw_put(w, 1, 1);	/* progressive_source */
+	bw_put(w, 0, 1);
+	bw_put(w, 0, 1);
+	bw_put(w, 1, 1);	/* frame_only_constraint */
+	bw_put(w, 0, 16);
+	bw_put(w, 0, 16);
+	bw_put(w, 0, 12);
+	bw_put(w, 120, 8);	/* level 4 */
+}
+
+static int gen_hevc_vps(u8 *rbsp, int cap)
+{
+	struct bw w = {rbsp, cap, 0};
+
+	bw_put(&w, 32 << 1, 8);	/* VPS */
+	bw_put(&w, 1, 8);	/* temporal_id_plus1 */
+	bw_put(&w, 0, 4);	/* vps_id */
+	bw_put(&w, 3, 2);
+	bw_put(&w, 0, 6);	/* max_layers_minus1 */
+	bw_put(&w, 0, 3);	/* max_sub_layers_minus1 */
+	bw_put(&w, 1, 1);	/* temporal_id_nesting */
+	bw_put(&w, 0xffff, 16);
+	put_ptl(&w);
+	bw_put(&w, 1, 1);	/* sub_layer_ordering_info_present */
+	bw_ue(&w, 4);
+	bw_ue(&w, 0);
+	bw_ue(&w, 0);
+	bw_put(&w, 0, 6);	/* max_layer_id */
+	bw_ue(&w, 0);		/* num_layer_sets_minus1 */
+	bw_put(&w, 0, 1);	/* timing_info_present */
+	bw_put(&w, 0, 1);	/* extension */
+
+	return bw_trailing(&w);
+}
+
+static int gen_hevc_sps(u8 *rbsp, int cap, int width, int height)
+{
+	struct bw w = {rbsp, cap, 0};
+
+	bw_put(&w, 33 << 1, 8);	/* SPS */
+	bw_put(&w, 1, 8);
+	bw_put(&w, 0, 4);	/* vps_id */
+	bw_put(&w, 0, 3);	/* max_sub_layers_minus1 */
+	bw_put(&w, 1, 1);
+	put_ptl(&w);
+	bw_ue(&w, 0);		/* sps_id */
+	bw_ue(&w, 1);		/* chroma_format_idc */
+	bw_ue(&w, width);
+	bw_ue(&w, height);
+	bw_put(&w, 0, 1);	/* conformance_window */
+	bw_ue(&w, 0);		/* bit_depth_luma_minus8 */
+	bw_ue(&w, 0);
+	bw_ue(&w, 4);		/* log2_max_poc_lsb_minus4 */
+	bw_put(&w, 1, 1);	/* sub_layer_ordering_info_present */
+	bw_ue(&w, 4);
+	bw_ue(&w, 0);
+	bw_ue(&w, 0);
+	bw_ue(&w, 0);		/* log2_min_cb_size_minus3 */
+	bw_ue(&w, 3);		/* 64x64 ctb */
+	bw_ue(&w, 0);		/* log2_min_tb_size_minus2 */
+	bw_ue(&w, 3);		/* 32x32 tb */
+	bw_ue(&w, 1);		/* max_transform_hierarchy_depth_inter */
+	bw_ue(&w, 1);
+	bw_put(&w, 0, 1);	/* scaling_list_enabled */
+	bw_put(&w, 1, 1);	/* amp */
+	bw_put(&w, 1, 1);	/* sao */
+	bw_put(&w, 0, 1);	/* pcm */
+	bw_ue(&w, 0);		/* num_short_term_ref_pic_sets */
+	bw_put(&w, 0, 1);	/* long_term_ref_pics_present */
+	bw_put(&w, 1, 1);	/* temporal_mvp */
+	bw_put(&w, 1, 1);	/* strong_intra_smoothing */
+	bw_put(&w, 0, 1);	/* vui */
+	bw_put(&w, 0, 1);	/* extension */
+
+	return bw_trailing(&w);
+}
+
+/* slice payload, zero heavy so plenty of bytes need escaping */
+static int gen_payload(u8 *rbsp, int len, u8 hdr0, u8 hdr1, int hevc)
+{
+	int i = 0;
+
+	rbsp[i++] = hdr0;
+	if (hevc)
+		rbsp[i++] = hdr1;
+	for (; i < len; i++) {
+		u32 r = rnd();
+
+		rbsp[i] = (r & 3) ? (r >> 8) & 3 : r >> 8;
+	}
+	rbsp[len - 1] |= 0x80;
+
+	return len;
+}
+
+/* sei/aud, parameter sets, then some slices, annex-b */
+static int gen_stream(u8 *dst, int hevc, int w, int h, int slices)
+{
+	u8 rbsp[4096];
+	int n = 0, len, i;
+
+	if (hevc) {
+		len = gen_payload(rbsp, 3, 35 << 1, 1, 1);	/* AUD */
+		n += put_nal(dst + n, rbsp, len, 1);
+		len = gen_hevc_vps(rbsp, sizeof(rbsp));
+		n += put_nal(dst + n, rbsp, len, 1);
+		len = gen_hevc_sps(rbsp, sizeof(rbsp), w, h);
+		n += put_nal(dst + n, rbsp, len, rnd() & 1);
+	} else {
+		len = gen_payload(rbsp, 2, 9, 0, 0);		/* AUD */
+		n += put_nal(dst + n, rbsp, len, 1);
+		len = gen_payload(rbsp, 64, 6, 0, 0);		/* SEI */
+		n += put_nal(dst + n, rbsp, len, 0);
+		len = gen_h264_sps(rbsp, sizeof(rbsp), w / 16, h / 16);
+		n += put_nal(dst + n, rbsp, len, rnd() & 1);
+	}
+	for (i = 0; i < slices; i++) {
+		len = 16 + rnd() % (sizeof(rbsp) - 16);
+		if (hevc)
+			len = gen_payload(rbsp, len, 19 << 1, 1, 1);
+		else
+			len = gen_payload(rbsp, len, 0x65, 0, 0);
+		n += put_nal(dst + n, rbsp, len, rnd() & 1);
+	}
+	/* trailing zero bytes, as a demuxer may leave them */
+	for (i = rnd() % 4; i > 0; i--)
+		dst[n++] = 0;
+
+	return n;
+}
+
+static int check_sizes(const u8 *buf, int size, int hevc, int w, int h)
+{
+	u8 *tmp = malloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+	int ret = 1;
+
+	if (!tmp)
+		return 1;
+	memcpy(tmp, buf, size);
+	if (hevc) {
+		struct h265_param_sets *ps = calloc(1, sizeof(*ps));
+
+		if (ps && !h265_decode_extradata_ps(tmp, size, ps) &&
+			ps->vps_parsed && ps->sps_parsed &&
+			ps->sps.width == w && ps->sps.height == h)
+			ret = 0;
+		else
+			printf("hevc %dx%d: got %s %dx%d\n", w, h,
+				ps && ps->sps_parsed ? "sps" : "no sps",
+				ps ? ps->sps.width : 0,
+				ps ? ps->sps.height : 0);
+		free(ps);
+	} else {
+		struct h264_param_sets *ps = calloc(1, sizeof(*ps));
+
+		if (ps && !h264_decode_extradata_ps(tmp, size, ps) &&
+			ps->sps_parsed &&
+			ps->sps.mb_width * 16 == w &&
+			ps->sps.mb_height * 16 == h)
+			ret = 0;
+		else
+			printf("h264 %dx%d: got %s %dx%d\n", w, h,
+				ps && ps->sps_parsed ? "sps" : "no sps",
+				ps ? ps->sps.mb_width * 16 : 0,
+				ps ? ps->sps.mb_height * 16 : 0);
+		free(ps);
+	}
+	free(tmp);
+
+	return ret;
+}
+
+/* random bytes, mostly 0, 1 and 3 so start codes and escapes collide */
+static int gen_blob(u8 *dst, int max)
+{
+	int len = rnd() % max, i;
+
+	for (i = 0; i < len; i++) {
+		u32 r = rnd();
+
+		dst[i] = (r & 1) ? "\0\0\0\1\3\x67\x40\x42"[(r >> 1) & 7] :
+			r >> 8;
+	}
+
+	return len;
+}
+
+/* old path: byte wise scan and a vmalloc'd rbsp per nal unit */
+static u64 bench_ref(const u8 *buf, int size, int loops)
+{
+	static struct ref_nal ref[MAX_NALS];
+	u64 t = now_ns(), sum = 0;
+	int l, i, n;
+
+	for (l = 0; l < loops; l++) {
+		n = ref_scan(buf, size, ref, MAX_NALS);
+		for (i = 0; i < n; i++) {
+			u32 len;
+			u8 *r = ref_extract_rbsp(buf + ref[i].off,
+				ref[i].len, &len);
+
+			sum += len;
+			free(r);
+		}
+	}
+	if (!sum)
+		printf("bench: no nal units\n");
+
+	return (now_ns() - t) / loops;
+}
+
+/* new path: one pass over the buffer, one scratch for all units */
+static u64 bench_new(const u8 *buf, int size, int loops)
+{
+	u64 t = now_ns(), sum = 0;
+	u8 *scratch = malloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+	struct nal_iter it;
+	const u8 *nal;
+	u32 nal_len;
+	int l;
+
+	if (!scratch)
+		return 0;
+	for (l = 0; l < loops; l++) {
+		nal_iter_init(&it, buf, size);
+		while ((nal = nal_iter_next(&it, &nal_len)) != NULL)
+			sum += nal_unit_unescape_rbsp(nal, nal_len, scratch);
+	}
+	free(scratch);
+	if (!sum)
+		printf("bench: no nal units\n");
+
+	return (now_ns() - t) / loops;
+}
+
+static int check_file(const char *file, u8 *buf)
+{
+	FILE *fp = fopen(file, "rb");
+	int size;
+
+	if (!fp) {
+		perror(file);
+		return 1;
+	}
+	size = fread(buf, 1, MAX_BUF, fp);
+	fclose(fp);
+	if (check_aligned(buf, size, file))
+		return 1;
+	parse_ps(buf, size);
+	printf("%s: %d bytes ok, old %llu ns new %llu ns\n", file, size,
+		(unsigned long long)bench_ref(buf, size, 20),
+		(unsigned long long)bench_new(buf, size, 20));
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-v] [-s seed] [-n rounds] [file...]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	static const int sizes[][2] = {
+		{176, 144}, {640, 480}, {1280, 720}, {1920, 1088}, {3840, 2160},
+	};
+	u8 *buf = malloc(MAX_BUF);
+	int rounds = 2000, errors = 0;
+	int opt, i, j, len;
+
+	if (!buf)
+		return 1;
+	while ((opt = getopt(argc, argv, "vs:n:h")) != -1) {
+		switch (opt) {
+		case 'v':
+			parser_test_verbose = 1;
+			break;
+		case 's':
+			rnd_state = strtoul(optarg, NULL, 0) | 1;
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind < argc) {
+		for (i = optind; i < argc; i++)
+			errors += check_file(argv[i], buf);
+		free(buf);
+		return errors ? 1 : 0;
+	}
+
+	for (i = 0; i < (int)ARRAY_SIZE(sizes); i++) {
+		for (j = 0; j < 2; j++) {
+			len = gen_stream(buf, j, sizes[i][0], sizes[i][1], 8);
+			errors += check_aligned(buf, len, j ? "hevc" : "h264");
+			errors += check_sizes(buf, len, j,
+				sizes[i][0], sizes[i][1]);
+		}
+	}
+
+	for (i = 0; i < rounds && errors < 16; i++) {
+		len = gen_blob(buf, 512);
+		errors += check_aligned(buf, len, "blob");
+		parse_ps(buf, len);
+	}
+	printf("%d generated streams, %d blobs, %d errors\n",
+		(int)ARRAY_SIZE(sizes) * 2, i, errors);
+
+	for (j = 0; j < 2; j++) {
+		u64 a, b;
+
+		len = gen_stream(buf, j, 1920, 1088, 200);
+		a = bench_ref(buf, len, 50);
+		b = bench_new(buf, len, 50);
+		printf("%s %d bytes: old %llu ns, new %llu ns (%.1fx)\n",
+			j ? "hevc" : "h264", len, (unsigned long long)a,
+			(unsigned long long)b, b ? (double)a / b : 0.0);
+	}
+
+	free(buf);
+	return errors ? 1 : 0;
+}
+#endif
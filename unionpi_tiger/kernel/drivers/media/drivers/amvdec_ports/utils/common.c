@@ -174,31 +174,132 @@ int calc_nal_len(u8 *data, int len)
 	return len; //Not find the end of nalu
 }
 
-u8 *nal_unit_extract_rbsp(const u8 *src, u32 src_len, u32 *dst_len)
+/*
+ * First 00 00 xx at or after p, NULL when there is none before end.
+ * Tests a word at a time for zero bytes, a 00 00 pair always has a
+ * zero at an odd offset of some word, so checking p[1] and p[3] of a
+ * word that has one is enough.
+ */
+static const u8 *find_00_00_xx(const u8 *p, const u8 *end, u8 x)
 {
-	u8 *dst;
-	u32 i, len;
+	const u8 *a = p + 4 - ((unsigned long)p & 3);
+	u32 v;
 
-	dst = vmalloc(src_len + AV_INPUT_BUFFER_PADDING_SIZE);
-	if (!dst)
+	if (end - p < 3)
 		return NULL;
 
+	for (end -= 2; p < a && p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == x)
+			return p;
+	}
+
+	for (end -= 3; p < end; p += 4) {
+		memcpy(&v, p, sizeof(v));
+		if (!((v - 0x01010101) & (~v) & 0x80808080))
+			continue;
+		if (p[1] == 0) {
+			if (p[0] == 0 && p[2] == x)
+				return p;
+			if (p[2] == 0 && p[3] == x)
+				return p + 1;
+		}
+		if (p[3] == 0) {
+			if (p[2] == 0 && p[4] == x)
+				return p + 2;
+			if (p[4] == 0 && p[5] == x)
+				return p + 3;
+		}
+	}
+
+	for (end += 3; p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == x)
+			return p;
+	}
+
+	return NULL;
+}
+
+void nal_iter_init(struct nal_iter *it, const u8 *buf, int size)
+{
+	it->end = buf + (size > 0 ? size : 0);
+	it->sc = find_00_00_xx(buf, it->end, 1);
+}
+
+/*
+ * Next NAL unit of the buffer, in one pass over the data. *nal_len
+ * is what calc_nal_len() gives: up to the next 3 or 4 byte start
+ * code, or the rest of the buffer when that is in the last 4 bytes.
+ */
+const u8 *nal_iter_next(struct nal_iter *it, u32 *nal_len)
+{
+	const u8 *nal, *next;
+	int len, i;
+
+	if (!it->sc)
+		return NULL;
+
+	nal = it->sc + 3;
+	if (nal >= it->end) {
+		it->sc = NULL;
+		return NULL;
+	}
+
+	len = it->end - nal;
+	next = find_00_00_xx(nal, it->end, 1);
+	if (next) {
+		i = next - nal;
+		if (i > 0 && nal[i - 1] == 0)
+			i--;
+		if (i < len - 4)
+			len = i;
+		/* a start code right at the nal header is not a new unit */
+		if (next == nal)
+			next = find_00_00_xx(nal + 1, it->end, 1);
+	}
+	it->sc = next;
+	*nal_len = len;
+
+	return nal;
+}
+
+/*
+ * Drop the emulation_prevention_three_bytes of a NAL unit, dst may be
+ * src to unescape in place. dst needs src_len bytes, the caller adds
+ * AV_INPUT_BUFFER_PADDING_SIZE for the bit reader. Returns the rbsp size.
+ */
+u32 nal_unit_unescape_rbsp(const u8 *src, u32 src_len, u8 *dst)
+{
+	const u8 *end = src + src_len;
+	const u8 *p, *esc;
+	u32 len;
+
 	/* NAL unit header (2 bytes) */
-	i = len = 0;
-	while (i < 2 && i < src_len)
-		dst[len++] = src[i++];
+	len = min_t(u32, src_len, 2);
+	memmove(dst, src, len);
+	p = src + len;
+
+	while ((esc = find_00_00_xx(p, end, 3))) {
+		memmove(dst + len, p, esc + 2 - p);
+		len += esc + 2 - p;
+		p = esc + 3; // remove emulation_prevention_three_byte
+	}
+
+	memmove(dst + len, p, end - p);
+	len += end - p;
 
-	while (i + 2 < src_len)
-	if (!src[i] && !src[i + 1] && src[i + 2] == 3) {
-		dst[len++] = src[i++];
-		dst[len++] = src[i++];
-		i++; // remove emulation_prevention_three_byte
-	} else
-		dst[len++] = src[i++];
+	return len;
+}
 
-	while (i < src_len)
-		dst[len++] = src[i++];
+u8 *nal_unit_extract_rbsp(const u8 *src, u32 src_len, u32 *dst_len)
+{
+	u8 *dst;
+	u32 len;
+
+	dst = vmalloc(src_len + AV_INPUT_BUFFER_PADDING_SIZE);
+	if (!dst)
+		return NULL;
 
+	len = nal_unit_unescape_rbsp(src, src_len, dst);
 	memset(dst + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
 	*dst_len = len;
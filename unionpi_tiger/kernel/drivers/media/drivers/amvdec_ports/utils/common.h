@@ -79,8 +79,16 @@ const char *av_color_transfer_name(enum AVColorTransferCharacteristic transfer);
 int av_log2(u32 v);
 
 //bitstream
+struct nal_iter {
+	const u8 *end;
+	const u8 *sc;	/* next start code, NULL when done */
+};
+
 int find_start_code(u8 *data, int data_sz);
 int calc_nal_len(u8 *data, int len);
+void nal_iter_init(struct nal_iter *it, const u8 *buf, int size);
+const u8 *nal_iter_next(struct nal_iter *it, u32 *nal_len);
+u32 nal_unit_unescape_rbsp(const u8 *src, u32 src_len, u8 *dst);
 u8 *nal_unit_extract_rbsp(const u8 *src, u32 src_len, u32 *dst_len);
 
 //debug
@@ -69,6 +69,8 @@ enum vdec_fb_status {
  * GET_PARAM_PIC_INFO		: get picture info, struct vdec_pic_info*
  * GET_PARAM_CROP_INFO		: get crop info, struct v4l2_crop*
  * GET_PARAM_DPB_SIZE		: get dpb size, unsigned int*
+ * GET_PARAM_DISP_FRAME_BUFFERS	: get all displayable frame buffers, up to
+ *				VDEC_DISP_BATCH, struct vdec_disp_fbs*
  */
 enum vdec_get_param_type {
 	GET_PARAM_DISP_FRAME_BUFFER,
@@ -76,7 +78,8 @@ enum vdec_get_param_type {
 	GET_PARAM_PIC_INFO,
 	GET_PARAM_CROP_INFO,
 	GET_PARAM_DPB_SIZE,
-	GET_PARAM_CONFIG_INFO
+	GET_PARAM_CONFIG_INFO,
+	GET_PARAM_DISP_FRAME_BUFFERS
 };
 
 /*
@@ -34,6 +34,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/dma-map-ops.h>
 #include <linux/delay.h>
+#include <linux/mutex.h>
 
 #include <linux/amlogic/media/codec_mm/codec_mm.h>
 #include <linux/amlogic/media/codec_mm/codec_mm_scatter.h>
@@ -44,6 +45,7 @@
 #include "codec_mm_priv.h"
 #include "codec_mm_scatter_priv.h"
 #include "codec_mm_keeper_priv.h"
+#include "codec_mm_index.h"
 #include <linux/highmem.h>
 #include <linux/page-flags.h>
 #include <linux/vmalloc.h>
@@ -181,6 +183,7 @@ struct codec_mm_mgt_s {
 	struct cma *cma;
 	struct device *dev;
 	struct list_head mem_list;
+	struct codec_mm_index_s mem_index;
 	struct gen_pool *res_pool;
 	struct extpool_mgt_s tvp_pool;
 	struct extpool_mgt_s cma_res_pool;
@@ -353,18 +356,9 @@ static ulong codec_mm_search_phy_addr(char *vaddr)
 	unsigned long flags;
 
 	spin_lock_irqsave(&mgt->lock, flags);
-
-	list_for_each_entry(mem, &mgt->mem_list, list) {
-		if (vaddr - mem->vbuffer >= 0 &&
-			vaddr - mem->vbuffer < mem->buffer_size) {
-
-			if (mem->phy_addr)
-				phy_addr = mem->phy_addr +
-					(vaddr - mem->vbuffer);
-			break;
-		}
-	}
-
+	mem = codec_mm_index_find_va(&mgt->mem_index, vaddr);
+	if (mem && mem->phy_addr)
+		phy_addr = mem->phy_addr + (vaddr - mem->vbuffer);
 	spin_unlock_irqrestore(&mgt->lock, flags);
 
 	return phy_addr;
@@ -381,18 +375,9 @@ static void *codec_mm_search_vaddr(unsigned long phy_addr)
 		return phys_to_virt(phy_addr);
 
 	spin_lock_irqsave(&mgt->lock, flags);
-
-	list_for_each_entry(mem, &mgt->mem_list, list) {
-		if (phy_addr >= mem->phy_addr &&
-			phy_addr < mem->phy_addr + mem->buffer_size) {
-
-			if (mem->vbuffer)
-				vaddr = mem->vbuffer +
-					(phy_addr - mem->phy_addr);
-			break;
-		}
-	}
-
+	mem = codec_mm_index_find_phy(&mgt->mem_index, phy_addr);
+	if (mem && mem->vbuffer)
+		vaddr = mem->vbuffer + (phy_addr - mem->phy_addr);
 	spin_unlock_irqrestore(&mgt->lock, flags);
 
 	return vaddr;
@@ -853,6 +838,7 @@ struct codec_mm_s *codec_mm_alloc(const char *owner, int size,
 	spin_lock_irqsave(&mgt->lock, flags);
 	mem->mem_id = mgt->global_memid++;
 	list_add_tail(&mem->list, &mgt->mem_list);
+	codec_mm_index_add(&mgt->mem_index, mem);
 	switch (mem->from_flags) {
 	case AMPORTS_MEM_FLAGS_FROM_GET_FROM_PAGES:
 		mgt->alloced_sys_size += mem->buffer_size;
@@ -928,6 +914,7 @@ void codec_mm_release(struct codec_mm_s *mem, const char *owner)
 	mem->owner[index] = NULL;
 	if (index == 0) {
 		list_del(&mem->list);
+		codec_mm_index_del(&mgt->mem_index, mem);
 		spin_unlock_irqrestore(&mgt->lock, flags);
 		codec_mm_free_in(mgt, mem);
 		kfree(mem);
@@ -1802,6 +1789,7 @@ struct codec_mm_s *v4l_reqbufs_from_codec_mm(const char *owner,
 	mgt->total_alloced_size += buf_size;
 	mgt->alloced_cma_size += buf_size;
 	list_add_tail(&mem->list, &mgt->mem_list);
+	codec_mm_index_add(&mgt->mem_index, mem);
 
 	spin_unlock_irqrestore(&mgt->lock, flags);
 
@@ -1831,6 +1819,7 @@ void v4l_freebufs_back_to_codec_mm(const char *owner, struct codec_mm_s *mem)
 	mgt->total_alloced_size -= mem->buffer_size;
 	mgt->alloced_cma_size -= mem->buffer_size;
 	list_del(&mem->list);
+	codec_mm_index_del(&mgt->mem_index, mem);
 
 	spin_unlock_irqrestore(&mgt->lock, flags);
 
@@ -1873,6 +1862,7 @@ int codec_mm_mgt_init(struct device *dev)
 	struct codec_mm_mgt_s *mgt = get_mem_mgt();
 
 	INIT_LIST_HEAD(&mgt->mem_list);
+	codec_mm_index_init(&mgt->mem_index);
 	mgt->dev = dev;
 	mgt->alloc_from_sys_pages_max = 4;
 	if (mgt->rmem.size > 0) {
@@ -2326,6 +2316,76 @@ static ssize_t debug_store(struct class *class,
 
 }
 
+static LIST_HEAD(codec_mm_selftest_list);
+static DEFINE_MUTEX(codec_mm_selftest_mutex);
+/*held while a test runs, one at a time.*/
+static DEFINE_MUTEX(codec_mm_selftest_run_mutex);
+
+void codec_mm_selftest_register(struct codec_mm_selftest_s *test)
+{
+	mutex_lock(&codec_mm_selftest_mutex);
+	list_add_tail(&test->list, &codec_mm_selftest_list);
+	mutex_unlock(&codec_mm_selftest_mutex);
+}
+EXPORT_SYMBOL(codec_mm_selftest_register);
+
+/*waits for a running test of the caller's module to finish.*/
+void codec_mm_selftest_unregister(struct codec_mm_selftest_s *test)
+{
+	mutex_lock(&codec_mm_selftest_run_mutex);
+	mutex_lock(&codec_mm_selftest_mutex);
+	list_del(&test->list);
+	mutex_unlock(&codec_mm_selftest_mutex);
+	mutex_unlock(&codec_mm_selftest_run_mutex);
+}
+EXPORT_SYMBOL(codec_mm_selftest_unregister);
+
+static ssize_t selftest_show(struct class *class,
+		struct class_attribute *attr, char *buf)
+{
+	struct codec_mm_selftest_s *test;
+	ssize_t size = 0;
+
+	mutex_lock(&codec_mm_selftest_mutex);
+	list_for_each_entry(test, &codec_mm_selftest_list, list)
+		size += snprintf(buf + size, PAGE_SIZE - size, "%s\n",
+			test->name);
+	mutex_unlock(&codec_mm_selftest_mutex);
+	return size;
+}
+
+static ssize_t selftest_store(struct class *class,
+		struct class_attribute *attr,
+		const char *buf, size_t size)
+{
+	struct codec_mm_selftest_s *test, *found = NULL;
+	const char *args;
+	size_t len;
+	int ret = -EINVAL;
+
+	buf = skip_spaces(buf);
+	len = strcspn(buf, " \t\n");
+	args = skip_spaces(buf + len);
+	/*keeps the test registered, the list stays free for the others.*/
+	if (!mutex_trylock(&codec_mm_selftest_run_mutex))
+		return -EBUSY;
+	mutex_lock(&codec_mm_selftest_mutex);
+	list_for_each_entry(test, &codec_mm_selftest_list, list) {
+		if (strlen(test->name) == len &&
+			!strncmp(test->name, buf, len)) {
+			found = test;
+			break;
+		}
+	}
+	mutex_unlock(&codec_mm_selftest_mutex);
+	if (found)
+		ret = found->run(args);
+	else
+		pr_err("unknown self test %.*s\n", (int)len, buf);
+	mutex_unlock(&codec_mm_selftest_run_mutex);
+	return ret < 0 ? ret : size;
+}
+
 static ssize_t debug_sc_mode_show(struct class *class,
 				  struct class_attribute *attr, char *buf)
 {
@@ -2388,6 +2448,7 @@ static CLASS_ATTR_RW(tvp_enable);
 static CLASS_ATTR_RW(fastplay_enable);
 static CLASS_ATTR_RW(config);
 static CLASS_ATTR_RW(debug);
+static CLASS_ATTR_RW(selftest);
 //static CLASS_ATTR_RW(debug_mode);
 static CLASS_ATTR_RW(debug_sc_mode);
 static CLASS_ATTR_RW(debug_keep_mode);
@@ -2401,6 +2462,7 @@ static struct attribute *codec_mm_class_attrs[] = {
 	&class_attr_fastplay_enable.attr,
 	&class_attr_config.attr,
 	&class_attr_debug.attr,
+	&class_attr_selftest.attr,
 	//&class_attr_debug_mode.attr,
 	&class_attr_debug_sc_mode.attr,
 	&class_attr_debug_keep_mode.attr,
@@ -2510,12 +2572,23 @@ static int codec_mm_probe(struct platform_device *pdev)
 	codec_mm_keeper_mgr_init();
 	amstream_test_init();
 	codec_mm_scatter_mgt_test();
+	codec_mm_selftest_register(&codec_mm_scatter_slot_selftest);
+	codec_mm_selftest_register(&codec_mm_index_selftest);
 	REG_PATH_CONFIGS(CONFIG_PATH, codec_mm_configs);
 	INIT_REG_NODE_CONFIGS(CONFIG_PATH, &codec_mm_trigger_node,
 		"trigger", codec_mm_trigger, CONFIG_FOR_RW | CONFIG_FOR_T);
 	return 0;
 }
 
+static int codec_mm_remove(struct platform_device *pdev)
+{
+	codec_mm_selftest_unregister(&codec_mm_index_selftest);
+	codec_mm_selftest_unregister(&codec_mm_scatter_slot_selftest);
+	codec_mm_scatter_mgt_exit();
+	class_unregister(&codec_mm_class);
+	return 0;
+}
+
 static const struct of_device_id amlogic_mem_dt_match[] = {
 	{
 			.compatible = "amlogic, codec, mm",
@@ -2525,7 +2598,7 @@ static const struct of_device_id amlogic_mem_dt_match[] = {
 
 static struct platform_driver codec_mm_driver = {
 	.probe = codec_mm_probe,
-	.remove = NULL,
+	.remove = codec_mm_remove,
 	.driver = {
 			.owner = THIS_MODULE,
 			.name = "codec_mm",
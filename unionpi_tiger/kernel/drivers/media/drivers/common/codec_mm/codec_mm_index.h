@@ -0,0 +1,114 @@
+/*
+ * drivers/amlogic/media/common/codec_mm/codec_mm_index.h
+ *
+ * Copyright (C) 2017 Amlogic, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ */
+
+#ifndef CODEC_MM_INDEX_PRIV_HEADER
+#define CODEC_MM_INDEX_PRIV_HEADER
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/interval_tree_generic.h>
+#include <linux/amlogic/media/codec_mm/codec_mm.h>
+
+/*
+ *Every live codec_mm_s is kept in two interval trees,
+ *[phy_addr, phy_addr + size) and [vbuffer, vbuffer + size),
+ *so address searches don't walk mem_list.
+ *All helpers must be called with the owner's lock held.
+ */
+struct codec_mm_index_s {
+	struct rb_root_cached phy_tree;
+	struct rb_root_cached va_tree;
+};
+
+#define CODEC_MM_PHY_START(mem) ((mem)->phy_addr)
+#define CODEC_MM_PHY_LAST(mem) ((mem)->phy_addr + (mem)->buffer_size - 1)
+#define CODEC_MM_VA_START(mem) ((ulong)(mem)->vbuffer)
+#define CODEC_MM_VA_LAST(mem) ((ulong)(mem)->vbuffer + (mem)->buffer_size - 1)
+
+INTERVAL_TREE_DEFINE(struct codec_mm_s, phy_node, ulong, phy_subtree_last,
+	CODEC_MM_PHY_START, CODEC_MM_PHY_LAST, static inline, codec_mm_phy_it)
+INTERVAL_TREE_DEFINE(struct codec_mm_s, va_node, ulong, va_subtree_last,
+	CODEC_MM_VA_START, CODEC_MM_VA_LAST, static inline, codec_mm_va_it)
+
+static inline void codec_mm_index_init(struct codec_mm_index_s *index)
+{
+	index->phy_tree = RB_ROOT_CACHED;
+	index->va_tree = RB_ROOT_CACHED;
+}
+
+/*phy_addr, vbuffer and buffer_size must not change while indexed.*/
+static inline void codec_mm_index_add(struct codec_mm_index_s *index,
+	struct codec_mm_s *mem)
+{
+	RB_CLEAR_NODE(&mem->phy_node);
+	RB_CLEAR_NODE(&mem->va_node);
+	if (mem->buffer_size <= 0)
+		return;
+	if (mem->phy_addr)
+		codec_mm_phy_it_insert(mem, &index->phy_tree);
+	if (mem->vbuffer)
+		codec_mm_va_it_insert(mem, &index->va_tree);
+}
+
+static inline void codec_mm_index_del(struct codec_mm_index_s *index,
+	struct codec_mm_s *mem)
+{
+	if (!RB_EMPTY_NODE(&mem->phy_node)) {
+		codec_mm_phy_it_remove(mem, &index->phy_tree);
+		RB_CLEAR_NODE(&mem->phy_node);
+	}
+	if (!RB_EMPTY_NODE(&mem->va_node)) {
+		codec_mm_va_it_remove(mem, &index->va_tree);
+		RB_CLEAR_NODE(&mem->va_node);
+	}
+}
+
+/*
+ *Ranges may nest (tvp and cma_res pools hand out parts of a
+ *codec_mm_s), so pick the oldest match: that is the entry the
+ *mem_list walk used to find first.
+ */
+static inline struct codec_mm_s *codec_mm_index_find_phy(
+	struct codec_mm_index_s *index, ulong phy_addr)
+{
+	struct codec_mm_s *mem, *found = NULL;
+
+	mem = codec_mm_phy_it_iter_first(&index->phy_tree,
+		phy_addr, phy_addr);
+	for (; mem; mem = codec_mm_phy_it_iter_next(mem, phy_addr, phy_addr)) {
+		if (!found || mem->mem_id < found->mem_id)
+			found = mem;
+	}
+	return found;
+}
+
+static inline struct codec_mm_s *codec_mm_index_find_va(
+	struct codec_mm_index_s *index, const char *vaddr)
+{
+	struct codec_mm_s *mem, *found = NULL;
+	ulong va = (ulong)vaddr;
+
+	mem = codec_mm_va_it_iter_first(&index->va_tree, va, va);
+	for (; mem; mem = codec_mm_va_it_iter_next(mem, va, va)) {
+		if (!found || mem->mem_id < found->mem_id)
+			found = mem;
+	}
+	return found;
+}
+
+extern struct codec_mm_selftest_s codec_mm_index_selftest;
+
+#endif
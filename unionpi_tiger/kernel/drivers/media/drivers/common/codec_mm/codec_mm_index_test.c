@@ -0,0 +1,179 @@
+/*
+ * drivers/amlogic/media/common/codec_mm/codec_mm_index_test.c
+ *
+ * Copyright (C) 2017 Amlogic, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/prandom.h>
+#include <linux/sched.h>
+
+#include "codec_mm_index.h"
+
+/*
+ *Fuzz the codec_mm address index against the mem_list walk it
+ *replaced. Entries are fake codec_mm_s with made up addresses, they
+ *never touch real memory, so this is safe on a running system:
+ *	echo "codec_mm_index <rounds> <seed>" > /sys/class/codec_mm/selftest
+ */
+#define INDEX_TEST_SLOTS 256
+#define INDEX_TEST_PAGES 4096
+#define INDEX_TEST_PHY_BASE 0x10000000UL
+#define INDEX_TEST_VA_BASE 0x40000000UL
+
+static struct codec_mm_s *list_find_phy(struct list_head *head,
+	ulong phy_addr)
+{
+	struct codec_mm_s *mem;
+
+	list_for_each_entry(mem, head, list) {
+		if (phy_addr >= mem->phy_addr &&
+			phy_addr < mem->phy_addr + mem->buffer_size)
+			return mem;
+	}
+	return NULL;
+}
+
+static struct codec_mm_s *list_find_va(struct list_head *head,
+	char *vaddr)
+{
+	struct codec_mm_s *mem;
+
+	list_for_each_entry(mem, head, list) {
+		if (vaddr - mem->vbuffer >= 0 &&
+			vaddr - mem->vbuffer < mem->buffer_size)
+			return mem;
+	}
+	return NULL;
+}
+
+static void index_test_fill(struct codec_mm_s *mem,
+	struct rnd_state *rnd, int mem_id)
+{
+	u32 r = prandom_u32_state(rnd);
+
+	memset(mem, 0, sizeof(*mem));
+	mem->mem_id = mem_id;
+	mem->page_count = 1 + (r & 0xf);
+	/*a few big ones, so ranges nest like the tvp pool*/
+	if (((r >> 4) & 0x1f) == 0)
+		mem->page_count <<= 6;
+	mem->buffer_size = mem->page_count * PAGE_SIZE;
+	r = prandom_u32_state(rnd);
+	/*1/8 without phy, 1/8 without vbuffer*/
+	if (r & 7)
+		mem->phy_addr = INDEX_TEST_PHY_BASE +
+			(ulong)((r >> 8) % INDEX_TEST_PAGES) * PAGE_SIZE;
+	r = prandom_u32_state(rnd);
+	if (r & 7)
+		mem->vbuffer = (char *)(INDEX_TEST_VA_BASE +
+			(ulong)((r >> 8) % INDEX_TEST_PAGES) * PAGE_SIZE);
+}
+
+static int codec_mm_index_test(int rounds, u32 seed)
+{
+	struct codec_mm_s *mems;
+	struct codec_mm_index_s index;
+	struct rnd_state rnd;
+	LIST_HEAD(head);
+	u64 list_ns = 0, tree_ns = 0, t;
+	int live = 0, lookups = 0, errors = 0;
+	int next_id = 0;
+	int i;
+
+	if (rounds <= 0)
+		rounds = 10000;
+	mems = kcalloc(INDEX_TEST_SLOTS, sizeof(*mems), GFP_KERNEL);
+	if (!mems)
+		return -ENOMEM;
+	codec_mm_index_init(&index);
+	prandom_seed_state(&rnd, seed);
+
+	for (i = 0; i < rounds && errors < 16; i++) {
+		u32 r = prandom_u32_state(&rnd);
+		struct codec_mm_s *mem = &mems[(r >> 8) % INDEX_TEST_SLOTS];
+		struct codec_mm_s *a, *b;
+		ulong addr;
+
+		if ((r & 3) == 0) {
+			/*alloc or free one slot*/
+			if (mem->buffer_size) {
+				list_del(&mem->list);
+				codec_mm_index_del(&index, mem);
+				mem->buffer_size = 0;
+				live--;
+			} else {
+				index_test_fill(mem, &rnd, next_id++);
+				list_add_tail(&mem->list, &head);
+				codec_mm_index_add(&index, mem);
+				live++;
+			}
+			continue;
+		}
+
+		r = prandom_u32_state(&rnd);
+		addr = (r >> 1) % ((INDEX_TEST_PAGES + 1024) * PAGE_SIZE);
+		lookups++;
+		if (r & 1) {
+			addr += INDEX_TEST_PHY_BASE;
+			t = ktime_get_ns();
+			a = list_find_phy(&head, addr);
+			list_ns += ktime_get_ns() - t;
+			t = ktime_get_ns();
+			b = codec_mm_index_find_phy(&index, addr);
+			tree_ns += ktime_get_ns() - t;
+		} else {
+			addr += INDEX_TEST_VA_BASE;
+			t = ktime_get_ns();
+			a = list_find_va(&head, (char *)addr);
+			list_ns += ktime_get_ns() - t;
+			t = ktime_get_ns();
+			b = codec_mm_index_find_va(&index, (char *)addr);
+			tree_ns += ktime_get_ns() - t;
+		}
+		if (a != b) {
+			errors++;
+			pr_err("index test: %s %lx list id %d tree id %d\n",
+				(r & 1) ? "phy" : "va", addr,
+				a ? a->mem_id : -1, b ? b->mem_id : -1);
+		}
+		if ((i & 1023) == 0)
+			cond_resched();
+	}
+
+	pr_info("index test: seed %u, %d rounds, %d live, %d lookups, %d errors\n",
+		seed, i, live, lookups, errors);
+	if (lookups)
+		pr_info("index test: list %llu ns/lookup, tree %llu ns/lookup\n",
+			div_u64(list_ns, lookups), div_u64(tree_ns, lookups));
+	kfree(mems);
+	return errors ? -EINVAL : 0;
+}
+
+/*"<rounds> <seed>"*/
+static int codec_mm_index_selftest_run(const char *args)
+{
+	int rounds = 0;
+	u32 seed = 0;
+
+	sscanf(args, "%d %u", &rounds, &seed);
+	return codec_mm_index_test(rounds, seed);
+}
+
+struct codec_mm_selftest_s codec_mm_index_selftest = {
+	.name = "codec_mm_index",
+	.run = codec_mm_index_selftest_run,
+};
@@ -40,6 +40,9 @@
 #include <linux/amlogic/media/codec_mm/configs.h>
 #include <linux/completion.h>
 #include <linux/sched/clock.h>
+#include <linux/hashtable.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "codec_mm_priv.h"
 #include "codec_mm_scatter_priv.h"
@@ -73,6 +76,15 @@
 #define HASH_PAGE_ADDR(paddr) (ADDR_SEED(paddr) % MAX_SID)
 #define SLOT_TO_SID(slot)	HASH_PAGE_ADDR(((slot->phy_addr)>>PAGE_SHIFT))
 
+/*
+*slot lookup hash, keyed by phy chunk:
+*a slot is linked in every chunk it covers.
+*/
+#define SLOT_HASH_BITS 10
+#define SLOT_HASH_CHUNK_SHIFT (PAGE_SHIFT + 5)
+#define SLOT_HASH_KEY(addr) ((ulong)(addr) >> SLOT_HASH_CHUNK_SHIFT)
+#define SLOT_PROBE_HIST_NUM 6
+
 #define ONE_PAGE_SID (SID_MASK)
 #define PAGE_SID(mm_page)  (page_sid_type)((mm_page) & SID_MASK)
 #define PAGE_ADDR(mm_page) (ulong)(((mm_page) >> MAX_ADDR_SHIFT)\
@@ -137,6 +149,7 @@ struct codec_mm_scatter_s {
 struct codec_mm_scatter_mgt {
 	unsigned int tag;/*=*/
 	struct codec_mm_slot *slot_list_map[MAX_SID];
+	DECLARE_HASHTABLE(slot_hash, SLOT_HASH_BITS);
 	int tvp_mode;
 	int codec_mm_num;
 	int total_page_num;
@@ -189,6 +202,13 @@ struct codec_mm_scatter_mgt {
 	int free_1_10ms_cnt;
 	int free_10_100ms_cnt;
 	int free_100ms_up_cnt;
+/*slot lookup states*/
+	u64 slot_find_cnt;
+	u64 slot_find_probes;
+	u32 slot_find_probe_max;
+	u32 slot_find_miss;
+	/*probes: 1, 2, 3-4, 5-8, 9-16, 17+*/
+	u32 slot_find_probe_hist[SLOT_PROBE_HIST_NUM];
 
 	struct delayed_work dealy_work;
 	int scatter_task_run_num;
@@ -441,6 +461,15 @@ static void codec_mm_clear_alloc_infos_in(
 	smgt->free_100ms_up_cnt = 0;
 	smgt->free_total_us = 0;
 	smgt->free_max_us = 0;
+
+	codec_mm_list_lock(smgt);
+	smgt->slot_find_cnt = 0;
+	smgt->slot_find_probes = 0;
+	smgt->slot_find_probe_max = 0;
+	smgt->slot_find_miss = 0;
+	memset(smgt->slot_find_probe_hist, 0,
+		sizeof(smgt->slot_find_probe_hist));
+	codec_mm_list_unlock(smgt);
 }
 void codec_mm_clear_alloc_infos(void)
 {
@@ -493,6 +522,8 @@ static int codec_mm_set_slot_in_hash(
 {
 
 	page_sid_type sid = SLOT_TO_SID(slot);
+	ulong key = SLOT_HASH_KEY(slot->phy_addr);
+	int i;
 
 	if (sid > MAX_SID) {
 		ERR_LOG("ERROR sid %d", sid);
@@ -502,6 +533,10 @@ static int codec_mm_set_slot_in_hash(
 	INIT_LIST_HEAD(&slot->sid_list);
 	INIT_LIST_HEAD(&slot->free_list);
 	codec_mm_list_lock(smgt);
+	for (i = 0; i < slot->hnode_num; i++) {
+		slot->hnodes[i].slot = slot;
+		hash_add(smgt->slot_hash, &slot->hnodes[i].node, key + i);
+	}
 	if (!smgt->slot_list_map[sid]) {
 		smgt->slot_list_map[sid] = slot;
 		slot->isroot = 1;
@@ -526,9 +561,66 @@ static int codec_mm_set_slot_in_hash(
 	return 0;
 }
 
+static inline void codec_mm_slot_probe_stat(
+	struct codec_mm_scatter_mgt *smgt,
+	int probes, int found)
+{
+	int i = 0;
+
+	smgt->slot_find_cnt++;
+	smgt->slot_find_probes += probes;
+	if (probes > smgt->slot_find_probe_max)
+		smgt->slot_find_probe_max = probes;
+	if (!found)
+		smgt->slot_find_miss++;
+	while (i < SLOT_PROBE_HIST_NUM - 1 && probes > (1 << i))
+		i++;
+	smgt->slot_find_probe_hist[i]++;
+}
+
 static struct codec_mm_slot *codec_mm_find_slot_in_hash(
 	struct codec_mm_scatter_mgt *smgt,
 	page_sid_type sid, ulong addr)
+{
+	struct codec_mm_slot_hnode *hn;
+	struct codec_mm_slot *slot = NULL;
+	int probes = 0;
+
+	if (!VALID_SID(sid) || SID_OF_ONEPAGE(sid))
+		return NULL;
+	codec_mm_list_lock(smgt);
+	hash_for_each_possible(smgt->slot_hash, hn, node,
+		SLOT_HASH_KEY(addr)) {
+		probes++;
+		if (addr >= hn->slot->phy_addr &&
+			addr < (hn->slot->phy_addr +
+			(hn->slot->page_num << PAGE_SHIFT))) {
+			slot = hn->slot;
+			break;
+		}
+	}
+	codec_mm_slot_probe_stat(smgt, probes, slot != NULL);
+	codec_mm_list_unlock(smgt);
+	if (!slot) {
+		ERR_LOG("can't find valid slot, for addr =%p\n",
+			(void *)addr);
+		return NULL;
+	}
+	if (slot->sid != sid) {
+		ERR_LOG("slot sid %d not match page sid %d, addr =%p\n",
+			slot->sid, (int)sid, (void *)addr);
+		return NULL;
+	}
+	return slot;
+}
+
+/*
+*the sid chain walk used before the slot hash,
+*only kept for the lookup benchmark.
+*/
+static struct codec_mm_slot *codec_mm_find_slot_in_sid_list(
+	struct codec_mm_scatter_mgt *smgt,
+	page_sid_type sid, ulong addr)
 {
 	struct codec_mm_slot *fslot, *slot;
 
@@ -542,7 +634,7 @@ static struct codec_mm_slot *codec_mm_find_slot_in_hash(
 		goto err;
 	}
 	slot = fslot;
-	while (!(addr >= slot->phy_addr &&	/*optimization with hash? */
+	while (!(addr >= slot->phy_addr &&
 			 addr <
 			 (slot->phy_addr +
 			(slot->page_num << PAGE_SHIFT)))) {
@@ -574,6 +666,7 @@ static int codec_mm_slot_free(
 	struct codec_mm_slot *slot)
 {
 	int ret = 0;
+	int i;
 
 	codec_mm_list_lock(smgt);
 	if (slot->alloced_page_num > 0 || slot->on_alloc_free) {
@@ -582,6 +675,8 @@ static int codec_mm_slot_free(
 	}
 	if (!list_empty(&slot->free_list))
 		list_del(&slot->free_list);
+	for (i = 0; i < slot->hnode_num; i++)
+		hash_del(&slot->hnodes[i].node);
 	if (!list_empty(&slot->sid_list)) {
 		if (slot->isroot) {
 			struct codec_mm_slot *next_slot;
@@ -624,6 +719,7 @@ static int codec_mm_slot_free(
 	}
 
 	kfree(slot->pagemap);
+	kfree(slot->hnodes);
 	kfree(slot);
 	return 0;
 }
@@ -659,6 +755,32 @@ static inline int codec_mm_slot_init_bitmap(struct codec_mm_slot *slot)
 	return 0;
 }
 
+static inline int codec_mm_slot_init_hnodes(struct codec_mm_slot *slot)
+{
+	ulong first = SLOT_HASH_KEY(slot->phy_addr);
+	ulong last = SLOT_HASH_KEY(slot->phy_addr +
+		((ulong)slot->page_num << PAGE_SHIFT) - 1);
+
+	slot->hnode_num = last - first + 1;
+	slot->hnodes = kcalloc(slot->hnode_num,
+		sizeof(struct codec_mm_slot_hnode), GFP_KERNEL);
+	if (!slot->hnodes) {
+		ERR_LOG("ERROR.init slot hash nodes failed\n");
+		slot->hnode_num = 0;
+		return -1;
+	}
+	return 0;
+}
+
+static inline void codec_mm_slot_free_maps(struct codec_mm_slot *slot)
+{
+	kfree(slot->pagemap);
+	slot->pagemap = NULL;
+	kfree(slot->hnodes);
+	slot->hnodes = NULL;
+	slot->hnode_num = 0;
+}
+
 /*
 *flags : 1. don't used codecmm.
 */
@@ -705,7 +827,10 @@ static struct codec_mm_slot *codec_mm_slot_alloc(
 				slot->page_num = mm->page_count;
 				slot->phy_addr = mm->phy_addr;
 				codec_mm_slot_init_bitmap(slot);
-				if (slot->pagemap == NULL) {
+				codec_mm_slot_init_hnodes(slot);
+				if (slot->pagemap == NULL ||
+					slot->hnodes == NULL) {
+					codec_mm_slot_free_maps(slot);
 					codec_mm_release(mm, SCATTER_MEM);
 					break;	/*try next. */
 				}
@@ -768,7 +893,9 @@ static struct codec_mm_slot *codec_mm_slot_alloc(
 		slot->phy_addr =
 			virt_to_phys((unsigned long *)slot->page_header);
 		codec_mm_slot_init_bitmap(slot);
-		if (slot->pagemap == NULL) {
+		codec_mm_slot_init_hnodes(slot);
+		if (slot->pagemap == NULL || slot->hnodes == NULL) {
+			codec_mm_slot_free_maps(slot);
 			free_pages(slot->page_header, page_order);
 			goto error;
 		}
@@ -2817,6 +2944,7 @@ static int codec_mm_scatter_mgt_alloc_in(struct codec_mm_scatter_mgt **psmgt)
 	}
 	memset(smgt, 0, sizeof(struct codec_mm_scatter_mgt));
 	spin_lock_init(&smgt->list_lock);
+	hash_init(smgt->slot_hash);
 	smgt->tag = SMGT_IDENTIFY_TAG;
 	smgt->alloced_page_num = 0;
 	smgt->try_alloc_in_cma_page_cnt = (16 * 1024 * 1024) / PAGE_SIZE;
@@ -2866,6 +2994,67 @@ static struct mconfig codec_mm_sc_configs[] = {
 
 static struct mconfig_node codec_mm_sc;
 
+static void codec_mm_slot_lookup_show_in(struct seq_file *m,
+	struct codec_mm_scatter_mgt *smgt)
+{
+	u64 cnt, probes;
+	u32 hist[SLOT_PROBE_HIST_NUM];
+	u32 max, miss;
+
+	if (!smgt)
+		return;
+	codec_mm_list_lock(smgt);
+	cnt = smgt->slot_find_cnt;
+	probes = smgt->slot_find_probes;
+	max = smgt->slot_find_probe_max;
+	miss = smgt->slot_find_miss;
+	memcpy(hist, smgt->slot_find_probe_hist, sizeof(hist));
+	codec_mm_list_unlock(smgt);
+
+	seq_printf(m, "%sscatter slot lookup:\n",
+		smgt->tvp_mode ? "TVP " : "");
+	seq_printf(m, "\tslots:%d, hash chunk:%d pages\n",
+		smgt->slot_cnt, 1 << (SLOT_HASH_CHUNK_SHIFT - PAGE_SHIFT));
+	seq_printf(m, "\tlookups:%llu, miss:%u\n", cnt, miss);
+	seq_printf(m, "\tprobes total:%llu, average(x100):%llu, max:%u\n",
+		probes, cnt ? div64_u64(probes * 100, cnt) : 0, max);
+	seq_printf(m, "\tprobe step 1:%u 2:%u 3-4:%u 5-8:%u 9-16:%u 17+:%u\n",
+		hist[0], hist[1], hist[2], hist[3], hist[4], hist[5]);
+}
+
+static int slot_lookup_show(struct seq_file *m, void *v)
+{
+	codec_mm_slot_lookup_show_in(m, codec_mm_get_scatter_mgt(0));
+	codec_mm_slot_lookup_show_in(m, codec_mm_get_scatter_mgt(1));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(slot_lookup);
+
+static struct dentry *codec_mm_scatter_debugfs_root;
+
+static int codec_mm_scatter_init_debugfs(void)
+{
+	struct dentry *root, *lookup;
+
+	root = debugfs_create_dir("codec_mm_scatter", NULL);
+	if (IS_ERR_OR_NULL(root))
+		goto err;
+
+	lookup = debugfs_create_file("slot_lookup", 0400, root, NULL,
+			&slot_lookup_fops);
+	if (IS_ERR_OR_NULL(lookup))
+		goto err_1;
+
+	codec_mm_scatter_debugfs_root = root;
+	return 0;
+
+err_1:
+	debugfs_remove(root);
+err:
+	ERR_LOG("Can not create debugfs for codec_mm_scatter\n");
+	return 0;
+}
+
 int codec_mm_scatter_mgt_init(void)
 {
 	struct codec_mm_scatter_mgt *smgt;
@@ -2890,9 +3079,16 @@ int codec_mm_scatter_mgt_init(void)
 		&codec_mm_sc, "scatter",
 		codec_mm_sc_configs,
 		CONFIG_FOR_RW);
+	codec_mm_scatter_init_debugfs();
 	return 0;
 }
 
+void codec_mm_scatter_mgt_exit(void)
+{
+	debugfs_remove_recursive(codec_mm_scatter_debugfs_root);
+	codec_mm_scatter_debugfs_root = NULL;
+}
+
 int codec_mm_scatter_mgt_test(void)
 {
 #if 0
@@ -2964,6 +3160,97 @@ int codec_mm_scatter_mgt_test(void)
 }
 EXPORT_SYMBOL(codec_mm_scatter_mgt_test);
 
+/*
+*alloc page_num scattered pages, look every page up through the
+*sid chain walk and through the slot hash, then free them all.
+*/
+static int codec_mm_scatter_slot_bench(int page_num, int rounds)
+{
+	struct codec_mm_scatter_mgt *smgt;
+	struct codec_mm_scatter *mms;
+	u64 t, sid_ns, hash_ns, free_ns;
+	int lookups = 0, errors = 0;
+	int i, r, n;
+
+	if (page_num <= 0)
+		page_num = 8192;
+	if (rounds <= 0)
+		rounds = 4;
+	mms = codec_mm_scatter_alloc(page_num, page_num, 0);
+	if (!mms) {
+		ERR_LOG("slot bench alloc %d pages failed\n", page_num);
+		return -ENOMEM;
+	}
+	smgt = (struct codec_mm_scatter_mgt *)mms->manager;
+	n = mms->page_cnt;
+
+	for (i = 0; i < n; i++) {
+		page_sid_type sid = PAGE_SID_OF_MMS(mms, i);
+		ulong addr = PAGE_ADDR_OF_MMS(mms, i);
+
+		if (SID_OF_ONEPAGE(sid))
+			continue;
+		lookups++;
+		if (codec_mm_find_slot_in_sid_list(smgt, sid, addr) !=
+			codec_mm_find_slot_in_hash(smgt, sid, addr))
+			errors++;
+	}
+
+	t = local_clock();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < n; i++) {
+			page_sid_type sid = PAGE_SID_OF_MMS(mms, i);
+
+			if (!SID_OF_ONEPAGE(sid))
+				codec_mm_find_slot_in_sid_list(smgt, sid,
+					PAGE_ADDR_OF_MMS(mms, i));
+		}
+	}
+	sid_ns = local_clock() - t;
+
+	t = local_clock();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < n; i++) {
+			page_sid_type sid = PAGE_SID_OF_MMS(mms, i);
+
+			if (!SID_OF_ONEPAGE(sid))
+				codec_mm_find_slot_in_hash(smgt, sid,
+					PAGE_ADDR_OF_MMS(mms, i));
+		}
+	}
+	hash_ns = local_clock() - t;
+
+	t = local_clock();
+	codec_mm_scatter_free_tail_pages(mms, 0);
+	free_ns = local_clock() - t;
+	codec_mm_scatter_free_on_nouser(smgt, mms);
+
+	INFO_LOG("slot bench: %d pages, %d slots, %d lookups, %d errors\n",
+		n, smgt->slot_cnt, lookups, errors);
+	if (lookups > 0) {
+		INFO_LOG("slot bench: sid walk %llu ns, hash %llu ns per lookup\n",
+			div_u64(sid_ns, lookups * rounds),
+			div_u64(hash_ns, lookups * rounds));
+		INFO_LOG("slot bench: free %d pages in %llu us\n",
+			n, div_u64(free_ns, NSEC_PER_USEC));
+	}
+	return errors ? -EINVAL : 0;
+}
+
+/*"<pages> <rounds>"*/
+static int codec_mm_scatter_slot_selftest_run(const char *args)
+{
+	int page_num = 0, rounds = 0;
+
+	sscanf(args, "%d %d", &page_num, &rounds);
+	return codec_mm_scatter_slot_bench(page_num, rounds);
+}
+
+struct codec_mm_selftest_s codec_mm_scatter_slot_selftest = {
+	.name = "codec_mm_scatter_slot",
+	.run = codec_mm_scatter_slot_selftest_run,
+};
+
 /*
 *mode:0,dump, 1,alloc 2,more,3,free some,4,free all
 *0:dump ALL
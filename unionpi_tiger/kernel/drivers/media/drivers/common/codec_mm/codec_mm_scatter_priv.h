@@ -22,6 +22,12 @@
 #include <linux/amlogic/media/codec_mm/codec_mm.h>
 #include <linux/amlogic/media/codec_mm/codec_mm_scatter.h>
 
+struct codec_mm_slot;
+struct codec_mm_slot_hnode {
+	struct hlist_node node;
+	struct codec_mm_slot *slot;
+};
+
 struct codec_mm_slot {
 	struct codec_mm_s *mm;
 	unsigned long page_header;
@@ -40,11 +46,15 @@ struct codec_mm_slot {
 	spinlock_t lock;
 	struct list_head sid_list;
 	struct list_head free_list;
+	/*one node for every phy hash chunk the slot covers.*/
+	struct codec_mm_slot_hnode *hnodes;
+	int hnode_num;
 };
 
 int codec_mm_dump_slot(struct codec_mm_slot *slot, void *buf, int size);
 
 int codec_mm_scatter_mgt_init(void);
+void codec_mm_scatter_mgt_exit(void);
 int codec_mm_scatter_mgt_test(void);
 
 int codec_mm_scatter_info_dump(void *buf, int size);
@@ -54,6 +64,7 @@ int codec_mm_dump_all_scatters(void);
 
 int codec_mm_scatter_mgt_test(void);
 int codec_mm_scatter_test(int mode, int p1, int p2);
+extern struct codec_mm_selftest_s codec_mm_scatter_slot_selftest;
 int codec_mm_dump_all_hash_table(void);
 
 int codec_mm_scatter_mask_for_keep(void *sc_mm);
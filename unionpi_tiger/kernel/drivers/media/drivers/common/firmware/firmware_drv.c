@@ -39,6 +39,9 @@
 #include <linux/amlogic/major.h>
 #include <linux/cdev.h>
 #include <linux/crc32.h>
+#include <linux/jhash.h>
+#include <linux/rculist.h>
+#include <linux/ktime.h>
 #include "../chips/decoder_cpu_ver_info.h"
 
 /* major.minor */
@@ -88,50 +91,185 @@ static inline bool tee_enabled(void)
 }
 #endif
 
-int get_firmware_data(unsigned int format, char *buf)
+static struct firmware_s *fw_image_alloc(int len)
+{
+	struct fw_image_s *img;
+
+	/* never less than the 64k a microcode loader reads. */
+	img = vzalloc(offsetof(struct fw_image_s, fw) +
+		max_t(int, len, sizeof(struct firmware_s) + FRIMWARE_SIZE));
+	if (img == NULL)
+		return NULL;
+
+	kref_init(&img->ref);
+
+	return &img->fw;
+}
+
+static void fw_image_free_rcu(struct rcu_head *rcu)
+{
+	vfree(container_of(rcu, struct fw_image_s, rcu));
+}
+
+static void fw_image_release(struct kref *ref)
+{
+	struct fw_image_s *img = container_of(ref, struct fw_image_s, ref);
+
+	call_rcu(&img->rcu, fw_image_free_rcu);
+}
+
+static void fw_image_put(struct firmware_s *data)
+{
+	struct fw_image_s *img = container_of(data, struct fw_image_s, fw);
+
+	kref_put(&img->ref, fw_image_release);
+}
+
+static u32 fw_name_key(const char *name)
+{
+	return jhash(name, strlen(name), 0);
+}
+
+/* info->data on the update side, which the fw mutex serializes. */
+static struct firmware_s *fw_info_data(struct fw_info_s *info)
+{
+	return rcu_dereference_protected(info->data,
+		lockdep_is_held(&mutex));
+}
+
+static struct firmware_s *fw_find_data(struct fw_mgr_s *mgr,
+	unsigned int format, const char *name)
 {
-	int data_len, ret = -1;
-	struct fw_mgr_s *mgr = g_mgr;
 	struct fw_info_s *info;
 
-	pr_info("[%s], the fw (%s) will be loaded.\n",
-		tee_enabled() ? "TEE" : "LOCAL",
-		get_fw_format_name(format));
+	if (name) {
+		hash_for_each_possible_rcu(mgr->name_hash, info, name_node,
+			fw_name_key(name)) {
+			if (!strcmp(name, info->name))
+				return rcu_dereference(info->data);
+		}
+	} else {
+		hash_for_each_possible_rcu(mgr->fmt_hash, info, fmt_node,
+			format) {
+			if (format == info->format)
+				return rcu_dereference(info->data);
+		}
+	}
 
-	if (tee_enabled())
-		return 0;
+	return NULL;
+}
 
-	mutex_lock(&mutex);
+/* copies the microcode to buf, or takes a reference to it in ref. */
+static int fw_take_data(struct firmware_s *data, char *buf,
+	struct fw_ref_s *ref)
+{
+	struct fw_image_s *img;
 
-	if (list_empty(&mgr->fw_head)) {
-		pr_info("the info list is empty.\n");
-		goto out;
+	if (IS_ERR_OR_NULL(data))
+		return -1;
+
+	if (buf) {
+		memcpy(buf, data->data, data->head.data_size);
+		return data->head.data_size;
 	}
 
-	list_for_each_entry(info, &mgr->fw_head, node) {
-		if (format != info->format)
-			continue;
+	img = container_of(data, struct fw_image_s, fw);
+	if (!kref_get_unless_zero(&img->ref))
+		return -1;
+
+	ref->data = data->data;
+	ref->size = data->head.data_size;
+	ref->priv = img;
+	atomic_inc(&g_mgr->stat.ref_cnt);
+
+	return ref->size;
+}
 
-		data_len = info->data->head.data_size;
-		memcpy(buf, info->data->data, data_len);
-		ret = data_len;
+static void fw_ref_drop(struct fw_ref_s *ref)
+{
+	struct fw_image_s *img = ref->priv;
 
-		break;
+	if (img) {
+		atomic_dec(&g_mgr->stat.ref_cnt);
+		fw_image_put(&img->fw);
 	}
-out:
-	mutex_unlock(&mutex);
+	memset(ref, 0, sizeof(*ref));
+}
+
+/*
+ * Looks up the fw by format, or by name if not NULL. The lookup runs
+ * under RCU and doesn't take the mutex unless the fw list is being
+ * (re)loaded, or the fw isn't found at all. The loader holds the mutex
+ * until it is done, so the locked retry sees the complete list just
+ * like the callers always did.
+ */
+static int fw_get_data(unsigned int format, const char *name,
+	char *buf, struct fw_ref_s *ref)
+{
+	struct fw_mgr_s *mgr = g_mgr;
+	struct fw_stat_s *stat = &mgr->stat;
+	u64 start = ktime_get_ns(), cost;
+	s64 max;
+	unsigned int seq;
+	int ret = -1;
+
+	seq = raw_read_seqcount(&mgr->load_seq);
+	if (!(seq & 1)) {
+		rcu_read_lock();
+		ret = fw_take_data(fw_find_data(mgr, format, name), buf, ref);
+		rcu_read_unlock();
+
+		if (ret >= 0 && read_seqcount_retry(&mgr->load_seq, seq)) {
+			if (ref)
+				fw_ref_drop(ref);
+			ret = -1;
+		}
+	}
+
+	if (ret < 0) {
+		mutex_lock(&mutex);
+
+		if (list_empty(&mgr->fw_head))
+			pr_info("the info list is empty.\n");
+
+		rcu_read_lock();
+		ret = fw_take_data(fw_find_data(mgr, format, name), buf, ref);
+		rcu_read_unlock();
+
+		mutex_unlock(&mutex);
+		atomic_inc(&stat->locked_cnt);
+	}
+
+	cost = ktime_get_ns() - start;
+	atomic_inc(&stat->load_cnt);
+	atomic64_add(cost, &stat->load_ns);
+	max = atomic64_read(&stat->load_max_ns);
+	while (cost > max &&
+		!atomic64_try_cmpxchg(&stat->load_max_ns, &max, cost))
+		;
+	if (ret < 0)
+		atomic_inc(&stat->fail_cnt);
 
 	return ret;
 }
+
+int get_firmware_data(unsigned int format, char *buf)
+{
+	pr_info("[%s], the fw (%s) will be loaded.\n",
+		tee_enabled() ? "TEE" : "LOCAL",
+		get_fw_format_name(format));
+
+	if (tee_enabled())
+		return 0;
+
+	return fw_get_data(format, NULL, buf, NULL);
+}
 EXPORT_SYMBOL(get_firmware_data);
 
 int get_data_from_name(const char *name, char *buf)
 {
-	int data_len, ret = -1;
-	struct fw_mgr_s *mgr = g_mgr;
-	struct fw_info_s *info;
 	char *fw_name = __getname();
-	int len;
+	int len, ret;
 
 	if (fw_name == NULL)
 		return -ENOMEM;
@@ -142,31 +280,59 @@ int get_data_from_name(const char *name, char *buf)
 		return -ENAMETOOLONG;
 	}
 
-	mutex_lock(&mutex);
+	ret = fw_get_data(0, fw_name, buf, NULL);
 
-	if (list_empty(&mgr->fw_head)) {
-		pr_info("the info list is empty.\n");
-		goto out;
-	}
+	__putname(fw_name);
 
-	list_for_each_entry(info, &mgr->fw_head, node) {
-		if (strcmp(fw_name, info->name))
-			continue;
+	return ret;
+}
+EXPORT_SYMBOL(get_data_from_name);
+
+/*
+ * Zero copy variants of get_firmware_data() and get_data_from_name(),
+ * see struct fw_ref_s. Return the microcode size, or < 0 if there is
+ * no such fw, in which case nothing needs to be put.
+ */
+int get_firmware_ref(unsigned int format, struct fw_ref_s *ref)
+{
+	memset(ref, 0, sizeof(*ref));
+
+	if (tee_enabled())
+		return -1;
+
+	return fw_get_data(format, NULL, NULL, ref);
+}
+EXPORT_SYMBOL(get_firmware_ref);
 
-		data_len = info->data->head.data_size;
-		memcpy(buf, info->data->data, data_len);
-		ret = data_len;
+int get_firmware_ref_by_name(const char *name, struct fw_ref_s *ref)
+{
+	char *fw_name = __getname();
+	int len, ret;
 
-		break;
+	memset(ref, 0, sizeof(*ref));
+
+	if (fw_name == NULL)
+		return -ENOMEM;
+
+	len = snprintf(fw_name, PATH_MAX, "%s.bin", name);
+	if (len >= PATH_MAX) {
+		__putname(fw_name);
+		return -ENAMETOOLONG;
 	}
-out:
-	mutex_unlock(&mutex);
+
+	ret = fw_get_data(0, fw_name, NULL, ref);
 
 	__putname(fw_name);
 
 	return ret;
 }
-EXPORT_SYMBOL(get_data_from_name);
+EXPORT_SYMBOL(get_firmware_ref_by_name);
+
+void put_firmware_ref(struct fw_ref_s *ref)
+{
+	fw_ref_drop(ref);
+}
+EXPORT_SYMBOL(put_firmware_ref);
 
 static int fw_probe(char *buf)
 {
@@ -274,17 +440,32 @@ static void fw_add_info(struct fw_info_s *info)
 
 	flags = fw_mgr_lock(mgr);
 	list_add(&info->node, &mgr->fw_head);
+	hash_add_rcu(mgr->fmt_hash, &info->fmt_node, info->format);
+	hash_add_rcu(mgr->name_hash, &info->name_node,
+		fw_name_key(info->name));
 	fw_mgr_unlock(mgr, flags);
 }
 
+/* drops the info with its data, the mgr lock must be held. */
+static void __fw_del_info(struct fw_info_s *info)
+{
+	struct firmware_s *data = fw_info_data(info);
+
+	list_del(&info->node);
+	hash_del_rcu(&info->fmt_node);
+	hash_del_rcu(&info->name_node);
+	if (!IS_ERR_OR_NULL(data))
+		fw_image_put(data);
+	kfree_rcu(info, rcu);
+}
+
 static void fw_del_info(struct fw_info_s *info)
 {
 	unsigned long flags;
 	struct fw_mgr_s *mgr = g_mgr;
 
 	flags = fw_mgr_lock(mgr);
-	list_del(&info->node);
-	kfree(info);
+	__fw_del_info(info);
 	fw_mgr_unlock(mgr, flags);
 }
 
@@ -292,6 +473,7 @@ static void fw_info_walk(void)
 {
 	struct fw_mgr_s *mgr = g_mgr;
 	struct fw_info_s *info;
+	struct firmware_s *data;
 
 	if (list_empty(&mgr->fw_head)) {
 		pr_info("the info list is empty.\n");
@@ -299,24 +481,25 @@ static void fw_info_walk(void)
 	}
 
 	list_for_each_entry(info, &mgr->fw_head, node) {
-		if (IS_ERR_OR_NULL(info->data))
+		data = fw_info_data(info);
+		if (IS_ERR_OR_NULL(data))
 			continue;
 
 		pr_info("name : %s.\n", info->name);
 		pr_info("ver  : %s.\n",
-			info->data->head.version);
+			data->head.version);
 		pr_info("crc  : 0x%x.\n",
-			info->data->head.checksum);
+			data->head.checksum);
 		pr_info("size : %d.\n",
-			info->data->head.data_size);
+			data->head.data_size);
 		pr_info("maker: %s.\n",
-			info->data->head.maker);
+			data->head.maker);
 		pr_info("from : %s.\n", info->src_from);
 		pr_info("date : %s.\n",
-			info->data->head.date);
-		if (info->data->head.duplicate)
+			data->head.date);
+		if (data->head.duplicate)
 			pr_info("NOTE : Dup from %s.\n",
-				info->data->head.dup_from);
+				data->head.dup_from);
 		pr_info("\n");
 	}
 }
@@ -347,9 +530,12 @@ static ssize_t info_show(struct class *class,
 {
 	char *pbuf = buf;
 	struct fw_mgr_s *mgr = g_mgr;
+	struct fw_stat_s *stat = &mgr->stat;
 	struct fw_info_s *info;
+	struct firmware_s *data;
 	unsigned int secs = 0;
 	struct tm tm;
+	int loads;
 
 	mutex_lock(&mutex);
 
@@ -362,41 +548,54 @@ static ssize_t info_show(struct class *class,
 	pr_info("The driver version is %s\n", PACK_VERS);
 
 	list_for_each_entry(info, &mgr->fw_head, node) {
-		if (IS_ERR_OR_NULL(info->data))
+		data = fw_info_data(info);
+		if (IS_ERR_OR_NULL(data))
 			continue;
 
 		if (detail) {
 			pr_info("%-5s: %s\n", "name", info->name);
 			pr_info("%-5s: %s\n", "ver",
-				info->data->head.version);
+				data->head.version);
 			pr_info("%-5s: 0x%x\n", "sum",
-				info->data->head.checksum);
+				data->head.checksum);
 			pr_info("%-5s: %d\n", "size",
-				info->data->head.data_size);
+				data->head.data_size);
 			pr_info("%-5s: %s\n", "maker",
-				info->data->head.maker);
+				data->head.maker);
 			pr_info("%-5s: %s\n", "from",
 				info->src_from);
 			pr_info("%-5s: %s\n\n", "date",
-				info->data->head.date);
+				data->head.date);
 			continue;
 		}
 
-		secs = info->data->head.time
+		secs = data->head.time
 			- sys_tz.tz_minuteswest * 60;
 		time64_to_tm(secs, 0, &tm);
 
 		pr_info("%s %-16s, %02d:%02d:%02d %d/%d/%ld, %s %-8s, %s %-8s, %s %s\n",
-			"fmt:", info->data->head.format,
+			"fmt:", data->head.format,
 			tm.tm_hour, tm.tm_min, tm.tm_sec,
 			tm.tm_mon + 1, tm.tm_mday, tm.tm_year + 1900,
-			"cmtid:", info->data->head.commit,
-			"chgid:", info->data->head.change_id,
-			"mk:", info->data->head.maker);
+			"cmtid:", data->head.commit,
+			"chgid:", data->head.change_id,
+			"mk:", data->head.maker);
 	}
 out:
 	mutex_unlock(&mutex);
 
+	loads = atomic_read(&stat->load_cnt);
+	pbuf += sprintf(pbuf, "loads: %d, locked: %d, failed: %d, refs: %d\n",
+		loads, atomic_read(&stat->locked_cnt),
+		atomic_read(&stat->fail_cnt), atomic_read(&stat->ref_cnt));
+	pbuf += sprintf(pbuf, "load time: ave %llu us, max %llu us\n",
+		loads ? div_u64(div_u64(atomic64_read(&stat->load_ns),
+		loads), NSEC_PER_USEC) : 0,
+		div_u64(atomic64_read(&stat->load_max_ns), NSEC_PER_USEC));
+	pbuf += sprintf(pbuf, "preload: %u times, last %llu ms\n",
+		stat->preload_cnt,
+		div_u64(stat->preload_ns, NSEC_PER_MSEC));
+
 	return pbuf - buf;
 }
 
@@ -475,7 +674,7 @@ static int fw_data_filter(struct firmware_s *fw,
 
 	if (mgr->cur_cpu < cpu) {
 		kfree(fw_info);
-		kfree(fw);
+		fw_image_put(fw);
 		return -1;
 	}
 
@@ -487,7 +686,7 @@ static int fw_data_filter(struct firmware_s *fw,
 		if (info->format != fw_info->format)
 			continue;
 
-		if (IS_ERR_OR_NULL(info->data)) {
+		if (IS_ERR_OR_NULL(fw_info_data(info))) {
 			fw_del_info(info);
 			return 0;
 		}
@@ -496,17 +695,17 @@ static int fw_data_filter(struct firmware_s *fw,
 		if (info->file_type == VIDEO_FW_FILE) {
 			pr_info("the %s need to priority proc.\n",info->name);
 			kfree(fw_info);
-			kfree(fw);
+			fw_image_put(fw);
 			return 1;
 		}
 
 		/* the cpu ver is lower and needs to be filtered */
-		if (cpu < fw_get_cpu(info->data->head.cpu)) {
+		if (cpu < fw_get_cpu(fw_info_data(info)->head.cpu)) {
 			if (debug)
 				pr_info("keep the newer fw (%s) and ignore the older fw (%s).\n",
 					info->name, fw_info->name);
 			kfree(fw_info);
-			kfree(fw);
+			fw_image_put(fw);
 			return 1;
 		}
 
@@ -514,7 +713,6 @@ static int fw_data_filter(struct firmware_s *fw,
 		if (debug)
 			pr_info("drop the old fw (%s) will be load the newer fw (%s).\n",
 					info->name, fw_info->name);
-		kfree(info->data);
 		fw_del_info(info);
 	}
 
@@ -539,19 +737,20 @@ static int fw_replace_dup_data(char *buf)
 		list_for_each_entry(info, &mgr->fw_head, node) {
 			struct firmware_s *comp = NULL;
 			struct firmware_s *data = NULL;
+			struct firmware_s *old = NULL;
 			int len = 0;
 
 			comp = (struct firmware_s *)pinfo->data;
 			if (comp->head.duplicate)
 				break;
 
-			if (!info->data->head.duplicate ||
-				comp->head.checksum !=
-				info->data->head.checksum)
+			old = fw_info_data(info);
+			if (!old->head.duplicate ||
+				comp->head.checksum != old->head.checksum)
 				continue;
 
 			len = pinfo->head.length;
-			data = kzalloc(len, GFP_KERNEL);
+			data = fw_image_alloc(len);
 			if (data == NULL) {
 				ret = -ENOMEM;
 				goto out;
@@ -560,13 +759,13 @@ static int fw_replace_dup_data(char *buf)
 			memcpy(data, pinfo->data, len);
 
 			/* update header information. */
-			memcpy(data, info->data, sizeof(*data));
+			memcpy(data, old, sizeof(*data));
 
 			/* if replaced success need to update real size. */
 			data->head.data_size = comp->head.data_size;
 
-			kfree(info->data);
-			info->data = data;
+			rcu_assign_pointer(info->data, data);
+			fw_image_put(old);
 		}
 		pdata += (pinfo->head.length + sizeof(*pinfo));
 		pinfo = (struct package_info_s *)pdata;
@@ -644,7 +843,7 @@ static int fw_package_parse(struct fw_files_s *files,
 			goto out;
 		}
 
-		data = kzalloc(FRIMWARE_SIZE, GFP_KERNEL);
+		data = fw_image_alloc(FRIMWARE_SIZE);
 		if (data == NULL) {
 			kfree(info);
 			ret = -ENOMEM;
@@ -669,7 +868,7 @@ static int fw_package_parse(struct fw_files_s *files,
 		if (!data->head.duplicate &&
 			!fw_data_check_sum(data)) {
 			pr_info("check sum fail !\n");
-			kfree(data);
+			fw_image_put(data);
 			kfree(info);
 			goto out;
 		}
@@ -680,7 +879,7 @@ static int fw_package_parse(struct fw_files_s *files,
 		if (debug)
 			pr_info("adds %s to the fw list.\n", info->name);
 
-		info->data = data;
+		RCU_INIT_POINTER(info->data, data);
 		fw_add_info(info);
 	} while (try_cnt--);
 
@@ -698,13 +897,14 @@ static int fw_code_parse(struct fw_files_s *files,
 	char *buf, int size)
 {
 	struct fw_info_s *info;
+	struct firmware_s *data;
 
 	info = kzalloc(sizeof(struct fw_info_s), GFP_KERNEL);
 	if (info == NULL)
 		return -ENOMEM;
 
-	info->data = kzalloc(FRIMWARE_SIZE, GFP_KERNEL);
-	if (info->data == NULL) {
+	data = fw_image_alloc(FRIMWARE_SIZE);
+	if (data == NULL) {
 		kfree(info);
 		return -ENOMEM;
 	}
@@ -713,11 +913,11 @@ static int fw_code_parse(struct fw_files_s *files,
 	strncpy(info->src_from, files->name,
 		sizeof(info->src_from));
 	info->src_from[sizeof(info->src_from) - 1] = '\0';
-	memcpy(info->data, buf, size);
+	memcpy(data, buf, size);
 
-	if (!fw_data_check_sum(info->data)) {
+	if (!fw_data_check_sum(data)) {
 		pr_info("check sum fail !\n");
-		kfree(info->data);
+		fw_image_put(data);
 		kfree(info);
 		return -1;
 	}
@@ -725,6 +925,7 @@ static int fw_code_parse(struct fw_files_s *files,
 	if (debug)
 		pr_info("adds %s to the fw list.\n", info->name);
 
+	RCU_INIT_POINTER(info->data, data);
 	fw_add_info(info);
 
 	return 0;
@@ -789,17 +990,27 @@ static int fw_data_binding(void)
 
 static int fw_pre_load(void)
 {
+	struct fw_mgr_s *mgr = g_mgr;
+	u64 start = ktime_get_ns();
+	int ret = 0;
+
+	/* lookups meanwhile wait for the mutex, see fw_get_data(). */
+	raw_write_seqcount_begin(&mgr->load_seq);
+
 	if (fw_info_fill() < 0) {
 		pr_info("Get path fail.\n");
-		return -1;
-	}
-
-	if (fw_data_binding() < 0) {
+		ret = -1;
+	} else if (fw_data_binding() < 0) {
 		pr_info("Set data fail.\n");
-		return -1;
+		ret = -1;
 	}
 
-	return 0;
+	raw_write_seqcount_end(&mgr->load_seq);
+
+	mgr->stat.preload_cnt++;
+	mgr->stat.preload_ns = ktime_get_ns() - start;
+
+	return ret;
 }
 
 static int fw_mgr_init(void)
@@ -812,6 +1023,9 @@ static int fw_mgr_init(void)
 	INIT_LIST_HEAD(&g_mgr->files_head);
 	INIT_LIST_HEAD(&g_mgr->fw_head);
 	spin_lock_init(&g_mgr->lock);
+	hash_init(g_mgr->fmt_hash);
+	hash_init(g_mgr->name_hash);
+	seqcount_init(&g_mgr->load_seq);
 
 	return 0;
 }
@@ -834,9 +1048,7 @@ static void fw_ctx_clean(void)
 	while (!list_empty(&mgr->fw_head)) {
 		info = list_entry(mgr->fw_head.next,
 			struct fw_info_s, node);
-		list_del(&info->node);
-		kfree(info->data);
-		kfree(info);
+		__fw_del_info(info);
 	}
 	fw_mgr_unlock(mgr, flags);
 }
@@ -1007,7 +1219,9 @@ static int __init fw_module_init(void)
 		goto err;
 	}
 
+	mutex_lock(&mutex);
 	ret = fw_pre_load();
+	mutex_unlock(&mutex);
 	if (ret) {
 		pr_info("Error %d firmware pre load fail.\n", ret);
 		goto err;
@@ -1018,7 +1232,11 @@ err:
 
 static void __exit fw_module_exit(void)
 {
+	mutex_lock(&mutex);
 	fw_ctx_clean();
+	mutex_unlock(&mutex);
+	/* images and infos are freed from rcu callbacks. */
+	rcu_barrier();
 	fw_driver_exit();
 	pr_info("Firmware driver cleaned up.\n");
 }
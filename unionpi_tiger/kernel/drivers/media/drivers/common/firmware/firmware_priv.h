@@ -21,13 +21,35 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/cdev.h>
+#include <linux/hashtable.h>
+#include <linux/seqlock.h>
+#include <linux/kref.h>
 #include "firmware_type.h"
 
+#define FW_HASH_BITS	(6)
+
+struct fw_stat_s {
+	atomic_t load_cnt;	/* get_firmware_data() and friends */
+	atomic_t locked_cnt;	/* of those, fell back to the mutex */
+	atomic_t fail_cnt;
+	atomic_t ref_cnt;	/* get_firmware_ref() not yet put */
+	atomic64_t load_ns;
+	atomic64_t load_max_ns;
+	u32 preload_cnt;
+	u64 preload_ns;		/* last fw_pre_load() */
+};
+
 struct fw_mgr_s {
 	struct list_head fw_head;
 	struct list_head files_head;
 	spinlock_t lock;
 	int cur_cpu;
+	/* read side index of fw_head, looked up under RCU */
+	DECLARE_HASHTABLE(fmt_hash, FW_HASH_BITS);
+	DECLARE_HASHTABLE(name_hash, FW_HASH_BITS);
+	/* odd while fw_head is being filled */
+	seqcount_t load_seq;
+	struct fw_stat_s stat;
 };
 
 struct fw_files_s {
@@ -46,11 +68,15 @@ struct ucode_file_info_s {
 
 struct fw_info_s {
 	struct list_head node;
+	struct hlist_node fmt_node;
+	struct hlist_node name_node;
+	struct rcu_head rcu;
 	char name[32];
 	char src_from[32];
 	int file_type;
 	unsigned int format;
-	struct firmware_s *data;
+	/* replaced under the fw mutex, read under RCU */
+	struct firmware_s __rcu *data;
 };
 
 struct fw_head_s {
@@ -79,6 +105,17 @@ struct firmware_s {
 	char data[0];
 };
 
+/*
+ * Every firmware_s is the fw of an image. Images are refcounted for
+ * get_firmware_ref() and freed a grace period after the last put.
+ * They are vmalloc'ed, so fw and fw.data are cache line aligned.
+ */
+struct fw_image_s {
+	struct kref ref;
+	struct rcu_head rcu;
+	struct firmware_s fw ____cacheline_aligned;
+};
+
 struct package_head_s {
 	int magic;
 	int size;
@@ -91,6 +91,18 @@ struct cpu_type_s {
 	const char *name;
 };
 
+/*
+ * A reference to a preloaded image handed out by get_firmware_ref(),
+ * no copy is made. data is cache line aligned, stays valid across a
+ * reload until put_firmware_ref(), and at least 64k can be read from
+ * it whatever size says, as the microcode loaders do.
+ */
+struct fw_ref_s {
+	const char *data;
+	int size;
+	void *priv;
+};
+
 const char *get_fw_format_name(unsigned int format);
 unsigned int get_fw_format(const char *name);
 int fw_get_cpu(const char *name);
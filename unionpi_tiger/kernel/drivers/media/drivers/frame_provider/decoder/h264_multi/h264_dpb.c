@@ -22,9 +22,11 @@
 #include <linux/types.h>
 #include <linux/errno.h>
 
+#ifdef __KERNEL__
 #include <linux/amlogic/media/utils/vdec_reg.h>
 #include "../utils/vdec.h"
 #include "../utils/amvdec.h"
+#endif
 
 #include "h264_dpb.h"
 
@@ -40,6 +40,7 @@
 #define PRINT_FLAG_DUMP_BUFSPEC       0x1000
 #define PRINT_FLAG_V4L_DETAIL         0x8000
 #define DISABLE_ERROR_HANDLE          0x10000
+#define PRINT_FLAG_DPB_TRACE          0x20000
 #define DEBUG_DUMP_STAT               0x80000
 /*setting canvas mode and endian.
   if this flag is set, value of canvas mode
@@ -0,0 +1,746 @@
+/*
+* Copyright (C) 2017 Amlogic, Inc. All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+* more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+* Description: replay slice header traces against the H.264 DPB
+* manager in ../h264_dpb.c, built as plain userspace code.
+*
+* Build: gcc -O2 -I. -include kshim.h -o dpb_replay dpb_replay.c ../h264_dpb.c
+*
+* Traces are the "dpbtrace" lines of the kernel log, written with
+* PRINT_FLAG_DPB_TRACE set (format next to dpb_trace_config() in
+* ../vmh264.c):
+*	echo 0x20000 > /sys/module/amvdec_mh264/parameters/h264_debug_flag
+*	dmesg | grep dpbtrace > trace.txt
+* Without -f an IDR/P/B stream is generated, -o saves it in the same
+* format. Each run reports the CPU time of h264_slice_header_process()
+* and store_picture_in_dpb(), checks the output order against the
+* recorded O lines (or the POC order of the generated stream), and
+* reports DPB occupancy and output latency.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../h264_dpb.h"
+
+#define BUF_NUM		64	/* BUFSPEC_POOL_SIZE of vmh264.c */
+#define RPM_ROW		16
+#define RPM_WORDS	(RPM_END - RPM_BEGIN)
+
+unsigned int h264_debug_flag;
+unsigned int h264_debug_mask = 0xff;
+
+struct rp_event {
+	char type;
+	int arg[6];
+	u16 row[RPM_ROW];	/* W: the words, arg[0] the offset */
+};
+
+struct rp_trace {
+	struct rp_event *ev;
+	int num;
+	int size;
+	int id;
+	u16 shadow[RPM_WORDS];	/* generator: RPM as last written */
+};
+
+struct rp_out {
+	int period;		/* IDR periods seen before the frame */
+	int poc;
+};
+
+struct rp_buf {
+	int used;
+	int vf_ref;
+	int period;
+	int decode_idx;
+};
+
+struct rp_ctx {
+	struct h264_dpb_stru dpb;
+	struct vdec_s vdec;
+	struct rp_buf buf[BUF_NUM];
+	int buf_num;
+	int search_pos;
+	int period;
+	int pic_count;
+	int disp_latency;	/* pictures a frame stays on display */
+
+	/* frames on display, fs index and decode count at output */
+	int disp_fs[DPB_SIZE_MAX];
+	int disp_at[DPB_SIZE_MAX];
+	int disp_num;
+
+	/* results */
+	struct rp_out *out;
+	int out_num;
+	int out_size;
+	u64 *slice_ns;
+	int slice_num;
+	int slice_size;
+	u64 *store_ns;
+	int store_num;
+	int store_size;
+	u64 occupancy_total;
+	int occupancy_max;
+	int ref_max;
+	u64 latency_total;
+	int latency_max;
+	int store_errors;
+	int alloc_errors;
+	int dropped;
+};
+
+static void *rp_grow(void *p, int *size, int need, size_t elem)
+{
+	int n = *size ? *size : 1024;
+
+	if (need < *size)
+		return p;
+	while (n <= need)
+		n *= 2;
+	p = realloc(p, n * elem);
+	if (!p) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	*size = n;
+	return p;
+}
+
+static struct rp_event *rp_add(struct rp_trace *t, char type)
+{
+	struct rp_event *ev;
+
+	t->ev = rp_grow(t->ev, &t->size, t->num, sizeof(*t->ev));
+	ev = &t->ev[t->num++];
+	memset(ev, 0, sizeof(*ev));
+	ev->type = type;
+	return ev;
+}
+
+static u64 rp_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the vmh264.c side of the DPB manager */
+int get_free_buf_idx(struct vdec_s *vdec)
+{
+	struct rp_ctx *c = vdec->private;
+	int i, n;
+
+	for (n = 0; n < c->buf_num; n++) {
+		i = (c->search_pos + n) % c->buf_num;
+		if (!c->buf[i].used && !c->buf[i].vf_ref) {
+			c->buf[i].used = 1;
+			c->search_pos = (i + 1) % c->buf_num;
+			return i;
+		}
+	}
+	return -1;
+}
+
+int release_buf_spec_num(struct vdec_s *vdec, int buf_spec_num)
+{
+	struct rp_ctx *c = vdec->private;
+
+	if (buf_spec_num >= 0 && buf_spec_num < BUF_NUM)
+		c->buf[buf_spec_num].used = 0;
+	return 0;
+}
+
+int prepare_display_buf(struct vdec_s *vdec, struct FrameStore *frame)
+{
+	struct rp_ctx *c = vdec->private;
+	struct rp_buf *buf;
+	int latency;
+
+	if (frame->buf_spec_num < 0 || frame->buf_spec_num >= BUF_NUM)
+		return -1;
+	if (frame->data_flag & (NODISP_FLAG | NULL_FLAG | ERROR_FLAG)) {
+		c->dropped++;
+		set_frame_output_flag(&c->dpb, frame->index);
+		return 0;
+	}
+	buf = &c->buf[frame->buf_spec_num];
+	c->out = rp_grow(c->out, &c->out_size, c->out_num, sizeof(*c->out));
+	c->out[c->out_num].period = buf->period;
+	c->out[c->out_num].poc = frame->poc;
+	c->out_num++;
+
+	latency = c->pic_count - buf->decode_idx;
+	c->latency_total += latency;
+	if (latency > c->latency_max)
+		c->latency_max = latency;
+
+	buf->vf_ref = 1;
+	if (c->disp_num < DPB_SIZE_MAX) {
+		c->disp_fs[c->disp_num] = frame->index;
+		c->disp_at[c->disp_num] = frame->buf_spec_num;
+		c->disp_num++;
+	} else {
+		buf->vf_ref = 0;
+		set_frame_output_flag(&c->dpb, frame->index);
+	}
+	return 0;
+}
+
+void bufmgr_force_recover(struct h264_dpb_stru *p_H264_Dpb)
+{
+	bufmgr_h264_remove_unused_frame(p_H264_Dpb, 2);
+}
+
+/* the display returns all but the newest keep frames, like vf_put() */
+static void rp_display(struct rp_ctx *c, int keep)
+{
+	int n = c->disp_num - keep;
+	int i;
+
+	if (n <= 0)
+		return;
+	for (i = 0; i < n; i++) {
+		c->buf[c->disp_at[i]].vf_ref = 0;
+		set_frame_output_flag(&c->dpb, c->disp_fs[i]);
+	}
+	memmove(c->disp_fs, &c->disp_fs[n], (c->disp_num - n) * sizeof(int));
+	memmove(c->disp_at, &c->disp_at[n], (c->disp_num - n) * sizeof(int));
+	c->disp_num -= n;
+}
+
+static void rp_config(struct rp_ctx *c, int id, const int *a)
+{
+	dpb_init_global(&c->dpb, id, 0, 0);
+	c->dpb.vdec = &c->vdec;
+	c->vdec.private = c;
+	c->dpb.mDPB.size = a[0];
+	c->dpb.max_reference_size = a[1];
+	c->dpb.origin_max_reference = a[2];
+	c->dpb.colocated_buf_count = a[3];
+	c->dpb.first_insert_frame = a[4];
+	c->dpb.fast_output_enable = H264_OUTPUT_MODE_NORMAL;
+	c->buf_num = a[5] > 0 ? a[5] : a[0] + 1;
+	if (c->buf_num > BUF_NUM)
+		c->buf_num = BUF_NUM;
+	memset(c->buf, 0, sizeof(c->buf));
+	c->search_pos = 0;
+	c->disp_num = 0;
+}
+
+static void rp_store(struct rp_ctx *c, const int *a)
+{
+	struct h264_dpb_stru *p_H264_Dpb = &c->dpb;
+	struct StorablePicture *pic = p_H264_Dpb->mVideo.dec_picture;
+	u64 t;
+	int ret;
+
+	if (!pic)
+		return;
+	if (a[0] & IDR_FLAG)
+		c->period++;
+	if (pic->buf_spec_num >= 0 && pic->buf_spec_num < BUF_NUM) {
+		c->buf[pic->buf_spec_num].period = c->period;
+		c->buf[pic->buf_spec_num].decode_idx = c->pic_count;
+	}
+	p_H264_Dpb->fast_output_enable = a[1];
+
+	t = rp_cpu_ns();
+	ret = store_picture_in_dpb(p_H264_Dpb, pic, a[0]);
+	if (ret == -1) {
+		release_picture(p_H264_Dpb, pic);
+		bufmgr_force_recover(p_H264_Dpb);
+		c->store_errors++;
+	} else
+		bufmgr_post(p_H264_Dpb);
+	t = rp_cpu_ns() - t;
+	p_H264_Dpb->mVideo.dec_picture = NULL;
+	if (ret != -1)
+		p_H264_Dpb->decode_pic_count++;
+	c->pic_count++;
+
+	c->store_ns = rp_grow(c->store_ns, &c->store_size, c->store_num,
+		sizeof(u64));
+	c->store_ns[c->store_num++] = t;
+	c->occupancy_total += p_H264_Dpb->mDPB.used_size;
+	if (p_H264_Dpb->mDPB.used_size > c->occupancy_max)
+		c->occupancy_max = p_H264_Dpb->mDPB.used_size;
+	if (p_H264_Dpb->mDPB.ref_frames_in_buffer +
+		p_H264_Dpb->mDPB.ltref_frames_in_buffer > c->ref_max)
+		c->ref_max = p_H264_Dpb->mDPB.ref_frames_in_buffer +
+			p_H264_Dpb->mDPB.ltref_frames_in_buffer;
+
+	rp_display(c, c->disp_latency);
+}
+
+static void rp_run(struct rp_ctx *c, const struct rp_trace *t)
+{
+	struct h264_dpb_stru *p_H264_Dpb = &c->dpb;
+	u16 *rpm = p_H264_Dpb->dpb_param.l.data;
+	int configured = 0;
+	int i, gap;
+	u64 ns;
+
+	for (i = 0; i < t->num; i++) {
+		const struct rp_event *ev = &t->ev[i];
+
+		if (ev->type == 'C') {
+			rp_config(c, t->id, ev->arg);
+			configured = 1;
+			continue;
+		}
+		if (!configured)
+			continue;
+		switch (ev->type) {
+		case 'W':
+			memcpy(&rpm[ev->arg[0]], ev->row, sizeof(ev->row));
+			break;
+		case 'S':
+			ns = rp_cpu_ns();
+			h264_slice_header_process(p_H264_Dpb, &gap);
+			ns = rp_cpu_ns() - ns;
+			if (p_H264_Dpb->mVideo.dec_picture &&
+				p_H264_Dpb->mVideo.dec_picture->buf_spec_num < 0)
+				c->alloc_errors++;
+			c->slice_ns = rp_grow(c->slice_ns, &c->slice_size,
+				c->slice_num, sizeof(u64));
+			c->slice_ns[c->slice_num++] = ns;
+			break;
+		case 'P':
+			rp_store(c, ev->arg);
+			break;
+		case 'D':
+			if (p_H264_Dpb->mVideo.dec_picture) {
+				release_picture(p_H264_Dpb,
+					p_H264_Dpb->mVideo.dec_picture);
+				p_H264_Dpb->mVideo.dec_picture = NULL;
+			}
+			break;
+		case 'F':
+			flush_dpb(p_H264_Dpb);
+			rp_display(c, 0);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void rp_reset(struct rp_ctx *c)
+{
+	struct rp_out *out = c->out;
+	u64 *slice_ns = c->slice_ns, *store_ns = c->store_ns;
+	int out_size = c->out_size;
+	int slice_size = c->slice_size, store_size = c->store_size;
+	int latency = c->disp_latency;
+
+	memset(c, 0, sizeof(*c));
+	c->out = out;
+	c->out_size = out_size;
+	c->slice_ns = slice_ns;
+	c->slice_size = slice_size;
+	c->store_ns = store_ns;
+	c->store_size = store_size;
+	c->disp_latency = latency;
+}
+
+static int rp_load_trace(struct rp_trace *t, struct rp_trace *ref,
+	const char *file)
+{
+	FILE *fp = fopen(file, "r");
+	char line[512];
+
+	if (!fp) {
+		perror(file);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		char *p = strstr(line, "dpbtrace ");
+		struct rp_event *ev;
+		char type;
+		int id, n, i;
+
+		if (!p || sscanf(p, "dpbtrace %d %c%n", &id, &type, &n) != 2)
+			continue;
+		if (t->id < 0 && type == 'C')
+			t->id = id;
+		if (id != t->id)
+			continue;
+		p += n;
+		if (type == 'O') {
+			/* recorded output, the reference order */
+			ev = rp_add(ref, 'O');
+			sscanf(p, "%d %d", &ev->arg[0], &ev->arg[1]);
+			continue;
+		}
+		ev = rp_add(t, type);
+		if (type == 'W') {
+			unsigned int off, w;
+
+			if (sscanf(p, "%x%n", &off, &n) != 1 ||
+				off > RPM_WORDS - RPM_ROW) {
+				t->num--;
+				continue;
+			}
+			ev->arg[0] = off;
+			for (i = 0, p += n; i < RPM_ROW; i++, p += n) {
+				if (sscanf(p, "%x%n", &w, &n) != 1)
+					break;
+				ev->row[i] = w;
+			}
+		} else {
+			sscanf(p, "%d %d %d %d %d %d", &ev->arg[0],
+				&ev->arg[1], &ev->arg[2], &ev->arg[3],
+				&ev->arg[4], &ev->arg[5]);
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* W rows for what changed in rpm, then the slice itself */
+static void rp_gen_slice(struct rp_trace *t, const u16 *rpm)
+{
+	int i;
+
+	for (i = 0; i < RPM_WORDS; i += RPM_ROW) {
+		struct rp_event *ev;
+
+		if (!memcmp(&t->shadow[i], &rpm[i], RPM_ROW * sizeof(u16)))
+			continue;
+		memcpy(&t->shadow[i], &rpm[i], RPM_ROW * sizeof(u16));
+		ev = rp_add(t, 'W');
+		ev->arg[0] = i;
+		memcpy(ev->row, &rpm[i], sizeof(ev->row));
+	}
+	rp_add(t, 'S');
+}
+
+static void rp_gen_pic(struct rp_trace *t, struct rp_trace *ref,
+	union param *p, int type, int frame_num, int disp, int slices,
+	int refs)
+{
+	int idr = type == I_Slice;
+	int ref_idc = type == B_Slice ? 0 : (idr ? 3 : 2);
+	struct rp_event *ev;
+	int s;
+
+	p->l.data[SLICE_TYPE] = type;
+	p->dpb.NAL_info_mmco = (ref_idc << 5) | (idr ? 5 : 1);
+	p->dpb.frame_num = frame_num & 0xff;
+	p->dpb.pic_order_cnt_lsb = (disp * 2) & 0xff;
+	p->dpb.num_ref_idx_l0_active_minus1 = idr ? 0 : refs - 1;
+	p->dpb.num_ref_idx_l1_active_minus1 = 0;
+	for (s = 0; s < slices; s++) {
+		p->l.data[FIRST_MB_IN_SLICE] = s * 8160 / slices;
+		rp_gen_slice(t, p->l.data);
+	}
+	ev = rp_add(t, 'P');
+	ev->arg[0] = idr ? (I_FLAG | IDR_FLAG) : 0;
+	ev->arg[1] = H264_OUTPUT_MODE_NORMAL;
+
+	/* arg[1] gets the IDR period, counted from 1 like rp_store() */
+	ev = rp_add(ref, 'O');
+	ev->arg[0] = disp * 2;
+}
+
+/* the generated stream in the kernel trace format, O lines included */
+static int rp_save_trace(const struct rp_trace *t, const struct rp_out *expect,
+	int expect_num, const char *file)
+{
+	FILE *fp = fopen(file, "w");
+	const struct rp_event *ev;
+	int i, j;
+
+	if (!fp) {
+		perror(file);
+		return -1;
+	}
+	for (i = 0; i < t->num; i++) {
+		ev = &t->ev[i];
+		fprintf(fp, "dpbtrace %d %c", t->id, ev->type);
+		switch (ev->type) {
+		case 'C':
+			for (j = 0; j < 6; j++)
+				fprintf(fp, " %d", ev->arg[j]);
+			break;
+		case 'W':
+			fprintf(fp, " %03x", ev->arg[0]);
+			for (j = 0; j < RPM_ROW; j++)
+				fprintf(fp, " %04x", ev->row[j]);
+			break;
+		case 'P':
+			fprintf(fp, " %d %d", ev->arg[0], ev->arg[1]);
+			break;
+		default:
+			break;
+		}
+		fputc('\n', fp);
+	}
+	/* only their order is compared, buffers are unknown here */
+	for (i = 0; i < expect_num; i++)
+		fprintf(fp, "dpbtrace %d O %d -1\n", t->id, expect[i].poc);
+	fclose(fp);
+	return 0;
+}
+
+static int rp_cmp_out(const void *a, const void *b)
+{
+	const struct rp_out *x = a, *y = b;
+
+	if (x->period != y->period)
+		return x->period - y->period;
+	return x->poc - y->poc;
+}
+
+/*
+ * 1080p frames in IDR periods of gop pictures, each a run of bframes
+ * non reference B pictures between P anchors, in coding order.
+ */
+static void rp_gen(struct rp_trace *t, struct rp_out **expect, int *expect_num,
+	int frames, int gop, int bframes, int refs, int slices)
+{
+	static union param p;
+	struct rp_trace ref = {0};
+	struct rp_event *ev;
+	int n = 0, period = 0;
+	int i;
+
+	t->id = 0;
+	ev = rp_add(t, 'C');
+	ev->arg[0] = refs + 6 < 27 ? refs + 6 : 27;
+	ev->arg[1] = refs + 4 < 27 ? refs + 4 : 27;
+	ev->arg[2] = refs;
+	ev->arg[3] = 0;
+	ev->arg[4] = 0;
+	ev->arg[5] = 0;
+
+	memset(&p, 0, sizeof(p));
+	p.l.data[PIC_ORDER_CNT_TYPE] = 0;
+	p.l.data[LOG2_MAX_PIC_ORDER_CNT_LSB] = 8;
+	p.l.data[LOG2_MAX_FRAME_NUM] = 8;
+	p.l.data[NEW_PICTURE_STRUCTURE] = 3;
+	p.l.data[MAX_REFERENCE_FRAME_NUM] = refs;
+	p.l.data[PROFILE_IDC_MMCO] = 100 << 8;
+	p.mmco.l0_reorder_cmd[0] = 3;
+	p.mmco.l1_reorder_cmd[0] = 3;
+	p.mmco.mmco_cmd[0] = 0;
+
+	*expect = NULL;
+	*expect_num = 0;
+	while (n < frames) {
+		int len = frames - n < gop ? frames - n : gop;
+		int fnum = 1, d, k;
+		int first = ref.num;
+
+		period++;
+		rp_gen_pic(t, &ref, &p, I_Slice, 0, 0, slices, refs);
+		for (d = 1; d < len; d += bframes + 1) {
+			int anchor = d + bframes < len - 1 ? d + bframes : len - 1;
+
+			rp_gen_pic(t, &ref, &p, P_Slice, fnum, anchor, slices,
+				refs);
+			for (k = d; k < anchor; k++)
+				rp_gen_pic(t, &ref, &p, B_Slice, fnum + 1, k,
+					slices, refs);
+			fnum++;
+		}
+		for (i = first; i < ref.num; i++)
+			ref.ev[i].arg[1] = period;
+		n += len;
+	}
+	rp_add(t, 'F');
+
+	*expect = calloc(ref.num ? ref.num : 1, sizeof(struct rp_out));
+	for (i = 0; i < ref.num; i++) {
+		(*expect)[i].period = ref.ev[i].arg[1];
+		(*expect)[i].poc = ref.ev[i].arg[0];
+	}
+	*expect_num = ref.num;
+	qsort(*expect, *expect_num, sizeof(struct rp_out), rp_cmp_out);
+	free(ref.ev);
+}
+
+static int rp_cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void rp_print_ns(const char *name, u64 *ns, int num)
+{
+	u64 total = 0;
+	int i;
+
+	if (!num)
+		return;
+	for (i = 0; i < num; i++)
+		total += ns[i];
+	qsort(ns, num, sizeof(u64), rp_cmp_u64);
+	printf("%-6s %7d calls ave:%7llu ns p50:%7llu p99:%7llu max:%8llu\n",
+		name, num, (unsigned long long)(total / num),
+		(unsigned long long)ns[num / 2],
+		(unsigned long long)ns[num * 99 / 100],
+		(unsigned long long)ns[num - 1]);
+}
+
+/*
+ * Output order check. Against a generated stream the whole
+ * (period, poc) sequence is known; against a trace only the recorded
+ * POCs are, so periods are not compared there.
+ */
+static int rp_check(const struct rp_ctx *c, const struct rp_out *expect,
+	int expect_num, int with_period)
+{
+	int errors = 0, i;
+	int n = c->out_num < expect_num ? c->out_num : expect_num;
+
+	for (i = 0; i < n; i++) {
+		if (c->out[i].poc == expect[i].poc &&
+			(!with_period || c->out[i].period == expect[i].period))
+			continue;
+		if (!errors)
+			printf("first order error at output %d: poc %d, want %d\n",
+				i, c->out[i].poc, expect[i].poc);
+		errors++;
+	}
+	for (i = 1; i < c->out_num; i++) {
+		if (c->out[i].period == c->out[i - 1].period &&
+			c->out[i].poc < c->out[i - 1].poc)
+			errors++;
+	}
+	return errors;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-f trace [-i id]] [-n frames] [-g gop] [-b bframes]\n"
+		"\t[-r refs] [-s slices] [-o save_trace] [-l display_latency]\n"
+		"\t[-x runs] [-v]\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	static struct rp_ctx c;
+	struct rp_trace t = {.id = -1};
+	struct rp_trace ref = {0};
+	struct rp_out *expect = NULL;
+	const char *trace = NULL, *save = NULL;
+	int frames = 600, gop = 60, bframes = 2, refs = 4, slices = 1;
+	int latency = 2, runs = 1;
+	int expect_num, errors, opt, i;
+
+	while ((opt = getopt(argc, argv, "f:o:i:n:g:b:r:s:l:x:vh")) != -1) {
+		switch (opt) {
+		case 'f':
+			trace = optarg;
+			break;
+		case 'o':
+			save = optarg;
+			break;
+		case 'i':
+			t.id = atoi(optarg);
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'g':
+			gop = atoi(optarg);
+			break;
+		case 'b':
+			bframes = atoi(optarg);
+			break;
+		case 'r':
+			refs = atoi(optarg);
+			break;
+		case 's':
+			slices = atoi(optarg);
+			break;
+		case 'l':
+			latency = atoi(optarg);
+			break;
+		case 'x':
+			runs = atoi(optarg);
+			break;
+		case 'v':
+			h264_debug_flag |= PRINT_FLAG_DPB_DETAIL;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (gop < 1 || bframes < 0 || refs < 1 || refs > 16 || slices < 1 ||
+		latency < 0 || latency >= DPB_SIZE_MAX || runs < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (trace) {
+		if (rp_load_trace(&t, &ref, trace) < 0)
+			return 1;
+		expect_num = ref.num;
+		expect = calloc(expect_num ? expect_num : 1,
+			sizeof(struct rp_out));
+		for (i = 0; i < expect_num; i++)
+			expect[i].poc = ref.ev[i].arg[0];
+		free(ref.ev);
+		printf("trace %s: decoder %d, %d events, %d outputs\n",
+			trace, t.id, t.num, expect_num);
+	} else {
+		rp_gen(&t, &expect, &expect_num, frames, gop, bframes, refs,
+			slices);
+		printf("generated: %d frames, gop %d, %d B, %d refs, %d slices\n",
+			frames, gop, bframes, refs, slices);
+		if (save && rp_save_trace(&t, expect, expect_num, save) < 0)
+			return 1;
+	}
+	if (!t.num || t.ev[0].type != 'C')
+		printf("warning: trace does not start with a C line\n");
+
+	/* timing over all runs, order and occupancy from the last one */
+	c.disp_latency = latency;
+	for (i = 0; i < runs; i++) {
+		rp_reset(&c);
+		rp_run(&c, &t);
+	}
+
+	rp_print_ns("slice", c.slice_ns, c.slice_num);
+	rp_print_ns("store", c.store_ns, c.store_num);
+	errors = rp_check(&c, expect, expect_num, !trace);
+	printf("output %d of %d, order errors %d, dropped %d\n",
+		c.out_num, expect_num, errors, c.dropped);
+	printf("dpb used ave:%.2f max:%d, ref max:%d, store errors %d, no buffer %d\n",
+		c.pic_count ? (double)c.occupancy_total / c.pic_count : 0.0,
+		c.occupancy_max, c.ref_max, c.store_errors, c.alloc_errors);
+	printf("output latency ave:%.2f max:%d pictures\n",
+		c.out_num ? (double)c.latency_total / c.out_num : 0.0,
+		c.latency_max);
+
+	free(t.ev);
+	free(expect);
+	free(c.out);
+	free(c.slice_ns);
+	free(c.store_ns);
+	return errors || c.out_num != expect_num ? 2 : 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Kernel definitions h264_dpb.c needs, so the DPB manager builds as
+ * plain userspace code for dpb_replay.c. Included ahead of everything
+ * with -include, the linux/ headers next to it only pull this in.
+ * stdlib.h stays out: h264_dpb.c has its own static qsort().
+ */
+#ifndef DPB_REPLAY_KSHIM_H
+#define DPB_REPLAY_KSHIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define printk printf
+#define pr_info printf
+#define pr_err printf
+#define pr_debug printf
+#define KERN_INFO ""
+#define KERN_ERR ""
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* the only vdec state the DPB manager touches */
+struct vdec_frames_s {
+	u32 frame_size;
+	u32 hw_decode_time;
+};
+
+struct vdec_s {
+	struct vdec_frames_s *mvfrm;
+	void *private;
+};
+
+#endif
@@ -49,6 +49,7 @@
 
 #include <linux/amlogic/media/utils/vdec_reg.h>
 #include "../utils/vdec.h"
+#include "../utils/vdec_profile.h"
 #include "../utils/amvdec.h"
 #include "../h264/vh264.h"
 #include "../../../stream_input/amports/streambuf.h"
@@ -892,6 +893,8 @@ struct vdec_h264_hw_s {
 	u32 kpi_first_i_decoded;
 	int sidebind_type;
 	int sidebind_channel_id;
+	/* RPM words last written to the DPB trace */
+	unsigned short trace_rpm[RPM_END - RPM_BEGIN];
 };
 
 static u32 again_threshold;
@@ -913,6 +916,68 @@ static void release_aux_data(struct vdec_h264_hw_s *hw,
 static void h264_clear_dpb(struct vdec_h264_hw_s *hw);
 #endif
 
+/*
+ * DPB trace for test/dpb_replay.c, on with PRINT_FLAG_DPB_TRACE:
+ *	C dpb_size max_ref origin_max_ref colocated_num first_insert bufs
+ *	W row 16 x word		RPM row changed since the last S
+ *	S			h264_slice_header_process()
+ *	P data_flag fast_output	store_picture_in_dpb()
+ *	D			current picture dropped
+ *	F			flush_dpb()
+ *	O poc buf_spec_num	frame sent to display
+ * Every line starts with "dpbtrace <decoder id>".
+ */
+static inline bool dpb_trace_on(struct vdec_h264_hw_s *hw)
+{
+	return dpb_is_debug(DECODE_ID(hw), PRINT_FLAG_DPB_TRACE);
+}
+
+static void dpb_trace_config(struct vdec_h264_hw_s *hw)
+{
+	struct h264_dpb_stru *p_H264_Dpb = &hw->dpb;
+	int i, bufs = 0;
+
+	if (!dpb_trace_on(hw))
+		return;
+	for (i = 0; i < BUFSPEC_POOL_SIZE; i++) {
+		if (hw->buffer_spec[i].cma_alloc_addr ||
+			hw->buffer_spec[i].alloc_header_addr)
+			bufs++;
+	}
+	memset(hw->trace_rpm, 0, sizeof(hw->trace_rpm));
+	pr_info("dpbtrace %d C %d %d %d %d %d %d\n", DECODE_ID(hw),
+		p_H264_Dpb->mDPB.size, p_H264_Dpb->max_reference_size,
+		p_H264_Dpb->origin_max_reference,
+		p_H264_Dpb->colocated_buf_count,
+		p_H264_Dpb->first_insert_frame, bufs);
+}
+
+static void dpb_trace_slice(struct vdec_h264_hw_s *hw)
+{
+	unsigned short *d = hw->dpb.dpb_param.l.data;
+	int i;
+
+	if (!dpb_trace_on(hw))
+		return;
+	for (i = 0; i < RPM_END - RPM_BEGIN; i += 16, d += 16) {
+		if (!memcmp(&hw->trace_rpm[i], d, 16 * sizeof(*d)))
+			continue;
+		memcpy(&hw->trace_rpm[i], d, 16 * sizeof(*d));
+		pr_info("dpbtrace %d W %03x %04x %04x %04x %04x %04x %04x %04x %04x %04x %04x %04x %04x %04x %04x %04x %04x\n",
+			DECODE_ID(hw), i, d[0], d[1], d[2], d[3], d[4], d[5],
+			d[6], d[7], d[8], d[9], d[10], d[11], d[12], d[13],
+			d[14], d[15]);
+	}
+	pr_info("dpbtrace %d S\n", DECODE_ID(hw));
+}
+
+#define dpb_trace(hw, fmt, args...)					\
+	do {								\
+		if (dpb_trace_on(hw))					\
+			pr_info("dpbtrace %d " fmt "\n",		\
+				DECODE_ID(hw), ##args);			\
+	} while (0)
+
 #define		H265_PUT_SAO_4K_SET			0x03
 #define		H265_ABORT_SAO_4K_SET			0x04
 #define		H265_ABORT_SAO_4K_SET_DONE		0x05
@@ -1601,6 +1666,7 @@ static void release_cur_decoding_buf(struct vdec_h264_hw_s *hw)
 {
 	struct h264_dpb_stru *p_H264_Dpb = &hw->dpb;
 	if (p_H264_Dpb->mVideo.dec_picture) {
+		dpb_trace(hw, "D");
 		release_picture(p_H264_Dpb,
 			p_H264_Dpb->mVideo.dec_picture);
 		p_H264_Dpb->mVideo.dec_picture->data_flag &= ~ERROR_FLAG;
@@ -2746,6 +2812,7 @@ int prepare_display_buf(struct vdec_s *vdec, struct FrameStore *frame)
 	}
 
 	display_frame_count[DECODE_ID(hw)]++;
+	dpb_trace(hw, "O %d %d", frame->poc, frame->buf_spec_num);
 
 	if (dpb_is_debug(DECODE_ID(hw),
 	 PRINT_FLAG_DPB_DETAIL)) {
@@ -4023,6 +4090,7 @@ static struct vframe_s *vh264_vf_get(void *op_arg)
 		hw->last_frame_time = time;
 		vf->index_disp = hw->vf_get_count;
 		hw->vf_get_count++;
+		vdec_profile_vf_get(vdec, vf);
 		if (kfifo_peek(&hw->display_q, &next_vf)) {
 			vf->next_vf_pts_valid = true;
 			vf->next_vf_pts = next_vf->pts;
@@ -5032,6 +5100,7 @@ static int vh264_set_params(struct vdec_h264_hw_s *hw,
 		}
 
 		hw->config_bufmgr_done = 1;
+		dpb_trace_config(hw);
 
 	/*end of  config_bufmgr_done */
 	}
@@ -5761,10 +5830,16 @@ static int vh264_pic_done_proc(struct vdec_s *vdec)
 				hw->no_error_i_count = 0xf;
 			} else
 #endif
+			{
+				dpb_trace(hw, "P %d %d",
+					hw->data_flag | hw->dec_flag |
+					p_H264_Dpb->mVideo.dec_picture->data_flag,
+					p_H264_Dpb->fast_output_enable);
 				ret = store_picture_in_dpb(p_H264_Dpb,
 					p_H264_Dpb->mVideo.dec_picture,
 					hw->data_flag | hw->dec_flag |
 				p_H264_Dpb->mVideo.dec_picture->data_flag);
+			}
 
 
 
@@ -6080,8 +6155,10 @@ static irqreturn_t vh264_isr_thread_fn(struct vdec_s *vdec, int irq)
 		I_flag = (p_H264_Dpb->dpb_param.l.data[SLICE_TYPE] == I_Slice)
 			? I_FLAG : 0;
 
-		if ((hw->i_only & 0x2) && (I_flag & I_FLAG))
+		if ((hw->i_only & 0x2) && (I_flag & I_FLAG)) {
+			dpb_trace(hw, "F");
 			flush_dpb(p_H264_Dpb);
+		}
 
 		if ((hw->i_only & 0x2) && (!(I_flag & I_FLAG)) &&
 			(p_H264_Dpb->mSlice.structure == FRAME)) {
@@ -6089,6 +6166,7 @@ static irqreturn_t vh264_isr_thread_fn(struct vdec_s *vdec, int irq)
 				goto pic_done_proc;
 		}
 
+		dpb_trace_slice(hw);
 		slice_header_process_status =
 			h264_slice_header_process(p_H264_Dpb, &frame_num_gap);
 		if (hw->mmu_enable)
@@ -6636,8 +6714,10 @@ static void timeout_process(struct vdec_h264_hw_s *hw)
 		hevc_set_frame_done(hw);
 		hevc_sao_wait_done(hw);
 	}
-	if (!hw->i_only && (error_proc_policy & 0x2))
+	if (!hw->i_only && (error_proc_policy & 0x2)) {
+		dpb_trace(hw, "F");
 		flush_dpb(p_H264_Dpb);
+	}
 	dpb_print(DECODE_ID(hw),
 		PRINT_FLAG_ERROR, "%s decoder timeout\n", __func__);
 	release_cur_decoding_buf(hw);
@@ -8308,6 +8388,7 @@ static int v4l_res_change(struct vdec_h264_hw_s *hw,
 			if (hw->mmu_enable)
 				amhevc_stop();
 			hw->eos = 1;
+			dpb_trace(hw, "F");
 			flush_dpb(p_H264_Dpb);
 			//del_timer_sync(&hw->check_timer);
 			if (hw->is_used_v4l)
@@ -8574,6 +8655,7 @@ result_done:
 		if (hw->mmu_enable)
 			amhevc_stop();
 		hw->eos = 1;
+		dpb_trace(hw, "F");
 		flush_dpb(p_H264_Dpb);
 		if (hw->is_used_v4l)
 			notify_v4l_eos(hw_to_vdec(hw));
@@ -9128,6 +9210,7 @@ static void h264_reconfig(struct vdec_h264_hw_s *hw)
 		PRINT_FLAG_DUMP_BUFSPEC))
 		dump_bufspec(hw, "pre h264_reconfig");
 
+	dpb_trace(hw, "F");
 	flush_dpb(p_H264_Dpb);
 	bufmgr_h264_remove_unused_frame(p_H264_Dpb, 0);
 
@@ -9265,6 +9348,7 @@ static void h264_reset_bufmgr(struct vdec_s *vdec)
 	__func__, hw->decode_pic_count+1,
 	hw->skip_frame_count);
 
+	dpb_trace(hw, "F");
 	flush_dpb(&hw->dpb);
 
 	timeout = jiffies + HZ;
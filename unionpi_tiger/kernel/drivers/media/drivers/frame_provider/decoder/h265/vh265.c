@@ -94,6 +94,7 @@
 #include <linux/amlogic/media/utils/vdec_reg.h>
 
 #include "../utils/vdec.h"
+#include "../utils/vdec_profile.h"
 #include "../utils/amvdec.h"
 #include <linux/amlogic/media/video_sink/video.h>
 #include <linux/amlogic/media/codec_mm/configs.h>
@@ -8308,6 +8309,7 @@ static struct vframe_s *vh265_vf_get(void *op_arg)
 		hevc->show_frame_num++;
 		vf->index_disp = hevc->vf_get_count;
 		hevc->vf_get_count++;
+		vdec_profile_vf_get(hw_to_vdec(hevc), vf);
 
 		if (kfifo_peek(&hevc->display_q, &next_vf)) {
 			vf->next_vf_pts_valid = true;
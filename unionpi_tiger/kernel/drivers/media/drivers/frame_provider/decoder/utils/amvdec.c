@@ -325,29 +325,29 @@ static s32 am_vdec_loadmc_buf_ex(struct vdec_s *vdec,
 static s32 am_loadmc_ex(enum vformat_e type,
 		const char *name, char *def, s32(*load)(const u32 *))
 {
-	char *mc_addr = vmalloc(4096 * 16);
+	struct fw_ref_s ref;
 	char *pmc_addr = def;
 	int err;
 
-	if (!def && mc_addr) {
-		int loaded;
-
-		loaded = get_decoder_firmware_data(type,
-					name, mc_addr, (4096 * 16));
-		if (loaded > 0)
-			pmc_addr = mc_addr;
+	/* no bounce copy, load() reads the preloaded image itself. */
+	if (!def) {
+		if (get_firmware_ref_by_name(name, &ref) > 0)
+			pmc_addr = (char *)ref.data;
+		else
+			put_firmware_ref(&ref);
 	}
 	if (!pmc_addr) {
-		vfree(mc_addr);
+		pr_info("get firmware %s for format %d failed!\n",
+			name, type);
 		return -1;
 	}
 	err = (*load)((u32 *) pmc_addr);
+	if (!def)
+		put_firmware_ref(&ref);
 	if (err < 0) {
 		pr_err("loading firmware %s to vdec ram  failed!\n", name);
-		vfree(mc_addr);
 		return err;
 	}
-	vfree(mc_addr);
 
 	return err;
 }
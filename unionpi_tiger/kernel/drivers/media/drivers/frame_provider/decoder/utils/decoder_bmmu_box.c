@@ -26,6 +26,8 @@
 #include <linux/kfifo.h>
 #include <linux/kthread.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 #include <linux/amlogic/media/codec_mm/codec_mm_scatter.h>
 #include <linux/platform_device.h>
 
@@ -53,6 +55,9 @@ struct decoder_bmmu_box {
 	int change_size_on_need_smaller;
 	int align2n;		/*can overwite on idx alloc */
 	int mem_flags;		/*can overwite on idx alloc */
+	int cache_off;		/*don't park freed buffers in bmmu_cache */
+	int *mm_flags;		/*mem flags of each idx, after mm_list */
+	struct decoder_bmmu_box_stat stat;
 	struct codec_mm_s *mm_list[1];
 };
 
@@ -87,6 +92,235 @@ static int decoder_bmmu_box_mgr_del_box(struct decoder_bmmu_box *box)
 	return 0;
 }
 
+/*
+ *Size class cache of freed buffers. Seeks and resolution changes free
+ *the whole box and allocate the same sizes again right after; parked
+ *buffers save the trip to CMA and its compaction stalls. Bounded by
+ *bmmu_cache_mb and bmmu_cache_ms, disabled with bmmu_cache_mb = 0.
+ *Buffers still held by the video keeper or shared with anyone else are
+ *never parked, and the cache is drained before the keeper is asked to
+ *free memory.
+ */
+#define BMMU_CACHE_OWNER "bmmu_cache"
+
+static u32 bmmu_cache_mb;
+module_param(bmmu_cache_mb, uint, 0664);
+MODULE_PARM_DESC(bmmu_cache_mb, "\n max MB of freed buffers kept, 0 off\n");
+
+static u32 bmmu_cache_ms = 3000;
+module_param(bmmu_cache_ms, uint, 0664);
+MODULE_PARM_DESC(bmmu_cache_ms, "\n ms a freed buffer is kept\n");
+
+struct bmmu_cache_entry {
+	struct list_head list;
+	struct codec_mm_s *mm;
+	int mem_flags;
+	unsigned long put_jiffies;
+};
+
+struct bmmu_cache_s {
+	struct mutex mutex;
+	struct list_head lru;		/*newest first */
+	int num;
+	int total_size;
+	struct delayed_work expire_work;
+	u32 hit;
+	u32 miss;
+	u32 put;
+	u32 skip;			/*not cacheable */
+	u32 evict;			/*over bmmu_cache_mb */
+	u32 expire;			/*older than bmmu_cache_ms */
+	u32 drain;			/*given back on low memory */
+};
+static struct bmmu_cache_s bmmu_cache;
+
+/*4 classes per power of two, a hit wastes at most a quarter.*/
+static int bmmu_cache_class(int size)
+{
+	int order = fls(size);
+
+	if (order <= 3)
+		return size;
+	return (order << 2) | ((size >> (order - 3)) & 3);
+}
+
+static void bmmu_cache_free_entry(struct bmmu_cache_s *c,
+	struct bmmu_cache_entry *e)
+{
+	list_del(&e->list);
+	c->num--;
+	c->total_size -= e->mm->buffer_size;
+	codec_mm_release(e->mm, BMMU_CACHE_OWNER);
+	kfree(e);
+}
+
+static int bmmu_cache_drain(int size)
+{
+	struct bmmu_cache_s *c = &bmmu_cache;
+	struct bmmu_cache_entry *e, *tmp;
+	int freed = 0;
+
+	mutex_lock(&c->mutex);
+	list_for_each_entry_safe_reverse(e, tmp, &c->lru, list) {
+		if (size > 0 && freed >= size)
+			break;
+		freed += e->mm->buffer_size;
+		bmmu_cache_free_entry(c, e);
+		c->drain++;
+	}
+	mutex_unlock(&c->mutex);
+	return freed;
+}
+
+static void bmmu_cache_expire_work(struct work_struct *work)
+{
+	struct bmmu_cache_s *c = &bmmu_cache;
+	struct bmmu_cache_entry *e, *tmp;
+	unsigned long hold = msecs_to_jiffies(bmmu_cache_ms);
+
+	mutex_lock(&c->mutex);
+	list_for_each_entry_safe_reverse(e, tmp, &c->lru, list) {
+		if (time_before(jiffies, e->put_jiffies + hold))
+			break;
+		bmmu_cache_free_entry(c, e);
+		c->expire++;
+	}
+	if (c->num)
+		schedule_delayed_work(&c->expire_work, hold / 2 + 1);
+	mutex_unlock(&c->mutex);
+}
+
+/*takes over mm from box, false if the caller has to release it.*/
+static bool bmmu_cache_put(struct decoder_bmmu_box *box,
+	struct codec_mm_s *mm, int mem_flags)
+{
+	struct bmmu_cache_s *c = &bmmu_cache;
+	struct bmmu_cache_entry *e, *old, *tmp;
+	int max_size = min_t(u32, bmmu_cache_mb, 1024) << 20;
+
+	if (!max_size || box->cache_off)
+		return false;
+	if ((mem_flags & CODEC_MM_FLAGS_TVP) ||
+		mm->buffer_size > max_size ||
+		atomic_read(&mm->use_cnt) != 1 ||
+		is_codec_mm_keeped(mm)) {
+		c->skip++;
+		return false;
+	}
+	e = kzalloc(sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return false;
+	e->mm = mm;
+	e->mem_flags = mem_flags;
+	e->put_jiffies = jiffies;
+	codec_mm_request_shared_mem(mm, BMMU_CACHE_OWNER);
+	codec_mm_release(mm, box->name);
+
+	mutex_lock(&c->mutex);
+	list_for_each_entry_safe_reverse(old, tmp, &c->lru, list) {
+		if (c->total_size + mm->buffer_size <= max_size)
+			break;
+		bmmu_cache_free_entry(c, old);
+		c->evict++;
+	}
+	list_add(&e->list, &c->lru);
+	c->num++;
+	c->total_size += mm->buffer_size;
+	c->put++;
+	if (c->num == 1)
+		schedule_delayed_work(&c->expire_work,
+			msecs_to_jiffies(bmmu_cache_ms) / 2 + 1);
+	mutex_unlock(&c->mutex);
+	return true;
+}
+
+static struct codec_mm_s *bmmu_cache_get(struct decoder_bmmu_box *box,
+	int size, int align2n, int mem_flags)
+{
+	struct bmmu_cache_s *c = &bmmu_cache;
+	struct bmmu_cache_entry *e, *found = NULL;
+	struct codec_mm_s *mm;
+	int class = bmmu_cache_class(size);
+
+	if (box->cache_off)
+		return NULL;
+	mutex_lock(&c->mutex);
+	list_for_each_entry(e, &c->lru, list) {
+		if (e->mem_flags == mem_flags &&
+			e->mm->buffer_size >= size &&
+			bmmu_cache_class(e->mm->buffer_size) == class &&
+			!(e->mm->phy_addr & ((1 << align2n) - 1))) {
+			found = e;
+			break;
+		}
+	}
+	if (found) {
+		list_del(&found->list);
+		c->num--;
+		c->total_size -= found->mm->buffer_size;
+		c->hit++;
+	} else if (c->num || bmmu_cache_mb) {
+		c->miss++;
+	}
+	mutex_unlock(&c->mutex);
+	if (!found)
+		return NULL;
+	mm = found->mm;
+	kfree(found);
+	codec_mm_request_shared_mem(mm, box->name);
+	codec_mm_release(mm, BMMU_CACHE_OWNER);
+	return mm;
+}
+
+static void bmmu_box_release_mm(struct decoder_bmmu_box *box, int idx)
+{
+	struct codec_mm_s *mm = box->mm_list[idx];
+
+	box->mm_list[idx] = NULL;
+	box->total_size -= mm->buffer_size;
+	if (!bmmu_cache_put(box, mm, box->mm_flags[idx]))
+		codec_mm_release(mm, box->name);
+}
+
+void decoder_bmmu_box_set_cache(void *handle, int enable)
+{
+	struct decoder_bmmu_box *box = handle;
+
+	if (box)
+		box->cache_off = !enable;
+}
+EXPORT_SYMBOL(decoder_bmmu_box_set_cache);
+
+/*returns the old limit, parked buffers over the new one are freed.*/
+u32 decoder_bmmu_box_set_cache_mb(u32 mb)
+{
+	u32 old = bmmu_cache_mb;
+	int max_size = min_t(u32, mb, 1024) << 20;
+	int over;
+
+	bmmu_cache_mb = mb;
+	mutex_lock(&bmmu_cache.mutex);
+	over = bmmu_cache.total_size - max_size;
+	mutex_unlock(&bmmu_cache.mutex);
+	if (!mb)
+		bmmu_cache_drain(0);
+	else if (over > 0)
+		bmmu_cache_drain(over);
+	return old;
+}
+EXPORT_SYMBOL(decoder_bmmu_box_set_cache_mb);
+
+void decoder_bmmu_box_get_stat(void *handle,
+	struct decoder_bmmu_box_stat *stat)
+{
+	struct decoder_bmmu_box *box = handle;
+
+	mutex_lock(&box->mutex);
+	*stat = box->stat;
+	mutex_unlock(&box->mutex);
+}
+EXPORT_SYMBOL(decoder_bmmu_box_get_stat);
+
 bool decoder_bmmu_box_valide_check(void *box)
 {
 	struct decoder_bmmu_box_mgr *mgr = get_decoder_bmmu_box_mgr();
@@ -119,8 +353,8 @@ void *decoder_bmmu_box_alloc_box(const char *name,
 
 	pr_debug("decoder_bmmu_box_alloc_box, tvp_flags = %x\n", tvp_flags);
 
-	size = sizeof(struct decoder_bmmu_box) + sizeof(struct codec_mm_s *) *
-		   max_num;
+	size = sizeof(struct decoder_bmmu_box) + (sizeof(struct codec_mm_s *) +
+		   sizeof(int)) * max_num;
 	box = kmalloc(size, GFP_KERNEL);
 	if (!box) {
 		pr_err("can't alloc decoder buffers box!!!\n");
@@ -132,6 +366,7 @@ void *decoder_bmmu_box_alloc_box(const char *name,
 	box->channel_id = channel_id;
 	box->align2n = aligned;
 	box->mem_flags = mem_flags | tvp_flags;
+	box->mm_flags = (int *)&box->mm_list[max_num];
 	mutex_init(&box->mutex);
 	INIT_LIST_HEAD(&box->list);
 	decoder_bmmu_box_mgr_add_box(box);
@@ -178,22 +413,34 @@ int decoder_bmmu_box_alloc_idx(void *handle, int idx, int size, int aligned_2n,
 				invalid = 4;
 			}
 			if (invalid) {
-				box->total_size -= mm->buffer_size;
-				codec_mm_release(mm, box->name);
-				box->mm_list[idx] = NULL;
+				bmmu_box_release_mm(box, idx);
 				mm = NULL;
 			}
 		} else {
-			box->total_size -= mm->buffer_size;
-			codec_mm_release(mm, box->name);
-			box->mm_list[idx] = NULL;
+			bmmu_box_release_mm(box, idx);
 			mm = NULL;
 		}
 	}
 	if (!mm) {
-		mm = codec_mm_alloc(box->name, size, align, memflags);
+		box->stat.alloc++;
+		mm = bmmu_cache_get(box, size, align, memflags);
+		if (mm) {
+			box->stat.hit++;
+		} else {
+			u64 start = ktime_get_ns(), ns;
+
+			mm = codec_mm_alloc(box->name, size, align, memflags);
+			if (!mm && bmmu_cache_drain(size) > 0)
+				mm = codec_mm_alloc(box->name, size, align,
+					memflags);
+			ns = ktime_get_ns() - start;
+			box->stat.stall_ns += ns;
+			if (ns > box->stat.stall_max_ns)
+				box->stat.stall_max_ns = ns;
+		}
 		if (mm) {
 			box->mm_list[idx] = mm;
+			box->mm_flags[idx] = memflags;
 			box->total_size += mm->buffer_size;
 			mm->ins_id = box->channel_id;
 			mm->ins_buffer_id = idx;
@@ -207,7 +454,6 @@ int decoder_bmmu_box_alloc_idx(void *handle, int idx, int size, int aligned_2n,
 int decoder_bmmu_box_free_idx(void *handle, int idx)
 {
 	struct decoder_bmmu_box *box = handle;
-	struct codec_mm_s *mm;
 
 	if (!box || idx < 0 || idx >= box->max_mm_num) {
 		pr_err("can't free idx of box(%p),idx:%d  in (%d-%d)\n",
@@ -216,12 +462,8 @@ int decoder_bmmu_box_free_idx(void *handle, int idx)
 		return -1;
 	}
 	mutex_lock(&box->mutex);
-	mm = box->mm_list[idx];
-	if (mm) {
-		box->total_size -= mm->buffer_size;
-		codec_mm_release(mm, box->name);
-		box->mm_list[idx] = NULL;
-		mm = NULL;
+	if (box->mm_list[idx]) {
+		bmmu_box_release_mm(box, idx);
 		box->box_ref_cnt--;
 	}
 	mutex_unlock(&box->mutex);
@@ -232,7 +474,6 @@ EXPORT_SYMBOL(decoder_bmmu_box_free_idx);
 int decoder_bmmu_box_free(void *handle)
 {
 	struct decoder_bmmu_box *box = handle;
-	struct codec_mm_s *mm;
 	int i;
 
 	if (!box) {
@@ -241,11 +482,8 @@ int decoder_bmmu_box_free(void *handle)
 	}
 	mutex_lock(&box->mutex);
 	for (i = 0; i < box->max_mm_num; i++) {
-		mm = box->mm_list[i];
-		if (mm) {
-			codec_mm_release(mm, box->name);
-			box->mm_list[i] = NULL;
-		}
+		if (box->mm_list[i])
+			bmmu_box_release_mm(box, i);
 	}
 	mutex_unlock(&box->mutex);
 	decoder_bmmu_box_mgr_del_box(box);
@@ -334,6 +572,11 @@ void *decoder_bmmu_box_get_virt_addr(void *box_handle, int idx)
 /*flags: &0x1 for wait,*/
 int decoder_bmmu_box_check_and_wait_size(int size, int flags)
 {
+	int free_size = codec_mm_get_free_size();
+
+	/*parked buffers go before anything the keeper holds.*/
+	if (free_size < size)
+		bmmu_cache_drain(size - free_size);
 	if ((flags & BMMU_ALLOC_FLAGS_CAN_CLEAR_KEEPER) &&
 		codec_mm_get_free_size() < size) {
 		pr_err("CMA force free keep,for size = %d\n", size);
@@ -485,12 +728,29 @@ static int decoder_bmmu_box_dump_all(void *buf, int size)
 		pbuf += s; \
 	} while (0)
 
+	mutex_lock(&bmmu_cache.mutex);
+	BUFPRINT("cache: %d bufs, size:%d, max:%dM, hold:%dms\n",
+		bmmu_cache.num, bmmu_cache.total_size,
+		bmmu_cache_mb, bmmu_cache_ms);
+	BUFPRINT("cache: hit:%u miss:%u put:%u skip:%u\n",
+		bmmu_cache.hit, bmmu_cache.miss,
+		bmmu_cache.put, bmmu_cache.skip);
+	BUFPRINT("cache: evict:%u expire:%u drain:%u\n",
+		bmmu_cache.evict, bmmu_cache.expire, bmmu_cache.drain);
+	mutex_unlock(&bmmu_cache.mutex);
+	if (!buf) {
+		pr_info("%s", sbuf);
+		pbuf = sbuf;
+		tsize = 0;
+	}
+
 	mutex_lock(&mgr->mutex);
 	head = &mgr->box_list;
 	list = head->next;
 	i = 0;
 	while (list != head) {
 		struct decoder_bmmu_box *box;
+		u32 miss;
 
 		box = list_entry(list, struct decoder_bmmu_box, list);
 		BUFPRINT("box[%d]: %s, %splayer_id:%d, max_num:%d, size:%d\n",
@@ -500,6 +760,12 @@ static int decoder_bmmu_box_dump_all(void *buf, int size)
 				 box->channel_id,
 				 box->max_mm_num,
 				 box->total_size);
+		miss = box->stat.alloc - box->stat.hit;
+		BUFPRINT("\talloc:%u, hit:%u, stall ave:%lluus max:%lluus\n",
+				 box->stat.alloc, box->stat.hit,
+				 miss ? div_u64(box->stat.stall_ns,
+					miss * NSEC_PER_USEC) : 0,
+				 div_u64(box->stat.stall_max_ns, NSEC_PER_USEC));
 		if (buf) {
 			s = decoder_bmmu_box_dump(box, pbuf, size - tsize);
 			if (s > 0) {
@@ -509,7 +775,8 @@ static int decoder_bmmu_box_dump_all(void *buf, int size)
 		} else {
 			pr_info("%s", sbuf);
 			pbuf = sbuf;
-			tsize += decoder_bmmu_box_dump(box, NULL, 0);
+			tsize = 0;
+			decoder_bmmu_box_dump(box, NULL, 0);
 		}
 		list = list->next;
 		i++;
@@ -541,6 +808,8 @@ static ssize_t box_debug_show(struct class *class,
 	size += sprintf(buf + size, "n==0: clear all debugs)\n");
 	size += sprintf(buf + size,
 	"n=1: dump all box\n");
+	size += sprintf(buf + size,
+	"n=2: drop the buffer cache\n");
 
 	return size;
 }
@@ -560,6 +829,9 @@ static ssize_t box_debug_store(struct class *class,
 	case 1:
 		decoder_bmmu_box_dump_all(NULL , 0);
 		break;
+	case 2:
+		bmmu_cache_drain(0);
+		break;
 	default:
 		pr_err("unknow cmd! %d\n", val);
 	}
@@ -567,7 +839,6 @@ static ssize_t box_debug_store(struct class *class,
 
 }
 
-
 static CLASS_ATTR_RO(box_dump);
 static CLASS_ATTR_RW(box_debug);
 
@@ -591,14 +862,22 @@ int decoder_bmmu_box_init(void)
 	memset(&global_blk_mgr, 0, sizeof(global_blk_mgr));
 	INIT_LIST_HEAD(&global_blk_mgr.box_list);
 	mutex_init(&global_blk_mgr.mutex);
+	mutex_init(&bmmu_cache.mutex);
+	INIT_LIST_HEAD(&bmmu_cache.lru);
+	INIT_DELAYED_WORK(&bmmu_cache.expire_work, bmmu_cache_expire_work);
 	r = class_register(&decoder_bmmu_box_class);
+	if (!r)
+		codec_mm_selftest_register(&decoder_bmmu_box_cache_selftest);
 	return r;
 }
 EXPORT_SYMBOL(decoder_bmmu_box_init);
 
 void decoder_bmmu_box_exit(void)
 {
+	codec_mm_selftest_unregister(&decoder_bmmu_box_cache_selftest);
 	class_unregister(&decoder_bmmu_box_class);
+	cancel_delayed_work_sync(&bmmu_cache.expire_work);
+	bmmu_cache_drain(0);
 	pr_info("dec bmmu box exit.\n");
 }
 
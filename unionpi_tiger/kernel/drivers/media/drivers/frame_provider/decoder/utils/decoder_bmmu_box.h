@@ -39,6 +39,9 @@ unsigned long decoder_bmmu_box_get_phy_addr(
 void *decoder_bmmu_box_get_virt_addr(
 	void *box_handle, int idx);
 
+int decoder_bmmu_box_get_mem_size(
+	void *box_handle, int idx);
+
 /*flags: &0x1 for wait,*/
 int decoder_bmmu_box_check_and_wait_size(
 	int size, int flags);
@@ -63,6 +66,20 @@ int decoder_bmmu_box_alloc_idx_wait(
 bool decoder_bmmu_box_valide_check(void *box);
 void decoder_bmmu_try_to_release_box(void *handle);
 
+struct decoder_bmmu_box_stat {
+	u32 alloc;
+	u32 hit;		/*served from the freed buffer cache */
+	u64 stall_ns;		/*spent in codec_mm_alloc */
+	u64 stall_max_ns;
+};
+
+/*boxes use the cache by default when bmmu_cache_mb is set.*/
+void decoder_bmmu_box_set_cache(void *handle, int enable);
+u32 decoder_bmmu_box_set_cache_mb(u32 mb);
+void decoder_bmmu_box_get_stat(void *handle,
+	struct decoder_bmmu_box_stat *stat);
+extern struct codec_mm_selftest_s decoder_bmmu_box_cache_selftest;
+
 int decoder_bmmu_box_init(void);
 void decoder_bmmu_box_exit(void);
 
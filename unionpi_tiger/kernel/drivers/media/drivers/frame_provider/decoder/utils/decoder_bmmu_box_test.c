@@ -0,0 +1,169 @@
+/*
+ * drivers/amlogic/media/frame_provider/decoder/utils/decoder_bmmu_box_test.c
+ *
+ * Copyright (C) 2016 Amlogic, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/sizes.h>
+#include <linux/amlogic/media/codec_mm/codec_mm.h>
+
+#include "decoder_bmmu_box.h"
+
+/*
+ *Seek storm self test. Every round opens a box, allocates the frame
+ *buffers the way a decoder does after a seek and frees the whole box
+ *again; every 8th round switches buffer size like a resolution change.
+ *Runs once with the buffer cache off and once with it on, sized for
+ *one round of the larger buffers; bmmu_cache_mb is restored after:
+ *	echo "decoder_bmmu_box_cache <rounds> <bufs> <buf size>" \
+ *		> /sys/class/codec_mm/selftest
+ */
+#define CACHE_TEST_ROUNDS 64
+#define CACHE_TEST_BUFS 8
+#define CACHE_TEST_BUF_SIZE (4 * SZ_1M)
+#define CACHE_TEST_ALIGN 16
+
+struct cache_test_s {
+	struct decoder_bmmu_box_stat stat;
+	u64 ns;
+	int errors;
+};
+
+static int cache_test_size(int buf_size, int round)
+{
+	/*1080p-ish, then 4k-ish, then back.*/
+	return ((round >> 3) & 1) ? buf_size * 2 : buf_size;
+}
+
+static void cache_test_round(struct cache_test_s *t, int round,
+	int bufs, int buf_size, int cache)
+{
+	struct decoder_bmmu_box_stat stat;
+	unsigned long addr, prev = 0;
+	void *box;
+	int size = cache_test_size(buf_size, round);
+	int i;
+
+	box = decoder_bmmu_box_alloc_box("bmmu_cache_test", 0, bufs,
+		CACHE_TEST_ALIGN, CODEC_MM_FLAGS_CMA_CLEAR);
+	if (!box) {
+		t->errors++;
+		return;
+	}
+	decoder_bmmu_box_set_cache(box, cache);
+	for (i = 0; i < bufs; i++) {
+		if (decoder_bmmu_box_alloc_idx(box, i, size, -1, -1) < 0) {
+			if (t->errors++ < 16)
+				pr_err("cache test: round %d buf %d no memory\n",
+					round, i);
+			break;
+		}
+		addr = decoder_bmmu_box_get_phy_addr(box, i);
+		if (decoder_bmmu_box_get_mem_size(box, i) < size ||
+			(addr & ((1 << CACHE_TEST_ALIGN) - 1)) ||
+			addr == prev) {
+			if (t->errors++ < 16)
+				pr_err("cache test: round %d buf %d bad %lx size %d\n",
+					round, i, addr,
+					decoder_bmmu_box_get_mem_size(box, i));
+		}
+		prev = addr;
+	}
+	decoder_bmmu_box_get_stat(box, &stat);
+	t->stat.alloc += stat.alloc;
+	t->stat.hit += stat.hit;
+	t->stat.stall_ns += stat.stall_ns;
+	if (stat.stall_max_ns > t->stat.stall_max_ns)
+		t->stat.stall_max_ns = stat.stall_max_ns;
+	decoder_bmmu_box_free(box);
+}
+
+static void cache_test_run(struct cache_test_s *t, int rounds,
+	int bufs, int buf_size, int cache)
+{
+	u64 start = ktime_get_ns();
+	int i;
+
+	for (i = 0; i < rounds; i++)
+		cache_test_round(t, i, bufs, buf_size, cache);
+	t->ns = ktime_get_ns() - start;
+}
+
+static void cache_test_report(const char *name, struct cache_test_s *t)
+{
+	u32 miss = t->stat.alloc - t->stat.hit;
+
+	pr_info("cache test: %s %llu ms, alloc %u hit %u, stall ave %llu us max %llu us\n",
+		name, div_u64(t->ns, NSEC_PER_MSEC),
+		t->stat.alloc, t->stat.hit,
+		miss ? div_u64(t->stat.stall_ns, miss * NSEC_PER_USEC) : 0,
+		div_u64(t->stat.stall_max_ns, NSEC_PER_USEC));
+}
+
+static int decoder_bmmu_box_cache_test(int rounds, int bufs, int buf_size)
+{
+	struct cache_test_s *t;
+	u32 cache_mb;
+	int ret;
+
+	if (rounds <= 0)
+		rounds = CACHE_TEST_ROUNDS;
+	if (bufs <= 0)
+		bufs = CACHE_TEST_BUFS;
+	if (buf_size <= 0)
+		buf_size = CACHE_TEST_BUF_SIZE;
+	t = kcalloc(2, sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+
+	cache_test_run(&t[0], rounds, bufs, buf_size, 0);
+	cache_mb = decoder_bmmu_box_set_cache_mb(
+		max_t(u32, DIV_ROUND_UP((u64)bufs * buf_size * 2, SZ_1M), 1));
+	cache_test_run(&t[1], rounds, bufs, buf_size, 1);
+	decoder_bmmu_box_set_cache_mb(cache_mb);
+
+	if (t[0].stat.hit) {
+		t[0].errors++;
+		pr_err("cache test: %u hits with the cache off\n",
+			t[0].stat.hit);
+	}
+	cache_test_report("uncached", &t[0]);
+	cache_test_report("cached", &t[1]);
+	if (rounds > 1 && !t[1].stat.hit) {
+		t[1].errors++;
+		pr_err("cache test: no hits with the cache on\n");
+	}
+	pr_info("cache test: %d rounds of %d bufs, %d errors\n",
+		rounds, bufs, t[0].errors + t[1].errors);
+	ret = (t[0].errors + t[1].errors) ? -EINVAL : 0;
+	kfree(t);
+	return ret;
+}
+
+/*"<rounds> <bufs> <buf size>"*/
+static int decoder_bmmu_box_cache_selftest_run(const char *args)
+{
+	int rounds = 0, bufs = 0, buf_size = 0;
+
+	sscanf(args, "%d %d %d", &rounds, &bufs, &buf_size);
+	return decoder_bmmu_box_cache_test(rounds, bufs, buf_size);
+}
+
+struct codec_mm_selftest_s decoder_bmmu_box_cache_selftest = {
+	.name = "decoder_bmmu_box_cache",
+	.run = decoder_bmmu_box_cache_selftest_run,
+};
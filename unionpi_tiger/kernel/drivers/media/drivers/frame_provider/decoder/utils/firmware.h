@@ -36,6 +36,9 @@ extern int get_decoder_firmware_data(enum vformat_e type,
 	const char *file_name, char *buf, int size);
 extern int get_data_from_name(const char *name, char *buf);
 extern int get_firmware_data(unsigned int foramt, char *buf);
+extern int get_firmware_ref(unsigned int format, struct fw_ref_s *ref);
+extern int get_firmware_ref_by_name(const char *name, struct fw_ref_s *ref);
+extern void put_firmware_ref(struct fw_ref_s *ref);
 extern int video_fw_reload(int mode);
 
 #endif
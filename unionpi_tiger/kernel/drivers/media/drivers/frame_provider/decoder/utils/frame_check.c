@@ -43,6 +43,37 @@
 #include <linux/page-flags.h>
 #include "../../../common/chips/decoder_cpu_ver_info.h"
 #include <asm/cacheflush.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/device.h>
+#include <uapi/linux/amlogic/media/frame_check.h>
+
+/*
+ * Checking modes, fc_mode with fc_sample = N, for a 3840x2160 NV21
+ * frame (12.4 MB):
+ *
+ *	mode		read/frame	invalidated	frames to cover
+ *	0 full		12.4 MB		12.4 MB		1
+ *	1 line		12.4 MB / N	12.4 MB / N	N
+ *	2 tile		12.4 MB / N	12.4 MB / N	N
+ *
+ * The sampled modes move their start line/tile by one every frame,
+ * so N frames of a still picture cover all of it. Tile mode reads
+ * 64 byte x 16 line blocks spread over the picture, a local error
+ * shows up sooner than with whole lines. Their crcs only compare
+ * with crcs taken with the same mode and N.
+ *
+ * fc_hw_crc reads through the cacheable linear mapping, only
+ * invalidating the sampled lines. Without it each plane is vmapped
+ * once per frame. crc32_le() itself uses the ARMv8 CRC32
+ * instructions where the cpu has them.
+ *
+ * The cost of each frame, from the cache invalidate to the stored
+ * crc, is measured and shown per mode by cat frame_check. The crcs
+ * are read as struct fc_crc_rec_s from /dev/frame_check, while that
+ * is open the per frame printk is off.
+ */
 
 #define FC_ERROR	0x0
 
@@ -65,6 +96,9 @@
 
 static unsigned int fc_debug;
 static unsigned int size_yuv_buf = (YUV_DEF_SIZE * YUV_DEF_NUM);
+static unsigned int fc_mode = FC_MODE_FULL;
+static unsigned int fc_sample = 16;
+static unsigned int fc_hw_crc = 1;
 
 #define dbg_print(mask, ...) do {					\
 			if ((fc_debug & mask) ||				\
@@ -84,6 +118,217 @@ static unsigned int yuv_start[MAX_INSTANCE_MUN];
 static unsigned int yuv_num[MAX_INSTANCE_MUN];
 
 
+#define FC_RING_SIZE	1024	/* power of 2 */
+#define FC_DEV_NAME	"frame_check"
+
+/*
+ * Records of all instances, lock free: a writer takes a position by
+ * incrementing head and publishes the slot with seq = position + 1.
+ * Nothing ever waits for the reader, it loses the oldest records
+ * when it falls more than FC_RING_SIZE behind.
+ */
+struct fc_ring_slot_s {
+	u32 seq;
+	struct fc_crc_rec_s rec;
+};
+
+struct fc_ring_s {
+	atomic_t head;
+	atomic_t readers;
+	atomic_t lost;
+	wait_queue_head_t wait;
+	struct fc_ring_slot_s slot[FC_RING_SIZE];
+};
+
+static struct fc_ring_s *fc_ring;
+static int fc_dev_major;
+
+static void fc_ring_put(struct fc_crc_rec_s *rec)
+{
+	struct fc_ring_s *ring = fc_ring;
+	struct fc_ring_slot_s *slot;
+	u32 pos;
+
+	if (!ring)
+		return;
+	pos = (u32)atomic_inc_return(&ring->head) - 1;
+	slot = &ring->slot[pos & (FC_RING_SIZE - 1)];
+
+	WRITE_ONCE(slot->seq, 0);
+	smp_wmb();
+	rec->seq = pos;
+	slot->rec = *rec;
+	smp_store_release(&slot->seq, pos + 1);
+
+	if (atomic_read(&ring->readers))
+		wake_up_interruptible(&ring->wait);
+}
+
+/* the record at tail is published, or the writers lapped the reader */
+static bool fc_ring_ready(u32 tail)
+{
+	struct fc_ring_s *ring = fc_ring;
+	u32 head = (u32)atomic_read(&ring->head);
+
+	if (head == tail)
+		return false;
+	if (head - tail > FC_RING_SIZE)
+		return true;
+	return smp_load_acquire(&ring->slot[tail & (FC_RING_SIZE - 1)].seq) ==
+		tail + 1;
+}
+
+/* 1: got one, 0: nothing new or still being written */
+static int fc_ring_get(u32 *tail, struct fc_crc_rec_s *rec)
+{
+	struct fc_ring_s *ring = fc_ring;
+	struct fc_ring_slot_s *slot;
+	u32 head, seq;
+
+	for (;;) {
+		head = (u32)atomic_read(&ring->head);
+		if (head == *tail)
+			return 0;
+		if (head - *tail > FC_RING_SIZE) {
+			atomic_add(head - *tail - FC_RING_SIZE, &ring->lost);
+			*tail = head - FC_RING_SIZE;
+		}
+		slot = &ring->slot[*tail & (FC_RING_SIZE - 1)];
+		seq = smp_load_acquire(&slot->seq);
+		if (seq != *tail + 1) {
+			/* lapped meanwhile, or still being written */
+			if ((u32)atomic_read(&ring->head) - *tail > FC_RING_SIZE)
+				continue;
+			return 0;
+		}
+		*rec = slot->rec;
+		smp_rmb();
+		if (READ_ONCE(slot->seq) != seq)
+			continue;
+		(*tail)++;
+		return 1;
+	}
+}
+
+static int fc_dev_open(struct inode *inode, struct file *file)
+{
+	u32 *tail;
+
+	if (!fc_ring)
+		return -ENODEV;
+	tail = kmalloc(sizeof(*tail), GFP_KERNEL);
+	if (!tail)
+		return -ENOMEM;
+	/* only the records from now on */
+	*tail = (u32)atomic_read(&fc_ring->head);
+	file->private_data = tail;
+	atomic_inc(&fc_ring->readers);
+	return 0;
+}
+
+static int fc_dev_release(struct inode *inode, struct file *file)
+{
+	atomic_dec(&fc_ring->readers);
+	kfree(file->private_data);
+	return 0;
+}
+
+static ssize_t fc_dev_read(struct file *file, char __user *buf,
+	size_t count, loff_t *ppos)
+{
+	u32 *tail = file->private_data;
+	struct fc_crc_rec_s rec;
+	size_t done = 0;
+	int ret;
+
+	if (count < sizeof(rec))
+		return -EINVAL;
+
+	while (done + sizeof(rec) <= count) {
+		if (!fc_ring_get(tail, &rec)) {
+			if (done)
+				break;
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			/* fc_ring_put() wakes us once the slot is published */
+			ret = wait_event_interruptible(fc_ring->wait,
+				fc_ring_ready(*tail));
+			if (ret)
+				return ret;
+			continue;
+		}
+		if (copy_to_user(buf + done, &rec, sizeof(rec)))
+			return done ? done : -EFAULT;
+		done += sizeof(rec);
+	}
+	return done;
+}
+
+static __poll_t fc_dev_poll(struct file *file, poll_table *wait)
+{
+	u32 *tail = file->private_data;
+
+	poll_wait(file, &fc_ring->wait, wait);
+	if (fc_ring_ready(*tail))
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations fc_dev_fops = {
+	.owner = THIS_MODULE,
+	.open = fc_dev_open,
+	.release = fc_dev_release,
+	.read = fc_dev_read,
+	.poll = fc_dev_poll,
+	.llseek = noop_llseek,
+};
+
+int frame_check_dev_init(struct class *cls)
+{
+	struct device *dev;
+
+	fc_ring = vzalloc(sizeof(*fc_ring));
+	if (!fc_ring)
+		return -ENOMEM;
+	init_waitqueue_head(&fc_ring->wait);
+
+	fc_dev_major = register_chrdev(0, FC_DEV_NAME, &fc_dev_fops);
+	if (fc_dev_major <= 0) {
+		pr_err("frame_check: register chrdev failed %d\n",
+			fc_dev_major);
+		goto err;
+	}
+	dev = device_create(cls, NULL, MKDEV(fc_dev_major, 0), NULL,
+		FC_DEV_NAME);
+	if (IS_ERR(dev)) {
+		pr_err("frame_check: create device failed\n");
+		unregister_chrdev(fc_dev_major, FC_DEV_NAME);
+		goto err;
+	}
+	return 0;
+err:
+	fc_dev_major = 0;
+	vfree(fc_ring);
+	fc_ring = NULL;
+	return -ENODEV;
+}
+
+void frame_check_dev_exit(struct class *cls)
+{
+	if (fc_dev_major > 0) {
+		device_destroy(cls, MKDEV(fc_dev_major, 0));
+		unregister_chrdev(fc_dev_major, FC_DEV_NAME);
+		fc_dev_major = 0;
+	}
+	vfree(fc_ring);
+	fc_ring = NULL;
+}
+
+static inline bool fc_has_reader(void)
+{
+	return fc_ring && atomic_read(&fc_ring->readers);
+}
+
 static inline void set_enable(struct pic_check_mgr_t *p, int mask)
 {
 	p->enable |= mask;
@@ -562,6 +807,30 @@ static int do_yuv_dump(struct pic_check_mgr_t *mgr, struct vframe_s *vf)
 	return 0;
 }
 
+static void crc_record(struct pic_check_mgr_t *mgr, u32 crc_y, u32 crc_uv)
+{
+	struct fc_crc_rec_s rec;
+	u64 now = ktime_get_ns();
+	u32 mode = min_t(u32, fc_mode, FC_MODE_MAX - 1);
+	u32 cost = (u32)min_t(u64, now - mgr->check_start_ns, U32_MAX);
+
+	mgr->cost_sum_ns[mode] += cost;
+	mgr->cost_cnt[mode]++;
+	if (cost > mgr->cost_max_ns[mode])
+		mgr->cost_max_ns[mode] = cost;
+
+	rec.id = mgr->id;
+	rec.mode = mode;
+	rec.sample = (mode == FC_MODE_FULL) ? 1 :
+		clamp_t(u32, fc_sample, 1, 1024);
+	rec.frame = mgr->frame_cnt;
+	rec.crc_y = crc_y;
+	rec.crc_uv = crc_uv;
+	rec.cost_ns = cost;
+	rec.ts_ns = now;
+	fc_ring_put(&rec);
+}
+
 static int crc_store(struct pic_check_mgr_t *mgr, struct vframe_s *vf,
 	int crc_y, int crc_uv)
 {
@@ -570,7 +839,11 @@ static int crc_store(struct pic_check_mgr_t *mgr, struct vframe_s *vf,
 	int comp_frame = 0, comp_crc_y, comp_crc_uv;
 	struct pic_check_t *check = &mgr->pic_check;
 
+	crc_record(mgr, crc_y, crc_uv);
+
 	if (kfifo_get(&check->new_chk_q, &crc_addr) == 0) {
+		if (fc_has_reader())
+			return -1;
 		dbg_print(0, "%08d: %08x %08x\n",
 			mgr->frame_cnt, crc_y, crc_uv);
 		if (check->check_fp) {
@@ -605,7 +878,7 @@ static int crc_store(struct pic_check_mgr_t *mgr, struct vframe_s *vf,
 			dbg_print(0, "frame num error: frame_cnt(%d) frame_comp(%d)\n",
 				mgr->frame_cnt, comp_frame);
 		}
-	} else {
+	} else if (!fc_has_reader() || (fc_debug & FC_CRC_DEBUG)) {
 		dbg_print(0, "%08d: %08x %08x\n", mgr->frame_cnt, crc_y, crc_uv);
 	}
 
@@ -688,6 +961,86 @@ static int crc32_vmap_le(unsigned int *crc32,
 	return 0;
 }
 
+static int fc_span_crc(u32 *crc, void *vaddr, ulong phyaddr,
+	u32 offset, u32 len)
+{
+	if (vaddr) {
+		codec_mm_dma_flush(vaddr + offset, len, DMA_FROM_DEVICE);
+		*crc = crc32_le(*crc, vaddr + offset, len);
+		return 0;
+	}
+	return crc32_vmap_le(crc, phyaddr + offset, len);
+}
+
+/*
+ * Sampled crc of one plane, w bytes of h lines. The lines/tiles read
+ * start at phase and are n apart. Without a kernel mapping the plane
+ * is vmapped once for all of them.
+ */
+static int fc_plane_crc(u32 *crc, void *vaddr, ulong phyaddr,
+	u32 w, u32 h, u32 stride, u32 mode, u32 n, u32 phase)
+{
+	u32 cols = DIV_ROUND_UP(w, FC_TILE_W);
+	u32 rows = DIV_ROUND_UP(h, FC_TILE_H);
+	u32 i, k, r, c, y, len;
+	void *map = NULL;
+	int ret = 0;
+
+	/*single mode cannot use codec_mm_vmap*/
+	if (!vaddr && !single_mode_vdec && h) {
+		map = codec_mm_vmap(phyaddr, (h - 1) * stride + w);
+		vaddr = map;
+	}
+	/* kmap a page at a time, tiles are too small for that */
+	if (!vaddr)
+		mode = FC_MODE_LINE;
+
+	if (mode == FC_MODE_LINE) {
+		for (i = phase % n; i < h; i += n)
+			ret |= fc_span_crc(crc, vaddr, phyaddr,
+				i * stride, w);
+		goto out;
+	}
+
+	for (k = phase % n; k < rows * cols; k += n) {
+		r = k / cols;
+		c = k % cols;
+		len = min_t(u32, FC_TILE_W, w - c * FC_TILE_W);
+		for (y = r * FC_TILE_H; y < min(h, (r + 1) * FC_TILE_H); y++)
+			ret |= fc_span_crc(crc, vaddr, phyaddr,
+				y * stride + c * FC_TILE_W, len);
+	}
+out:
+	if (map)
+		codec_mm_unmap_phyaddr(map);
+	return ret;
+}
+
+static int do_check_nv21_sampled(struct pic_check_mgr_t *mgr,
+	struct vframe_s *vf, u32 mode)
+{
+	u32 crc_y = 0, crc_uv = 0;
+	u32 n = clamp_t(u32, fc_sample, 1, 1024);
+	void *y_vaddr = fc_hw_crc ? mgr->y_vaddr : NULL;
+	void *uv_vaddr = fc_hw_crc ? mgr->uv_vaddr : NULL;
+	int ret;
+
+	ret = fc_plane_crc(&crc_y, y_vaddr, mgr->y_phyaddr,
+		vf->width, vf->height, mgr->canvas_w,
+		mode, n, mgr->frame_cnt);
+	ret |= fc_plane_crc(&crc_uv, uv_vaddr, mgr->uv_phyaddr,
+		vf->width, vf->height / 2, mgr->canvas_w,
+		mode, n, mgr->frame_cnt);
+	if (ret < 0) {
+		dbg_print(0, "calc sampled crc failed\n");
+		return ret;
+	}
+
+	crc_store(mgr, vf, crc_y, crc_uv);
+
+	return 0;
+}
+
 static int do_check_nv21(struct pic_check_mgr_t *mgr, struct vframe_s *vf)
 {
 	int i;
@@ -919,12 +1272,24 @@ int decoder_do_frame_check(struct vdec_s *vdec, struct vframe_s *vf)
 		resize = 0;
 	mgr->last_size_pic = mgr->size_pic;
 
+	mgr->check_start_ns = ktime_get_ns();
 	if ((vf->type & VIDTYPE_VIU_NV21) || (mgr->mjpeg_flag)) {
 		int flush_size;
+		u32 mode = fc_mode;
 
 		if (canvas_get_virt_addr(mgr, vf) < 0)
 			return -2;
 
+		/* sampled modes invalidate only what they read */
+		if (mode >= FC_MODE_MAX || mgr->mjpeg_flag ||
+			vf->width > mgr->canvas_w)
+			mode = FC_MODE_FULL;
+		if ((mgr->enable & CRC_MASK) && !(mgr->enable & YUV_MASK) &&
+			mode != FC_MODE_FULL) {
+			ret = do_check_nv21_sampled(mgr, vf, mode);
+			goto out;
+		}
+
 		/* flush */
 		flush_size = mgr->mjpeg_flag ?
 				((mgr->canvas_w * mgr->canvas_h) >> 2) :
@@ -969,6 +1334,7 @@ int decoder_do_frame_check(struct vdec_s *vdec, struct vframe_s *vf)
 				(void *)planes[1], (void *)planes[2]);
 		}
 	}
+out:
 	mgr->frame_cnt++;
 
 	if (mgr->usr_cmp_num > 0) {
@@ -1293,6 +1659,28 @@ ssize_t frame_check_show(struct class *class,
 	pbuf += sprintf(pbuf,
 		"\nUsage:\techo [id]  [1:on/0:off] > frame_check\n\n");
 
+	pbuf += sprintf(pbuf, "mode %u (0:full 1:line 2:tile), sample %u, hw crc %u, lost %d\n",
+		fc_mode, fc_sample, fc_hw_crc,
+		fc_ring ? atomic_read(&fc_ring->lost) : 0);
+	for (i = 0; i < MAX_INSTANCE_MUN; i++) {
+		struct vdec_s *vdec = vdec_get_vdec_by_id(i);
+		struct pic_check_mgr_t *mgr;
+		int m;
+
+		if (!vdec)
+			continue;
+		mgr = &vdec->vfc;
+		for (m = 0; m < FC_MODE_MAX; m++) {
+			if (!mgr->cost_cnt[m])
+				continue;
+			pbuf += sprintf(pbuf,
+				"vdec.%d\tmode %d: %u frames, cost ave %llu max %u us\n",
+				i, m, mgr->cost_cnt[m],
+				div_u64(mgr->cost_sum_ns[m], mgr->cost_cnt[m]) / 1000,
+				mgr->cost_max_ns[m] / 1000);
+		}
+	}
+
 	if (fc_debug & FC_ERR_CRC_BLOCK_MODE) {
 		/* cat frame_check to next frame when block */
 		struct vdec_s *vdec = NULL;
@@ -1314,3 +1702,12 @@ MODULE_PARM_DESC(fc_debug, "\n frame check debug\n");
 module_param(size_yuv_buf, uint, 0664);
 MODULE_PARM_DESC(size_yuv_buf, "\n size_yuv_buf\n");
 
+module_param(fc_mode, uint, 0664);
+MODULE_PARM_DESC(fc_mode, "\n crc of 0:full frame 1:every nth line 2:every nth tile\n");
+
+module_param(fc_sample, uint, 0664);
+MODULE_PARM_DESC(fc_sample, "\n line/tile sample interval\n");
+
+module_param(fc_hw_crc, uint, 0664);
+MODULE_PARM_DESC(fc_hw_crc, "\n read through the cacheable mapping\n");
+
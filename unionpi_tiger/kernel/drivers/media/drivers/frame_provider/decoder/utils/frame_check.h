@@ -89,6 +89,12 @@ struct pic_check_mgr_t{
 	bool mjpeg_flag;
 	void *extra_v_vaddr;
 	ulong extra_v_phyaddr;
+
+	/* per frame cost, from before the flush to the crc stored */
+	u64 check_start_ns;
+	u64 cost_sum_ns[FC_MODE_MAX];
+	u32 cost_max_ns[FC_MODE_MAX];
+	u32 cost_cnt[FC_MODE_MAX];
 };
 
 int dump_yuv_trig(struct pic_check_mgr_t *mgr,
@@ -117,5 +123,8 @@ ssize_t dump_yuv_store(struct class *class,
 void vdec_frame_check_exit(struct vdec_s *vdec);
 int vdec_frame_check_init(struct vdec_s *vdec);
 
+int frame_check_dev_init(struct class *cls);
+void frame_check_dev_exit(struct class *cls);
+
 #endif /* __FRAME_CHECK_H__ */
 
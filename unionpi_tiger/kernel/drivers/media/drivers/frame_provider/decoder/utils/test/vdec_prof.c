@@ -0,0 +1,300 @@
+/*
+* Copyright (C) 2017 Amlogic, Inc. All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+* more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+* Description: decode the binary vdec_profile debugfs dumps.
+*
+* Build: gcc -O2 -o vdec_prof vdec_prof.c
+*
+*	cat /sys/kernel/debug/vdec_profile/hist_bin > hist.bin
+*	cat /sys/kernel/debug/vdec_profile/event_bin > event.bin
+*	vdec_prof hist.bin
+*	vdec_prof -e event.bin [-t]
+*
+* hist.bin gives the latency percentiles kept by the kernel while
+* dec_time_stat_flag is set. event.bin gives the same run2cb and
+* ready2run percentiles rebuilt from the event rings, -t also prints
+* the events in the debugfs "event" text format, which
+* vdec_sched_sim -f reads.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../vdec_profile.h"
+
+#define MAX_INST	64
+
+static const char * const format_name[] = {
+	"mpeg12", "mpeg4", "h264", "mjpeg", "real", "jpeg", "vc1", "avs",
+	"yuv", "h264mvc", "h264_4k2k", "h265", "h264_enc", "jpeg_enc",
+	"vp9", "avs2", "av1"
+};
+
+static const char * const lat_name[VDEC_PROFILE_MAX_LAT] = {
+	"run2cb", "ready2run", "cb2vf"
+};
+
+static const char * const event_name[VDEC_PROFILE_MAX_EVENT] = {
+	"run", "cb", "save_input", "check run ready", "run ready",
+	"disconnect", "dec_work", "info"
+};
+
+static const char *fmt_str(u32 format)
+{
+	if (format < sizeof(format_name) / sizeof(format_name[0]))
+		return format_name[format];
+	return "N/A";
+}
+
+static void *load_file(const char *file, size_t *size)
+{
+	FILE *fp = fopen(file, "rb");
+	char *buf = NULL;
+	size_t cap = 0, n;
+
+	if (!fp) {
+		perror(file);
+		return NULL;
+	}
+	*size = 0;
+	do {
+		if (*size == cap) {
+			cap = cap ? cap * 2 : 1 << 20;
+			buf = realloc(buf, cap);
+			if (!buf)
+				break;
+		}
+		n = fread(buf + *size, 1, cap - *size, fp);
+		*size += n;
+	} while (n);
+	fclose(fp);
+	return buf;
+}
+
+static void print_header(void)
+{
+	printf("%-12s %10s %8s %8s %8s %8s %8s %8s\n", "us", "count",
+		"ave", "p50", "p90", "p99", "p99.9", "max");
+}
+
+static void print_lat(const char *name, const u32 *cnt, u64 sum_ns,
+	u64 max_ns)
+{
+	static const u32 pct[] = {5000, 9000, 9900, 9990};
+	u64 total = 0;
+	int b, i;
+
+	for (b = 0; b < VDEC_PROFILE_HIST_BUCKETS; b++)
+		total += cnt[b];
+	printf("  %-10s %10llu %8llu", name, (unsigned long long)total,
+		total ? (unsigned long long)(sum_ns / total / 1000) : 0ULL);
+	for (i = 0; i < 4; i++) {
+		b = vdec_profile_hist_pct(cnt, total, pct[i]);
+		printf(" %8llu", total ? (unsigned long long)
+			(vdec_profile_hist_value(b) / 1000) : 0ULL);
+	}
+	printf(" %8llu\n", (unsigned long long)(max_ns / 1000));
+}
+
+static int show_hist(const char *file)
+{
+	struct vdec_profile_hist_hdr_s *hdr;
+	struct vdec_profile_hist_inst_s *inst;
+	size_t size, inst_size;
+	char *buf, *p;
+	u32 i, lat;
+
+	buf = load_file(file, &size);
+	if (!buf)
+		return -1;
+	hdr = (struct vdec_profile_hist_hdr_s *)buf;
+	if (size < sizeof(*hdr) || hdr->magic != VDEC_PROFILE_HIST_MAGIC ||
+		hdr->version != VDEC_PROFILE_VERSION ||
+		hdr->lat_num != VDEC_PROFILE_MAX_LAT ||
+		hdr->bucket_num != VDEC_PROFILE_HIST_BUCKETS ||
+		hdr->sub_bits != VDEC_PROFILE_HIST_SUB_BITS) {
+		fprintf(stderr, "%s: not a vdec_profile hist_bin dump\n", file);
+		free(buf);
+		return -1;
+	}
+	inst_size = sizeof(*inst) +
+		sizeof(u32) * VDEC_PROFILE_MAX_LAT * VDEC_PROFILE_HIST_BUCKETS;
+	if (size < sizeof(*hdr) + inst_size * hdr->inst_num) {
+		fprintf(stderr, "%s: truncated\n", file);
+		free(buf);
+		return -1;
+	}
+
+	print_header();
+	p = (char *)(hdr + 1);
+	for (i = 0; i < hdr->inst_num; i++, p += inst_size) {
+		inst = (struct vdec_profile_hist_inst_s *)p;
+		printf("[%u] %s\n", inst->id, fmt_str(inst->format));
+		for (lat = 0; lat < VDEC_PROFILE_MAX_LAT; lat++)
+			print_lat(lat_name[lat], (u32 *)(inst + 1) +
+				lat * VDEC_PROFILE_HIST_BUCKETS,
+				inst->sum_ns[lat], inst->max_ns[lat]);
+	}
+	free(buf);
+	return 0;
+}
+
+struct ev_inst {
+	u32 format;
+	u64 ready_ns;
+	u64 run_ns;
+	u64 sum_ns[2];
+	u64 max_ns[2];
+	u32 cnt[2][VDEC_PROFILE_HIST_BUCKETS];
+	int used;
+};
+
+static void ev_add(struct ev_inst *e, int lat, u64 ns)
+{
+	e->cnt[lat][vdec_profile_hist_bucket(ns)]++;
+	e->sum_ns[lat] += ns;
+	if (ns > e->max_ns[lat])
+		e->max_ns[lat] = ns;
+}
+
+/* the same pairing vdec_profile_statistics() does */
+static void ev_account(struct ev_inst *e,
+	const struct vdec_profile_event_s *rec)
+{
+	e->used = 1;
+	e->format = rec->format;
+	switch (rec->event) {
+	case VDEC_PROFILE_EVENT_RUN_READY:
+		if (!e->ready_ns)
+			e->ready_ns = rec->ns;
+		break;
+	case VDEC_PROFILE_EVENT_RUN:
+		if (e->ready_ns && rec->ns > e->ready_ns)
+			ev_add(e, VDEC_PROFILE_LAT_READY2RUN,
+				rec->ns - e->ready_ns);
+		e->ready_ns = 0;
+		e->run_ns = rec->ns;
+		break;
+	case VDEC_PROFILE_EVENT_CB:
+		if (e->run_ns && rec->ns > e->run_ns)
+			ev_add(e, VDEC_PROFILE_LAT_RUN2CB,
+				rec->ns - e->run_ns);
+		e->run_ns = 0;
+		break;
+	}
+}
+
+static int show_events(const char *file, int text)
+{
+	struct vdec_profile_events_hdr_s *hdr;
+	struct vdec_profile_event_s *rec;
+	struct ev_inst *insts;
+	size_t size;
+	char *buf;
+	u32 i, lat;
+
+	buf = load_file(file, &size);
+	if (!buf)
+		return -1;
+	hdr = (struct vdec_profile_events_hdr_s *)buf;
+	if (size < sizeof(*hdr) ||
+		hdr->magic != VDEC_PROFILE_EVENTS_MAGIC ||
+		hdr->version != VDEC_PROFILE_VERSION ||
+		hdr->rec_size != sizeof(*rec) ||
+		size < sizeof(*hdr) + (size_t)hdr->rec_num * sizeof(*rec)) {
+		fprintf(stderr, "%s: not a vdec_profile event_bin dump\n",
+			file);
+		free(buf);
+		return -1;
+	}
+	insts = calloc(MAX_INST, sizeof(*insts));
+	if (!insts) {
+		free(buf);
+		return -1;
+	}
+
+	rec = (struct vdec_profile_event_s *)(hdr + 1);
+	for (i = 0; i < hdr->rec_num; i++) {
+		if (text)
+			printf("[%s:%d] \t%016llu us : %s (%d,%d)\n",
+				rec[i].id < MAX_INST ?
+				fmt_str(rec[i].format) : "N/A",
+				rec[i].id < MAX_INST ? rec[i].id : 0,
+				(unsigned long long)
+				((rec[i].ns - rec[0].ns) / 1000),
+				rec[i].event < VDEC_PROFILE_MAX_EVENT ?
+				event_name[rec[i].event] : "INVALID",
+				rec[i].para1, rec[i].para2);
+		if (rec[i].id < MAX_INST)
+			ev_account(&insts[rec[i].id], &rec[i]);
+	}
+	if (text)
+		goto out;
+
+	printf("%u events, %u lost\n", hdr->rec_num, hdr->lost);
+	if (hdr->rec_num)
+		printf("%.3f s recorded\n",
+			(rec[hdr->rec_num - 1].ns - rec[0].ns) / 1e9);
+	print_header();
+	for (i = 0; i < MAX_INST; i++) {
+		if (!insts[i].used)
+			continue;
+		printf("[%u] %s\n", i, fmt_str(insts[i].format));
+		for (lat = 0; lat < 2; lat++)
+			print_lat(lat_name[lat], insts[i].cnt[lat],
+				insts[i].sum_ns[lat], insts[i].max_ns[lat]);
+	}
+out:
+	free(insts);
+	free(buf);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s hist_bin\n", prog);
+	fprintf(stderr, "       %s -e event_bin [-t]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *events = NULL;
+	int text = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "e:th")) != -1) {
+		switch (c) {
+		case 'e':
+			events = optarg;
+			break;
+		case 't':
+			text = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (events)
+		return show_events(events, text) ? 1 : 0;
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	return show_hist(argv[optind]) ? 1 : 0;
+}
@@ -0,0 +1,385 @@
+/*
+* Copyright (C) 2017 Amlogic, Inc. All rights reserved.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+* FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+* more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*
+* Description: replay vdec run/cb traces against the vdec_core_thread
+* election policies in ../vdec_sched.h.
+*
+* Build: gcc -O2 -Wall -Wextra -o vdec_sched_sim vdec_sched_sim.c
+*
+* Trace lines are either copied from the vdec_profile debugfs "event"
+* file:
+*	[ammvdec_h264:0]	0000000000012345 us : run (0,0)
+* or in the short form "<us> <id> <name> run|cb". Every run..cb pair
+* becomes one job released at its recorded run time, the instance
+* name stands for its microcode type. Without -f a mixed H.264/HEVC
+* workload is generated.
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../vdec_sched.h"
+
+#define MAX_INST	16
+#define MAX_JOBS	65536
+#define NAME_LEN	64
+
+struct sim_job {
+	u64 release_ns;
+	u64 service_ns;
+};
+
+struct sim_inst {
+	char name[NAME_LEN];
+	u32 mc_type;
+	u64 frame_ns;
+	struct sim_job *jobs;
+	int job_num;
+	u64 open_run_ns;	/* trace parsing: run without cb yet */
+	u64 first_cb_ns;
+	u64 last_cb_ns;
+	int cb_num;
+
+	/* simulation */
+	int next;
+	struct vdec_sched_s s;
+};
+
+static struct sim_inst insts[MAX_INST];
+static int inst_num;
+static u32 mc_type_num;
+static char mc_names[MAX_INST][NAME_LEN];
+
+static u32 sim_mc_type(const char *name)
+{
+	u32 i;
+
+	for (i = 0; i < mc_type_num; i++) {
+		if (!strcmp(mc_names[i], name))
+			return i;
+	}
+	strncpy(mc_names[mc_type_num], name, NAME_LEN - 1);
+	return mc_type_num++;
+}
+
+static struct sim_inst *sim_get_inst(int id, const char *name)
+{
+	struct sim_inst *inst;
+
+	if (id < 0 || id >= MAX_INST)
+		return NULL;
+	inst = &insts[id];
+	if (!inst->jobs) {
+		inst->jobs = calloc(MAX_JOBS, sizeof(struct sim_job));
+		if (!inst->jobs)
+			return NULL;
+		strncpy(inst->name, name, NAME_LEN - 1);
+		inst->mc_type = sim_mc_type(name);
+	}
+	if (id >= inst_num)
+		inst_num = id + 1;
+	return inst;
+}
+
+static void sim_add_event(int id, const char *name, const char *ev,
+	u64 ts_ns)
+{
+	struct sim_inst *inst = sim_get_inst(id, name);
+
+	if (!inst)
+		return;
+	if (!strcmp(ev, "run")) {
+		inst->open_run_ns = ts_ns;
+	} else if (!strcmp(ev, "cb") && inst->open_run_ns) {
+		if (inst->job_num < MAX_JOBS) {
+			inst->jobs[inst->job_num].release_ns =
+				inst->open_run_ns;
+			inst->jobs[inst->job_num].service_ns =
+				ts_ns - inst->open_run_ns;
+			inst->job_num++;
+		}
+		inst->open_run_ns = 0;
+		if (!inst->cb_num)
+			inst->first_cb_ns = ts_ns;
+		inst->last_cb_ns = ts_ns;
+		inst->cb_num++;
+	}
+}
+
+static int sim_load_trace(const char *file)
+{
+	FILE *fp = fopen(file, "r");
+	char line[256];
+	char name[NAME_LEN];
+	char ev[32];
+	unsigned long long us;
+	int id;
+
+	if (!fp) {
+		perror(file);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "[%63[^:]:%d] %llu us : %31s",
+			name, &id, &us, ev) == 4 ||
+			sscanf(line, "%llu %d %63s %31s",
+			&us, &id, name, ev) == 4)
+			sim_add_event(id, name, ev, us * 1000 + 1000000);
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* 2 x H.264 at 30 fps and 2 x HEVC at 60 fps, input arriving in time */
+static void sim_gen_workload(int frames)
+{
+	static const struct {
+		const char *name;
+		u64 frame_ns;
+		u64 service_ns;
+	} w[] = {
+		{"ammvdec_h264", 33333333, 5000000},
+		{"ammvdec_h265", 16666666, 3000000},
+		{"ammvdec_h264", 33333333, 5000000},
+		{"ammvdec_h265", 16666666, 2500000},
+	};
+	int i, j;
+
+	for (i = 0; i < 4; i++) {
+		struct sim_inst *inst = sim_get_inst(i, w[i].name);
+
+		if (!inst)
+			return;
+		inst->frame_ns = w[i].frame_ns;
+		for (j = 0; j < frames && j < MAX_JOBS; j++) {
+			inst->jobs[j].release_ns =
+				1000000 + j * w[i].frame_ns;
+			/* every 8th frame is a heavier one */
+			inst->jobs[j].service_ns = w[i].service_ns *
+				((j & 7) ? 1 : 2);
+		}
+		inst->job_num = j;
+	}
+}
+
+struct sim_result {
+	u64 end_ns;
+	u32 switches;
+	u32 misses;
+	u64 wait_total_ns;
+	u64 wait_max_ns;
+	u32 runs;
+};
+
+static void sim_run(int policy, u64 reload_ns,
+	const struct vdec_sched_param_s *base, struct sim_result *r)
+{
+	struct vdec_sched_param_s param = *base;
+	struct sim_inst *last = NULL;
+	u64 now = 0;
+	u32 batch = 0;
+	int i;
+
+	param.policy = policy;
+	for (i = 0; i < inst_num; i++) {
+		memset(&insts[i].s, 0, sizeof(insts[i].s));
+		insts[i].s.policy = VDEC_SCHED_DEFAULT;
+		insts[i].s.frame_ns = insts[i].frame_ns;
+		insts[i].next = 0;
+	}
+	memset(r, 0, sizeof(*r));
+
+	for (;;) {
+		struct sim_inst *best = NULL;
+		u64 best_key = 0, next_release = 0;
+		int start = last ? (int)(last - insts) + 1 : 0;
+		int other_mc_ready = 0;
+		int switched, n;
+
+		/* same walk order as vdec_sched_elect() */
+		for (n = 0; n < inst_num; n++) {
+			struct sim_inst *inst = &insts[(start + n) % inst_num];
+			struct sim_job *job;
+			int same_mc;
+			u64 key;
+
+			if (inst->next >= inst->job_num)
+				continue;
+			job = &inst->jobs[inst->next];
+			if (job->release_ns > now) {
+				if (!next_release || job->release_ns < next_release)
+					next_release = job->release_ns;
+				continue;
+			}
+			vdec_sched_on_ready(&inst->s, job->release_ns);
+			same_mc = last && last->mc_type == inst->mc_type;
+			if (!same_mc)
+				other_mc_ready = 1;
+			key = vdec_sched_key(&inst->s, &param, same_mc, batch);
+			if (!best || key < best_key) {
+				best = inst;
+				best_key = key;
+			}
+			if (vdec_sched_stop(&inst->s, &param, same_mc, batch))
+				break;
+		}
+		if (!best) {
+			if (!next_release)
+				break;
+			now = next_release;
+			continue;
+		}
+
+		if (last && last->mc_type == best->mc_type) {
+			if (other_mc_ready)
+				batch++;
+		} else
+			batch = 0;
+
+		switched = !last || (last != best &&
+			last->mc_type != best->mc_type);
+		vdec_sched_on_run(&best->s, now, switched);
+		now += best->jobs[best->next].service_ns;
+		if (switched) {
+			now += reload_ns;
+			r->switches++;
+		}
+		vdec_sched_on_cb(&best->s, now);
+		best->next++;
+		last = best;
+	}
+
+	r->end_ns = now;
+	for (i = 0; i < inst_num; i++) {
+		struct vdec_sched_s *s = &insts[i].s;
+
+		r->misses += s->miss_cnt;
+		r->runs += s->run_cnt;
+		r->wait_total_ns += s->wait_total_ns;
+		if (s->wait_max_ns > r->wait_max_ns)
+			r->wait_max_ns = s->wait_max_ns;
+	}
+}
+
+static void sim_print(const char *name, const struct sim_result *r)
+{
+	int i;
+
+	printf("%-9s end:%8.1fms runs:%6u switch:%6u miss:%6u wait ave:%7.2fms max:%7.2fms\n",
+		name, r->end_ns / 1e6, r->runs, r->switches, r->misses,
+		r->runs ? r->wait_total_ns / 1e6 / r->runs : 0.0,
+		r->wait_max_ns / 1e6);
+	for (i = 0; i < inst_num; i++) {
+		struct vdec_sched_s *s = &insts[i].s;
+
+		if (!insts[i].job_num)
+			continue;
+		printf("\t[%d] %-16s run:%6u switch:%6u miss:%6u wait ave:%7.2fms max:%7.2fms\n",
+			i, insts[i].name, s->run_cnt, s->switch_cnt,
+			s->miss_cnt,
+			s->run_cnt ? s->wait_total_ns / 1e6 / s->run_cnt : 0.0,
+			s->wait_max_ns / 1e6);
+	}
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-f trace] [-n frames] [-m reload_us] [-r id:fps]\n"
+		"\t[-a affinity_us] [-b affinity_batch]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	static const char * const names[VDEC_SCHED_POLICY_MAX] = {
+		"rr", "edf", "affinity"
+	};
+	struct vdec_sched_param_s param = {
+		.policy = VDEC_SCHED_RR,
+		.affinity_ns = 16000000,
+		.affinity_batch = 4,
+	};
+	struct sim_result r;
+	const char *trace = NULL;
+	u64 reload_ns = 1000000;
+	int frames = 600;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "f:n:m:r:a:b:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			trace = optarg;
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'm':
+			reload_ns = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'a':
+			param.affinity_ns = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'b':
+			param.affinity_batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'r': {
+			int id, fps;
+
+			if (sscanf(optarg, "%d:%d", &id, &fps) == 2 &&
+				id >= 0 && id < MAX_INST && fps > 0)
+				insts[id].frame_ns = 1000000000ULL / fps;
+			break;
+		}
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (trace) {
+		if (sim_load_trace(trace) < 0)
+			return 1;
+		/* without -r, take the recorded output rate */
+		for (i = 0; i < inst_num; i++) {
+			struct sim_inst *inst = &insts[i];
+
+			if (!inst->frame_ns && inst->cb_num > 1)
+				inst->frame_ns = (inst->last_cb_ns -
+					inst->first_cb_ns) / (inst->cb_num - 1);
+		}
+	} else {
+		sim_gen_workload(frames);
+	}
+
+	for (i = 0; i < inst_num; i++) {
+		if (insts[i].job_num)
+			printf("[%d] %s mc:%u jobs:%d frame:%.2fms\n", i,
+				insts[i].name, insts[i].mc_type,
+				insts[i].job_num, insts[i].frame_ns / 1e6);
+	}
+	printf("reload:%lluus\n", (unsigned long long)(reload_ns / 1000));
+
+	for (i = 0; i < VDEC_SCHED_POLICY_MAX; i++) {
+		sim_run(i, reload_ns, &param, &r);
+		sim_print(names[i], &r);
+	}
+
+	for (i = 0; i < MAX_INST; i++)
+		free(insts[i].jobs);
+	return 0;
+}
@@ -27,6 +27,9 @@
 #include <uapi/linux/sched/types.h>
 #include <linux/sched.h>
 #include <linux/sched/rt.h>
+#include <linux/sched/clock.h>
+#include <linux/seq_file.h>
+#include <linux/version.h>
 #include <linux/interrupt.h>
 #include <linux/amlogic/media/utils/vformat.h>
 #include <linux/amlogic/iomap.h>
@@ -74,6 +77,7 @@
 #include "secprot.h"
 #include "../../../common/chips/decoder_cpu_ver_info.h"
 #include "frame_check.h"
+#include "config_parser.h"
 
 #ifdef CONFIG_AMLOGIC_POWER
 #include <linux/amlogic/power_ctrl.h>
@@ -148,6 +152,13 @@ static int fps_clear;
 static int force_nosecure_even_drm;
 static int disable_switch_single_to_mult;
 
+/* vdec_core_thread election, see vdec_sched.h */
+static int sched_policy = VDEC_SCHED_RR;
+static unsigned int sched_affinity_us = 16000;
+static unsigned int sched_affinity_batch = 4;
+/* run vdec_core_thread as SCHED_FIFO */
+static bool sched_fifo;
+
 static DEFINE_SPINLOCK(vdec_spin_lock);
 
 #define HEVC_TEST_LIMIT 100
@@ -219,6 +230,9 @@ struct vdec_core_s {
 	struct decode_fps_s decode_fps[MAX_INSTANCE_MUN];
 	unsigned long buff_flag;
 	unsigned long stream_buff_flag;
+	/* runs the loaded mc_type kept while another type was ready */
+	u32 sched_batch;
+	u32 sched_switch_cnt;
 };
 
 struct canvas_status_s {
@@ -2094,6 +2108,26 @@ EXPORT_SYMBOL(walk_vdec_core_list);
 /* insert vdec to vdec_core for scheduling,
  * for dual running decoders, connect/disconnect always runs in pairs
  */
+static void vdec_sched_init(struct vdec_s *vdec)
+{
+	int policy;
+
+	memset(&vdec->sched_state, 0, sizeof(vdec->sched_state));
+	vdec->sched_state.policy = VDEC_SCHED_DEFAULT;
+	if (get_config_int(vdec->config, "vdec_sched_policy", &policy) == 0)
+		vdec_set_sched_policy(vdec, policy);
+}
+
+int vdec_set_sched_policy(struct vdec_s *vdec, int policy)
+{
+	if (policy < VDEC_SCHED_DEFAULT || policy >= VDEC_SCHED_POLICY_MAX)
+		return -EINVAL;
+
+	vdec->sched_state.policy = policy;
+	return 0;
+}
+EXPORT_SYMBOL(vdec_set_sched_policy);
+
 int vdec_connect(struct vdec_s *vdec)
 {
 	unsigned long flags;
@@ -2107,12 +2141,14 @@ int vdec_connect(struct vdec_s *vdec)
 	vdec_set_next_status(vdec, VDEC_STATUS_CONNECTED);
 
 	init_completion(&vdec->inactive_done);
+	vdec_sched_init(vdec);
 
 	if (vdec->slave) {
 		vdec_set_status(vdec->slave, VDEC_STATUS_CONNECTED);
 		vdec_set_next_status(vdec->slave, VDEC_STATUS_CONNECTED);
 
 		init_completion(&vdec->slave->inactive_done);
+		vdec_sched_init(vdec->slave);
 	}
 
 	flags = vdec_core_lock(vdec_core);
@@ -2876,6 +2912,7 @@ static void vdec_callback(struct vdec_s *vdec, void *data)
 #ifdef CONFIG_AMLOGIC_MEDIA_MULTI_DEC
 	vdec_profile(vdec, VDEC_PROFILE_EVENT_CB);
 #endif
+	vdec_sched_on_cb(&vdec->sched_state, local_clock());
 
 	up(&core->sem);
 }
@@ -3118,6 +3155,163 @@ void vdec_prepare_run(struct vdec_s *vdec, unsigned long mask)
 }
 
 
+static void vdec_sched_get_param(struct vdec_sched_param_s *param)
+{
+	param->policy = (sched_policy >= 0 &&
+		sched_policy < VDEC_SCHED_POLICY_MAX) ?
+		sched_policy : VDEC_SCHED_RR;
+	param->affinity_ns = (u64)sched_affinity_us * NSEC_PER_USEC;
+	param->affinity_batch = sched_affinity_batch;
+}
+
+/* sys_info rate is the frame duration in 1/96000 s */
+static void vdec_sched_update_frame_ns(struct vdec_s *vdec)
+{
+	struct dec_sysinfo *info = vdec->sys_info;
+
+	if (info && info->rate > 0 && info->rate < 96000)
+		vdec->sched_state.frame_ns =
+			div_u64((u64)info->rate * NSEC_PER_SEC, 96000);
+}
+
+struct vdec_sched_elect_s {
+	struct vdec_sched_param_s param;
+	u64 now;
+	struct vdec_s *best;
+	unsigned long best_mask;
+	u64 best_key;
+	bool other_mc_ready;
+};
+
+/* returns true when the election can stop, see vdec_sched_stop() */
+static bool vdec_sched_consider(struct vdec_core_s *core,
+	struct vdec_s *vdec, struct vdec_sched_elect_s *e)
+{
+	struct vdec_sched_s *s = &vdec->sched_state;
+	unsigned long mask;
+	bool same_mc;
+	u64 key;
+
+	mask = vdec_schedule_mask(vdec, core->sched_mask);
+	if (!mask)
+		return false;
+
+	mask = vdec_ready_to_run(vdec, mask);
+	if (!mask) {
+		s->ready_ns = 0;
+		return false;
+	}
+
+	vdec_sched_on_ready(s, e->now);
+	if (!s->frame_ns)
+		vdec_sched_update_frame_ns(vdec);
+
+	same_mc = core->last_vdec &&
+		(core->last_vdec->mc_type == vdec->mc_type);
+	if (!same_mc)
+		e->other_mc_ready = true;
+
+	key = vdec_sched_key(s, &e->param, same_mc, core->sched_batch);
+	if (!e->best || key < e->best_key) {
+		e->best = vdec;
+		e->best_mask = mask;
+		e->best_key = key;
+	}
+	return vdec_sched_stop(s, &e->param, same_mc, core->sched_batch);
+}
+
+/*
+ * Walk the connected instances in round-robin order starting after
+ * the last scheduled one, until vdec_sched_stop() says so, and elect
+ * the ready instance with the smallest vdec_sched_key().
+ */
+static struct vdec_s *vdec_sched_elect(struct vdec_core_s *core,
+	unsigned long *sched_mask)
+{
+	struct vdec_sched_elect_s e;
+	struct vdec_s *vdec;
+
+	memset(&e, 0, sizeof(e));
+	vdec_sched_get_param(&e.param);
+	e.now = local_clock();
+
+	vdec = core->last_vdec;
+	if (vdec) {
+		vdec = list_entry(vdec->list.next, struct vdec_s, list);
+		list_for_each_entry_from(vdec,
+			&core->connected_vdec_list, list) {
+			if (vdec_sched_consider(core, vdec, &e))
+				goto out;
+		}
+	}
+
+	list_for_each_entry(vdec, &core->connected_vdec_list, list) {
+		if (vdec_sched_consider(core, vdec, &e))
+			break;
+		if (vdec == core->last_vdec)
+			break;
+	}
+
+out:
+	if (e.best && core->last_vdec &&
+		core->last_vdec->mc_type == e.best->mc_type) {
+		/* the loaded type won while another type was waiting */
+		if (e.other_mc_ready)
+			core->sched_batch++;
+	} else
+		core->sched_batch = 0;
+
+	*sched_mask = e.best_mask;
+	return e.best;
+}
+
+static const char * const vdec_sched_policy_name[] = {
+	"rr", "edf", "affinity"
+};
+
+static const char *vdec_sched_policy_str(int policy)
+{
+	if (policy < 0 || policy >= (int)ARRAY_SIZE(vdec_sched_policy_name))
+		return "unknown";
+	return vdec_sched_policy_name[policy];
+}
+
+void vdec_sched_dump(struct seq_file *m)
+{
+	struct vdec_sched_param_s param;
+	struct vdec_s *vdec;
+	unsigned long flags;
+
+	if (!vdec_core)
+		return;
+
+	vdec_sched_get_param(&param);
+	seq_printf(m, "policy:%s affinity:%uus/%u runs, mc switch:%u\n",
+		vdec_sched_policy_str(param.policy),
+		sched_affinity_us, sched_affinity_batch,
+		vdec_core->sched_switch_cnt);
+
+	flags = vdec_core_lock(vdec_core);
+	list_for_each_entry(vdec, &vdec_core->connected_vdec_list, list) {
+		struct vdec_sched_s *s = &vdec->sched_state;
+		int policy = vdec_sched_policy(s, &param);
+
+		seq_printf(m, "[%d] %s mc:%u policy:%s frame:%lluus\n",
+			vdec->id, vdec_device_name_str(vdec), vdec->mc_type,
+			vdec_sched_policy_str(policy), div_u64(s->frame_ns, NSEC_PER_USEC));
+		seq_printf(m, "\trun:%u switch:%u miss:%u\n",
+			s->run_cnt, s->switch_cnt, s->miss_cnt);
+		seq_printf(m, "\twait ave:%lluus max:%lluus, run ave:%lluus\n",
+			s->run_cnt ? div_u64(s->wait_total_ns,
+				s->run_cnt * NSEC_PER_USEC) : 0,
+			div_u64(s->wait_max_ns, NSEC_PER_USEC),
+			s->run_cnt ? div_u64(s->run_total_ns,
+				s->run_cnt * NSEC_PER_USEC) : 0);
+	}
+	vdec_core_unlock(vdec_core, flags);
+}
+EXPORT_SYMBOL(vdec_sched_dump);
+
 /* struct vdec_core_shread manages all decoder instance in active list. When
  * a vdec is added into the active list, it can onlt be in two status:
  * VDEC_STATUS_CONNECTED(the decoder does not own HW resource and ready to run)
@@ -3128,12 +3322,10 @@ void vdec_prepare_run(struct vdec_s *vdec, unsigned long mask)
 static int vdec_core_thread(void *data)
 {
 	struct vdec_core_s *core = (struct vdec_core_s *)data;
-	struct sched_param param = {.sched_priority = MAX_RT_PRIO/2};
 	unsigned long flags;
+	bool fifo = false;
 	int i;
 
-	//sched_setscheduler(current, SCHED_FIFO, &param); //FIXME
-
 	allow_signal(SIGTERM);
 
 	while (down_interruptible(&core->sem) == 0) {
@@ -3143,6 +3335,17 @@ static int vdec_core_thread(void *data)
 
 		if (kthread_should_stop())
 			break;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+		/* sched_setscheduler() is no longer exported to modules */
+		if (fifo != READ_ONCE(sched_fifo)) {
+			fifo = !fifo;
+			if (fifo)
+				sched_set_fifo(current);
+			else
+				sched_set_normal(current, 0);
+		}
+#endif
 		mutex_lock(&vdec_mutex);
 
 		if (core->parallel_dec == 1) {
@@ -3224,65 +3427,14 @@ static int vdec_core_thread(void *data)
 		vdec_core_unlock(vdec_core, flags);
 		mutex_unlock(&vdec_mutex);
 		/* elect next vdec to be scheduled */
-		vdec = core->last_vdec;
-		if (vdec) {
-			vdec = list_entry(vdec->list.next, struct vdec_s, list);
-			list_for_each_entry_from(vdec,
-				&core->connected_vdec_list, list) {
-				sched_mask = vdec_schedule_mask(vdec,
-					core->sched_mask);
-				if (!sched_mask)
-					continue;
-				sched_mask = vdec_ready_to_run(vdec,
-					sched_mask);
-				if (sched_mask)
-					break;
-			}
-
-			if (&vdec->list == &core->connected_vdec_list)
-				vdec = NULL;
-		}
-
-		if (!vdec) {
-			/* search from beginning */
-			list_for_each_entry(vdec,
-				&core->connected_vdec_list, list) {
-				sched_mask = vdec_schedule_mask(vdec,
-					core->sched_mask);
-				if (vdec == core->last_vdec) {
-					if (!sched_mask) {
-						vdec = NULL;
-						break;
-					}
-
-					sched_mask = vdec_ready_to_run(vdec,
-						sched_mask);
-
-					if (!sched_mask) {
-						vdec = NULL;
-						break;
-					}
-					break;
-				}
-
-				if (!sched_mask)
-					continue;
-
-				sched_mask = vdec_ready_to_run(vdec,
-					sched_mask);
-				if (sched_mask)
-					break;
-			}
-
-			if (&vdec->list == &core->connected_vdec_list)
-				vdec = NULL;
-		}
+		vdec = vdec_sched_elect(core, &sched_mask);
 
 		worker = vdec;
 
 		if (vdec) {
 			unsigned long mask = sched_mask;
 			unsigned long i;
+			bool switched;
 
 			/* setting active_mask should be atomic.
 			 * it can be modified by decoder driver callbacks.
@@ -3295,12 +3447,19 @@ static int vdec_core_thread(void *data)
 
 			/* vdec's sched_mask is only set from core thread */
 			vdec->sched_mask |= mask;
+			switched = false;
 			if (core->last_vdec) {
 				if ((core->last_vdec != vdec) &&
 					(core->last_vdec->mc_type != vdec->mc_type))
-					vdec->mc_loaded = 0;/*clear for reload firmware*/
+					switched = true;
 			} else
-				vdec->mc_loaded = 0;
+				switched = true;
+			if (switched) {
+				vdec->mc_loaded = 0;/*clear for reload firmware*/
+				core->sched_switch_cnt++;
+			}
+			vdec_sched_on_run(&vdec->sched_state, local_clock(),
+				switched);
 			core->last_vdec = vdec;
 			if (debug & 2)
 				vdec->mc_loaded = 0;/*alway reload firmware*/
@@ -5284,6 +5443,8 @@ static int vdec_probe(struct platform_device *pdev)
 		pr_info("vdec class create fail.\n");
 		return r;
 	}
+	if (frame_check_dev_init(&vdec_class))
+		pr_info("frame_check device create fail.\n");
 
 	vdec_core->vdec_core_platform_device = pdev;
 
@@ -5365,6 +5526,7 @@ static int vdec_remove(struct platform_device *pdev)
 	kthread_stop(vdec_core->thread);
 
 	destroy_workqueue(vdec_core->vdec_core_wq);
+	frame_check_dev_exit(&vdec_class);
 	class_unregister(&vdec_class);
 
 	return 0;
@@ -5402,20 +5564,30 @@ static struct codec_profile_t amvdec_input_profile = {
 
 int vdec_module_init(void)
 {
+	if (vdec_input_module_init()) {
+		pr_info("failed to create vdec input caches\n");
+		return -ENOMEM;
+	}
 	if (platform_driver_register(&vdec_driver)) {
 		pr_info("failed to register vdec module\n");
+		vdec_input_module_exit();
 		return -ENODEV;
 	}
 	INIT_REG_NODE_CONFIGS("media.decoder", &vdec_node,
 		"vdec", vdec_configs, CONFIG_FOR_RW);
 	vcodec_profile_register(&amvdec_input_profile);
+	codec_mm_selftest_register(&vdec_input_pool_selftest);
+	codec_mm_selftest_register(&vdec_input_chunk_selftest);
 	return 0;
 }
 EXPORT_SYMBOL(vdec_module_init);
 
 void vdec_module_exit(void)
 {
+	codec_mm_selftest_unregister(&vdec_input_chunk_selftest);
+	codec_mm_selftest_unregister(&vdec_input_pool_selftest);
 	platform_driver_unregister(&vdec_driver);
+	vdec_input_module_exit();
 }
 EXPORT_SYMBOL(vdec_module_exit);
 
@@ -5480,6 +5652,8 @@ void vdec_fill_vdec_frame(struct vdec_s *vdec, struct vframe_qos_s *vframe_qos,
 	struct vframe_counter_s *fifo_buf;
 	struct vdec_frames_s *mvfrm = vdec->mvfrm;
 
+	if (vf)
+		vdec_profile_vf_ready(vf);
 	if (!mvfrm)
 		return;
 	fifo_buf = mvfrm->fifo_buf;
@@ -5579,6 +5753,19 @@ module_param(fps_clear, int, 0664);
 module_param(force_nosecure_even_drm, int, 0664);
 module_param(disable_switch_single_to_mult, int, 0664);
 
+module_param(sched_policy, int, 0664);
+MODULE_PARM_DESC(sched_policy,
+	"\n vdec core default policy, 0:rr 1:edf 2:mc affinity\n");
+module_param(sched_affinity_us, uint, 0664);
+MODULE_PARM_DESC(sched_affinity_us,
+	"\n head start of instances with the loaded mc type\n");
+module_param(sched_affinity_batch, uint, 0664);
+MODULE_PARM_DESC(sched_affinity_batch,
+	"\n max runs of the loaded mc type while others wait\n");
+module_param(sched_fifo, bool, 0664);
+MODULE_PARM_DESC(sched_fifo,
+	"\n run the vdec core thread as SCHED_FIFO\n");
+
 module_param(frameinfo_flag, int, 0664);
 MODULE_PARM_DESC(frameinfo_flag,
 				"\n frameinfo_flag\n");
@@ -36,6 +36,7 @@
 
 #include "vdec_input.h"
 #include "frame_check.h"
+#include "vdec_sched.h"
 
 s32 vdec_dev_register(void);
 s32 vdec_dev_unregister(void);
@@ -193,6 +194,7 @@ struct vdec_s {
 	bool timestamp_valid;
 	int flag;
 	int sched;
+	struct vdec_sched_s sched_state;
 	int need_more_data;
 	u32 canvas_mode;
 
@@ -407,6 +409,11 @@ extern const char *vdec_type_str(struct vdec_s *vdec);
 
 extern const char *vdec_device_name_str(struct vdec_s *vdec);
 
+extern int vdec_set_sched_policy(struct vdec_s *vdec, int policy);
+
+struct seq_file;
+extern void vdec_sched_dump(struct seq_file *m);
+
 extern void vdec_schedule_work(struct work_struct *work);
 
 extern void  vdec_count_info(struct vdec_info *vs, unsigned int err,
@@ -19,6 +19,7 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/dma-mapping.h>
+#include <linux/wait_bit.h>
 #include <linux/amlogic/media/codec_mm/codec_mm.h>
 
 #include "../../../stream_input/amports/amports_priv.h"
@@ -52,12 +53,214 @@
 
 #define MEM_NAME "VFRAME_INPUT"
 
+/*
+ *Chunk pool holds VFRAME_BLOCK_MAX_LEVEL of frames averaging 1/16
+ *block: 256 chunks with the 1080p block size, 64 with the 4K one.
+ *Block pool holds the structures of VFRAME_BLOCK_MAX_TOTAL_SIZE.
+ */
+#define VFRAME_CHUNK_POOL_MIN 32
+#define VFRAME_CHUNK_POOL_MAX 256
+#define VFRAME_BLOCK_POOL_MIN 4
+#define VFRAME_BLOCK_POOL_MAX 32
+
 //static int vdec_input_get_duration_u64(struct vdec_input_s *input);
 static struct vframe_block_list_s *
 	vdec_input_alloc_new_block(struct vdec_input_s *input,
 	ulong phy_addr,
 	int size);
 
+static struct kmem_cache *vdec_input_chunk_cache;
+static struct kmem_cache *vdec_input_block_cache;
+
+int vdec_input_module_init(void)
+{
+	vdec_input_chunk_cache = KMEM_CACHE(vframe_chunk_s,
+		SLAB_HWCACHE_ALIGN);
+	vdec_input_block_cache = KMEM_CACHE(vframe_block_list_s,
+		SLAB_HWCACHE_ALIGN);
+	if (!vdec_input_chunk_cache || !vdec_input_block_cache) {
+		vdec_input_module_exit();
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void vdec_input_module_exit(void)
+{
+	kmem_cache_destroy(vdec_input_chunk_cache);
+	kmem_cache_destroy(vdec_input_block_cache);
+	vdec_input_chunk_cache = NULL;
+	vdec_input_block_cache = NULL;
+}
+
+static void vdec_input_pool_reset(struct vdec_input_pool_s *pool)
+{
+	init_llist_head(&pool->free);
+	pool->stash = NULL;
+	atomic_set(&pool->cached, 0);
+	atomic_set(&pool->in_use, 0);
+	pool->max_cached = 0;
+	pool->peak = 0;
+	pool->hit = 0;
+	pool->miss = 0;
+}
+
+/*
+ *Writer side. llist_del_all() hands back the most recently released
+ *structures first, they are likely still in the cache.
+ *stash and the llist_del_all() consumer run without a lock: llist
+ *allows any number of adders but only one deleter, and only
+ *vdec_write_vframe() (through vdec_input_add_chunk()) allocates from
+ *an input, one writer at a time. A second concurrent writer on the
+ *same input would race on stash and has to take a lock here first.
+ */
+static void *vdec_input_pool_get(struct vdec_input_pool_s *pool,
+	struct kmem_cache *cache, size_t offset, size_t size)
+{
+	struct llist_node *node = pool->stash;
+	void *obj;
+	int used;
+
+	if (!node)
+		node = llist_del_all(&pool->free);
+	if (node) {
+		pool->stash = node->next;
+		atomic_dec(&pool->cached);
+		pool->hit++;
+		obj = (void *)node - offset;
+		memset(obj, 0, size);
+	} else {
+		obj = kmem_cache_zalloc(cache, GFP_KERNEL);
+		if (!obj)
+			return NULL;
+		pool->miss++;
+	}
+	used = atomic_inc_return(&pool->in_use);
+	if (used > pool->peak)
+		pool->peak = used;
+	return obj;
+}
+
+/*any context, no lock needed.*/
+static void vdec_input_pool_put(struct vdec_input_pool_s *pool,
+	struct kmem_cache *cache, struct llist_node *node, void *obj)
+{
+	atomic_dec(&pool->in_use);
+	if (atomic_inc_return(&pool->cached) > pool->max_cached) {
+		atomic_dec(&pool->cached);
+		kmem_cache_free(cache, obj);
+		return;
+	}
+	llist_add(node, &pool->free);
+}
+
+static void vdec_input_pool_fill(struct vdec_input_pool_s *pool,
+	struct kmem_cache *cache, size_t offset)
+{
+	void *obj;
+
+	while (atomic_read(&pool->cached) < pool->max_cached) {
+		obj = kmem_cache_zalloc(cache, GFP_KERNEL);
+		if (!obj)
+			break;
+		atomic_inc(&pool->cached);
+		llist_add(obj + offset, &pool->free);
+	}
+}
+
+static void vdec_input_pool_free_list(struct llist_node *node,
+	struct kmem_cache *cache, size_t offset)
+{
+	struct llist_node *next;
+
+	for (; node; node = next) {
+		next = node->next;
+		kmem_cache_free(cache, (void *)node - offset);
+	}
+}
+
+static void vdec_input_pool_drain(struct vdec_input_pool_s *pool,
+	struct kmem_cache *cache, size_t offset)
+{
+	vdec_input_pool_free_list(pool->stash, cache, offset);
+	pool->stash = NULL;
+	vdec_input_pool_free_list(llist_del_all(&pool->free), cache, offset);
+	atomic_set(&pool->cached, 0);
+}
+
+static void vdec_input_pool_size(struct vdec_input_s *input)
+{
+	int block_size = max(input->default_block_size, SZ_64K);
+
+	input->chunk_pool.max_cached = clamp_t(int,
+		VFRAME_BLOCK_MAX_LEVEL / (block_size / 16),
+		VFRAME_CHUNK_POOL_MIN, VFRAME_CHUNK_POOL_MAX);
+	input->block_pool.max_cached = clamp_t(int,
+		VFRAME_BLOCK_MAX_TOTAL_SIZE / block_size,
+		VFRAME_BLOCK_POOL_MIN, VFRAME_BLOCK_POOL_MAX);
+}
+
+/*pools must be empty, input->default_block_size set.*/
+void vdec_input_pool_setup(struct vdec_input_s *input)
+{
+	vdec_input_pool_reset(&input->chunk_pool);
+	vdec_input_pool_reset(&input->block_pool);
+	vdec_input_pool_size(input);
+}
+
+void vdec_input_pool_release(struct vdec_input_s *input)
+{
+	vdec_input_pool_drain(&input->chunk_pool, vdec_input_chunk_cache,
+		offsetof(struct vframe_chunk_s, pool_node));
+	vdec_input_pool_drain(&input->block_pool, vdec_input_block_cache,
+		offsetof(struct vframe_block_list_s, pool_node));
+}
+
+struct vframe_chunk_s *vdec_input_chunk_alloc(struct vdec_input_s *input)
+{
+	return vdec_input_pool_get(&input->chunk_pool,
+		vdec_input_chunk_cache,
+		offsetof(struct vframe_chunk_s, pool_node),
+		sizeof(struct vframe_chunk_s));
+}
+
+void vdec_input_chunk_free(struct vdec_input_s *input,
+	struct vframe_chunk_s *chunk)
+{
+	vdec_input_pool_put(&input->chunk_pool, vdec_input_chunk_cache,
+		&chunk->pool_node, chunk);
+}
+
+static struct vframe_block_list_s *vdec_input_block_alloc(
+	struct vdec_input_s *input)
+{
+	return vdec_input_pool_get(&input->block_pool,
+		vdec_input_block_cache,
+		offsetof(struct vframe_block_list_s, pool_node),
+		sizeof(struct vframe_block_list_s));
+}
+
+static void vdec_input_block_free(struct vdec_input_s *input,
+	struct vframe_block_list_s *block)
+{
+	vdec_input_pool_put(&input->block_pool, vdec_input_block_cache,
+		&block->pool_node, block);
+}
+
+int vdec_input_dump_pool(struct vdec_input_s *input, char *buf, int size)
+{
+	struct vdec_input_pool_s *c = &input->chunk_pool;
+	struct vdec_input_pool_s *b = &input->block_pool;
+
+	if (size <= 0)
+		return 0;
+	return snprintf(buf, size,
+		"pool:chunk hit:%u miss:%u used:%d peak:%d cached:%d/%d,block hit:%u miss:%u used:%d peak:%d\n",
+		c->hit, c->miss, atomic_read(&c->in_use), c->peak,
+		atomic_read(&c->cached), c->max_cached,
+		b->hit, b->miss, atomic_read(&b->in_use), b->peak);
+}
+
 static int aml_copy_from_user(void *to, const void *from, ulong n)
 {
 	int ret =0;
@@ -229,7 +432,7 @@ static void vframe_block_free_block(struct vframe_block_list_s *block)
 	/*
 	*pr_err("free block %d, size=%d\n", block->id, block->size);
 	*/
-	kfree(block);
+	vdec_input_block_free(block->input, block);
 }
 
 static int vframe_block_init_alloc_storage(struct vdec_input_s *input,
@@ -288,6 +491,7 @@ void vdec_input_init(struct vdec_input_s *input, struct vdec_s *vdec)
 	input->block_id_seq = 0;
 	input->size = 0;
 	input->default_block_size = VFRAME_BLOCK_SIZE;
+	vdec_input_pool_setup(input);
 }
 int vdec_input_prepare_bufs(struct vdec_input_s *input,
 	int frame_width, int frame_height)
@@ -304,6 +508,11 @@ int vdec_input_prepare_bufs(struct vdec_input_s *input,
 		/*have add data before. ignore prepare buffers.*/
 		input->default_block_size = VFRAME_BLOCK_SIZE_4K;
 	}
+	vdec_input_pool_size(input);
+	vdec_input_pool_fill(&input->chunk_pool, vdec_input_chunk_cache,
+		offsetof(struct vframe_chunk_s, pool_node));
+	vdec_input_pool_fill(&input->block_pool, vdec_input_block_cache,
+		offsetof(struct vframe_block_list_s, pool_node));
 	/*prepared 3 buffers for smooth start.*/
 	for (i = 0; i < 3; i++) {
 		block = vdec_input_alloc_new_block(input, 0, 0);
@@ -382,6 +591,7 @@ int vdec_input_dump_blocks(struct vdec_input_s *input,
 		input->data_size,
 		input->have_frame_num,
 		vdec_input_get_duration_u64(input)/1000);
+	s += vdec_input_dump_pool(input, lbuf + s, size - s);
 	if (bufs)
 		lbuf += s;
 	else {
@@ -481,6 +691,7 @@ int vdec_input_dump_chunks(int id, struct vdec_input_s *input,
 		input->data_size,
 		input->have_frame_num,
 		input->frame_max_size);
+	s += vdec_input_dump_pool(input, lbuf + s, size - s);
 	if (bufs)
 		lbuf += s;
 	if (!bufs) {
@@ -608,8 +819,7 @@ static struct vframe_block_list_s *
 	int size)
 {
 	struct vframe_block_list_s *block;
-	block = kzalloc(sizeof(struct vframe_block_list_s),
-			GFP_KERNEL);
+	block = vdec_input_block_alloc(input);
 	if (block == NULL) {
 		input->no_mem_err_cnt++;
 		pr_err("vframe_block structure allocation failed\n");
@@ -618,7 +828,7 @@ static struct vframe_block_list_s *
 
 	if (vframe_block_init_alloc_storage(input,
 		block, phy_addr, size) != 0) {
-		kfree(block);
+		vdec_input_block_free(input, block);
 		pr_err("vframe_block storage allocation failed\n");
 		return NULL;
 	}
@@ -857,7 +1067,7 @@ int vdec_input_add_chunk(struct vdec_input_s *input, const char *buf,
 		}
 	}
 
-	chunk = kzalloc(sizeof(struct vframe_chunk_s), GFP_KERNEL);
+	chunk = vdec_input_chunk_alloc(input);
 
 	if (!chunk) {
 		pr_err("vframe_chunk structure allocation failed\n");
@@ -899,7 +1109,7 @@ int vdec_input_add_chunk(struct vdec_input_s *input, const char *buf,
 		chunk->pading_size = need_pading_size;
 		if (vframe_chunk_fill(input, chunk, buf, count, block)) {
 			pr_err("vframe_chunk_fill failed\n");
-			kfree(chunk);
+			vdec_input_chunk_free(input, chunk);
 			return -EFAULT;
 		}
 
@@ -1024,6 +1234,8 @@ void vdec_input_release_chunk(struct vdec_input_s *input,
 	unsigned long flags;
 	struct vframe_block_list_s *block = chunk->block;
 	struct vframe_block_list_s *tofreeblock = NULL;
+	void (*notify)(void *priv) = NULL;
+	void *notify_priv = NULL;
 	flags = vdec_input_lock(input);
 
 	list_for_each_entry(p, &input->vframe_chunk_list, list) {
@@ -1041,6 +1253,13 @@ void vdec_input_release_chunk(struct vdec_input_s *input,
 
 	list_del(&chunk->list);
 	input->have_frame_num--;
+	if (input->space_notify &&
+		input->have_frame_num <= input->space_level) {
+		/*vdec_input_clear_space_notify() waits for this call.*/
+		notify = input->space_notify;
+		notify_priv = input->space_priv;
+		atomic_inc(&input->space_notify_users);
+	}
 	ATRACE_COUNTER(MEM_NAME, input->have_frame_num);
 	if (chunk->pts_valid) {
 		input->last_comsumed_no_pts_cnt = 0;
@@ -1073,10 +1292,41 @@ void vdec_input_release_chunk(struct vdec_input_s *input,
 	vdec_input_unlock(input, flags);
 	if (tofreeblock)
 		vframe_block_free_block(tofreeblock);
-	kfree(chunk);
+	vdec_input_chunk_free(input, chunk);
+	if (notify) {
+		notify(notify_priv);
+		if (atomic_dec_and_test(&input->space_notify_users))
+			wake_up_var(&input->space_notify_users);
+	}
 }
 EXPORT_SYMBOL(vdec_input_release_chunk);
 
+void vdec_input_set_space_notify(struct vdec_input_s *input,
+	void (*notify)(void *priv), void *priv, int level)
+{
+	unsigned long flags;
+
+	flags = vdec_input_lock(input);
+	input->space_notify = notify;
+	input->space_priv = priv;
+	input->space_level = level;
+	vdec_input_unlock(input, flags);
+}
+EXPORT_SYMBOL(vdec_input_set_space_notify);
+
+void vdec_input_clear_space_notify(struct vdec_input_s *input)
+{
+	unsigned long flags;
+
+	flags = vdec_input_lock(input);
+	input->space_notify = NULL;
+	input->space_priv = NULL;
+	vdec_input_unlock(input, flags);
+	wait_var_event(&input->space_notify_users,
+		!atomic_read(&input->space_notify_users));
+}
+EXPORT_SYMBOL(vdec_input_clear_space_notify);
+
 unsigned long vdec_input_lock(struct vdec_input_s *input)
 {
 	unsigned long flags;
@@ -1129,6 +1379,7 @@ void vdec_input_release(struct vdec_input_s *input)
 	input->swap_page = NULL;
 	input->swap_page_phys = 0;
 	input->swap_valid = false;
+	vdec_input_pool_release(input);
 }
 EXPORT_SYMBOL(vdec_input_release);
 
@@ -1152,7 +1403,7 @@ u32 vdec_input_get_freed_handle(struct vdec_s *vdec)
 
 		handle = block->handle;
 		vdec_input_del_block_locked(input, block);
-		kfree(block);
+		vdec_input_block_free(input, block);
 
 	} while(!handle);
 
@@ -18,6 +18,8 @@
 #ifndef VDEC_INPUT_H
 #define VDEC_INPUT_H
 
+#include <linux/llist.h>
+
 struct vdec_s;
 struct vdec_input_s;
 
@@ -38,6 +40,7 @@ struct vframe_block_list_s {
 	int is_out_buf;
 	u32 handle;
 	struct vdec_input_s *input;
+	struct llist_node pool_node;
 };
 
 #define VFRAME_CHUNK_FLAG_CONSUMED  0x0001
@@ -56,6 +59,7 @@ struct vframe_chunk_s {
 	bool timestamp_valid;
 	u64 sequence;
 	struct vframe_block_list_s *block;
+	struct llist_node pool_node;
 };
 
 #define VDEC_INPUT_TARGET_VLD           0
@@ -63,6 +67,22 @@ struct vframe_chunk_s {
 #define VLD_PADDING_SIZE                1024
 #define HEVC_PADDING_SIZE               (1024*16)
 
+/*
+ * Recycled chunk or block structures of one input. Release puts them
+ * back with llist_add() from any context, only the writer of the
+ * input takes them out again, so neither side needs a lock.
+ */
+struct vdec_input_pool_s {
+	struct llist_head free;
+	struct llist_node *stash;	/* writer private, refilled from free */
+	atomic_t cached;		/* on free and stash */
+	atomic_t in_use;
+	int max_cached;
+	int peak;
+	u32 hit;
+	u32 miss;
+};
+
 struct vdec_input_s {
 	struct list_head vframe_block_list;
 	struct list_head vframe_chunk_list;
@@ -107,6 +127,18 @@ struct vdec_input_s {
 			      HEVC_SHIFT_BYTE_COUNT for hevc */
 	bool (*vdec_is_input_frame_empty)(struct vdec_s *);
 	void (*vdec_up)(struct vdec_s *);
+	/*
+	 * optional, called after a chunk is consumed while have_frame_num
+	 * is at or below space_level, so a producer held back by a full
+	 * input can resume without polling. Set and cleared through
+	 * vdec_input_set_space_notify()/vdec_input_clear_space_notify().
+	 */
+	void (*space_notify)(void *priv);
+	void *space_priv;
+	int space_level;
+	atomic_t space_notify_users;
+	struct vdec_input_pool_s chunk_pool;
+	struct vdec_input_pool_s block_pool;
 };
 
 struct vdec_input_status_s {
@@ -158,6 +190,13 @@ extern struct vframe_chunk_s *vdec_input_next_input_chunk(
 extern void vdec_input_release_chunk(struct vdec_input_s *input,
 	struct vframe_chunk_s *chunk);
 
+/* Call notify(priv) once the input drained to level frames */
+extern void vdec_input_set_space_notify(struct vdec_input_s *input,
+	void (*notify)(void *priv), void *priv, int level);
+
+/* Stop the space notify and wait for a running one to return */
+extern void vdec_input_clear_space_notify(struct vdec_input_s *input);
+
 /* Get decoder input buffer status */
 extern int vdec_input_get_status(struct vdec_input_s *input,
 	struct vdec_input_status_s *status);
@@ -177,4 +216,17 @@ int vdec_input_dump_blocks(struct vdec_input_s *input,
 
 int vdec_input_get_duration_u64(struct vdec_input_s *input);
 
+int vdec_input_module_init(void);
+void vdec_input_module_exit(void);
+
+/* chunk structure pool, shared with the pool self test */
+void vdec_input_pool_setup(struct vdec_input_s *input);
+void vdec_input_pool_release(struct vdec_input_s *input);
+struct vframe_chunk_s *vdec_input_chunk_alloc(struct vdec_input_s *input);
+void vdec_input_chunk_free(struct vdec_input_s *input,
+	struct vframe_chunk_s *chunk);
+int vdec_input_dump_pool(struct vdec_input_s *input, char *buf, int size);
+extern struct codec_mm_selftest_s vdec_input_pool_selftest;
+extern struct codec_mm_selftest_s vdec_input_chunk_selftest;
+
 #endif /* VDEC_INPUT_H */
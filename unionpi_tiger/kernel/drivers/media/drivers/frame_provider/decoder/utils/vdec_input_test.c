@@ -0,0 +1,400 @@
+/*
+ * drivers/amlogic/media/frame_provider/decoder/utils/vdec_input_test.c
+ *
+ * Copyright (C) 2016 Amlogic, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/sizes.h>
+#include <linux/vmalloc.h>
+#include <linux/amlogic/media/codec_mm/codec_mm.h>
+
+#include "vdec.h"
+#include "vdec_input.h"
+
+/*
+ *Chunk pool self test. A writer allocates chunks at the given rate
+ *and queues them the way vdec_input_add_chunk() does, a decoder
+ *thread releases them the way vdec_input_release_chunk() does. No
+ *vdec and no block storage is involved, safe on a running system:
+ *	echo "vdec_input_pool <chunks> <chunks per second>" \
+ *		> /sys/class/codec_mm/selftest
+ */
+#define POOL_TEST_MAGIC 0x54534554
+#define POOL_TEST_CHUNKS 100000
+#define POOL_TEST_RATE 10000
+#define POOL_TEST_BLOCK_SIZE (512 * SZ_1K)
+
+struct pool_test_s {
+	struct vdec_input_s *input;
+	struct list_head queue;
+	spinlock_t lock;
+	u64 next_seq;
+	int queued;
+	int max_queued;
+	int errors;
+};
+
+static bool pool_test_release_one(struct pool_test_s *t)
+{
+	struct vframe_chunk_s *chunk;
+	unsigned long flags;
+
+	spin_lock_irqsave(&t->lock, flags);
+	chunk = list_first_entry_or_null(&t->queue,
+		struct vframe_chunk_s, list);
+	if (chunk) {
+		list_del(&chunk->list);
+		t->queued--;
+	}
+	spin_unlock_irqrestore(&t->lock, flags);
+	if (!chunk)
+		return false;
+
+	if (chunk->magic != POOL_TEST_MAGIC ||
+		chunk->sequence != t->next_seq) {
+		if (t->errors++ < 16)
+			pr_err("pool test: chunk %llu magic %x, want %llu\n",
+				chunk->sequence, chunk->magic, t->next_seq);
+	}
+	t->next_seq = chunk->sequence + 1;
+	/*like vdec_input_release_chunk: freed outside the lock*/
+	vdec_input_chunk_free(t->input, chunk);
+	return true;
+}
+
+static int pool_test_release_thread(void *data)
+{
+	struct pool_test_s *t = data;
+
+	while (!kthread_should_stop()) {
+		if (!pool_test_release_one(t))
+			usleep_range(100, 200);
+	}
+	return 0;
+}
+
+static u64 pool_test_kzalloc_ns(int n)
+{
+	struct vframe_chunk_s *chunk;
+	u64 t = ktime_get_ns();
+	int i;
+
+	for (i = 0; i < n; i++) {
+		chunk = kzalloc(sizeof(*chunk), GFP_KERNEL);
+		if (!chunk)
+			break;
+		kfree(chunk);
+	}
+	return i ? div_u64(ktime_get_ns() - t, i) : 0;
+}
+
+static int vdec_input_pool_test(int chunks, int rate)
+{
+	struct pool_test_s *t;
+	struct vframe_chunk_s *chunk;
+	struct vdec_input_pool_s *pool;
+	struct task_struct *task;
+	unsigned long flags;
+	u64 start, alloc_ns = 0, now, due;
+	int i, ret;
+
+	if (chunks <= 0)
+		chunks = POOL_TEST_CHUNKS;
+	if (rate <= 0)
+		rate = POOL_TEST_RATE;
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->input = kzalloc(sizeof(*t->input), GFP_KERNEL);
+	if (!t->input) {
+		kfree(t);
+		return -ENOMEM;
+	}
+	INIT_LIST_HEAD(&t->queue);
+	spin_lock_init(&t->lock);
+	t->input->default_block_size = POOL_TEST_BLOCK_SIZE;
+	vdec_input_pool_setup(t->input);
+	pool = &t->input->chunk_pool;
+
+	task = kthread_run(pool_test_release_thread, t, "vdec_pool_test");
+	if (IS_ERR(task)) {
+		ret = PTR_ERR(task);
+		goto out;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < chunks; i++) {
+		due = start + div_u64((u64)i * NSEC_PER_SEC, rate);
+		now = ktime_get_ns();
+		if (due > now + NSEC_PER_MSEC)
+			usleep_range(div_u64(due - now, NSEC_PER_USEC),
+				div_u64(due - now, NSEC_PER_USEC) + 100);
+
+		now = ktime_get_ns();
+		chunk = vdec_input_chunk_alloc(t->input);
+		alloc_ns += ktime_get_ns() - now;
+		if (!chunk) {
+			t->errors++;
+			break;
+		}
+		if (chunk->magic || chunk->block) {
+			if (t->errors++ < 16)
+				pr_err("pool test: chunk %d not cleared\n", i);
+		}
+		chunk->magic = POOL_TEST_MAGIC;
+		chunk->sequence = i;
+		INIT_LIST_HEAD(&chunk->list);
+
+		spin_lock_irqsave(&t->lock, flags);
+		list_add_tail(&chunk->list, &t->queue);
+		if (++t->queued > t->max_queued)
+			t->max_queued = t->queued;
+		spin_unlock_irqrestore(&t->lock, flags);
+	}
+	kthread_stop(task);
+	/*the thread may stop before the queue is empty*/
+	while (pool_test_release_one(t))
+		;
+	now = ktime_get_ns();
+
+	if (atomic_read(&pool->in_use) != 0 || t->next_seq != i ||
+		pool->hit + pool->miss != i) {
+		t->errors++;
+		pr_err("pool test: in use %d, released %llu, hit+miss %u of %d\n",
+			atomic_read(&pool->in_use), t->next_seq,
+			pool->hit + pool->miss, i);
+	}
+	pr_info("pool test: %d chunks in %llu ms, max queued %d, %d errors\n",
+		i, div_u64(now - start, NSEC_PER_MSEC), t->max_queued,
+		t->errors);
+	pr_info("pool test: hit %u miss %u peak %d cached %d/%d\n",
+		pool->hit, pool->miss, pool->peak,
+		atomic_read(&pool->cached), pool->max_cached);
+	if (i)
+		pr_info("pool test: pool %llu ns/alloc, kzalloc+kfree %llu ns\n",
+			div_u64(alloc_ns, i), pool_test_kzalloc_ns(i));
+	ret = t->errors ? -EINVAL : 0;
+out:
+	vdec_input_pool_release(t->input);
+	kfree(t->input);
+	kfree(t);
+	return ret;
+}
+
+/*"<chunks> <chunks per second>"*/
+static int vdec_input_pool_selftest_run(const char *args)
+{
+	int chunks = 0, rate = 0;
+
+	sscanf(args, "%d %d", &chunks, &rate);
+	return vdec_input_pool_test(chunks, rate);
+}
+
+struct codec_mm_selftest_s vdec_input_pool_selftest = {
+	.name = "vdec_input_pool",
+	.run = vdec_input_pool_selftest_run,
+};
+
+/*
+ *Chunk cycle self test. A writer adds frames with
+ *vdec_input_add_chunk() to a frame based input of a stand-in vdec,
+ *a decoder thread takes them with vdec_input_next_chunk() and gives
+ *them back with vdec_input_release_chunk(), so chunks, blocks and
+ *their storage all cycle through the pools. Each frame starts with
+ *its sequence number, checked on release:
+ *	echo "vdec_input_chunk <frames> <max frame size>" \
+ *		> /sys/class/codec_mm/selftest
+ */
+#define CHUNK_TEST_FRAMES 20000
+#define CHUNK_TEST_MAX_SIZE (64 * SZ_1K)
+
+struct chunk_test_s {
+	struct vdec_s *vdec;
+	u32 max_size;
+	u64 next_seq;
+	int released;
+	int errors;
+	u64 release_ns;
+};
+
+static u32 chunk_test_size(struct chunk_test_s *t, u64 seq)
+{
+	/*spread over 64 bytes to max_size, not page aligned*/
+	return 64 + ((u32)seq * 7919) % (t->max_size - 64);
+}
+
+static void chunk_test_vdec_up(struct vdec_s *vdec)
+{
+}
+
+static bool chunk_test_release_one(struct chunk_test_s *t)
+{
+	struct vdec_input_s *input = &t->vdec->input;
+	struct vframe_chunk_s *chunk;
+	struct vframe_block_list_s *block;
+	u64 start;
+
+	chunk = vdec_input_next_chunk(input);
+	if (!chunk)
+		return false;
+
+	block = chunk->block;
+	if (chunk->sequence != t->next_seq ||
+		chunk->size != chunk_test_size(t, chunk->sequence)) {
+		if (t->errors++ < 16)
+			pr_err("chunk test: chunk %llu size %u, want %llu\n",
+				chunk->sequence, chunk->size, t->next_seq);
+	} else if (block->is_mapped &&
+		*(u64 *)(block->start_virt + chunk->offset) !=
+		chunk->sequence) {
+		if (t->errors++ < 16)
+			pr_err("chunk test: chunk %llu data %llx\n",
+				chunk->sequence,
+				*(u64 *)(block->start_virt + chunk->offset));
+	}
+	t->next_seq = chunk->sequence + 1;
+
+	start = ktime_get_ns();
+	vdec_input_release_chunk(input, chunk);
+	t->release_ns += ktime_get_ns() - start;
+	t->released++;
+	return true;
+}
+
+static int chunk_test_release_thread(void *data)
+{
+	struct chunk_test_s *t = data;
+
+	while (!kthread_should_stop()) {
+		if (!chunk_test_release_one(t))
+			usleep_range(100, 200);
+	}
+	return 0;
+}
+
+static int vdec_input_chunk_test(int frames, int max_size)
+{
+	struct chunk_test_s *t;
+	struct vdec_input_s *input;
+	struct task_struct *task;
+	u64 start, add_ns = 0, now, stuck = 0;
+	int i, ret, full = 0;
+	u8 *buf;
+
+	if (frames <= 0)
+		frames = CHUNK_TEST_FRAMES;
+	if (max_size <= 128 || max_size > SZ_1M)
+		max_size = CHUNK_TEST_MAX_SIZE;
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->max_size = max_size;
+	buf = vmalloc(max_size);
+	t->vdec = vzalloc(sizeof(*t->vdec));
+	if (!buf || !t->vdec) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	memset(buf, 0x5a, max_size);
+	input = &t->vdec->input;
+	vdec_input_init(input, t->vdec);
+	vdec_input_set_type(input, VDEC_TYPE_FRAME_BLOCK,
+		VDEC_INPUT_TARGET_VLD);
+	input->vdec_up = chunk_test_vdec_up;
+
+	task = kthread_run(chunk_test_release_thread, t, "vdec_chunk_test");
+	if (IS_ERR(task)) {
+		ret = PTR_ERR(task);
+		goto out;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < frames; ) {
+		u32 size = chunk_test_size(t, i);
+
+		*(u64 *)buf = i;
+		now = ktime_get_ns();
+		ret = vdec_input_add_chunk(input, buf, size, 0);
+		if (ret == -EAGAIN) {
+			/*all blocks in use, let the decoder catch up*/
+			if (!stuck)
+				stuck = now;
+			if (now - stuck < NSEC_PER_SEC * 5) {
+				full++;
+				usleep_range(500, 1000);
+				continue;
+			}
+		}
+		stuck = 0;
+		add_ns += ktime_get_ns() - now;
+		if (ret != (int)size) {
+			pr_err("chunk test: add %d of %u returned %d\n",
+				i, size, ret);
+			t->errors++;
+			break;
+		}
+		i++;
+	}
+	kthread_stop(task);
+	/*the thread may stop before the input is empty*/
+	while (chunk_test_release_one(t))
+		;
+	now = ktime_get_ns();
+
+	if (t->released != i || input->have_frame_num ||
+		atomic_read(&input->chunk_pool.in_use) != 0) {
+		t->errors++;
+		pr_err("chunk test: released %d of %d, %d queued, %d in use\n",
+			t->released, i, input->have_frame_num,
+			atomic_read(&input->chunk_pool.in_use));
+	}
+	pr_info("chunk test: %d frames in %llu ms, %d blocks %d bytes, input full %d times, %d errors\n",
+		i, div_u64(now - start, NSEC_PER_MSEC), input->block_nums,
+		input->size, full, t->errors);
+	if (i)
+		pr_info("chunk test: add %llu ns, release %llu ns per frame\n",
+			div_u64(add_ns, i), div_u64(t->release_ns, i));
+	pr_info("chunk test: chunk hit %u miss %u, block hit %u miss %u\n",
+		input->chunk_pool.hit, input->chunk_pool.miss,
+		input->block_pool.hit, input->block_pool.miss);
+	ret = t->errors ? -EINVAL : 0;
+out:
+	vdec_input_release(input);
+out_free:
+	vfree(t->vdec);
+	vfree(buf);
+	kfree(t);
+	return ret;
+}
+
+/*"<frames> <max frame size>"*/
+static int vdec_input_chunk_selftest_run(const char *args)
+{
+	int frames = 0, max_size = 0;
+
+	sscanf(args, "%d %d", &frames, &max_size);
+	return vdec_input_chunk_test(frames, max_size);
+}
+
+struct codec_mm_selftest_s vdec_input_chunk_selftest = {
+	.name = "vdec_input_chunk",
+	.run = vdec_input_chunk_selftest_run,
+};
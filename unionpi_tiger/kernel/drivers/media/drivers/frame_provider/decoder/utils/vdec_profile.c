@@ -16,69 +16,67 @@
 */
 
 #include <linux/kernel.h>
-#include <linux/mutex.h>
 #include <linux/types.h>
 #include <linux/debugfs.h>
 #include <linux/moduleparam.h>
 #include <linux/sched/clock.h>
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
 
 #include <linux/amlogic/media/utils/vdec_reg.h>
+#include <linux/amlogic/media/utils/vformat.h>
+#include <linux/amlogic/media/vfm/vframe.h>
 #include <linux/amlogic/meson_atrace.h>
 #include "vdec_profile.h"
 #include "vdec.h"
 
+#include "vdec_trace.h"
+
 
 #define ISA_TIMERE 0x2662
 #define ISA_TIMERE_HI 0x2663
 
-#define PROFILE_REC_SIZE 40
+/*
+ * Events go to a ring per cpu and latencies to per cpu histograms of
+ * each instance, both written with local irqs off and no lock, so
+ * profiling can stay on with many streams. Readers take a snapshot
+ * and drop records a writer overwrote meanwhile.
+ */
+#define PROFILE_REC_SIZE 4096 /* per cpu, power of 2 */
 
-static DEFINE_MUTEX(vdec_profile_mutex);
-static int rec_wp;
-static bool rec_wrapped;
 static uint dec_time_stat_flag;
 static uint dec_time_stat_reset;
 
+static struct dentry *profile_root;
 
-struct dentry *root, *event;
+struct vdec_profile_ring_s {
+	struct vdec_profile_event_s *recs;
+	u32 *seq;		/* record index + 1, 0 while written */
+	u64 wp;
+};
 
-#define MAX_INSTANCE_MUN  9
+static DEFINE_PER_CPU(struct vdec_profile_ring_s, profile_ring);
 
-struct vdec_profile_time_stat_s {
-	int time_6ms_less_cnt;
-	int time_6_9ms_cnt;
-	int time_9_12ms_cnt;
-	int time_12_15ms_cnt;
-	int time_15_18ms_cnt;
-	int time_18_21ms_cnt;
-	int time_21ms_up_cnt;
-	u64 time_max_us;
-	u64 time_total_us;
+struct vdec_profile_hist_s {
+	u32 cnt[VDEC_PROFILE_MAX_LAT][VDEC_PROFILE_HIST_BUCKETS];
+	u64 sum_ns[VDEC_PROFILE_MAX_LAT];
+	u64 max_ns[VDEC_PROFILE_MAX_LAT];
 };
 
-struct vdec_profile_statistics_s {
-	bool status;
-	u64 run_lasttimestamp;
-	int run_cnt;
-	u64 cb_lasttimestamp;
-	int cb_cnt;
-	u64 decode_first_us;
-	struct vdec_profile_time_stat_s run2cb_time_stat;
-	struct vdec_profile_time_stat_s decode_time_stat;
+struct vdec_profile_inst_s {
+	struct vdec_profile_hist_s __percpu *hist;
+	u64 ready_ns;		/* first seen ready since last run */
+	u64 run_ns;
+	int format;
+	bool used;
+	bool flushed;		/* instance gone, reset on reuse */
 };
 
-static struct vdec_profile_statistics_s statistics_s[MAX_INSTANCE_MUN];
+static struct vdec_profile_inst_s insts[MAX_INSTANCE_MUN];
+static const char *format_name[VFORMAT_MAX];
 
-
-struct vdec_profile_rec_s {
-	struct vdec_s *vdec;
-	u64 timestamp;
-	int event;
-	int para1;
-	int para2;
-};
-
-static struct vdec_profile_rec_s recs[PROFILE_REC_SIZE];
 static const char *event_name[VDEC_PROFILE_MAX_EVENT] = {
 	"run",
 	"cb",
@@ -90,6 +88,12 @@ static const char *event_name[VDEC_PROFILE_MAX_EVENT] = {
 	"info"
 };
 
+static const char *lat_name[VDEC_PROFILE_MAX_LAT] = {
+	"run2cb",
+	"ready2run",
+	"cb2vf"
+};
+
 #if 0 /* get time from hardware. */
 static u64 get_us_time_hw(void)
 {
@@ -110,141 +114,189 @@ static u64 get_us_time_hw(void)
 }
 #endif
 
-static u64 get_us_time_system(void)
+static void vdec_profile_rec(struct vdec_s *vdec, int event,
+	int para1, int para2, u64 now)
 {
-	return div64_u64(local_clock(), 1000);
-}
+	struct vdec_profile_ring_s *ring = this_cpu_ptr(&profile_ring);
+	struct vdec_profile_event_s *rec;
+	u32 i;
 
-static void vdec_profile_update_alloc_time(
-	struct vdec_profile_time_stat_s *time_stat, u64 startus, u64 endus)
-{
-	u64 spend_time_us = endus - startus;
-
-	if (spend_time_us > 0 && spend_time_us < 100000000) {
-		if (spend_time_us < 6000)
-			time_stat->time_6ms_less_cnt++;
-		else if (spend_time_us < 9000)
-			time_stat->time_6_9ms_cnt++;
-		else if (spend_time_us < 12000)
-			time_stat->time_9_12ms_cnt++;
-		else if (spend_time_us < 15000)
-			time_stat->time_12_15ms_cnt++;
-		else if (spend_time_us < 18000)
-			time_stat->time_15_18ms_cnt++;
-		else if (spend_time_us < 21000)
-			time_stat->time_18_21ms_cnt++;
-		else
-			time_stat->time_21ms_up_cnt++;
+	if (!ring->recs)
+		return;
+	i = ring->wp & (PROFILE_REC_SIZE - 1);
+	rec = &ring->recs[i];
+	WRITE_ONCE(ring->seq[i], 0);
+	smp_wmb();
+	rec->ns = now;
+	rec->para1 = para1;
+	rec->para2 = para2;
+	if (vdec && vdec->id >= 0) {
+		rec->id = vdec->id;
+		rec->format = vdec->format;
+		if ((u32)vdec->format < VFORMAT_MAX)
+			format_name[vdec->format] = vdec_device_name_str(vdec);
+	} else {
+		rec->id = 0xffff;
+		rec->format = 0;
 	}
+	rec->event = event;
+	rec->cpu = smp_processor_id();
+	smp_wmb();
+	WRITE_ONCE(ring->seq[i], (u32)ring->wp + 1);
+	WRITE_ONCE(ring->wp, ring->wp + 1);
+}
 
-	if (spend_time_us > time_stat->time_max_us)
-		time_stat->time_max_us = spend_time_us;
+static void vdec_profile_hist_add(struct vdec_profile_inst_s *inst,
+	int lat, u64 ns)
+{
+	struct vdec_profile_hist_s *h = this_cpu_ptr(inst->hist);
 
-	time_stat->time_total_us += spend_time_us;
+	h->cnt[lat][vdec_profile_hist_bucket(ns)]++;
+	h->sum_ns[lat] += ns;
+	if (ns > h->max_ns[lat])
+		h->max_ns[lat] = ns;
+	trace_vdec_profile_latency(inst - insts, lat, ns);
 }
 
-
-static void vdec_profile_statistics(struct vdec_s *vdec, int event)
+static void vdec_profile_inst_reset(struct vdec_profile_inst_s *inst)
 {
-	struct vdec_profile_statistics_s *time_stat = NULL;
-	u64 timestamp;
-	int i;
+	int cpu;
 
-	if (vdec->id >= MAX_INSTANCE_MUN)
-		return;
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(inst->hist, cpu), 0,
+			sizeof(struct vdec_profile_hist_s));
+	inst->ready_ns = 0;
+	inst->run_ns = 0;
+}
 
-	if (event != VDEC_PROFILE_EVENT_RUN &&
-			event != VDEC_PROFILE_EVENT_CB)
-		return;
+static struct vdec_profile_inst_s *vdec_profile_get_inst(
+	struct vdec_s *vdec)
+{
+	struct vdec_profile_inst_s *inst;
+	int i;
 
-	mutex_lock(&vdec_profile_mutex);
+	if (vdec->id < 0 || vdec->id >= MAX_INSTANCE_MUN)
+		return NULL;
+	inst = &insts[vdec->id];
+	if (!inst->hist)
+		return NULL;
 
-	if (dec_time_stat_reset == 1) {
-		if (event != VDEC_PROFILE_EVENT_RUN) {
-			mutex_unlock(&vdec_profile_mutex);
-			return;
-		}
-		for (i = 0; i < MAX_INSTANCE_MUN; i++)
-			memset(&statistics_s[i], 0,
-				sizeof(struct vdec_profile_statistics_s));
+	/* may race with writers on other cpus, a few counts off is fine */
+	if (unlikely(dec_time_stat_reset == 1)) {
 		dec_time_stat_reset = 0;
+		for (i = 0; i < MAX_INSTANCE_MUN; i++) {
+			if (insts[i].hist)
+				vdec_profile_inst_reset(&insts[i]);
+		}
+	}
+	if (unlikely(!inst->used || inst->flushed)) {
+		vdec_profile_inst_reset(inst);
+		inst->format = vdec->format;
+		inst->flushed = false;
+		inst->used = true;
 	}
+	return inst;
+}
 
-	time_stat = &statistics_s[vdec->id];
-	timestamp = get_us_time_system();
+static void vdec_profile_statistics(struct vdec_s *vdec, int event, u64 now)
+{
+	struct vdec_profile_inst_s *inst;
+	unsigned long flags;
 
-	if (time_stat->status == false) {
-		time_stat->decode_first_us = timestamp;
-		time_stat->status = true;
-	}
+	if (event != VDEC_PROFILE_EVENT_RUN &&
+		event != VDEC_PROFILE_EVENT_CB &&
+		event != VDEC_PROFILE_EVENT_RUN_READY)
+		return;
 
-	if (event == VDEC_PROFILE_EVENT_RUN) {
-		time_stat->run_lasttimestamp = timestamp;
-		time_stat->run_cnt++;
-	} else if (event == VDEC_PROFILE_EVENT_CB) {
-		/*run2cb statistics*/
-		vdec_profile_update_alloc_time(&time_stat->run2cb_time_stat, time_stat->run_lasttimestamp, timestamp);
-
-		/*decode statistics*/
-		if (time_stat->cb_cnt == 0)
-			vdec_profile_update_alloc_time(&time_stat->decode_time_stat, time_stat->decode_first_us, timestamp);
-		else
-			vdec_profile_update_alloc_time(&time_stat->decode_time_stat, time_stat->cb_lasttimestamp, timestamp);
-
-		time_stat->cb_lasttimestamp = timestamp;
-		time_stat->cb_cnt++;
-	}
+	inst = vdec_profile_get_inst(vdec);
+	if (!inst)
+		return;
 
-	mutex_unlock(&vdec_profile_mutex);
+	local_irq_save(flags);
+	if (event == VDEC_PROFILE_EVENT_RUN_READY) {
+		if (!inst->ready_ns)
+			inst->ready_ns = now;
+	} else if (event == VDEC_PROFILE_EVENT_RUN) {
+		if (inst->ready_ns && now > inst->ready_ns)
+			vdec_profile_hist_add(inst, VDEC_PROFILE_LAT_READY2RUN,
+				now - inst->ready_ns);
+		inst->ready_ns = 0;
+		inst->run_ns = now;
+	} else {
+		if (inst->run_ns && now > inst->run_ns)
+			vdec_profile_hist_add(inst, VDEC_PROFILE_LAT_RUN2CB,
+				now - inst->run_ns);
+		inst->run_ns = 0;
+	}
+	local_irq_restore(flags);
 }
 
-
 void vdec_profile_more(struct vdec_s *vdec, int event, int para1, int para2)
 {
-	mutex_lock(&vdec_profile_mutex);
-
-	recs[rec_wp].vdec = vdec;
-	recs[rec_wp].timestamp = get_us_time_system();
-	recs[rec_wp].event = event;
-	recs[rec_wp].para1 = para1;
-	recs[rec_wp].para2 = para2;
-
-	rec_wp++;
-	if (rec_wp == PROFILE_REC_SIZE) {
-		rec_wrapped = true;
-		rec_wp = 0;
-	}
+	unsigned long flags;
+	u64 now = local_clock();
+
+	local_irq_save(flags);
+	vdec_profile_rec(vdec, event, para1, para2, now);
+	local_irq_restore(flags);
 
-	mutex_unlock(&vdec_profile_mutex);
+	trace_vdec_profile_event(vdec ? vdec->id : -1, event, para1, para2);
 }
 EXPORT_SYMBOL(vdec_profile_more);
 
 void vdec_profile(struct vdec_s *vdec, int event)
 {
+	u64 now = local_clock();
+	unsigned long flags;
+
 	ATRACE_COUNTER(vdec->vfm_map_id, event);
-	vdec_profile_more(vdec, event, 0 , 0);
+	local_irq_save(flags);
+	vdec_profile_rec(vdec, event, 0, 0, now);
+	local_irq_restore(flags);
+	trace_vdec_profile_event(vdec->id, event, 0, 0);
+
 	if (dec_time_stat_flag == 1)
-		vdec_profile_statistics(vdec, event);
+		vdec_profile_statistics(vdec, event, now);
 }
 EXPORT_SYMBOL(vdec_profile);
 
-void vdec_profile_flush(struct vdec_s *vdec)
+/* decoder put vf on its display queue */
+void vdec_profile_vf_ready(struct vframe_s *vf)
 {
-	int i;
+	vf->ready_clock[0] = local_clock();
+}
+EXPORT_SYMBOL(vdec_profile_vf_ready);
 
-	if (vdec->id >= MAX_INSTANCE_MUN)
-			return;
+/* consumer got vf from the decoder */
+void vdec_profile_vf_get(struct vdec_s *vdec, struct vframe_s *vf)
+{
+	struct vdec_profile_inst_s *inst;
+	unsigned long flags;
+	u64 now, ready = vf->ready_clock[0];
 
-	mutex_lock(&vdec_profile_mutex);
+	vf->ready_clock[0] = 0;
+	if (dec_time_stat_flag != 1 || !ready)
+		return;
+	inst = vdec_profile_get_inst(vdec);
+	if (!inst)
+		return;
+	now = local_clock();
+	if (now <= ready)
+		return;
 
-	for (i = 0; i < PROFILE_REC_SIZE; i++) {
-		if (recs[i].vdec == vdec)
-			recs[i].vdec = NULL;
-	}
+	local_irq_save(flags);
+	vdec_profile_hist_add(inst, VDEC_PROFILE_LAT_CB2VF, now - ready);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(vdec_profile_vf_get);
 
-	memset(&statistics_s[vdec->id], 0, sizeof(struct vdec_profile_statistics_s));
+void vdec_profile_flush(struct vdec_s *vdec)
+{
+	if (vdec->id < 0 || vdec->id >= MAX_INSTANCE_MUN)
+		return;
 
-	mutex_unlock(&vdec_profile_mutex);
+	/* keep the histograms readable until the id is reused */
+	insts[vdec->id].flushed = true;
 }
 
 static const char *event_str(int event)
@@ -255,123 +307,250 @@ static const char *event_str(int event)
 	return "INVALID";
 }
 
-static int vdec_profile_dbg_show(struct seq_file *m, void *v)
+struct vdec_profile_snap_s {
+	struct vdec_profile_events_hdr_s hdr;
+	struct vdec_profile_event_s recs[0];
+};
+
+static int vdec_profile_rec_cmp(const void *a, const void *b)
 {
-	int i, end;
-	u64 base_timestamp;
+	const struct vdec_profile_event_s *ra = a, *rb = b;
 
-	mutex_lock(&vdec_profile_mutex);
+	if (ra->ns == rb->ns)
+		return 0;
+	return ra->ns < rb->ns ? -1 : 1;
+}
 
-	if (rec_wrapped) {
-		i = rec_wp;
-		end = rec_wp;
-	} else {
-		i = 0;
-		end = rec_wp;
+/* all valid records of all cpus, sorted by time */
+static struct vdec_profile_snap_s *vdec_profile_snapshot(void)
+{
+	struct vdec_profile_snap_s *snap;
+	struct vdec_profile_ring_s *ring;
+	struct vdec_profile_event_s *rec;
+	u64 wp, n;
+	u32 i, seq;
+	int cpu;
+
+	snap = vzalloc(sizeof(*snap) + sizeof(struct vdec_profile_event_s) *
+		PROFILE_REC_SIZE * num_possible_cpus());
+	if (!snap)
+		return NULL;
+
+	rec = snap->recs;
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(&profile_ring, cpu);
+		if (!ring->recs)
+			continue;
+		wp = READ_ONCE(ring->wp);
+		smp_rmb();
+		n = wp > PROFILE_REC_SIZE ? wp - PROFILE_REC_SIZE : 0;
+		for (; n < wp; n++) {
+			i = n & (PROFILE_REC_SIZE - 1);
+			seq = READ_ONCE(ring->seq[i]);
+			smp_rmb();
+			*rec = ring->recs[i];
+			smp_rmb();
+			if (seq != (u32)n + 1 ||
+				READ_ONCE(ring->seq[i]) != seq) {
+				snap->hdr.lost++;
+				continue;
+			}
+			rec++;
+		}
 	}
+	snap->hdr.magic = VDEC_PROFILE_EVENTS_MAGIC;
+	snap->hdr.version = VDEC_PROFILE_VERSION;
+	snap->hdr.rec_size = sizeof(struct vdec_profile_event_s);
+	snap->hdr.rec_num = rec - snap->recs;
+	sort(snap->recs, snap->hdr.rec_num, sizeof(*rec),
+		vdec_profile_rec_cmp, NULL);
+	return snap;
+}
 
-	base_timestamp = recs[i].timestamp;
-	while (1) {
-		if ((!rec_wrapped) && (i == end))
-			break;
-
-		if (recs[i].vdec) {
-			seq_printf(m, "[%s:%d] \t%016llu us : %s (%d,%d)\n",
-				vdec_device_name_str(recs[i].vdec),
-				recs[i].vdec->id,
-				recs[i].timestamp - base_timestamp,
-				event_str(recs[i].event),
-				recs[i].para1,
-				recs[i].para2
-				);
-		} else {
-			seq_printf(m, "[%s:%d] \t%016llu us : %s (%d,%d)\n",
-				"N/A",
-				0,
-				recs[i].timestamp - base_timestamp,
-				event_str(recs[i].event),
-				recs[i].para1,
-				recs[i].para2
-				);
-		}
-		if (++i == PROFILE_REC_SIZE)
-			i = 0;
+static int vdec_profile_dbg_show(struct seq_file *m, void *v)
+{
+	struct vdec_profile_snap_s *snap;
+	struct vdec_profile_event_s *rec;
+	const char *name;
+	u32 i;
+
+	snap = vdec_profile_snapshot();
+	if (!snap)
+		return -ENOMEM;
+
+	for (i = 0; i < snap->hdr.rec_num; i++) {
+		rec = &snap->recs[i];
+		name = (rec->id != 0xffff && rec->format < VFORMAT_MAX) ?
+			format_name[rec->format] : NULL;
+		seq_printf(m, "[%s:%d] \t%016llu us : %s (%d,%d)\n",
+			name ? name : "N/A",
+			name ? rec->id : 0,
+			div_u64(rec->ns - snap->recs[0].ns, NSEC_PER_USEC),
+			event_str(rec->event),
+			rec->para1,
+			rec->para2);
+	}
+
+	vfree(snap);
+	return 0;
+}
 
-		if (rec_wrapped && (i == end))
-			break;
+static void vdec_profile_hist_sum(struct vdec_profile_inst_s *inst,
+	struct vdec_profile_hist_inst_s *sum, u32 *cnt)
+{
+	struct vdec_profile_hist_s *h;
+	int cpu, lat, b;
+
+	memset(sum, 0, sizeof(*sum));
+	memset(cnt, 0, sizeof(u32) * VDEC_PROFILE_MAX_LAT *
+		VDEC_PROFILE_HIST_BUCKETS);
+	sum->id = inst - insts;
+	sum->format = inst->format;
+	for_each_possible_cpu(cpu) {
+		h = per_cpu_ptr(inst->hist, cpu);
+		for (lat = 0; lat < VDEC_PROFILE_MAX_LAT; lat++) {
+			for (b = 0; b < VDEC_PROFILE_HIST_BUCKETS; b++)
+				cnt[lat * VDEC_PROFILE_HIST_BUCKETS + b] +=
+					READ_ONCE(h->cnt[lat][b]);
+			sum->sum_ns[lat] += READ_ONCE(h->sum_ns[lat]);
+			if (h->max_ns[lat] > sum->max_ns[lat])
+				sum->max_ns[lat] = h->max_ns[lat];
+		}
 	}
+}
 
-	mutex_unlock(&vdec_profile_mutex);
+static int time_stat_profile_dbg_show(struct seq_file *m, void *v)
+{
+	static const u32 pct[] = {5000, 9000, 9900, 9990};
+	struct vdec_profile_hist_inst_s sum;
+	u32 *cnt, *c;
+	u64 total;
+	int i, lat, b, j;
+
+	cnt = vmalloc(sizeof(u32) * VDEC_PROFILE_MAX_LAT *
+		VDEC_PROFILE_HIST_BUCKETS);
+	if (!cnt)
+		return -ENOMEM;
+
+	seq_puts(m, "us:\t\tcount\tave\tp50\tp90\tp99\tp99.9\tmax\n");
+	for (i = 0; i < MAX_INSTANCE_MUN; i++) {
+		if (!insts[i].hist || !insts[i].used)
+			continue;
+		vdec_profile_hist_sum(&insts[i], &sum, cnt);
+		seq_printf(m, "[%d]%s%s\n", i,
+			(sum.format < VFORMAT_MAX && format_name[sum.format]) ?
+			format_name[sum.format] : "",
+			insts[i].flushed ? " (gone)" : "");
+		for (lat = 0; lat < VDEC_PROFILE_MAX_LAT; lat++) {
+			c = &cnt[lat * VDEC_PROFILE_HIST_BUCKETS];
+			total = 0;
+			for (b = 0; b < VDEC_PROFILE_HIST_BUCKETS; b++)
+				total += c[b];
+			seq_printf(m, "\t%s\t%llu\t%llu", lat_name[lat], total,
+				total ? div64_u64(sum.sum_ns[lat],
+					total * NSEC_PER_USEC) : 0);
+			for (j = 0; j < ARRAY_SIZE(pct); j++) {
+				b = vdec_profile_hist_pct(c, total, pct[j]);
+				seq_printf(m, "\t%llu", total ?
+					div_u64(vdec_profile_hist_value(b),
+					NSEC_PER_USEC) : 0);
+			}
+			seq_printf(m, "\t%llu\n",
+				div_u64(sum.max_ns[lat], NSEC_PER_USEC));
+		}
+	}
 
+	vfree(cnt);
 	return 0;
 }
 
-static int time_stat_profile_dbg_show(struct seq_file *m, void *v)
+/* binary dumps, built on open and freed on release */
+struct vdec_profile_blob_s {
+	size_t size;
+	char data[0];
+};
+
+static int vdec_profile_blob_open(struct inode *inode, struct file *file,
+	void *data, size_t size)
 {
-	int i;
+	struct vdec_profile_blob_s *blob;
+
+	blob = vmalloc(sizeof(*blob) + size);
+	if (!blob)
+		return -ENOMEM;
+	blob->size = size;
+	memcpy(blob->data, data, size);
+	file->private_data = blob;
+	return 0;
+}
 
-	mutex_lock(&vdec_profile_mutex);
+static int events_bin_open(struct inode *inode, struct file *file)
+{
+	struct vdec_profile_snap_s *snap;
+	int ret;
+
+	snap = vdec_profile_snapshot();
+	if (!snap)
+		return -ENOMEM;
+	ret = vdec_profile_blob_open(inode, file, snap, sizeof(snap->hdr) +
+		sizeof(snap->recs[0]) * snap->hdr.rec_num);
+	vfree(snap);
+	return ret;
+}
 
-	for (i = 0; i < MAX_INSTANCE_MUN; i++)
-	{
-		if (statistics_s[i].status == false)
+static int hist_bin_open(struct inode *inode, struct file *file)
+{
+	struct vdec_profile_hist_hdr_s *hdr;
+	size_t inst_size = sizeof(struct vdec_profile_hist_inst_s) +
+		sizeof(u32) * VDEC_PROFILE_MAX_LAT * VDEC_PROFILE_HIST_BUCKETS;
+	char *p;
+	int i, ret;
+
+	hdr = vzalloc(sizeof(*hdr) + inst_size * MAX_INSTANCE_MUN);
+	if (!hdr)
+		return -ENOMEM;
+	p = (char *)(hdr + 1);
+	for (i = 0; i < MAX_INSTANCE_MUN; i++) {
+		if (!insts[i].hist || !insts[i].used)
 			continue;
-
-		seq_printf(m, "[%d]run_cnt:%d, cb_cnt:%d\n\
-			\t\t\ttime_total_us:%llu\n\
-			\t\t\trun2cb time:\n\
-			\t\t\ttime_max_us:%llu\n\
-			\t\t\t[%d]run2cb ave_us:%llu\n\
-			\t\t\ttime_6ms_less_cnt:%d\n\
-			\t\t\ttime_6_9ms_cnt:%d\n\
-			\t\t\ttime_9_12ms_cnt:%d\n\
-			\t\t\ttime_12_15ms_cnt:%d\n\
-			\t\t\ttime_15_18ms_cnt:%d\n\
-			\t\t\ttime_18_21ms_cnt:%d\n\
-			\t\t\ttime_21ms_up_cnt:%d\n\
-			\t\t\tdecode time:\n\
-			\t\t\ttime_total_us:%llu\n\
-			\t\t\ttime_max_us:%llu\n\
-			\t\t\t[%d]cb2cb ave_us:%llu\n\
-			\t\t\ttime_6ms_less_cnt:%d\n\
-			\t\t\ttime_6_9ms_cnt:%d\n\
-			\t\t\ttime_9_12ms_cnt:%d\n\
-			\t\t\ttime_12_15ms_cnt:%d\n\
-			\t\t\ttime_15_18ms_cnt:%d\n\
-			\t\t\ttime_18_21ms_cnt:%d\n\
-			\t\t\ttime_21ms_up_cnt:%d\n",
-			i,
-			statistics_s[i].run_cnt,
-			statistics_s[i].cb_cnt,
-			statistics_s[i].run2cb_time_stat.time_total_us,
-			statistics_s[i].run2cb_time_stat.time_max_us,
-			i,
-			div_u64(statistics_s[i].run2cb_time_stat.time_total_us , statistics_s[i].cb_cnt),
-			statistics_s[i].run2cb_time_stat.time_6ms_less_cnt,
-			statistics_s[i].run2cb_time_stat.time_6_9ms_cnt,
-			statistics_s[i].run2cb_time_stat.time_9_12ms_cnt,
-			statistics_s[i].run2cb_time_stat.time_12_15ms_cnt,
-			statistics_s[i].run2cb_time_stat.time_15_18ms_cnt,
-			statistics_s[i].run2cb_time_stat.time_18_21ms_cnt,
-			statistics_s[i].run2cb_time_stat.time_21ms_up_cnt,
-			statistics_s[i].decode_time_stat.time_total_us,
-			statistics_s[i].decode_time_stat.time_max_us,
-			i,
-			div_u64(statistics_s[i].decode_time_stat.time_total_us , statistics_s[i].cb_cnt),
-			statistics_s[i].decode_time_stat.time_6ms_less_cnt,
-			statistics_s[i].decode_time_stat.time_6_9ms_cnt,
-			statistics_s[i].decode_time_stat.time_9_12ms_cnt,
-			statistics_s[i].decode_time_stat.time_12_15ms_cnt,
-			statistics_s[i].decode_time_stat.time_15_18ms_cnt,
-			statistics_s[i].decode_time_stat.time_18_21ms_cnt,
-			statistics_s[i].decode_time_stat.time_21ms_up_cnt);
+		vdec_profile_hist_sum(&insts[i],
+			(struct vdec_profile_hist_inst_s *)p,
+			(u32 *)(p + sizeof(struct vdec_profile_hist_inst_s)));
+		p += inst_size;
+		hdr->inst_num++;
 	}
+	hdr->magic = VDEC_PROFILE_HIST_MAGIC;
+	hdr->version = VDEC_PROFILE_VERSION;
+	hdr->lat_num = VDEC_PROFILE_MAX_LAT;
+	hdr->bucket_num = VDEC_PROFILE_HIST_BUCKETS;
+	hdr->sub_bits = VDEC_PROFILE_HIST_SUB_BITS;
+	ret = vdec_profile_blob_open(inode, file, hdr,
+		p - (char *)hdr);
+	vfree(hdr);
+	return ret;
+}
 
-	mutex_unlock(&vdec_profile_mutex);
+static ssize_t vdec_profile_blob_read(struct file *file, char __user *buf,
+	size_t count, loff_t *ppos)
+{
+	struct vdec_profile_blob_s *blob = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos,
+		blob->data, blob->size);
+}
 
+static int vdec_profile_blob_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
 	return 0;
 }
 
+static int sched_stat_profile_dbg_show(struct seq_file *m, void *v)
+{
+	vdec_sched_dump(m);
+
+	return 0;
+}
 
 static int vdec_profile_dbg_open(struct inode *inode, struct file *file)
 {
@@ -383,6 +562,11 @@ static int time_stat_profile_dbg_open(struct inode *inode, struct file *file)
 	return single_open(file, time_stat_profile_dbg_show, NULL);
 }
 
+static int sched_stat_profile_dbg_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sched_stat_profile_dbg_show, NULL);
+}
+
 
 static const struct file_operations event_dbg_fops = {
 	.open    = vdec_profile_dbg_open,
@@ -398,6 +582,27 @@ static const struct file_operations time_stat_dbg_fops = {
 	.release = single_release,
 };
 
+static const struct file_operations sched_stat_dbg_fops = {
+	.open    = sched_stat_profile_dbg_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations events_bin_fops = {
+	.open    = events_bin_open,
+	.read    = vdec_profile_blob_read,
+	.llseek  = default_llseek,
+	.release = vdec_profile_blob_release,
+};
+
+static const struct file_operations hist_bin_fops = {
+	.open    = hist_bin_open,
+	.read    = vdec_profile_blob_read,
+	.llseek  = default_llseek,
+	.release = vdec_profile_blob_release,
+};
+
 
 #if 0 /*DEBUG_TMP*/
 static int __init vdec_profile_init_debugfs(void)
@@ -426,9 +631,56 @@ err:
 
 #endif
 
+static void vdec_profile_free(void)
+{
+	struct vdec_profile_ring_s *ring;
+	int i, cpu;
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(&profile_ring, cpu);
+		vfree(ring->recs);
+		vfree(ring->seq);
+		ring->recs = NULL;
+		ring->seq = NULL;
+	}
+	for (i = 0; i < MAX_INSTANCE_MUN; i++) {
+		free_percpu(insts[i].hist);
+		insts[i].hist = NULL;
+	}
+}
+
+static int vdec_profile_alloc(void)
+{
+	struct vdec_profile_ring_s *ring;
+	int i, cpu;
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(&profile_ring, cpu);
+		ring->seq = vzalloc(sizeof(u32) * PROFILE_REC_SIZE);
+		ring->recs = vzalloc(sizeof(struct vdec_profile_event_s) *
+			PROFILE_REC_SIZE);
+		if (!ring->seq || !ring->recs)
+			goto err;
+	}
+	for (i = 0; i < MAX_INSTANCE_MUN; i++) {
+		insts[i].hist = alloc_percpu(struct vdec_profile_hist_s);
+		if (!insts[i].hist)
+			goto err;
+	}
+	return 0;
+
+err:
+	vdec_profile_free();
+	return -ENOMEM;
+}
+
 int vdec_profile_init_debugfs(void)
 {
-	struct dentry *root, *event, *time_stat;
+	struct dentry *root, *event, *time_stat, *sched_stat;
+	struct dentry *events_bin, *hist;
+
+	if (vdec_profile_alloc() < 0)
+		pr_err("Can not alloc vdec_profile buffers\n");
 
 	root = debugfs_create_dir("vdec_profile", NULL);
 	if (IS_ERR(root) || !root)
@@ -442,16 +694,29 @@ int vdec_profile_init_debugfs(void)
 	time_stat = debugfs_create_file("time_stat", 0400, root, NULL,
 			&time_stat_dbg_fops);
 	if (!time_stat)
-		goto err_2;
+		goto err_1;
 
-	mutex_init(&vdec_profile_mutex);
+	sched_stat = debugfs_create_file("sched_stat", 0400, root, NULL,
+			&sched_stat_dbg_fops);
+	if (!sched_stat)
+		goto err_1;
+
+	events_bin = debugfs_create_file("event_bin", 0400, root, NULL,
+			&events_bin_fops);
+	if (!events_bin)
+		goto err_1;
+
+	hist = debugfs_create_file("hist_bin", 0400, root, NULL,
+			&hist_bin_fops);
+	if (!hist)
+		goto err_1;
+
+	profile_root = root;
 
 	return 0;
 
-err_2:
-	debugfs_remove(event);
 err_1:
-	debugfs_remove(root);
+	debugfs_remove_recursive(root);
 err:
 	pr_err("Can not create debugfs for vdec_profile\n");
 	return 0;
@@ -460,8 +725,9 @@ EXPORT_SYMBOL(vdec_profile_init_debugfs);
 
 void vdec_profile_exit_debugfs(void)
 {
-	debugfs_remove(event);
-	debugfs_remove(root);
+	debugfs_remove_recursive(profile_root);
+	profile_root = NULL;
+	vdec_profile_free();
 }
 EXPORT_SYMBOL(vdec_profile_exit_debugfs);
 
@@ -18,7 +18,22 @@
 #ifndef VDEC_PROFILE_H
 #define VDEC_PROFILE_H
 
+/*
+ * The binary debugfs formats and the histogram bucket math below have
+ * no kernel dependency, test/vdec_prof.c decodes the dumps with them.
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+#endif
+
 struct vdec_s;
+struct vframe_s;
 
 #define VDEC_PROFILE_EVENT_RUN         0
 #define VDEC_PROFILE_EVENT_CB          1
@@ -30,11 +45,134 @@ struct vdec_s;
 #define VDEC_PROFILE_EVENT_INFO        7
 #define VDEC_PROFILE_MAX_EVENT         8
 
+/* latencies kept in per instance histograms */
+#define VDEC_PROFILE_LAT_RUN2CB        0 /* run to decoder callback */
+#define VDEC_PROFILE_LAT_READY2RUN     1 /* input ready to run */
+#define VDEC_PROFILE_LAT_CB2VF         2 /* frame out to consumer get */
+#define VDEC_PROFILE_MAX_LAT           3
+
+/*
+ * Log-linear buckets of nanoseconds: values below 2^SUB_BITS get a
+ * bucket each, every power of two above is split in 2^SUB_BITS equal
+ * buckets, so a bucket is at most 12.5% wide. The last bucket takes
+ * everything from 2^ORDERS ns (18 minutes) up.
+ */
+#define VDEC_PROFILE_HIST_SUB_BITS     3
+#define VDEC_PROFILE_HIST_SUB          (1 << VDEC_PROFILE_HIST_SUB_BITS)
+#define VDEC_PROFILE_HIST_ORDERS       40
+#define VDEC_PROFILE_HIST_BUCKETS \
+	((VDEC_PROFILE_HIST_ORDERS - VDEC_PROFILE_HIST_SUB_BITS + 1) * \
+	VDEC_PROFILE_HIST_SUB)
+
+static inline int vdec_profile_hist_bucket(u64 ns)
+{
+	int order;
+
+	if (ns < VDEC_PROFILE_HIST_SUB)
+		return (int)ns;
+	if (ns >> VDEC_PROFILE_HIST_ORDERS)
+		return VDEC_PROFILE_HIST_BUCKETS - 1;
+	order = 63 - __builtin_clzll(ns);
+	return (order - VDEC_PROFILE_HIST_SUB_BITS + 1) *
+		VDEC_PROFILE_HIST_SUB +
+		(int)((ns >> (order - VDEC_PROFILE_HIST_SUB_BITS)) &
+		(VDEC_PROFILE_HIST_SUB - 1));
+}
+
+/* smallest value falling in bucket b */
+static inline u64 vdec_profile_hist_low(int b)
+{
+	int order;
+
+	if (b < VDEC_PROFILE_HIST_SUB)
+		return b;
+	order = b / VDEC_PROFILE_HIST_SUB + VDEC_PROFILE_HIST_SUB_BITS - 1;
+	return (u64)(VDEC_PROFILE_HIST_SUB + b % VDEC_PROFILE_HIST_SUB) <<
+		(order - VDEC_PROFILE_HIST_SUB_BITS);
+}
+
+/* midpoint of bucket b */
+static inline u64 vdec_profile_hist_value(int b)
+{
+	u64 low = vdec_profile_hist_low(b);
+
+	if (b >= VDEC_PROFILE_HIST_BUCKETS - 1)
+		return low;
+	return low + ((vdec_profile_hist_low(b + 1) - low) >> 1);
+}
+
+/* bucket holding the q / 10000 quantile of total samples in cnt */
+static inline int vdec_profile_hist_pct(const u32 *cnt, u64 total, u32 q)
+{
+	u64 sum = 0;
+	int b;
+
+	for (b = 0; b < VDEC_PROFILE_HIST_BUCKETS; b++) {
+		sum += cnt[b];
+		if (sum && sum * 10000 >= total * q)
+			return b;
+	}
+	return VDEC_PROFILE_HIST_BUCKETS - 1;
+}
+
+/*
+ * debugfs "event_bin": a header, then the valid records of all cpu
+ * rings sorted by time.
+ */
+#define VDEC_PROFILE_EVENTS_MAGIC      0x56504556 /* "VEPV" */
+#define VDEC_PROFILE_VERSION           1
+
+struct vdec_profile_events_hdr_s {
+	u32 magic;
+	u32 version;
+	u32 rec_size;
+	u32 rec_num;
+	u32 lost;		/* overwritten before read */
+	u32 reserved;
+};
+
+struct vdec_profile_event_s {
+	u64 ns;			/* local_clock() */
+	s32 para1;
+	s32 para2;
+	u16 id;			/* vdec id, 0xffff: none */
+	u16 format;		/* vdec format, name for "event" */
+	u16 event;
+	u16 cpu;
+};
+
+/*
+ * debugfs "hist_bin": a header, then for each instance in use a
+ * vdec_profile_hist_inst_s followed by VDEC_PROFILE_MAX_LAT arrays of
+ * VDEC_PROFILE_HIST_BUCKETS u32 counters, summed over all cpus.
+ */
+#define VDEC_PROFILE_HIST_MAGIC        0x56504853 /* "VPHS" */
+
+struct vdec_profile_hist_hdr_s {
+	u32 magic;
+	u32 version;
+	u32 inst_num;
+	u32 lat_num;
+	u32 bucket_num;
+	u32 sub_bits;
+};
+
+struct vdec_profile_hist_inst_s {
+	u32 id;
+	u32 format;
+	u64 max_ns[VDEC_PROFILE_MAX_LAT];
+	u64 sum_ns[VDEC_PROFILE_MAX_LAT];
+};
+
+#ifdef __KERNEL__
 extern void vdec_profile(struct vdec_s *vdec, int event);
 extern void vdec_profile_more(struct vdec_s *vdec, int event, int para1, int para2);
 extern void vdec_profile_flush(struct vdec_s *vdec);
+extern void vdec_profile_vf_ready(struct vframe_s *vf);
+extern void vdec_profile_vf_get(struct vdec_s *vdec, struct vframe_s *vf);
 
 int vdec_profile_init_debugfs(void);
 void vdec_profile_exit_debugfs(void);
+#endif
 
 #endif /* VDEC_PROFILE_H */
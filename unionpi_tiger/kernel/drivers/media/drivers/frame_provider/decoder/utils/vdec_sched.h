@@ -0,0 +1,175 @@
+/*
+ * drivers/amlogic/media/frame_provider/decoder/utils/vdec_sched.h
+ *
+ * Copyright (C) 2016 Amlogic, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+*/
+
+#ifndef VDEC_SCHED_H
+#define VDEC_SCHED_H
+
+/*
+ * Instance election policies of vdec_core_thread. This header has no
+ * kernel dependency so the scheduler simulator in test/ runs the
+ * very same code against recorded run/cb traces.
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+#endif
+
+#define VDEC_SCHED_DEFAULT	-1
+/* least recently run instance first */
+#define VDEC_SCHED_RR		0
+/* earliest deadline first, one frame period after input got ready */
+#define VDEC_SCHED_EDF		1
+/* like RR, but keep running the loaded microcode type for a while */
+#define VDEC_SCHED_AFFINITY	2
+#define VDEC_SCHED_POLICY_MAX	3
+
+struct vdec_sched_param_s {
+	int policy;		/* core default policy */
+	u64 affinity_ns;	/* head start of the loaded mc_type */
+	u32 affinity_batch;	/* max back to back runs it gets */
+};
+
+/* per instance scheduling state and statistics */
+struct vdec_sched_s {
+	int policy;		/* VDEC_SCHED_DEFAULT: core policy */
+	u64 frame_ns;		/* output frame duration, 0: unknown */
+	u64 ready_ns;		/* first seen ready since last run */
+	u64 run_ns;		/* last run start */
+	u64 cb_ns;		/* last run done */
+	u64 deadline_ns;	/* frame of the current run due, 0: none */
+
+	u32 run_cnt;
+	u32 switch_cnt;		/* runs that needed a microcode reload */
+	u32 miss_cnt;		/* runs done after their deadline */
+	u64 wait_total_ns;
+	u64 wait_max_ns;
+	u64 run_total_ns;
+};
+
+static inline int vdec_sched_policy(const struct vdec_sched_s *s,
+	const struct vdec_sched_param_s *p)
+{
+	if (s->policy > VDEC_SCHED_DEFAULT &&
+		s->policy < VDEC_SCHED_POLICY_MAX)
+		return s->policy;
+	return p->policy;
+}
+
+static inline int vdec_sched_is_edf(const struct vdec_sched_s *s,
+	const struct vdec_sched_param_s *p)
+{
+	return vdec_sched_policy(s, p) == VDEC_SCHED_EDF && s->frame_ns;
+}
+
+static inline int vdec_sched_is_batched(const struct vdec_sched_s *s,
+	const struct vdec_sched_param_s *p, int same_mc, u32 batch)
+{
+	return vdec_sched_policy(s, p) == VDEC_SCHED_AFFINITY &&
+		same_mc && batch < p->affinity_batch;
+}
+
+/*
+ * Election key of a ready instance, the smallest key runs next.
+ * Every policy maps to a point in time, so instances using different
+ * policies can be compared: RR and affinity instances are keyed by
+ * their last run, an EDF instance by the time its pending frame is
+ * due, one frame period after it got ready. An affinity instance of
+ * the loaded mc_type gets a head start until it ran affinity_batch
+ * times in a row while another type was waiting.
+ */
+static inline u64 vdec_sched_key(const struct vdec_sched_s *s,
+	const struct vdec_sched_param_s *p, int same_mc, u32 batch)
+{
+	u64 key = s->run_ns;
+
+	if (vdec_sched_is_edf(s, p))
+		return s->ready_ns + s->frame_ns;
+	if (vdec_sched_is_batched(s, p, same_mc, batch))
+		key = key > p->affinity_ns ? key - p->affinity_ns : 0;
+	return key;
+}
+
+/*
+ * The election walks the instances in round-robin order and stops at
+ * the first ready RR instance, like the plain round robin did, so
+ * instances behind it are not asked whether they are ready. A ready
+ * EDF instance makes it look further for an earlier deadline, a ready
+ * affinity instance for one of the loaded mc_type, unless it is of
+ * that type itself.
+ */
+static inline int vdec_sched_stop(const struct vdec_sched_s *s,
+	const struct vdec_sched_param_s *p, int same_mc, u32 batch)
+{
+	switch (vdec_sched_policy(s, p)) {
+	case VDEC_SCHED_EDF:
+		return !vdec_sched_is_edf(s, p);
+	case VDEC_SCHED_AFFINITY:
+		return vdec_sched_is_batched(s, p, same_mc, batch);
+	default:
+		return 1;
+	}
+}
+
+static inline void vdec_sched_on_ready(struct vdec_sched_s *s, u64 now)
+{
+	if (!s->ready_ns)
+		s->ready_ns = now;
+}
+
+static inline void vdec_sched_on_run(struct vdec_sched_s *s, u64 now,
+	int switched)
+{
+	u64 wait = 0;
+
+	if (s->ready_ns && now > s->ready_ns)
+		wait = now - s->ready_ns;
+	s->wait_total_ns += wait;
+	if (wait > s->wait_max_ns)
+		s->wait_max_ns = wait;
+	s->deadline_ns = s->frame_ns ?
+		(s->ready_ns ? s->ready_ns : now) + s->frame_ns : 0;
+	s->ready_ns = 0;
+	s->run_ns = now;
+	s->run_cnt++;
+	if (switched)
+		s->switch_cnt++;
+}
+
+static inline void vdec_sched_on_cb(struct vdec_sched_s *s, u64 now)
+{
+	if (s->run_ns && now > s->run_ns)
+		s->run_total_ns += now - s->run_ns;
+	if (s->deadline_ns && now > s->deadline_ns)
+		s->miss_cnt++;
+	s->deadline_ns = 0;
+	s->cb_ns = now;
+}
+
+static inline void vdec_sched_reset_stats(struct vdec_sched_s *s)
+{
+	s->run_cnt = 0;
+	s->switch_cnt = 0;
+	s->miss_cnt = 0;
+	s->wait_total_ns = 0;
+	s->wait_max_ns = 0;
+	s->run_total_ns = 0;
+}
+
+#endif /* VDEC_SCHED_H */
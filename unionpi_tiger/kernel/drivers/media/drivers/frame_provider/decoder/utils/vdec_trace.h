@@ -137,13 +137,61 @@ DEFINE_EVENT(vdec_pts_class, name, \
 DEFINE_PTS_EVENT(vdec_set_pts);
 DEFINE_PTS_EVENT(vdec_set_pts64);
 
+/* vdec_profile events and latencies, see vdec_profile.h */
+TRACE_EVENT(vdec_profile_event,
+	TP_PROTO(int id, int event, int para1, int para2),
+	TP_ARGS(id, event, para1, para2),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(int, event)
+		__field(int, para1)
+		__field(int, para2)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->event = event;
+		__entry->para1 = para1;
+		__entry->para2 = para2;
+	),
+	TP_printk("[%d]:%s (%d,%d)", __entry->id,
+		__print_symbolic(__entry->event,
+			{0, "run"},
+			{1, "cb"},
+			{2, "save_input"},
+			{3, "check run ready"},
+			{4, "run ready"},
+			{5, "disconnect"},
+			{6, "dec_work"},
+			{7, "info"}),
+		__entry->para1, __entry->para2)
+);
+
+TRACE_EVENT(vdec_profile_latency,
+	TP_PROTO(int id, int lat, u64 ns),
+	TP_ARGS(id, lat, ns),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(int, lat)
+		__field(u64, ns)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->lat = lat;
+		__entry->ns = ns;
+	),
+	TP_printk("[%d]:%s %llu ns", __entry->id,
+		__print_symbolic(__entry->lat,
+			{0, "run2cb"},
+			{1, "ready2run"},
+			{2, "cb2vf"}),
+		__entry->ns)
+);
+
 #endif /* _VDEC_TRACE_H */
 
-/*
+/* instantiated by vdec.c */
 #undef TRACE_INCLUDE_PATH
 #undef TRACE_INCLUDE_FILE
 #define TRACE_INCLUDE_PATH .
 #define TRACE_INCLUDE_FILE vdec_trace
 #include <trace/define_trace.h>
-*/
-/**/ //DEBUG_TMP
@@ -6875,6 +6875,7 @@ static struct vframe_s *vvp9_vf_get(void *op_arg)
 			(vf->type & VIDTYPE_V4L_EOS)) {
 			vf->index_disp = pbi->vf_get_count;
 			pbi->vf_get_count++;
+			vdec_profile_vf_get(hw_to_vdec(pbi), vf);
 			if (debug & VP9_DEBUG_BUFMGR)
 				pr_info("%s type 0x%x w/h %d/%d, pts %d, %lld\n",
 					__func__, vf->type,
@@ -43,6 +43,7 @@
 #include <linux/of_fdt.h>
 #include <linux/dma-map-ops.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/sched/rt.h>
 #include <linux/amlogic/media/utils/amports_config.h>
 #include "encoder.h"
@@ -93,6 +94,7 @@ static u32 clock_level = 5;
 
 static u32 encode_print_level = LOG_DEBUG;
 static u32 no_timeout;
+static u32 pipeline_mode = 1;
 static int nr_mode = -1;
 static u32 qp_table_debug;
 
@@ -1050,10 +1052,30 @@ static void mfdin_basic(u32 input, u8 iformat,
 }
 
 #ifdef CONFIG_AMLOGIC_MEDIA_GE2D
+/* point a canvas pair at the wq scaler buffer, ge2d output layout */
+static u32 scale_dst_canvas_config(struct encode_wq_s *wq, u32 y, u32 uv)
+{
+	u32 dst_w = ((wq->pic.encoder_width + 15) >> 4) << 4;
+	u32 dst_h = ((wq->pic.encoder_height + 15) >> 4) << 4;
+	u32 dst_canvas_w = ((dst_w + 31) >> 5) << 5;
+
+	canvas_config(y,
+		wq->mem.scaler_buff_start_addr,
+		dst_canvas_w, dst_h,
+		CANVAS_ADDR_NOWRAP, CANVAS_BLKMODE_LINEAR);
+
+	canvas_config(uv,
+		wq->mem.scaler_buff_start_addr + dst_canvas_w * dst_h,
+		dst_canvas_w, dst_h / 2,
+		CANVAS_ADDR_NOWRAP, CANVAS_BLKMODE_LINEAR);
+
+	return (uv << 8) | y;
+}
+
 static int scale_frame(struct encode_wq_s *wq,
 	struct encode_request_s *request,
 	struct config_para_ex_s *ge2d_config,
-	u32 src_addr, bool canvas)
+	u32 src_addr, bool canvas, u32 dst_y, u32 dst_uv)
 {
 	struct ge2d_context_s *context = encode_manager.context;
 	int src_top, src_left, src_width, src_height;
@@ -1155,19 +1177,7 @@ static int scale_frame(struct encode_wq_s *wq,
 	}
 
 	dst_canvas_w =  ((dst_w + 31) >> 5) << 5;
-
-	canvas_config(ENC_CANVAS_OFFSET + 6,
-		wq->mem.scaler_buff_start_addr,
-		dst_canvas_w, dst_h,
-		CANVAS_ADDR_NOWRAP, CANVAS_BLKMODE_LINEAR);
-
-	canvas_config(ENC_CANVAS_OFFSET + 7,
-		wq->mem.scaler_buff_start_addr + dst_canvas_w * dst_h,
-		dst_canvas_w, dst_h / 2,
-		CANVAS_ADDR_NOWRAP, CANVAS_BLKMODE_LINEAR);
-
-	dst_canvas = ((ENC_CANVAS_OFFSET + 7) << 8) |
-		(ENC_CANVAS_OFFSET + 6);
+	dst_canvas = scale_dst_canvas_config(wq, dst_y, dst_uv);
 
 	ge2d_config->alu_const_color = 0;
 	ge2d_config->bitmask_en  = 0;
@@ -1237,6 +1247,71 @@ static int scale_frame(struct encode_wq_s *wq,
 		0, 0, wq->pic.encoder_width, wq->pic.encoder_height);
 	return dst_canvas_w*dst_h * 3 / 2;
 }
+
+static void scale_input(struct encode_wq_s *wq,
+	struct encode_request_s *request, u32 src_addr, bool canvas)
+{
+	struct config_para_ex_s ge2d_config;
+
+	/* already in the scaler buffer, only point mfdin at it */
+	if (request->prepared & ENCODE_PREP_SCALE) {
+		scale_dst_canvas_config(wq, ENC_CANVAS_OFFSET + 6,
+			ENC_CANVAS_OFFSET + 7);
+		return;
+	}
+
+	memset(&ge2d_config, 0, sizeof(struct config_para_ex_s));
+	scale_frame(wq, request, &ge2d_config, src_addr, canvas,
+		ENC_CANVAS_OFFSET + 6, ENC_CANVAS_OFFSET + 7);
+}
+
+/*
+ * Scale a queued request while the hcodec still encodes another wq.
+ * mfdin reads its input through canvas 6/7 for the whole frame, so
+ * ge2d writes through the canvases of the pool instead, the ge2d
+ * source canvases 9-11 are not used by the hcodec.
+ */
+static int prepare_scale(struct encode_wq_s *wq,
+	struct encode_request_s *request)
+{
+	struct config_para_ex_s ge2d_config;
+	u32 src_addr;
+	bool canvas = false;
+
+	if (!encode_manager.context ||
+		encode_manager.prep_canvas[0] < 0 ||
+		encode_manager.prep_canvas[1] < 0)
+		return -1;
+
+	switch (request->type) {
+	case LOCAL_BUFF:
+		if (request->flush_flag & AMVENC_FLUSH_FLAG_INPUT)
+			dma_flush(wq->mem.dct_buff_start_addr,
+				request->framesize);
+		src_addr = wq->mem.dct_buff_start_addr;
+		break;
+	case DMA_BUFF:
+		src_addr = (unsigned long)request->dma_cfg[0].paddr;
+		break;
+	case PHYSICAL_BUFF:
+		src_addr = request->src;
+		break;
+	case CANVAS_BUFF:
+		src_addr = request->src;
+		canvas = true;
+		break;
+	default:
+		return -1;
+	}
+
+	memset(&ge2d_config, 0, sizeof(struct config_para_ex_s));
+	if (scale_frame(wq, request, &ge2d_config, src_addr, canvas,
+		encode_manager.prep_canvas[0],
+		encode_manager.prep_canvas[1]) < 0)
+		return -1;
+
+	return 0;
+}
 #endif
 
 static s32 set_input_format(struct encode_wq_s *wq,
@@ -1263,7 +1338,8 @@ static s32 set_input_format(struct encode_wq_s *wq,
 		|| (request->type == PHYSICAL_BUFF)
 		|| (request->type == DMA_BUFF)) {
 		if ((request->type == LOCAL_BUFF) &&
-			(request->flush_flag & AMVENC_FLUSH_FLAG_INPUT))
+			(request->flush_flag & AMVENC_FLUSH_FLAG_INPUT) &&
+			!(request->prepared & ENCODE_PREP_SCALE))
 			dma_flush(wq->mem.dct_buff_start_addr,
 				request->framesize);
 		if (request->type == LOCAL_BUFF) {
@@ -1306,15 +1382,7 @@ static s32 set_input_format(struct encode_wq_s *wq,
 		}
 		if (request->scale_enable) {
 #ifdef CONFIG_AMLOGIC_MEDIA_GE2D
-			struct config_para_ex_s ge2d_config;
-
-			memset(&ge2d_config, 0,
-				sizeof(struct config_para_ex_s));
-			scale_frame(
-				wq, request,
-				&ge2d_config,
-				src_addr,
-				false);
+			scale_input(wq, request, src_addr, false);
 			iformat = 2;
 			r2y_en = 0;
 			input = ((ENC_CANVAS_OFFSET + 7) << 8) |
@@ -1467,13 +1535,7 @@ static s32 set_input_format(struct encode_wq_s *wq,
 		r2y_en = 0;
 		if (request->scale_enable) {
 #ifdef CONFIG_AMLOGIC_MEDIA_GE2D
-			struct config_para_ex_s ge2d_config;
-			memset(&ge2d_config, 0,
-				sizeof(struct config_para_ex_s));
-			scale_frame(
-				wq, request,
-				&ge2d_config,
-				input, true);
+			scale_input(wq, request, input, true);
 			iformat = 2;
 			r2y_en = 0;
 			input = ((ENC_CANVAS_OFFSET + 7) << 8) |
@@ -3414,6 +3476,17 @@ static long amvenc_avc_ioctl(struct file *file, u32 cmd, ulong arg)
 		get_user(qp_mode, ((u32 *)arg));
 		pr_info("qp_mode %d\n", qp_mode);
 		break;
+	case AMVENC_AVC_IOC_SET_PRIORITY:
+		get_user(argV, ((u32 *)arg));
+		if (argV > ENCODE_PRIORITY_MAX) {
+			enc_pr(LOG_ERROR,
+				"avc priority %lu out of range, wq: %p.\n",
+				argV, (void *)wq);
+			return -1;
+		}
+		/* only requests queued from now on */
+		wq->priority = argV;
+		break;
 	default:
 		r = -1;
 		break;
@@ -3486,37 +3559,133 @@ static const struct file_operations amvenc_avc_fops = {
 };
 
 /* work queue function */
-static s32 encode_process_request(struct encode_manager_s *manager,
-	struct encode_queue_item_s *pitem)
+static void encode_lat_add(struct encode_lat_hist_s *h, u64 ns)
 {
-	s32 ret = 0;
-	struct encode_wq_s *wq = pitem->request.parent;
-	struct encode_request_s *request = &pitem->request;
-	u32 timeout = (request->timeout == 0) ?
-		1 : msecs_to_jiffies(request->timeout);
-	u32 buf_start = 0;
-	u32 size = 0;
-	u32 flush_size = ((wq->pic.encoder_width + 31) >> 5 << 5) *
-		((wq->pic.encoder_height + 15) >> 4 << 4) * 3 / 2;
+	u32 us = (u32)min_t(u64, div_u64(ns, 1000), U32_MAX);
+	u32 i = min_t(u32, fls(us >> 6), ENCODE_LAT_BUCKETS - 1);
+
+	h->bucket[i]++;
+	h->count++;
+	h->sum_us += us;
+	if (us > h->max_us)
+		h->max_us = us;
+}
 
-	struct enc_dma_cfg *cfg = NULL;
-	int i = 0;
+/* called with sem_lock held */
+static void encode_lat_record(struct encode_manager_s *manager,
+	struct encode_queue_item_s *pitem, u64 now)
+{
+	struct encode_lat_stat_s *lat = &manager->lat;
+
+	if (!pitem->start_ns)
+		return;
+	encode_lat_add(&lat->queue, pitem->start_ns - pitem->queue_ns);
+	if (pitem->prep_ns)
+		encode_lat_add(&lat->prep, pitem->prep_ns);
+	encode_lat_add(&lat->setup, pitem->kick_ns - pitem->start_ns);
+	if (pitem->done_ns)
+		encode_lat_add(&lat->hw, pitem->done_ns - pitem->kick_ns);
+	encode_lat_add(&lat->total, now - pitem->queue_ns);
+}
 
+static bool encode_cbr_wanted(struct encode_request_s *request)
+{
 #ifdef H264_ENC_CBR
-	if (request->cmd == ENCODER_IDR || request->cmd == ENCODER_NON_IDR) {
-		if (request->flush_flag & AMVENC_FLUSH_FLAG_CBR
-			&& get_cpu_type() >= MESON_CPU_MAJOR_ID_GXTVBB) {
-			void *vaddr = wq->mem.cbr_info_ddr_virt_addr;
-			ConvertTable2Risc(vaddr, 0xa00);
-			buf_start = getbuffer(wq, ENCODER_BUFFER_CBR);
-			codec_mm_dma_flush(vaddr, wq->mem.cbr_info_ddr_size, DMA_TO_DEVICE);
-		}
+	return (request->cmd == ENCODER_IDR ||
+		request->cmd == ENCODER_NON_IDR) &&
+		(request->flush_flag & AMVENC_FLUSH_FLAG_CBR) &&
+		get_cpu_type() >= MESON_CPU_MAJOR_ID_GXTVBB;
+#else
+	return false;
+#endif
+}
+
+static void encode_cbr_prepare(struct encode_wq_s *wq)
+{
+#ifdef H264_ENC_CBR
+	void *vaddr = wq->mem.cbr_info_ddr_virt_addr;
+
+	ConvertTable2Risc(vaddr, 0xa00);
+	codec_mm_dma_flush(vaddr, wq->mem.cbr_info_ddr_size, DMA_TO_DEVICE);
+#endif
+}
+
+/*
+ * Do the cpu side work of a queued request while the hcodec encodes
+ * another wq. The cbr table and the scaler buffer belong to the wq,
+ * so a request of the wq on the hardware is never prepared.
+ */
+static void encode_prepare_next(struct encode_manager_s *manager,
+	struct encode_queue_item_s *cur)
+{
+	struct encode_queue_item_s *pitem = NULL;
+	struct encode_request_s *request;
+	struct encode_wq_s *wq;
+	u64 t;
+
+	if (!pipeline_mode)
+		return;
+
+	spin_lock(&manager->event.sem_lock);
+	if (!list_empty(&manager->process_queue) && !manager->remove_flag) {
+		pitem = list_first_entry(&manager->process_queue,
+			struct encode_queue_item_s, list);
+		if (pitem->request.parent == cur->request.parent ||
+			pitem->request.prepared)
+			pitem = NULL;
 	}
+	if (pitem)
+		manager->pend_wq = pitem->request.parent;
+	spin_unlock(&manager->event.sem_lock);
+	if (!pitem)
+		return;
+
+	t = ktime_get_ns();
+	request = &pitem->request;
+	wq = request->parent;
+	if (encode_cbr_wanted(request)) {
+		encode_cbr_prepare(wq);
+		request->prepared |= ENCODE_PREP_CBR;
+	}
+#ifdef CONFIG_AMLOGIC_MEDIA_GE2D
+	if ((request->cmd == ENCODER_IDR ||
+		request->cmd == ENCODER_NON_IDR) &&
+		request->scale_enable && !prepare_scale(wq, request))
+		request->prepared |= ENCODE_PREP_SCALE;
 #endif
+	pitem->prep_ns = ktime_get_ns() - t;
 
-Again:
-	amvenc_avc_start_cmd(wq, request);
+	spin_lock(&manager->event.sem_lock);
+	manager->pend_wq = NULL;
+	if (request->prepared)
+		manager->lat.prepared++;
+	spin_unlock(&manager->event.sem_lock);
+}
+
+static void encode_start_request(struct encode_manager_s *manager,
+	struct encode_queue_item_s *pitem)
+{
+	struct encode_request_s *request = &pitem->request;
+
+	pitem->start_ns = ktime_get_ns();
+	if (encode_cbr_wanted(request) &&
+		!(request->prepared & ENCODE_PREP_CBR))
+		encode_cbr_prepare(request->parent);
+
+	amvenc_avc_start_cmd(request->parent, request);
+	pitem->kick_ns = ktime_get_ns();
+}
 
+/* wait for the hardware and take the results out of its registers */
+static void encode_wait_request(struct encode_manager_s *manager,
+	struct encode_queue_item_s *pitem)
+{
+	struct encode_wq_s *wq = pitem->request.parent;
+	struct encode_request_s *request = &pitem->request;
+	u32 timeout = (request->timeout == 0) ?
+		1 : msecs_to_jiffies(request->timeout);
+
+Again:
 	if (no_timeout) {
 		wait_event_interruptible(manager->event.hw_complete,
 			(manager->encode_hw_status == ENCODER_IDR_DONE
@@ -3532,28 +3701,73 @@ Again:
 			timeout);
 	}
 
+	pitem->hw_status = manager->encode_hw_status;
 	if ((request->cmd == ENCODER_SEQUENCE) &&
 	    (manager->encode_hw_status == ENCODER_SEQUENCE_DONE)) {
 		wq->sps_size = READ_HREG(HCODEC_VLC_TOTAL_BYTES);
 		wq->hw_status = manager->encode_hw_status;
 		request->cmd = ENCODER_PICTURE;
+		amvenc_avc_start_cmd(wq, request);
 		goto Again;
 	} else if ((request->cmd == ENCODER_PICTURE) &&
 		   (manager->encode_hw_status == ENCODER_PICTURE_DONE)) {
 		wq->pps_size =
 			READ_HREG(HCODEC_VLC_TOTAL_BYTES) - wq->sps_size;
 		wq->hw_status = manager->encode_hw_status;
-		if (request->flush_flag & AMVENC_FLUSH_FLAG_OUTPUT) {
-			buf_start = getbuffer(wq, ENCODER_BUFFER_OUTPUT);
-			cache_flush(buf_start,
-				wq->sps_size + wq->pps_size);
-		}
 		wq->output_size = (wq->sps_size << 16) | wq->pps_size;
 	} else {
 		wq->hw_status = manager->encode_hw_status;
 		if ((manager->encode_hw_status == ENCODER_IDR_DONE) ||
 		    (manager->encode_hw_status == ENCODER_NON_IDR_DONE)) {
 			wq->output_size = READ_HREG(HCODEC_VLC_TOTAL_BYTES);
+		} else {
+			manager->encode_hw_status = ENCODER_ERROR;
+			enc_pr(LOG_DEBUG, "avc encode light reset --- ");
+			enc_pr(LOG_DEBUG,
+				"frame type: %s, size: %dx%d, wq: %p\n",
+				(request->cmd == ENCODER_IDR) ? "IDR" : "P",
+				wq->pic.encoder_width,
+				wq->pic.encoder_height, (void *)wq);
+			enc_pr(LOG_DEBUG,
+				"mb info: 0x%x, encode status: 0x%x, dct status: 0x%x ",
+				READ_HREG(HCODEC_VLC_MB_INFO),
+				READ_HREG(ENCODER_STATUS),
+				READ_HREG(HCODEC_QDCT_STATUS_CTRL));
+			enc_pr(LOG_DEBUG,
+				"vlc status: 0x%x, me status: 0x%x, risc pc:0x%x, debug:0x%x\n",
+				READ_HREG(HCODEC_VLC_STATUS_CTRL),
+				READ_HREG(HCODEC_ME_STATUS),
+				READ_HREG(HCODEC_MPC_E),
+				READ_HREG(DEBUG_REG));
+			amvenc_avc_light_reset(wq, 30);
+		}
+	}
+	pitem->done_ns = ktime_get_ns();
+}
+
+/* cache maintenance and user wakeup, no hcodec access */
+static void encode_finish_request(struct encode_manager_s *manager,
+	struct encode_queue_item_s *pitem)
+{
+	struct encode_wq_s *wq = pitem->request.parent;
+	struct encode_request_s *request = &pitem->request;
+	u32 buf_start = 0;
+	u32 size = 0;
+	u32 flush_size = ((wq->pic.encoder_width + 31) >> 5 << 5) *
+		((wq->pic.encoder_height + 15) >> 4 << 4) * 3 / 2;
+	struct enc_dma_cfg *cfg = NULL;
+	int i = 0;
+
+	if ((request->cmd == ENCODER_PICTURE) &&
+		(pitem->hw_status == ENCODER_PICTURE_DONE)) {
+		if (request->flush_flag & AMVENC_FLUSH_FLAG_OUTPUT) {
+			buf_start = getbuffer(wq, ENCODER_BUFFER_OUTPUT);
+			cache_flush(buf_start,
+				wq->sps_size + wq->pps_size);
+		}
+	} else {
+		if ((pitem->hw_status == ENCODER_IDR_DONE) ||
+		    (pitem->hw_status == ENCODER_NON_IDR_DONE)) {
 			if (request->flush_flag & AMVENC_FLUSH_FLAG_OUTPUT) {
 				buf_start = getbuffer(wq,
 					ENCODER_BUFFER_OUTPUT);
@@ -3579,26 +3793,6 @@ Again:
 				buf_start = getbuffer(wq, ref_id);
 				cache_flush(buf_start, flush_size);
 			}
-		} else {
-			manager->encode_hw_status = ENCODER_ERROR;
-			enc_pr(LOG_DEBUG, "avc encode light reset --- ");
-			enc_pr(LOG_DEBUG,
-				"frame type: %s, size: %dx%d, wq: %p\n",
-				(request->cmd == ENCODER_IDR) ? "IDR" : "P",
-				wq->pic.encoder_width,
-				wq->pic.encoder_height, (void *)wq);
-			enc_pr(LOG_DEBUG,
-				"mb info: 0x%x, encode status: 0x%x, dct status: 0x%x ",
-				READ_HREG(HCODEC_VLC_MB_INFO),
-				READ_HREG(ENCODER_STATUS),
-				READ_HREG(HCODEC_QDCT_STATUS_CTRL));
-			enc_pr(LOG_DEBUG,
-				"vlc status: 0x%x, me status: 0x%x, risc pc:0x%x, debug:0x%x\n",
-				READ_HREG(HCODEC_VLC_STATUS_CTRL),
-				READ_HREG(HCODEC_ME_STATUS),
-				READ_HREG(HCODEC_MPC_E),
-				READ_HREG(DEBUG_REG));
-			amvenc_avc_light_reset(wq, 30);
 		}
 		for (i = 0; i < request->plane_num; i++) {
 			cfg = &request->dma_cfg[i];
@@ -3610,13 +3804,92 @@ Again:
 	}
 	atomic_inc(&wq->request_ready);
 	wake_up_interruptible(&wq->request_complete);
-	return ret;
+}
+
+/*
+ * Take the next request off the queue to start it right after the
+ * current one is done, before the current one's cache maintenance.
+ * Requests of the same wq keep the old order, its user is not even
+ * woken up yet.
+ */
+static struct encode_queue_item_s *encode_pop_next(
+	struct encode_manager_s *manager,
+	struct encode_queue_item_s *cur)
+{
+	struct encode_queue_item_s *pitem = NULL;
+
+	if (!pipeline_mode)
+		return NULL;
+
+	spin_lock(&manager->event.sem_lock);
+	if (!list_empty(&manager->process_queue) && !manager->remove_flag) {
+		pitem = list_first_entry(&manager->process_queue,
+			struct encode_queue_item_s, list);
+		if (pitem->request.parent == cur->request.parent)
+			pitem = NULL;
+	}
+	if (pitem) {
+		list_del(&pitem->list);
+		manager->current_item = pitem;
+		manager->current_wq = pitem->request.parent;
+		manager->pend_wq = cur->request.parent;
+		manager->lat.overlapped++;
+	}
+	spin_unlock(&manager->event.sem_lock);
+
+	return pitem;
+}
+
+static void encode_release_request(struct encode_manager_s *manager,
+	struct encode_queue_item_s *pitem, bool overlapped)
+{
+	spin_lock(&manager->event.sem_lock);
+	encode_lat_record(manager, pitem, ktime_get_ns());
+	list_add_tail(&pitem->list, &manager->free_queue);
+	manager->last_wq = pitem->request.parent;
+	if (overlapped) {
+		manager->pend_wq = NULL;
+	} else {
+		manager->current_item = NULL;
+		manager->current_wq = NULL;
+	}
+	spin_unlock(&manager->event.sem_lock);
+}
+
+/*
+ * Encode pitem and, in pipeline mode, the requests of other wqs that
+ * queue up behind it: while one request is on the hcodec the next one
+ * gets its cbr table and ge2d scaling done, and the finished one its
+ * cache maintenance.
+ */
+static void encode_process_request(struct encode_manager_s *manager,
+	struct encode_queue_item_s *pitem)
+{
+	struct encode_queue_item_s *next;
+
+	encode_start_request(manager, pitem);
+	for (;;) {
+		encode_prepare_next(manager, pitem);
+		encode_wait_request(manager, pitem);
+
+		next = encode_pop_next(manager, pitem);
+		if (next)
+			encode_start_request(manager, next);
+
+		encode_finish_request(manager, pitem);
+		encode_release_request(manager, pitem, next != NULL);
+		if (!next)
+			break;
+		pitem = next;
+	}
 }
 
 s32 encode_wq_add_request(struct encode_wq_s *wq)
 {
 	struct encode_queue_item_s *pitem = NULL;
+	struct encode_queue_item_s *pos = NULL;
 	struct list_head *head = NULL;
+	struct list_head *prev = NULL;
 	struct encode_wq_s *tmp = NULL;
 	bool find = false;
 
@@ -3659,7 +3932,28 @@ s32 encode_wq_add_request(struct encode_wq_s *wq)
 	wq->hw_status = 0;
 	wq->output_size = 0;
 	pitem->request.parent = wq;
-	list_move_tail(&pitem->list, &encode_manager.process_queue);
+	pitem->priority = wq->priority;
+	pitem->hw_status = 0;
+	pitem->queue_ns = ktime_get_ns();
+	pitem->start_ns = 0;
+	pitem->kick_ns = 0;
+	pitem->done_ns = 0;
+	pitem->prep_ns = 0;
+
+	/*
+	 * Behind every request of a priority not lower than its own and
+	 * behind every request of its own wq, so a wq is always encoded in
+	 * order even when its priority got raised.
+	 */
+	prev = &encode_manager.process_queue;
+	list_for_each_entry_reverse(pos, &encode_manager.process_queue, list) {
+		if (pos->priority >= pitem->priority ||
+			pos->request.parent == wq) {
+			prev = &pos->list;
+			break;
+		}
+	}
+	list_move(&pitem->list, prev);
 	spin_unlock(&encode_manager.event.sem_lock);
 
 	enc_pr(LOG_INFO,
@@ -3711,6 +4005,7 @@ struct encode_wq_s *create_encode_work_queue(void)
 	encode_work_queue->cbr_info.short_shift = CBR_SHORT_SHIFT;
 	encode_work_queue->cbr_info.long_mb_num = CBR_LONG_MB_NUM;
 #endif
+	encode_work_queue->priority = ENCODE_PRIORITY_DEFAULT;
 	init_waitqueue_head(&encode_work_queue->request_complete);
 	atomic_set(&encode_work_queue->request_ready, 0);
 	spin_lock(&encode_manager.event.sem_lock);
@@ -3791,7 +4086,8 @@ s32 destroy_encode_work_queue(struct encode_wq_s *encode_work_queue)
 
 	if (encode_work_queue) {
 		spin_lock(&encode_manager.event.sem_lock);
-		if (encode_manager.current_wq == encode_work_queue) {
+		if (encode_manager.current_wq == encode_work_queue ||
+			encode_manager.pend_wq == encode_work_queue) {
 			encode_manager.remove_flag = true;
 			spin_unlock(&encode_manager.event.sem_lock);
 			enc_pr(LOG_DEBUG,
@@ -3835,6 +4131,33 @@ s32 destroy_encode_work_queue(struct encode_wq_s *encode_work_queue)
 	return  0;
 }
 
+#ifdef CONFIG_AMLOGIC_MEDIA_GE2D
+static void encode_prep_canvas_alloc(struct encode_manager_s *manager)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (manager->prep_canvas[i] < 0)
+			manager->prep_canvas[i] =
+				canvas_pool_map_alloc_canvas(ENCODE_NAME);
+	}
+	if (manager->prep_canvas[0] < 0 || manager->prep_canvas[1] < 0)
+		enc_pr(LOG_DEBUG,
+			"no canvas for ge2d ahead of the hw, scale inline.\n");
+}
+
+static void encode_prep_canvas_free(struct encode_manager_s *manager)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (manager->prep_canvas[i] >= 0)
+			canvas_pool_map_free_canvas(manager->prep_canvas[i]);
+		manager->prep_canvas[i] = -1;
+	}
+}
+#endif
+
 static s32 encode_monitor_thread(void *data)
 {
 	struct encode_manager_s *manager = (struct encode_manager_s *)data;
@@ -3871,6 +4194,7 @@ static s32 encode_monitor_thread(void *data)
 					if (!manager->context)
 						manager->context =
 						create_ge2d_work_queue();
+					encode_prep_canvas_alloc(manager);
 #endif
 					avc_init(first_wq);
 					manager->inited = true;
@@ -3900,6 +4224,7 @@ static s32 encode_monitor_thread(void *data)
 				destroy_ge2d_work_queue(manager->context);
 				manager->context = NULL;
 			}
+			encode_prep_canvas_free(manager);
 #endif
 			enc_pr(LOG_DEBUG, "power off encode.\n");
 			continue;
@@ -3912,15 +4237,8 @@ static s32 encode_monitor_thread(void *data)
 		}
 		spin_unlock(&manager->event.sem_lock);
 
-		if (pitem) {
+		if (pitem)
 			encode_process_request(manager, pitem);
-			spin_lock(&manager->event.sem_lock);
-			list_add_tail(&pitem->list, &manager->free_queue);
-			manager->current_item = NULL;
-			manager->last_wq = manager->current_wq;
-			manager->current_wq = NULL;
-			spin_unlock(&manager->event.sem_lock);
-		}
 		if (manager->remove_flag) {
 			complete(&manager->event.process_complete);
 			manager->remove_flag = false;
@@ -4022,6 +4340,10 @@ static s32 encode_wq_init(void)
 	}
 	encode_manager.current_wq = NULL;
 	encode_manager.last_wq = NULL;
+	encode_manager.pend_wq = NULL;
+	encode_manager.prep_canvas[0] = -1;
+	encode_manager.prep_canvas[1] = -1;
+	memset(&encode_manager.lat, 0, sizeof(encode_manager.lat));
 	encode_manager.encode_thread = NULL;
 	encode_manager.current_item = NULL;
 	encode_manager.wq_count = 0;
@@ -4169,10 +4491,75 @@ static ssize_t encode_status_show(struct class *cla,
 	return snprintf(buf, 40, "encode max instance: %d\n", max_instance);
 }
 
+static ssize_t encode_lat_hist_show(char *buf, ssize_t size,
+	const char *name, const struct encode_lat_hist_s *h)
+{
+	ssize_t len = 0;
+	int i;
+
+	len += scnprintf(buf + len, size - len,
+		"%-6s count %u ave %llu max %u us\n", name, h->count,
+		h->count ? div_u64(h->sum_us, h->count) : 0, h->max_us);
+	for (i = 0; i < ENCODE_LAT_BUCKETS; i++) {
+		if (!h->bucket[i])
+			continue;
+		if (i < ENCODE_LAT_BUCKETS - 1)
+			len += scnprintf(buf + len, size - len,
+				"\t< %8u us: %u\n", 64U << i, h->bucket[i]);
+		else
+			len += scnprintf(buf + len, size - len,
+				"\t>=%8u us: %u\n", 64U << (i - 1),
+				h->bucket[i]);
+	}
+	return len;
+}
+
+static ssize_t encode_latency_show(struct class *cla,
+	struct class_attribute *attr, char *buf)
+{
+	struct encode_lat_stat_s *lat;
+	ssize_t len = 0;
+
+	lat = kmalloc(sizeof(*lat), GFP_KERNEL);
+	if (!lat)
+		return -ENOMEM;
+	spin_lock(&encode_manager.event.sem_lock);
+	memcpy(lat, &encode_manager.lat, sizeof(*lat));
+	spin_unlock(&encode_manager.event.sem_lock);
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+		"pipeline %u, prepared %u, overlapped %u\n",
+		pipeline_mode, lat->prepared, lat->overlapped);
+	len += encode_lat_hist_show(buf + len, PAGE_SIZE - len,
+		"queue", &lat->queue);
+	len += encode_lat_hist_show(buf + len, PAGE_SIZE - len,
+		"prep", &lat->prep);
+	len += encode_lat_hist_show(buf + len, PAGE_SIZE - len,
+		"setup", &lat->setup);
+	len += encode_lat_hist_show(buf + len, PAGE_SIZE - len,
+		"hw", &lat->hw);
+	len += encode_lat_hist_show(buf + len, PAGE_SIZE - len,
+		"total", &lat->total);
+	kfree(lat);
+	return len;
+}
+
+/* any write clears the histograms */
+static ssize_t encode_latency_store(struct class *cla,
+	struct class_attribute *attr, const char *buf, size_t size)
+{
+	spin_lock(&encode_manager.event.sem_lock);
+	memset(&encode_manager.lat, 0, sizeof(encode_manager.lat));
+	spin_unlock(&encode_manager.event.sem_lock);
+	return size;
+}
+
 static CLASS_ATTR_RO(encode_status);
+static CLASS_ATTR_RW(encode_latency);
 
 static struct attribute *amvenc_class_attrs[] = {
 	&class_attr_encode_status.attr,
+	&class_attr_encode_latency.attr,
 	NULL
 };
 
@@ -4561,6 +4948,9 @@ MODULE_PARM_DESC(encode_print_level, "\n encode_print_level\n");
 module_param(no_timeout, uint, 0664);
 MODULE_PARM_DESC(no_timeout, "\n no_timeout flag for process request\n");
 
+module_param(pipeline_mode, uint, 0664);
+MODULE_PARM_DESC(pipeline_mode, "\n prepare/finish requests beside the hw\n");
+
 module_param(nr_mode, int, 0664);
 MODULE_PARM_DESC(nr_mode, "\n nr_mode option\n");
 
@@ -126,6 +126,7 @@
 #define AMVENC_AVC_IOC_SUBMIT	_IOW(AMVENC_AVC_IOC_MAGIC, 0x09, u32)
 #define AMVENC_AVC_IOC_READ_CANVAS _IOW(AMVENC_AVC_IOC_MAGIC, 0x0a, u32)
 #define AMVENC_AVC_IOC_QP_MODE _IOW(AMVENC_AVC_IOC_MAGIC, 0x0b, u32)
+#define AMVENC_AVC_IOC_SET_PRIORITY _IOW(AMVENC_AVC_IOC_MAGIC, 0x0c, u32)
 
 
 
@@ -164,6 +165,10 @@ enum amvenc_frame_fmt_e {
 
 #define MAX_ENCODE_INSTANCE  8   /* 64 */
 
+/* higher priority wq requests are encoded first, fifo within a level */
+#define ENCODE_PRIORITY_DEFAULT	0
+#define ENCODE_PRIORITY_MAX	7
+
 #define ENCODE_PROCESS_QUEUE_START	0
 #define ENCODE_PROCESS_QUEUE_STOP	1
 
@@ -226,11 +231,42 @@ struct encode_request_s {
 	struct encode_wq_s *parent;
 	struct enc_dma_cfg dma_cfg[3];
 	u32 plane_num;
+	u32 prepared; /* ENCODE_PREP_xxx done ahead of the hw start */
 };
 
+#define ENCODE_PREP_CBR		0x1
+#define ENCODE_PREP_SCALE	0x2
+
 struct encode_queue_item_s {
 	struct list_head list;
 	struct encode_request_s request;
+	u32 priority;
+	u32 hw_status; /* encode_hw_status when the request got done */
+	u64 queue_ns;
+	u64 start_ns;
+	u64 kick_ns;
+	u64 done_ns;
+	u64 prep_ns; /* time spent preparing ahead */
+};
+
+/* log2 buckets, [0] < 64us, [n] < 64us << n, the last one open ended */
+#define ENCODE_LAT_BUCKETS	16
+
+struct encode_lat_hist_s {
+	u32 count;
+	u32 max_us;
+	u64 sum_us;
+	u32 bucket[ENCODE_LAT_BUCKETS];
+};
+
+struct encode_lat_stat_s {
+	struct encode_lat_hist_s queue; /* queued -> hw start */
+	struct encode_lat_hist_s prep; /* cbr table, ge2d scale ahead */
+	struct encode_lat_hist_s setup; /* register setup, inline scale */
+	struct encode_lat_hist_s hw; /* hw kicked -> done */
+	struct encode_lat_hist_s total; /* queued -> user woken */
+	u32 prepared; /* prepared while another request was encoding */
+	u32 overlapped; /* finished while the next one was encoding */
 };
 
 struct Buff_s {
@@ -342,6 +378,7 @@ struct encode_wq_s {
 	struct encode_picinfo_s pic;
 	struct encode_request_s request;
 	struct encode_cbr_s cbr_info;
+	u32 priority;
 	atomic_t request_ready;
 	wait_queue_head_t request_complete;
 };
@@ -383,7 +420,11 @@ struct encode_manager_s {
 	struct Buff_s *reserve_buff;
 	struct encode_wq_s *current_wq;
 	struct encode_wq_s *last_wq;
+	/* wq of a request prepared or finished beside the current one */
+	struct encode_wq_s *pend_wq;
 	struct encode_queue_item_s *current_item;
+	s32 prep_canvas[2]; /* ge2d target while mfdin reads the scaler canvas */
+	struct encode_lat_stat_s lat;
 	struct task_struct *encode_thread;
 	struct Buff_s reserve_mem;
 	struct encode_event_s event;
@@ -28,6 +28,7 @@
 #include <linux/platform_device.h>
 #include <linux/spinlock.h>
 #include <linux/ctype.h>
+#include <linux/ktime.h>
 
 #include <linux/amlogic/media/frame_sync/ptsserv.h>
 #include <linux/amlogic/media/utils/amstream.h>
@@ -1529,23 +1530,28 @@ static void convert_quant_table(u16 *qtable, u16 *basic_table,
 	_convert_quant_table(qtable, basic_table, scale_factor, true);
 }
 
-static void write_jpeg_quant_lut(s32 table_num)
+static void build_jpeg_quant_lut(u32 *lut, s32 table_num)
 {
 	s32 i;
-	u32 data32;
 
 	for (i = 0; i < DCTSIZE2; i += 2) {
-		data32 = reciprocal(gQuantTable[table_num][i]);
-		data32 |= reciprocal(gQuantTable[table_num][i + 1]) << 16;
-		WRITE_HREG(HCODEC_QDCT_JPEG_QUANT_DATA, data32);
+		lut[i / 2] = reciprocal(gQuantTable[table_num][i]);
+		lut[i / 2] |= reciprocal(gQuantTable[table_num][i + 1]) << 16;
 	}
 }
 
-static void write_jpeg_huffman_lut_dc(s32 table_num)
+static void write_jpeg_quant_lut(const u32 *lut)
+{
+	s32 i;
+
+	for (i = 0; i < DCTSIZE2 / 2; i++)
+		WRITE_HREG(HCODEC_QDCT_JPEG_QUANT_DATA, lut[i]);
+}
+
+static void build_jpeg_huffman_lut_dc(s32 table_num, u32 *lut)
 {
 	u32 code_len, code_word, pos, addr;
 	u32 num_code_len;
-	u32 lut[12];
 	u32 i, j;
 
 	code_len = 1;
@@ -1566,19 +1572,14 @@ static void write_jpeg_huffman_lut_dc(s32 table_num)
 			pos++;
 		}
 	}
-
-	/* Write DC Huffman table to HW */
-	for (i = 0; i < 12; i++)
-		WRITE_HREG(HCODEC_VLC_HUFFMAN_DATA, lut[i]);
 }
 
-static void write_jpeg_huffman_lut_ac(s32 table_num)
+static void build_jpeg_huffman_lut_ac(s32 table_num, u32 *lut)
 {
 	u32 code_len, code_word, pos;
 	u32 num_code_len;
 	u32 run, size;
 	u32 data, addr = 0;
-	u32 lut[162];
 	u32 i, j;
 	code_len = 1;
 	code_word = 1;
@@ -1613,12 +1614,52 @@ static void write_jpeg_huffman_lut_ac(s32 table_num)
 			pos++;
 		}
 	}
+}
+
+static void write_jpeg_huffman_lut(const u32 *lut, u32 num)
+{
+	u32 i;
 
-	/* Write AC Huffman table to HW */
-	for (i = 0; i < 162; i++)
+	for (i = 0; i < num; i++)
 		WRITE_HREG(HCODEC_VLC_HUFFMAN_DATA, lut[i]);
 }
 
+static void jpegenc_hdr_cache_reset(struct jpegenc_wq_s *wq)
+{
+	wq->hdr_cache.valid = false;
+}
+
+static void jpegenc_hdr_key_init(struct jpegenc_wq_s *wq,
+	struct jpegenc_hdr_key_s *key)
+{
+	memset(key, 0, sizeof(*key));
+	key->width = wq->cmd.encoder_width;
+	key->height = wq->cmd.encoder_height;
+	key->input_fmt = wq->cmd.input_fmt;
+	key->output_fmt = wq->cmd.output_fmt;
+	key->quality = wq->cmd.jpeg_quality;
+	key->quant_id = wq->cmd.QuantTable_id;
+	key->dc_huff_id = (DC_HUFF_SEL_COMP0 << 4) | DC_HUFF_SEL_COMP1;
+	key->ac_huff_id = (AC_HUFF_SEL_COMP0 << 4) | AC_HUFF_SEL_COMP1;
+}
+
+/* huffman LUTs only depend on the static tables, build them once */
+static struct jpegenc_hdr_cache_s *jpegenc_huff_lut_get(
+	struct jpegenc_wq_s *wq)
+{
+	struct jpegenc_hdr_cache_s *c = &wq->hdr_cache;
+	s32 i;
+
+	if (!c->huff_valid) {
+		for (i = 0; i < 2; i++) {
+			build_jpeg_huffman_lut_dc(i, c->huff_dc_lut[i]);
+			build_jpeg_huffman_lut_ac(i, c->huff_ac_lut[i]);
+		}
+		c->huff_valid = true;
+	}
+	return c;
+}
+
 static void prepare_jpeg_header(struct jpegenc_wq_s *wq)
 {
 	s32 pic_format;
@@ -1938,6 +1979,9 @@ static void init_jpeg_encoder(struct jpegenc_wq_s *wq)
 	s32 h_factor_comp0, v_factor_comp0;
 	s32 h_factor_comp1, v_factor_comp1;
 	s32 h_factor_comp2, v_factor_comp2;
+	struct jpegenc_hdr_cache_s *cache = jpegenc_huff_lut_get(wq);
+	struct jpegenc_hdr_key_s key;
+	bool hit;
 
 	jenc_pr(LOG_INFO, "Initialize JPEG Encoder ....\n");
 	if (wq->cmd.output_fmt >= JPEGENC_MAX_FRAME_FMT)
@@ -2014,15 +2058,20 @@ static void init_jpeg_encoder(struct jpegenc_wq_s *wq)
 	WRITE_HREG(HCODEC_QDCT_JPEG_Y_START_END,
 		   ((pic_y_end << 16) | (pic_y_start << 0)));
 
+	jpegenc_hdr_key_init(wq, &key);
+	hit = cache->valid && !memcmp(&cache->key, &key, sizeof(key));
+
 	/* Configure quantization tables */
 #ifdef EXTEAN_QUANT_TABLE
 	if (external_quant_table_available) {
-		convert_quant_table(&gQuantTable[0][0],
-			&gExternalQuantTablePtr[0],
-			wq->cmd.jpeg_quality);
-		convert_quant_table(&gQuantTable[1][0],
-			&gExternalQuantTablePtr[DCTSIZE2],
-			wq->cmd.jpeg_quality);
+		if (!hit) {
+			convert_quant_table(&gQuantTable[0][0],
+				&gExternalQuantTablePtr[0],
+				wq->cmd.jpeg_quality);
+			convert_quant_table(&gQuantTable[1][0],
+				&gExternalQuantTablePtr[DCTSIZE2],
+				wq->cmd.jpeg_quality);
+		}
 		q_sel_comp0 = 0;
 		q_sel_comp1 = 1;
 		q_sel_comp2 = 1;
@@ -2034,13 +2083,15 @@ static void init_jpeg_encoder(struct jpegenc_wq_s *wq)
 		tq[1] = (q_sel_comp0 != q_sel_comp1) ?
 			q_sel_comp1 : (q_sel_comp0 != q_sel_comp2) ?
 			q_sel_comp2 : q_sel_comp0;
-		convert_quant_table(&gQuantTable[0][0],
-			(u16 *)&jpeg_quant[tq[0]],
-			wq->cmd.jpeg_quality);
-		if (tq[0] != tq[1])
-			convert_quant_table(&gQuantTable[1][0],
-				(u16 *)&jpeg_quant[tq[1]],
+		if (!hit) {
+			convert_quant_table(&gQuantTable[0][0],
+				(u16 *)&jpeg_quant[tq[0]],
 				wq->cmd.jpeg_quality);
+			if (tq[0] != tq[1])
+				convert_quant_table(&gQuantTable[1][0],
+					(u16 *)&jpeg_quant[tq[1]],
+					wq->cmd.jpeg_quality);
+		}
 		q_sel_comp0 = tq[0];
 		q_sel_comp1 = tq[1];
 		q_sel_comp2 = tq[1];
@@ -2053,10 +2104,15 @@ static void init_jpeg_encoder(struct jpegenc_wq_s *wq)
 
 	WRITE_HREG(HCODEC_QDCT_JPEG_QUANT_ADDR, data32);
 
+	if (!hit) {
+		build_jpeg_quant_lut(cache->quant_lut[0], 0);
+		build_jpeg_quant_lut(cache->quant_lut[1], 1);
+	}
+
 	/* Burst-write Quantization LUT data */
-	write_jpeg_quant_lut(0);
+	write_jpeg_quant_lut(cache->quant_lut[0]);
 	if (q_sel_comp0 != q_sel_comp1)
-		write_jpeg_quant_lut(1);
+		write_jpeg_quant_lut(cache->quant_lut[1]);
 #if 0
 	write_jpeg_quant_lut(q_sel_comp0);
 	if (q_sel_comp1 != q_sel_comp0)
@@ -2074,9 +2130,10 @@ static void init_jpeg_encoder(struct jpegenc_wq_s *wq)
 	WRITE_HREG(HCODEC_VLC_HUFFMAN_ADDR, data32);
 
 	/* Burst-write DC Huffman LUT data */
-	write_jpeg_huffman_lut_dc(dc_huff_sel_comp0);
+	write_jpeg_huffman_lut(cache->huff_dc_lut[dc_huff_sel_comp0], 12);
 	if (dc_huff_sel_comp1 != dc_huff_sel_comp0)
-		write_jpeg_huffman_lut_dc(dc_huff_sel_comp1);
+		write_jpeg_huffman_lut(cache->huff_dc_lut[dc_huff_sel_comp1],
+			12);
 
 #if 0
 	if ((dc_huff_sel_comp2 != dc_huff_sel_comp0)
@@ -2091,9 +2148,10 @@ static void init_jpeg_encoder(struct jpegenc_wq_s *wq)
 	WRITE_HREG(HCODEC_VLC_HUFFMAN_ADDR, data32);
 
 	/* Burst-write AC Huffman LUT data */
-	write_jpeg_huffman_lut_ac(ac_huff_sel_comp0);
+	write_jpeg_huffman_lut(cache->huff_ac_lut[ac_huff_sel_comp0], 162);
 	if (ac_huff_sel_comp1 != ac_huff_sel_comp0)
-		write_jpeg_huffman_lut_ac(ac_huff_sel_comp1);
+		write_jpeg_huffman_lut(cache->huff_ac_lut[ac_huff_sel_comp1],
+			162);
 
 #if 0
 	if ((ac_huff_sel_comp2 != ac_huff_sel_comp0)
@@ -2214,7 +2272,24 @@ static void init_jpeg_encoder(struct jpegenc_wq_s *wq)
 		(0 << 0)); /* soft reset */
 
 	/* Assember JPEG file header */
+	if (hit) {
+		memcpy((u8 *)wq->AssitstreamStartVirtAddr, cache->header,
+			cache->headbytes);
+		wq->headbytes = cache->headbytes;
+		cache->hit++;
+		return;
+	}
 	prepare_jpeg_header(wq);
+	cache->miss++;
+	if (wq->headbytes <= JPEGENC_HEADER_MAX) {
+		memcpy(cache->header, (u8 *)wq->AssitstreamStartVirtAddr,
+			wq->headbytes);
+		cache->headbytes = wq->headbytes;
+		cache->key = key;
+		cache->valid = true;
+	} else {
+		cache->valid = false;
+	}
 }
 
 static void jpegenc_init_output_buffer(struct jpegenc_wq_s *wq)
@@ -2223,11 +2298,11 @@ static void jpegenc_init_output_buffer(struct jpegenc_wq_s *wq)
 		((1 << 31) | (0x3f << 24) |
 		(0x20 << 16) | (2 << 0)));
 	WRITE_HREG(HCODEC_VLC_VB_START_PTR,
-		wq->BitstreamStart);
+		wq->BitstreamStart + wq->BitstreamOffset);
 	WRITE_HREG(HCODEC_VLC_VB_WR_PTR,
-		wq->BitstreamStart);
+		wq->BitstreamStart + wq->BitstreamOffset);
 	WRITE_HREG(HCODEC_VLC_VB_SW_RD_PTR,
-		wq->BitstreamStart);
+		wq->BitstreamStart + wq->BitstreamOffset);
 	WRITE_HREG(HCODEC_VLC_VB_END_PTR,
 		wq->BitstreamEnd);
 	WRITE_HREG(HCODEC_VLC_VB_CONTROL, 1);
@@ -2263,6 +2338,7 @@ static void jpegenc_buffspec_init(struct jpegenc_wq_s *wq)
 	wq->AssitstreamStartVirtAddr =
 		codec_mm_vmap(wq->AssitStart, (wq->AssitEnd - wq->AssitStart + 1));
 #endif
+	jpegenc_hdr_cache_reset(wq);
 	//jenc_pr(LOG_ERROR, "[%s:%d], (wq->AssitEnd - wq->AssitStart + 1)=%d\n", 
 		//__FUNCTION__, __LINE__, (wq->AssitEnd - wq->AssitStart + 1));
 	jenc_pr(LOG_ERROR, "AssitstreamStartVirtAddr is %p\n",
@@ -3048,6 +3124,9 @@ static s32 jpegenc_open(struct inode *inode, struct file *file)
 	wq->max_width = gJpegenc.mem.bufspec->max_width;
 	wq->max_height = gJpegenc.mem.bufspec->max_height;
 	wq->headbytes = 0;
+	wq->BitstreamOffset = 0;
+	memset(&wq->burst_stat, 0, sizeof(wq->burst_stat));
+	memset(&wq->hdr_cache, 0, sizeof(wq->hdr_cache));
 	file->private_data = (void *)wq;
 
 #ifdef EXTEAN_QUANT_TABLE
@@ -3108,6 +3187,142 @@ static s32 jpegenc_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/*
+ * Encode the frames one after another without returning to user
+ * space, each into its own part of the bitstream buffer.
+ */
+static long jpegenc_burst(struct jpegenc_wq_s *wq, void __user *argp)
+{
+	struct jpegenc_burst_s burst;
+	struct jpegenc_burst_frame_s *frames;
+	struct jpegenc_burst_frame_s *f;
+	struct jpegenc_request_s *reqs;
+	struct jpegenc_burst_stat_s *stat = &wq->burst_stat;
+	u32 bitstream_size = wq->BitstreamEnd - wq->BitstreamStart + 1;
+	u32 offset = 0;
+	u32 budget;
+	u32 done = 0;
+	u32 us;
+	u64 start, sum_us = 0, max_us = 0;
+	struct jpegenc_hdr_key_s key0, key;
+	long r = 0;
+	long ret;
+
+	if (copy_from_user(&burst, argp, sizeof(burst)))
+		return -EFAULT;
+	if (burst.num == 0 || burst.num > JPEGENC_BURST_MAX ||
+		!wq->BitstreamStart) {
+		jenc_pr(LOG_ERROR, "jpegenc burst of %u frames invalid\n",
+			burst.num);
+		r = -EINVAL;
+		goto out_stat;
+	}
+	frames = kcalloc(burst.num, sizeof(*frames), GFP_KERNEL);
+	reqs = kcalloc(burst.num, sizeof(*reqs), GFP_KERNEL);
+	if (!frames || !reqs) {
+		r = -ENOMEM;
+		goto out;
+	}
+	if (copy_from_user(frames, u64_to_user_ptr(burst.frames),
+		burst.num * sizeof(*frames))) {
+		r = -EFAULT;
+		goto out;
+	}
+
+	/* the assist and header setup is shared by the whole burst */
+	for (done = 0; done < burst.num; done++) {
+		if (convert_cmd(wq, frames[done].cmd)) {
+			r = -EINVAL;
+			break;
+		}
+		/* a single input buffer can't hold a burst */
+		if (wq->cmd.type == JPEGENC_LOCAL_BUFF && burst.num > 1) {
+			jenc_pr(LOG_ERROR,
+				"jpegenc burst needs physical or canvas input\n");
+			r = -EINVAL;
+			break;
+		}
+		jpegenc_hdr_key_init(wq, done ? &key : &key0);
+		if (done && memcmp(&key, &key0, sizeof(key))) {
+			jenc_pr(LOG_ERROR,
+				"jpegenc burst frame %u changes header params\n",
+				done);
+			r = -EINVAL;
+			break;
+		}
+		reqs[done] = wq->cmd;
+	}
+	if (r) {
+		done = 0;
+		goto out;
+	}
+
+	for (done = 0; done < burst.num; done++) {
+		f = &frames[done];
+		wq->cmd = reqs[done];
+		budget = burst.out_budget ? burst.out_budget :
+			wq->cmd.encoder_width * wq->cmd.encoder_height * 3 / 2;
+		if (offset >= bitstream_size ||
+			bitstream_size - offset < budget) {
+			jenc_pr(LOG_DEBUG,
+				"jpegenc burst stops at %u, out of bitstream\n",
+				done);
+			break;
+		}
+
+		atomic_set(&wq->ready, 0);
+		wq->hw_status = 0;
+		wq->output_size = 0;
+		wq->BitstreamOffset = offset;
+		start = ktime_get_ns();
+		jpegenc_start_cmd(wq);
+		ret = wait_event_interruptible_timeout(wq->complete,
+			atomic_read(&wq->ready), HZ);
+		if (ret <= 0) {
+			jenc_pr(LOG_ERROR,
+				"jpegenc burst frame %u %s, status %d\n", done,
+				ret ? "interrupted" : "timeout",
+				gJpegenc.encode_hw_status);
+			r = ret ? ret : -ETIMEDOUT;
+			break;
+		}
+		atomic_dec(&wq->ready);
+		us = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+		sum_us += us;
+		max_us = max_t(u64, max_us, us);
+
+		cache_flush(wq->BitstreamStart + offset, wq->output_size);
+		f->headbytes = wq->headbytes;
+		f->offset = offset;
+		f->size = wq->output_size;
+		f->status = wq->hw_status;
+		offset = ALIGN(offset + wq->output_size, 64);
+	}
+	wq->BitstreamOffset = 0;
+
+	burst.num = done;
+	if (copy_to_user(u64_to_user_ptr(burst.frames), frames,
+		done * sizeof(*frames)) ||
+		copy_to_user(argp, &burst, sizeof(burst)))
+		r = -EFAULT;
+out:
+	kfree(reqs);
+	kfree(frames);
+out_stat:
+	spin_lock(&gJpegenc.sem_lock);
+	stat->bursts++;
+	stat->frames += done;
+	if (r)
+		stat->errors++;
+	else if (done < burst.num)
+		stat->short_bursts++;
+	stat->sum_us += sum_us;
+	if (max_us > stat->max_us)
+		stat->max_us = max_us;
+	spin_unlock(&gJpegenc.sem_lock);
+	return r;
+}
+
 static long jpegenc_ioctl(struct file *file, u32 cmd, ulong arg)
 {
 	long r = 0;
@@ -3122,9 +3337,13 @@ static long jpegenc_ioctl(struct file *file, u32 cmd, ulong arg)
 				"jpegenc get new cmd error.\n");
 			return -1;
 		}
+		wq->BitstreamOffset = 0;
 		if (!convert_cmd(wq, addr_info))
 			jpegenc_start_cmd(wq);
 		break;
+	case JPEGENC_IOC_NEW_CMD_BURST:
+		r = jpegenc_burst(wq, (void __user *)arg);
+		break;
 	case JPEGENC_IOC_GET_STAGE:
 		put_user(wq->hw_status, (u32 *)arg);
 		break;
@@ -3170,6 +3389,7 @@ static long jpegenc_ioctl(struct file *file, u32 cmd, ulong arg)
 		break;
 	case JPEGENC_IOC_SET_EXT_QUANT_TABLE:
 #ifdef EXTEAN_QUANT_TABLE
+		jpegenc_hdr_cache_reset(wq);
 		if (arg == 0) {
 			kfree(gExternalQuantTablePtr);
 			gExternalQuantTablePtr = NULL;
@@ -3360,10 +3580,49 @@ static ssize_t jpegenc_status_show(struct class *cla,
 	return snprintf(buf, 40, "max size: %dx%d\n", max_w, max_h);
 }
 
+static ssize_t jpegenc_stat_show(struct class *cla,
+	struct class_attribute *attr, char *buf)
+{
+	struct jpegenc_burst_stat_s stat;
+	u32 hit, miss;
+	ssize_t len = 0;
+
+	spin_lock(&gJpegenc.sem_lock);
+	stat = gJpegenc.wq.burst_stat;
+	hit = gJpegenc.wq.hdr_cache.hit;
+	miss = gJpegenc.wq.hdr_cache.miss;
+	spin_unlock(&gJpegenc.sem_lock);
+
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+		"header cache hit %u, miss %u\n", hit, miss);
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+		"burst count %u, frames %u, short %u, errors %u\n",
+		stat.bursts, stat.frames, stat.short_bursts, stat.errors);
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+		"burst frame ave %llu max %u us\n",
+		stat.frames ? div_u64(stat.sum_us, stat.frames) : 0,
+		stat.max_us);
+	return len;
+}
+
+/* any write clears the counters */
+static ssize_t jpegenc_stat_store(struct class *cla,
+	struct class_attribute *attr, const char *buf, size_t size)
+{
+	spin_lock(&gJpegenc.sem_lock);
+	memset(&gJpegenc.wq.burst_stat, 0, sizeof(gJpegenc.wq.burst_stat));
+	gJpegenc.wq.hdr_cache.hit = 0;
+	gJpegenc.wq.hdr_cache.miss = 0;
+	spin_unlock(&gJpegenc.sem_lock);
+	return size;
+}
+
 static CLASS_ATTR_RO(jpegenc_status);
+static CLASS_ATTR_RW(jpegenc_stat);
 
 static struct attribute *jpegenc_class_attrs[] = {
 	&class_attr_jpegenc_status.attr,
+	&class_attr_jpegenc_stat.attr,
 	NULL
 };
 
@@ -88,9 +88,17 @@
 #define JPEGENC_IOC_GET_STAGE	_IOW(JPEGENC_IOC_MAGIC, 0x03, u32)
 #define JPEGENC_IOC_GET_OUTPUT_SIZE	_IOW(JPEGENC_IOC_MAGIC, 0x04, u32)
 #define JPEGENC_IOC_SET_EXT_QUANT_TABLE	_IOW(JPEGENC_IOC_MAGIC, 0x05, u32)
+#define JPEGENC_IOC_NEW_CMD_BURST	\
+	_IOWR(JPEGENC_IOC_MAGIC, 0x06, struct jpegenc_burst_s)
 
 #define DCTSIZE2	    64
 
+/* words of a JPEGENC_IOC_NEW_CMD command */
+#define JPEGENC_CMD_INFO_SIZE	10
+#define JPEGENC_BURST_MAX	16
+/* SOI + DQT + DHT + SOF0 + filler + SOS is 596 bytes at most */
+#define JPEGENC_HEADER_MAX	640
+
 #define JPEGENC_FLUSH_FLAG_INPUT			0x1
 #define JPEGENC_FLUSH_FLAG_OUTPUT		0x2
 
@@ -173,6 +181,68 @@ struct jpegenc_request_s {
 	enum jpegenc_frame_fmt_e output_fmt;
 };
 
+/*
+ * JPEGENC_IOC_NEW_CMD_BURST: encode up to JPEGENC_BURST_MAX frames
+ * back to back, the ioctl returns once all of them are done. Every
+ * frame is written to the bitstream buffer at its own offset,
+ * out_budget bytes (0: width * height * 3 / 2) must be left there
+ * before a frame is started. num returns the frames encoded.
+ * All frames share one header and quant setup, so size, formats,
+ * quality and quant table must be the same in every cmd.
+ */
+struct jpegenc_burst_frame_s {
+	u32 cmd[JPEGENC_CMD_INFO_SIZE];	/* as JPEGENC_IOC_NEW_CMD */
+	u32 headbytes;
+	u32 offset;	/* in the bitstream buffer */
+	u32 size;
+	u32 status;
+};
+
+struct jpegenc_burst_s {
+	u32 num;
+	u32 out_budget;
+	u64 frames;	/* user pointer to num jpegenc_burst_frame_s */
+};
+
+struct jpegenc_hdr_key_s {
+	u32 width;
+	u32 height;
+	u32 input_fmt;
+	u32 output_fmt;
+	u32 quality;
+	u32 quant_id;
+	u32 dc_huff_id;
+	u32 ac_huff_id;
+};
+
+/*
+ * Per session cache of the JFIF header and the quant LUT words, an
+ * MJPEG stream keeps size, format and quality from frame to frame.
+ * The huffman LUTs only depend on the static tables.
+ */
+struct jpegenc_hdr_cache_s {
+	bool valid;
+	bool huff_valid;
+	struct jpegenc_hdr_key_s key;
+	u32 headbytes;
+	u32 quant_lut[2][DCTSIZE2 / 2];
+	u32 huff_dc_lut[2][12];
+	u32 huff_ac_lut[2][162];
+	u8 header[JPEGENC_HEADER_MAX];
+	u32 hit;
+	u32 miss;
+};
+
+/* JPEGENC_IOC_NEW_CMD_BURST counters, see the jpegenc_stat node */
+struct jpegenc_burst_stat_s {
+	u32 bursts;
+	u32 frames;
+	u32 short_bursts;	/* stopped early, out of bitstream */
+	u32 errors;		/* rejected or failed */
+	u64 sum_us;		/* hw time of all burst frames */
+	u32 max_us;		/* slowest burst frame */
+};
+
 struct jpegenc_meminfo_s {
 	u32 buf_start;
 	u32 buf_size;
@@ -201,12 +271,15 @@ struct jpegenc_wq_s {
 
 	u32 BitstreamStart;
 	u32 BitstreamEnd;
+	u32 BitstreamOffset;	/* output start of the next frame */
 	void __iomem *AssitstreamStartVirtAddr;
 
 	u32 max_width;
 	u32 max_height;
 
 	struct jpegenc_request_s cmd;
+	struct jpegenc_hdr_cache_s hdr_cache;
+	struct jpegenc_burst_stat_s burst_stat;
 	atomic_t ready;
 	wait_queue_head_t complete;
 #ifdef CONFIG_CMA
@@ -21,6 +21,7 @@
 #include <linux/atomic.h>
 #include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 
 /*
 *memflags
@@ -113,6 +114,11 @@ struct codec_mm_s {
 	int next_bit;
 	struct list_head list;
 	u32 tvp_handle;
+	/*phy/vaddr interval index, owned by codec_mm mgt*/
+	struct rb_node phy_node;
+	struct rb_node va_node;
+	ulong phy_subtree_last;
+	ulong va_subtree_last;
 };
 struct codec_mm_s *codec_mm_alloc(const char *owner, int size,
 		int align2n, int memflags);
@@ -164,4 +170,20 @@ struct codec_mm_s *v4l_reqbufs_from_codec_mm(const char *owner,
 	unsigned int addr, unsigned int size, unsigned int index);
 void v4l_freebufs_back_to_codec_mm(const char *owner, struct codec_mm_s *mem);
 
+/*
+ *in-module self tests of the media drivers, "cat" the
+ *class/codec_mm/selftest node to list them and start one with
+ *	echo "<name> [args]" > /sys/class/codec_mm/selftest
+ *run() gets the text after the name. One test runs at a time,
+ *starting another meanwhile fails with -EBUSY.
+ */
+struct codec_mm_selftest_s {
+	const char *name;
+	int (*run)(const char *args);
+	struct list_head list;
+};
+
+void codec_mm_selftest_register(struct codec_mm_selftest_s *test);
+void codec_mm_selftest_unregister(struct codec_mm_selftest_s *test);
+
 #endif
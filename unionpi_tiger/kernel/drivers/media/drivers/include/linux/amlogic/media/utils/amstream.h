@@ -233,6 +233,9 @@
 #define AMSTREAM_IOC_SET_CRC _IOW((_A_M), 0xc9, struct usr_crc_info_t)
 #define AMSTREAM_IOC_GET_CRC_CMP_RESULT _IOWR((_A_M), 0xca, int)
 #define AMSTREAM_IOC_GET_MVDECINFO _IOR((_A_M), 0xcb, int)
+#define AMSTREAM_IOC_WRITE_DMABUF _IOWR((_A_M), 0xcc, struct am_dmabuf_write_s)
+#define AMSTREAM_IOC_RING_SETUP _IOR((_A_M), 0xcd, int)
+#define AMSTREAM_IOC_RING_KICK _IO((_A_M), 0xce)
 
 
 #define TRICKMODE_NONE       0x00
@@ -552,6 +555,44 @@ struct usr_crc_info_t {
 	u32 uv_crc;
 };
 
+/* feed es/ts data from a dma-buf to the parser without copy */
+struct am_dmabuf_write_s {
+	int fd;		/*input*/
+	u32 offset;	/*input*/
+	u32 size;	/*input*/
+	u32 written;	/*output, may be less than size*/
+};
+
+/*
+ * Shared write ring of a threaded es video port. AMSTREAM_IOC_RING_SETUP
+ * returns the mmap() length: this header page, then the write buffers,
+ * buffer i at buf_off[i]. Userspace owns all buffers at first. It fills
+ * one, stores it at sub[sub_head % AM_RING_MAX_BUFS], bumps sub_head
+ * and calls AMSTREAM_IOC_RING_KICK, arg 1 to wait for a done buffer.
+ * Written buffers come back in done[], the kernel bumps done_head and
+ * userspace done_tail.
+ */
+#define AM_RING_VERSION		1
+#define AM_RING_MAX_BUFS	128
+
+struct am_ring_desc_s {
+	u32 idx;
+	u32 len;
+};
+
+struct am_ring_s {
+	u32 version;
+	u32 buf_num;
+	u32 buf_off[AM_RING_MAX_BUFS];
+	u32 buf_size[AM_RING_MAX_BUFS];
+	u32 sub_head;	/*user*/
+	u32 sub_tail;	/*kernel*/
+	struct am_ring_desc_s sub[AM_RING_MAX_BUFS];
+	u32 done_head;	/*kernel*/
+	u32 done_tail;	/*user*/
+	u32 done[AM_RING_MAX_BUFS];
+};
+
 /*******************************************************************
 * 0x100~~0x1FF : set cmd
 * 0x200~~0x2FF : set ex cmd
@@ -0,0 +1,45 @@
+/*
+ * include/uapi/linux/amlogic/media/frame_check.h
+ *
+ * Copyright (C) 2016 Amlogic, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+*/
+
+#ifndef _UAPI_AML_FRAME_CHECK_H
+#define _UAPI_AML_FRAME_CHECK_H
+
+#include <linux/types.h>
+
+/* fc_mode: how much of a NV21 frame goes into its crc */
+#define FC_MODE_FULL	0	/* every line */
+#define FC_MODE_LINE	1	/* every fc_sample-th line */
+#define FC_MODE_TILE	2	/* every fc_sample-th 64 byte x 16 line tile */
+#define FC_MODE_MAX	3
+
+#define FC_TILE_W	64
+#define FC_TILE_H	16
+
+/* one record read from /dev/frame_check */
+struct fc_crc_rec_s {
+	__u32 seq;
+	__u8 id;
+	__u8 mode;
+	__u16 sample;
+	__u32 frame;
+	__u32 crc_y;
+	__u32 crc_uv;
+	__u32 cost_ns;
+	__u64 ts_ns;
+};
+
+#endif /* _UAPI_AML_FRAME_CHECK_H */
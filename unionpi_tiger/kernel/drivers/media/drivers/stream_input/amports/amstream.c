@@ -170,6 +170,7 @@ static long amstream_compat_ioctl
 #endif
 static ssize_t amstream_vbuf_write
 (struct file *file, const char *buf, size_t count, loff_t *ppos);
+static int amstream_vbuf_mmap(struct file *file, struct vm_area_struct *vma);
 static ssize_t amstream_vframe_write
 (struct file *file, const char *buf, size_t count, loff_t *ppos);
 static ssize_t amstream_abuf_write
@@ -200,6 +201,7 @@ static const struct file_operations vbuf_fops = {
 	.open = amstream_open,
 	.release = amstream_release,
 	.write = amstream_vbuf_write,
+	.mmap = amstream_vbuf_mmap,
 	.unlocked_ioctl = amstream_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl = amstream_compat_ioctl,
@@ -1141,6 +1143,16 @@ static ssize_t amstream_vbuf_write(struct file *file, const char *buf,
 	return r;
 }
 
+static int amstream_vbuf_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct port_priv_s *priv = (struct port_priv_s *)file->private_data;
+
+	if (!(port_get_inited(priv)) || !priv->vdec)
+		return -ENODEV;
+
+	return threadrw_mmap(&priv->vdec->vbuf, vma);
+}
+
 static ssize_t amstream_vframe_write(struct file *file, const char *buf,
 					   size_t count, loff_t *ppos)
 {
@@ -3440,6 +3452,80 @@ static long amstream_do_ioctl_old(struct port_priv_s *priv,
 	return r;
 }
 
+static long amstream_ioctl_write_dmabuf(struct file *file,
+	void __user *arg)
+{
+	struct port_priv_s *priv = (struct port_priv_s *)file->private_data;
+	struct stream_port_s *port = priv->port;
+	struct am_dmabuf_write_s w;
+	ssize_t r;
+
+	if (copy_from_user(&w, arg, sizeof(w)))
+		return -EFAULT;
+
+	if (!(port_get_inited(priv))) {
+		r = amstream_port_init(priv);
+		if (r < 0)
+			return r;
+	}
+
+	if (port->flag & PORT_FLAG_DRM)
+		return -EINVAL;
+
+	if ((port->type & PORT_TYPE_MPTS) && priv->vdec) {
+		r = tsdemux_write_dmabuf(file, &priv->vdec->vbuf,
+			&bufs[BUF_TYPE_AUDIO], w.fd, w.offset, w.size);
+	} else if (port->type & PORT_TYPE_SUB) {
+		r = esparser_write_dmabuf(file, &bufs[BUF_TYPE_SUBTITLE],
+			w.fd, w.offset, w.size);
+		if (r > 0)
+			wakeup_sub_poll();
+	} else if ((port->type & PORT_TYPE_VIDEO) && priv->vdec &&
+		priv->vdec->vbuf.ops == get_esparser_stbuf_ops()) {
+		r = esparser_write_dmabuf(file, &priv->vdec->vbuf,
+			w.fd, w.offset, w.size);
+	} else
+		r = -EINVAL;
+
+	if (r < 0)
+		return r;
+
+	w.written = r;
+	if (copy_to_user(arg, &w, sizeof(w)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static long amstream_ioctl_ring(struct file *file, unsigned int cmd,
+	ulong arg)
+{
+	struct port_priv_s *priv = (struct port_priv_s *)file->private_data;
+	struct stream_port_s *port = priv->port;
+	struct stream_buf_s *pbuf;
+	long r;
+
+	if (!(port_get_inited(priv))) {
+		r = amstream_port_init(priv);
+		if (r < 0)
+			return r;
+	}
+
+	if (!(port->type & PORT_TYPE_ES) || !(port->type & PORT_TYPE_VIDEO) ||
+		!priv->vdec || (port->flag & PORT_FLAG_DRM))
+		return -EINVAL;
+
+	pbuf = &priv->vdec->vbuf;
+	if (cmd == AMSTREAM_IOC_RING_KICK)
+		return threadrw_ring_kick(pbuf, !!arg);
+
+	r = threadrw_ring_setup(file, pbuf);
+	if (r < 0)
+		return r;
+
+	return put_user((int)r, (int __user *)arg);
+}
+
 static long amstream_do_ioctl(struct port_priv_s *priv,
 	unsigned int cmd, ulong arg)
 {
@@ -3476,6 +3562,11 @@ static long amstream_ioctl(struct file *file, unsigned int cmd, ulong arg)
 	if (!this)
 		return -ENODEV;
 
+	if (cmd == AMSTREAM_IOC_WRITE_DMABUF)
+		return amstream_ioctl_write_dmabuf(file, (void __user *)arg);
+	if (cmd == AMSTREAM_IOC_RING_SETUP || cmd == AMSTREAM_IOC_RING_KICK)
+		return amstream_ioctl_ring(file, cmd, arg);
+
 	return amstream_do_ioctl(priv, cmd, arg);
 }
 
@@ -3650,6 +3741,13 @@ static long amstream_compat_ioctl(struct file *file,
 		return amstream_set_sysinfo(priv, compat_ptr(arg));
 	case AMSTREAM_IOC_UD_BUF_READ:
 		return amstream_ioc_get_userdata(priv, compat_ptr(arg));
+	case AMSTREAM_IOC_WRITE_DMABUF:
+		return amstream_ioctl_write_dmabuf(file, compat_ptr(arg));
+	case AMSTREAM_IOC_RING_SETUP:
+		return amstream_ioctl_ring(file, cmd,
+			(ulong)compat_ptr(arg));
+	case AMSTREAM_IOC_RING_KICK:
+		return amstream_ioctl_ring(file, cmd, arg);
 	default:
 		return amstream_do_ioctl(priv, cmd, (ulong)compat_ptr(arg));
 	}
@@ -3767,6 +3865,9 @@ static int show_vbuf_status_cb(struct stream_buf_s *p, char *buf)
 	} else
 		pbuf += sprintf(pbuf, "\tbuf no used.\n");
 
+	if (p->write_thread)
+		pbuf += threadrw_stat_show(p, pbuf);
+
 	return pbuf - buf;
 }
 
@@ -3914,6 +4015,7 @@ static ssize_t bufs_show(struct class *class, struct class_attribute *attr,
 						threadrw_freefifo_len(p),
 						threadrw_passed_len(p)
 					);
+			pbuf += threadrw_stat_show(p, pbuf);
 		}
 	}
 
@@ -4158,6 +4260,21 @@ ssize_t dump_stream_store(struct class *class,
 
 
 
+static ssize_t esparser_fetch_stat_show_attr(struct class *class,
+		struct class_attribute *attr, char *buf)
+{
+	return esparser_fetch_stat_show(buf);
+}
+
+/* echo anything to clear */
+static ssize_t esparser_fetch_stat_store(struct class *class,
+		struct class_attribute *attr,
+		const char *buf, size_t size)
+{
+	esparser_fetch_stat_clear();
+	return size;
+}
+
 static struct class_attribute amstream_class_attrs[] = {
 	__ATTR_RO(ports),
 	__ATTR_RO(bufs),
@@ -4171,6 +4288,8 @@ static struct class_attribute amstream_class_attrs[] = {
 	NULL, audio_path_store),
 	__ATTR(dump_stream, S_IRUGO | S_IWUSR | S_IWGRP,
 	dump_stream_show, dump_stream_store),
+	__ATTR(esparser_fetch_stat, S_IRUGO | S_IWUSR | S_IWGRP,
+	esparser_fetch_stat_show_attr, esparser_fetch_stat_store),
 	__ATTR_NULL
 };
 
@@ -4422,12 +4541,14 @@ static int __init amstream_module_init(void)
 		pr_err("failed to init subtitle\n");
 		return -ENODEV;
 	}
+	codec_mm_selftest_register(&threadrw_ring_selftest);
 
 	return 0;
 }
 
 static void __exit amstream_module_exit(void)
 {
+	codec_mm_selftest_unregister(&threadrw_ring_selftest);
 	platform_driver_unregister(&amstream_driver);
 	subtitle_exit();
 }
@@ -314,6 +314,7 @@ static void stream_buffer_set_rp(struct stream_buf_s *stbuf, u32 val)
 
 	stbuf->buf_rp = val;
 	atomic_sub(len, &stbuf->payload);
+	stbuf_notify_space(stbuf);
 }
 
 static struct stream_buf_ops stream_buffer_ops = {
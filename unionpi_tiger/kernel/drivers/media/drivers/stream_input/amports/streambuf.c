@@ -35,8 +35,12 @@
 #include "streambuf.h"
 #include <linux/amlogic/media/utils/amports_config.h>
 #include "../amports/amports_priv.h"
+#include "thread_rw.h"
 #include <linux/dma-mapping.h>
 #include <linux/dma-contiguous.h>
+#include <linux/dma-buf.h>
+#include <linux/scatterlist.h>
+#include <linux/sched/clock.h>
 #include <linux/amlogic/media/codec_mm/codec_mm.h>
 
 #define STBUF_SIZE   (64*1024)
@@ -44,6 +48,7 @@
 #define MEM_NAME "streambuf"
 
 void *fetchbuf = 0;
+void *fetchbufs[FETCHBUF_NUM];
 
 static s32 _stbuf_alloc(struct stream_buf_s *buf, bool is_secure)
 {
@@ -170,30 +175,266 @@ int stbuf_change_size(struct stream_buf_s *buf, int size, bool is_secure)
 
 int stbuf_fetch_init(void)
 {
+	int i;
+
 	if (NULL != fetchbuf)
 		return 0;
 
-	fetchbuf = (void *)__get_free_pages(GFP_KERNEL,
+	for (i = 0; i < FETCHBUF_NUM; i++) {
+		if (fetchbufs[i])
+			continue;
+		fetchbufs[i] = (void *)__get_free_pages(GFP_KERNEL,
 						get_order(FETCHBUF_SIZE));
-
-	if (!fetchbuf) {
-		pr_info("%s: Can not allocate fetch working buffer\n",
-				__func__);
-		return -ENOMEM;
+		if (!fetchbufs[i]) {
+			pr_info("%s: Can not allocate fetch working buffer\n",
+					__func__);
+			return -ENOMEM;
+		}
 	}
+	/* single buffer users (psparser, rmparser) keep the first one */
+	fetchbuf = fetchbufs[0];
 	return 0;
 }
 EXPORT_SYMBOL(stbuf_fetch_init);
 
 void stbuf_fetch_release(void)
 {
+	int i;
+
 	if (0 && fetchbuf) {
 		/* always don't free.for safe alloc/free*/
-		free_pages((unsigned long)fetchbuf, get_order(FETCHBUF_SIZE));
+		for (i = 0; i < FETCHBUF_NUM; i++) {
+			free_pages((unsigned long)fetchbufs[i],
+				get_order(FETCHBUF_SIZE));
+			fetchbufs[i] = NULL;
+		}
 		fetchbuf = 0;
 	}
 }
 
+ssize_t stbuf_fetch_stat_show(struct stbuf_fetch_stat_s *stat, char *buf)
+{
+	char *pbuf = buf;
+	u64 bytes = stat->bytes + stat->dmabuf_bytes;
+	u64 busy_us = div_u64(stat->busy_ns, NSEC_PER_USEC);
+
+	pbuf += sprintf(pbuf, "writes: %u (dmabuf %u)\n",
+		stat->writes, stat->dmabuf_writes);
+	pbuf += sprintf(pbuf, "bytes: %llu (dmabuf %llu)\n",
+		bytes, stat->dmabuf_bytes);
+	pbuf += sprintf(pbuf, "fetch cmds: %u, timeouts: %u\n",
+		stat->chunks, stat->timeouts);
+	pbuf += sprintf(pbuf, "busy: %llu us, copy: %llu us, stall: %llu us\n",
+		busy_us, div_u64(stat->copy_ns, NSEC_PER_USEC),
+		div_u64(stat->stall_ns, NSEC_PER_USEC));
+	pbuf += sprintf(pbuf, "throughput: %llu KB/s\n",
+		busy_us ? div64_u64(bytes * 1000, busy_us) : 0);
+	return pbuf - buf;
+}
+EXPORT_SYMBOL(stbuf_fetch_stat_show);
+
+/*
+ * Map a dma-buf for the parser fetch engine. The parser reads it by
+ * dma address, nothing is copied or touched by the cpu.
+ */
+int stbuf_dmabuf_import(int fd, struct stbuf_dmabuf_s *d)
+{
+	struct device *dev = amports_get_dma_device();
+	int ret;
+
+	memset(d, 0, sizeof(*d));
+	d->dbuf = dma_buf_get(fd);
+	if (IS_ERR_OR_NULL(d->dbuf)) {
+		pr_err("%s: dma_buf_get fd %d failed\n", __func__, fd);
+		d->dbuf = NULL;
+		return -EBADF;
+	}
+
+	d->attach = dma_buf_attach(d->dbuf, dev);
+	if (IS_ERR_OR_NULL(d->attach)) {
+		ret = d->attach ? PTR_ERR(d->attach) : -EINVAL;
+		goto err_put;
+	}
+
+	d->sgt = dma_buf_map_attachment(d->attach, DMA_TO_DEVICE);
+	if (IS_ERR_OR_NULL(d->sgt)) {
+		ret = d->sgt ? PTR_ERR(d->sgt) : -EINVAL;
+		goto err_detach;
+	}
+	return 0;
+
+err_detach:
+	dma_buf_detach(d->dbuf, d->attach);
+err_put:
+	dma_buf_put(d->dbuf);
+	memset(d, 0, sizeof(*d));
+	pr_err("%s: map fd %d failed %d\n", __func__, fd, ret);
+	return ret;
+}
+EXPORT_SYMBOL(stbuf_dmabuf_import);
+
+void stbuf_dmabuf_release(struct stbuf_dmabuf_s *d)
+{
+	if (!d->dbuf)
+		return;
+	dma_buf_unmap_attachment(d->attach, d->sgt, DMA_TO_DEVICE);
+	dma_buf_detach(d->dbuf, d->attach);
+	dma_buf_put(d->dbuf);
+	memset(d, 0, sizeof(*d));
+}
+EXPORT_SYMBOL(stbuf_dmabuf_release);
+
+/* one dma-buf fetch command, below the 27 bit FETCH_CMD length */
+#define STBUF_FETCH_MAX_LEN	(1 << 20)
+
+static u32 fetch_slot;
+
+/*
+ * Copy user data through the fetch buffer ring: while the parser
+ * fetches chunk k, chunk k + 1 is copied into the next buffer.
+ * Returns the bytes the parser took, or the error if none.
+ */
+ssize_t stbuf_fetch_write(const char __user *buf, size_t count,
+	const struct stbuf_fetch_ops *ops, void *priv,
+	struct stbuf_fetch_stat_s *stat)
+{
+	struct device *dev = amports_get_dma_device();
+	const char __user *p = buf;
+	size_t r = count;
+	size_t done = 0;
+	dma_addr_t busy_addr = 0;
+	u32 busy_len = 0;
+	u64 start = local_clock();
+	u64 t;
+	int ret = 0;
+
+	while (r > 0 || busy_len) {
+		dma_addr_t dma_addr = 0;
+		u32 len = 0;
+
+		if (r > 0 && !ret) {
+			void *vbuf = fetchbufs[fetch_slot];
+
+			len = min_t(size_t, r, FETCHBUF_SIZE);
+			t = local_clock();
+			if (copy_from_user(vbuf, p, len)) {
+				ret = -EFAULT;
+				len = 0;
+			} else {
+				stat->copy_ns += local_clock() - t;
+				dma_addr = dma_map_single(dev, vbuf, len,
+						DMA_TO_DEVICE);
+				if (dma_mapping_error(dev, dma_addr)) {
+					ret = -EFAULT;
+					len = 0;
+				}
+			}
+		}
+
+		if (busy_len) {
+			int err;
+
+			t = local_clock();
+			err = ops->wait(priv);
+			stat->stall_ns += local_clock() - t;
+			dma_unmap_single(dev, busy_addr, busy_len,
+					DMA_TO_DEVICE);
+			if (err < 0) {
+				if (err == -EAGAIN)
+					stat->timeouts++;
+				if (len)
+					dma_unmap_single(dev, dma_addr, len,
+							DMA_TO_DEVICE);
+				ret = err;
+				break;
+			}
+			done += busy_len;
+			busy_len = 0;
+		}
+
+		if (!len)
+			break;
+
+		ops->start(priv, dma_addr, len);
+		stat->chunks++;
+		busy_addr = dma_addr;
+		busy_len = len;
+		fetch_slot = (fetch_slot + 1) % FETCHBUF_NUM;
+		p += len;
+		r -= len;
+	}
+
+	stat->writes++;
+	stat->bytes += done;
+	stat->busy_ns += local_clock() - start;
+
+	return done ? done : ret;
+}
+EXPORT_SYMBOL(stbuf_fetch_write);
+
+/*
+ * Let the parser fetch [offset, offset + count) of an imported
+ * dma-buf, one command per scatterlist segment.
+ */
+ssize_t stbuf_fetch_write_dmabuf(struct stbuf_dmabuf_s *d,
+	u32 offset, u32 count, const struct stbuf_fetch_ops *ops,
+	void *priv, struct stbuf_fetch_stat_s *stat)
+{
+	struct scatterlist *sg;
+	u64 skip = offset;
+	u32 done = 0;
+	u64 start = local_clock();
+	u64 t;
+	int ret = 0;
+	int i;
+
+	for_each_sg(d->sgt->sgl, sg, d->sgt->nents, i) {
+		dma_addr_t addr = sg_dma_address(sg);
+		u32 seg_len = sg_dma_len(sg);
+
+		if (skip >= seg_len) {
+			skip -= seg_len;
+			continue;
+		}
+		addr += skip;
+		seg_len -= skip;
+		skip = 0;
+
+		while (seg_len && done < count) {
+			u32 len = min3(seg_len, count - done,
+					(u32)STBUF_FETCH_MAX_LEN);
+
+			if (upper_32_bits(addr + len - 1)) {
+				ret = -EINVAL;
+				goto out;
+			}
+			ops->start(priv, addr, len);
+			stat->chunks++;
+			t = local_clock();
+			ret = ops->wait(priv);
+			stat->stall_ns += local_clock() - t;
+			if (ret < 0) {
+				if (ret == -EAGAIN)
+					stat->timeouts++;
+				goto out;
+			}
+			addr += len;
+			seg_len -= len;
+			done += len;
+		}
+		if (done >= count)
+			break;
+	}
+
+out:
+	stat->dmabuf_writes++;
+	stat->dmabuf_bytes += done;
+	stat->busy_ns += local_clock() - start;
+
+	return done ? done : ret;
+}
+EXPORT_SYMBOL(stbuf_fetch_write_dmabuf);
+
 static void _stbuf_timer_func(unsigned long arg)
 {
 	struct stream_buf_s *p = (struct stream_buf_s *)arg;
@@ -427,6 +668,21 @@ s32 stbuf_wait_space(struct stream_buf_s *stream_buf, size_t count)
 	return 0;
 }
 
+/*
+ * Called when the read pointer is moved by software. Wakes a writer
+ * sleeping in stbuf_wait_space() as soon as its wcnt bytes are free
+ * instead of leaving it to the next STBUF_WAIT_INTERVAL poll; the
+ * timer still covers read pointers only the hardware moves.
+ */
+void stbuf_notify_space(struct stream_buf_s *buf)
+{
+	if (waitqueue_active(&buf->wq) && stbuf_space(buf) >= buf->wcnt)
+		wake_up_interruptible(&buf->wq);
+
+	threadrw_notify_space(buf);
+}
+EXPORT_SYMBOL(stbuf_notify_space);
+
 void stbuf_release(struct stream_buf_s *buf)
 {
 	int r;
@@ -489,6 +745,7 @@ EXPORT_SYMBOL(parser_get_rp);
 void parser_set_rp(struct stream_buf_s *vb, u32 val)
 {
 	WRITE_PARSER_REG(PARSER_VIDEO_RP, val);
+	stbuf_notify_space(vb);
 }
 EXPORT_SYMBOL(parser_set_rp);
 
@@ -35,10 +35,47 @@
 #define INVALID_PTS 0xffffffff
 
 #define FETCHBUF_SIZE   (64*1024)
+/*
+ * The parser takes one fetch command at a time, two buffers are
+ * enough to copy the next chunk while the current one is fetched.
+ */
+#define FETCHBUF_NUM    2
 #define USER_DATA_SIZE  (8*1024)
 
 struct vdec_s;
 struct stream_buf_s;
+struct dma_buf;
+struct dma_buf_attachment;
+struct sg_table;
+
+/* write statistics of a parser fetch path */
+struct stbuf_fetch_stat_s {
+	u64 bytes;		/* fetched from fetch buffers */
+	u64 dmabuf_bytes;	/* fetched straight from imported dma-bufs */
+	u32 writes;
+	u32 dmabuf_writes;
+	u32 chunks;		/* fetch commands issued */
+	u32 timeouts;
+	u64 copy_ns;		/* copy_from_user into the fetch buffers */
+	u64 stall_ns;		/* writer blocked on a fetch to finish */
+	u64 busy_ns;		/* write calls, entry to last fetch done */
+};
+
+struct stbuf_dmabuf_s {
+	struct dma_buf *dbuf;
+	struct dma_buf_attachment *attach;
+	struct sg_table *sgt;
+};
+
+/*
+ * Parser hooks of the pipelined fetch. start() issues one fetch
+ * command and returns, wait() blocks until it is done: 0 on success,
+ * -EAGAIN when nothing was fetched, -ERESTARTSYS on a signal.
+ */
+struct stbuf_fetch_ops {
+	void (*start)(void *priv, dma_addr_t addr, u32 len);
+	int (*wait)(void *priv);
+};
 
 struct parser_args {
 	u32 vid;
@@ -145,6 +182,7 @@ struct drm_info {
 struct vdec_s;
 
 extern void *fetchbuf;
+extern void *fetchbufs[FETCHBUF_NUM];
 
 extern u32 stbuf_level(struct stream_buf_s *buf);
 extern u32 stbuf_rp(struct stream_buf_s *buf);
@@ -153,11 +191,22 @@ extern u32 stbuf_size(struct stream_buf_s *buf);
 extern u32 stbuf_canusesize(struct stream_buf_s *buf);
 extern s32 stbuf_init(struct stream_buf_s *buf, struct vdec_s *vdec);
 extern s32 stbuf_wait_space(struct stream_buf_s *stream_buf, size_t count);
+extern void stbuf_notify_space(struct stream_buf_s *buf);
 extern void stbuf_release(struct stream_buf_s *buf);
 extern int stbuf_change_size(struct stream_buf_s *buf, int size,
 				bool is_secure);
 extern int stbuf_fetch_init(void);
 extern void stbuf_fetch_release(void);
+extern ssize_t stbuf_fetch_stat_show(struct stbuf_fetch_stat_s *stat,
+	char *buf);
+extern int stbuf_dmabuf_import(int fd, struct stbuf_dmabuf_s *d);
+extern void stbuf_dmabuf_release(struct stbuf_dmabuf_s *d);
+extern ssize_t stbuf_fetch_write(const char __user *buf, size_t count,
+	const struct stbuf_fetch_ops *ops, void *priv,
+	struct stbuf_fetch_stat_s *stat);
+extern ssize_t stbuf_fetch_write_dmabuf(struct stbuf_dmabuf_s *d,
+	u32 offset, u32 count, const struct stbuf_fetch_ops *ops,
+	void *priv, struct stbuf_fetch_stat_s *stat);
 extern u32 stbuf_sub_rp_get(void);
 extern void stbuf_sub_rp_set(unsigned int sub_rp);
 extern u32 stbuf_sub_wp_get(void);
@@ -28,7 +28,10 @@
 #include <linux/uaccess.h>
 #include <linux/fs.h>
 #include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
 #include <linux/amlogic/media/codec_mm/codec_mm.h>
+#include <linux/amlogic/media/utils/amstream.h>
 
 /* #include <mach/am_regs.h> */
 #include <linux/delay.h>
@@ -41,6 +44,16 @@
 
 #define DEFAULT_BLOCK_SIZE (64*1024)
 
+/*
+ *stream buffer full: the write work waits for threadrw_notify_space(),
+ *WAIT_SPACE_DELAY is only a fallback. Read pointers only the hardware
+ *moves (single instance) are never reported, those stream buffers are
+ *polled every POLL_SPACE_DELAY as before.
+ */
+#define WAIT_SPACE_DELAY (HZ / 100)
+#define POLL_SPACE_DELAY (HZ / 10)
+#define ERROR_RETRY_DELAY (HZ / 10)
+
 struct threadrw_buf {
 	void *vbuffer;
 	dma_addr_t dma_handle;
@@ -48,6 +61,7 @@ struct threadrw_buf {
 	int data_size;
 	int buffer_size;
 	int from_cma;
+	int ring_busy;
 };
 
 #define MAX_MM_BUFFER_NUM 16
@@ -72,6 +86,15 @@ struct threadrw_write_task {
 	int manual_write;
 	int failed_onmore;
 	wait_queue_head_t wq;
+	atomic_t space_seq;
+	int wait_space;
+	int rp_notify;		/*threadrw_notify_space() was called */
+	u64 notify_ns;
+	struct am_ring_s *ring;
+	u32 ring_map_size;
+	u32 ring_sub_tail;
+	u32 ring_done_head;
+	struct threadrw_stat stat;
 	ssize_t (*write)(struct file *,
 		struct stream_buf_s *,
 		const char __user *,
@@ -82,6 +105,21 @@ struct threadrw_write_task {
 
 static int free_task_buffers(struct threadrw_write_task *task);
 
+/*
+ *hands a written buffer back to userspace, in the task mutex.
+ */
+static void threadrw_ring_done(struct threadrw_write_task *task,
+	struct threadrw_buf *rwbuf)
+{
+	struct am_ring_s *ring = task->ring;
+
+	rwbuf->ring_busy = 0;
+	ring->done[task->ring_done_head % AM_RING_MAX_BUFS] =
+		rwbuf - task->buf;
+	smp_wmb();
+	WRITE_ONCE(ring->done_head, ++task->ring_done_head);
+}
+
 static struct workqueue_struct *threadrw_wq_get(void)
 {
 	static struct workqueue_struct *threadrw_wq;
@@ -131,10 +169,11 @@ static ssize_t threadrw_write_onece(
 
 	to_write = min_t(u32, rwbuf->buffer_size, count);
 	if (copy_from_user(rwbuf->vbuffer, buf, to_write)) {
-		kfifo_put(&task->freefifo, (const void *)buf);
+		kfifo_put(&task->freefifo, (const void *)rwbuf);
 		ret = -EFAULT;
 		goto err;
 	}
+	task->stat.copy_bytes += to_write;
 	rwbuf->data_size = to_write;
 	rwbuf->write_off = 0;
 	kfifo_put(&task->datafifo, (const void *)rwbuf);
@@ -232,14 +271,18 @@ static int do_write_work_in(struct threadrw_write_task *task)
 		rwbuf->data_size,
 		3);	/* noblock,phy addr */
 	}
-	if (ret == -EAGAIN) {
-		need_re_write = 0;
-		/*do later retry. */
+	if (ret == -EAGAIN || ret == 0) {
+		need_re_write = -EAGAIN;
+		/*retry on the next read pointer advance. */
 	} else if (ret >= rwbuf->data_size) {
 		write_len += rwbuf->data_size;
 		if (kfifo_get(&task->datafifo, (void *)&rwbuf)) {
 			rwbuf->data_size = 0;
-			kfifo_put(&task->freefifo, (const void *)rwbuf);
+			if (task->ring)
+				threadrw_ring_done(task, rwbuf);
+			else
+				kfifo_put(&task->freefifo,
+					(const void *)rwbuf);
 			/*wakeup write thread. */
 			wake_up_interruptible(&task->wq);
 		} else
@@ -250,10 +293,11 @@ static int do_write_work_in(struct threadrw_write_task *task)
 		rwbuf->write_off += ret;
 		write_len += ret;
 		need_re_write = 1;
-	} else {		/*ret <=0 */
+	} else {		/*ret <0 */
 		pr_err("get errors ret=%d size=%d\n", ret,
 			rwbuf->data_size);
 		task->errors = ret;
+		need_re_write = ret;
 	}
 	if (write_len > 0) {
 		spin_lock_irqsave(&task->lock, flags);
@@ -264,20 +308,55 @@ static int do_write_work_in(struct threadrw_write_task *task)
 
 }
 
+static void threadrw_wake_stat(struct threadrw_write_task *task)
+{
+	struct threadrw_stat *stat = &task->stat;
+	u64 notify_ns = READ_ONCE(task->notify_ns);
+	u64 ns;
+
+	if (xchg(&task->wait_space, 0)) {
+		stat->wakeups++;
+	} else if (notify_ns) {
+		ns = ktime_get_ns() - notify_ns;
+		task->notify_ns = 0;
+		stat->wake_total_ns += ns;
+		if (ns > stat->wake_max_ns)
+			stat->wake_max_ns = ns;
+	}
+}
+
 static void do_write_work(struct work_struct *work)
 {
 	struct threadrw_write_task *task = container_of(work,
 					struct threadrw_write_task,
 					write_work.work);
 	int need_retry = 1;
+	int seq;
 
 	task->writework_on = 1;
-	while (need_retry) {
+	threadrw_wake_stat(task);
+	while (need_retry > 0) {
+		seq = atomic_read(&task->space_seq);
 		mutex_lock(&task->mutex);
 		need_retry = do_write_work_in(task);
 		mutex_unlock(&task->mutex);
+		if (need_retry != -EAGAIN)
+			continue;
+
+		task->stat.retries++;
+		xchg(&task->wait_space, 1);
+		/*the read pointer moved meanwhile, don't wait for it. */
+		if (atomic_read(&task->space_seq) != seq) {
+			if (xchg(&task->wait_space, 0))
+				need_retry = 1;
+			continue;
+		}
+		threadrw_schedule_delayed_work(task,
+			READ_ONCE(task->rp_notify) ?
+			WAIT_SPACE_DELAY : POLL_SPACE_DELAY);
 	}
-	threadrw_schedule_delayed_work(task, HZ / 10);
+	if (need_retry < 0 && need_retry != -EAGAIN)
+		threadrw_schedule_delayed_work(task, ERROR_RETRY_DELAY);
 	task->writework_on = 0;
 }
 
@@ -542,6 +621,8 @@ ssize_t threadrw_write(struct file *file, struct stream_buf_s *stbuf,
 	struct threadrw_write_task *task = stbuf->write_thread;
 	ssize_t size;
 
+	if (task->ring)
+		return -EBUSY;
 	if (!task->file) {
 		task->file = file;
 		task->sbuf = stbuf;
@@ -561,7 +642,9 @@ int threadrw_flush_buffers(struct stream_buf_s *stbuf)
 		return 0;
 	while (!kfifo_is_empty(&task->datafifo) && max_retry-- > 0) {
 		threadrw_schedule_delayed_work(task, 0);
-		msleep(20);
+		wait_event_timeout(task->wq,
+			kfifo_is_empty(&task->datafifo),
+			msecs_to_jiffies(20));
 	}
 	if (!kfifo_is_empty(&task->datafifo))
 		return -1;/*data not flushed*/
@@ -577,7 +660,7 @@ int threadrw_alloc_more_buffer_size(
 	int ret = -1;
 	int old_num;
 
-	if (!task)
+	if (!task || task->ring)
 		return -1;
 	mutex_lock(&task->mutex);
 	block_size = task->def_block_size;
@@ -624,7 +707,224 @@ void threadrw_release(struct stream_buf_s *stbuf)
 		mutex_unlock(&task->mutex);
 		kfifo_free(&task->freefifo);
 		kfifo_free(&task->datafifo);
+		if (task->ring)
+			free_page((unsigned long)task->ring);
 		vfree(task);
 	}
 	stbuf->write_thread = NULL;
 }
+
+/*
+ *called whenever the stream buffer read pointer advances, restarts a
+ *write work waiting for space right away.
+ */
+void threadrw_notify_space(struct stream_buf_s *stbuf)
+{
+	struct threadrw_write_task *task = stbuf->write_thread;
+
+	if (!task)
+		return;
+	if (!READ_ONCE(task->rp_notify))
+		WRITE_ONCE(task->rp_notify, 1);
+	atomic_inc(&task->space_seq);
+	smp_mb__after_atomic();
+	if (READ_ONCE(task->wait_space) && xchg(&task->wait_space, 0)) {
+		task->notify_ns = ktime_get_ns();
+		task->stat.notifies++;
+		threadrw_schedule_delayed_work(task, 0);
+	}
+}
+EXPORT_SYMBOL(threadrw_notify_space);
+
+/*
+ *switches the task to the shared ring, see struct am_ring_s.
+ *returns the mmap length.
+ */
+int threadrw_ring_setup(struct file *file, struct stream_buf_s *stbuf)
+{
+	struct threadrw_write_task *task = stbuf->write_thread;
+	struct am_ring_s *ring;
+	struct threadrw_buf *rwbuf;
+	u32 off = PAGE_SIZE;
+	int i, ret;
+
+	if (!task)
+		return -ENODEV;
+	mutex_lock(&task->mutex);
+	if (task->ring) {
+		ret = task->ring_map_size;
+		goto out;
+	}
+	ret = -EOPNOTSUPP;
+	if (task->manual_write || task->bufs_num > AM_RING_MAX_BUFS)
+		goto out;
+	/*only codec_mm buffers are physically contiguous to map. */
+	for (i = 0; i < task->bufs_num; i++) {
+		rwbuf = &task->buf[i];
+		if (!rwbuf->from_cma || !PAGE_ALIGNED(rwbuf->dma_handle))
+			goto out;
+	}
+	ret = -EBUSY;
+	if (!kfifo_is_empty(&task->datafifo))
+		goto out;
+	ring = (struct am_ring_s *)get_zeroed_page(GFP_KERNEL);
+	ret = -ENOMEM;
+	if (!ring)
+		goto out;
+
+	ring->version = AM_RING_VERSION;
+	ring->buf_num = task->bufs_num;
+	for (i = 0; i < task->bufs_num; i++) {
+		ring->buf_off[i] = off;
+		ring->buf_size[i] = task->buf[i].buffer_size;
+		task->buf[i].ring_busy = 0;
+		off += PAGE_ALIGN(task->buf[i].buffer_size);
+	}
+	/*all buffers belong to userspace now. */
+	kfifo_reset(&task->freefifo);
+	task->file = file;
+	task->sbuf = stbuf;
+	task->ring_sub_tail = 0;
+	task->ring_done_head = 0;
+	task->ring_map_size = off;
+	task->ring = ring;
+	ret = off;
+out:
+	mutex_unlock(&task->mutex);
+	return ret;
+}
+
+/*
+ *queues the buffers userspace submitted to the ring. with wait, blocks
+ *until a written buffer is ready for userspace to reuse.
+ */
+int threadrw_ring_kick(struct stream_buf_s *stbuf, int wait)
+{
+	struct threadrw_write_task *task = stbuf->write_thread;
+	struct am_ring_s *ring;
+	struct threadrw_buf *rwbuf;
+	unsigned long flags;
+	u32 head, idx, len;
+	int queued = 0, bytes = 0, ret = 0;
+
+	if (!task || !task->ring)
+		return -EINVAL;
+	ring = task->ring;
+	mutex_lock(&task->mutex);
+	head = READ_ONCE(ring->sub_head);
+	smp_rmb();
+	while (task->ring_sub_tail != head) {
+		struct am_ring_desc_s *desc =
+			&ring->sub[task->ring_sub_tail % AM_RING_MAX_BUFS];
+
+		idx = READ_ONCE(desc->idx);
+		len = READ_ONCE(desc->len);
+		if (idx >= task->bufs_num) {
+			ret = -EINVAL;
+			break;
+		}
+		rwbuf = &task->buf[idx];
+		if (rwbuf->ring_busy || !len || len > rwbuf->buffer_size) {
+			ret = -EINVAL;
+			break;
+		}
+		rwbuf->ring_busy = 1;
+		rwbuf->data_size = len;
+		rwbuf->write_off = 0;
+		kfifo_put(&task->datafifo, (const void *)rwbuf);
+		task->ring_sub_tail++;
+		bytes += len;
+		queued++;
+	}
+	WRITE_ONCE(ring->sub_tail, task->ring_sub_tail);
+	task->stat.ring_bufs += queued;
+	task->stat.ring_bytes += bytes;
+	mutex_unlock(&task->mutex);
+
+	if (queued) {
+		spin_lock_irqsave(&task->lock, flags);
+		task->buffered_data_size += bytes;
+		task->data_offset += bytes;
+		spin_unlock_irqrestore(&task->lock, flags);
+		threadrw_schedule_delayed_work(task, 0);
+	}
+	if (ret < 0)
+		return ret;
+	if (wait && wait_event_interruptible(task->wq,
+			task->ring_done_head != READ_ONCE(ring->done_tail) ||
+			task->errors))
+		return -ERESTARTSYS;
+	return task->errors ? task->errors : queued;
+}
+
+int threadrw_mmap(struct stream_buf_s *stbuf, struct vm_area_struct *vma)
+{
+	struct threadrw_write_task *task = stbuf->write_thread;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long off = PAGE_SIZE, len;
+	int i, ret;
+
+	if (!task || !task->ring)
+		return -EINVAL;
+	if (vma->vm_pgoff || size > task->ring_map_size)
+		return -EINVAL;
+	mutex_lock(&task->mutex);
+	vma->vm_flags |= VM_IO | VM_DONTEXPAND | VM_DONTDUMP;
+	ret = remap_pfn_range(vma, vma->vm_start,
+		virt_to_phys(task->ring) >> PAGE_SHIFT,
+		PAGE_SIZE, vma->vm_page_prot);
+	/*offsets from the task, userspace may scribble on the ring. */
+	for (i = 0; !ret && i < task->bufs_num && off < size; i++) {
+		len = min_t(unsigned long,
+			PAGE_ALIGN(task->buf[i].buffer_size), size - off);
+		ret = remap_pfn_range(vma, vma->vm_start + off,
+			task->buf[i].dma_handle >> PAGE_SHIFT,
+			len, vma->vm_page_prot);
+		off += len;
+	}
+	mutex_unlock(&task->mutex);
+	return ret;
+}
+
+struct am_ring_s *threadrw_ring(struct stream_buf_s *stbuf)
+{
+	struct threadrw_write_task *task = stbuf->write_thread;
+
+	return task ? task->ring : NULL;
+}
+
+void threadrw_get_stat(struct stream_buf_s *stbuf,
+	struct threadrw_stat *stat)
+{
+	struct threadrw_write_task *task = stbuf->write_thread;
+
+	if (task)
+		*stat = task->stat;
+	else
+		memset(stat, 0, sizeof(*stat));
+}
+
+int threadrw_stat_show(struct stream_buf_s *stbuf, char *buf)
+{
+	struct threadrw_write_task *task = stbuf->write_thread;
+	struct threadrw_stat *stat;
+	char *pbuf = buf;
+
+	if (!task)
+		return 0;
+	stat = &task->stat;
+	pbuf += sprintf(pbuf,
+		"	write thread retries:%u, notifies:%u, wakeups:%u\n",
+		stat->retries, stat->notifies, stat->wakeups);
+	pbuf += sprintf(pbuf,
+		"	write thread wake latency ave:%lluus, max:%lluus\n",
+		stat->notifies ? div_u64(div_u64(stat->wake_total_ns,
+		stat->notifies), NSEC_PER_USEC) : 0,
+		div_u64(stat->wake_max_ns, NSEC_PER_USEC));
+	pbuf += sprintf(pbuf,
+		"	write thread copied:%llu, ring:%llu in %u bufs%s\n",
+		stat->copy_bytes, stat->ring_bytes, stat->ring_bufs,
+		task->ring ? " (ring mode)" : "");
+	return pbuf - buf;
+}
+
@@ -22,6 +22,17 @@
 #include "../../stream_input/parser/esparser.h"
 #include "../../stream_input/amports/amports_priv.h"
 
+struct threadrw_stat {
+	u32 retries;		/*stream buffer full */
+	u32 notifies;		/*woken by a read pointer advance */
+	u32 wakeups;		/*woken by new data or the fallback */
+	u64 copy_bytes;		/*write() */
+	u64 ring_bytes;		/*ring kick, no copy */
+	u32 ring_bufs;
+	u64 wake_total_ns;	/*notify to write work running */
+	u64 wake_max_ns;
+};
+
 ssize_t threadrw_write(struct file *file,
 		struct stream_buf_s *stbuf,
 		const char __user *buf,
@@ -50,4 +61,14 @@ int threadrw_alloc_more_buffer_size(
 int threadrw_support_more_buffers(struct stream_buf_s *stbuf);
 void threadrw_update_buffer_level(struct stream_buf_s *stbuf,
 	int parsed_size);
+void threadrw_notify_space(struct stream_buf_s *stbuf);
+int threadrw_ring_setup(struct file *file, struct stream_buf_s *stbuf);
+int threadrw_ring_kick(struct stream_buf_s *stbuf, int wait);
+int threadrw_mmap(struct stream_buf_s *stbuf, struct vm_area_struct *vma);
+/*the kernel side of the mapping, for the ring self test.*/
+struct am_ring_s *threadrw_ring(struct stream_buf_s *stbuf);
+void threadrw_get_stat(struct stream_buf_s *stbuf,
+	struct threadrw_stat *stat);
+int threadrw_stat_show(struct stream_buf_s *stbuf, char *buf);
+extern struct codec_mm_selftest_s threadrw_ring_selftest;
 #endif
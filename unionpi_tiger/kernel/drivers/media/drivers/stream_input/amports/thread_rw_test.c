@@ -0,0 +1,222 @@
+/*
+ * drivers/amlogic/media/stream_input/amports/thread_rw_test.c
+ *
+ * Copyright (C) 2016 Amlogic, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/spinlock.h>
+#include <linux/sizes.h>
+#include <linux/amlogic/media/codec_mm/codec_mm.h>
+#include <linux/amlogic/media/utils/amstream.h>
+
+#include "streambuf.h"
+#include "thread_rw.h"
+
+/*
+ *Ring self test. Buffers are submitted to the shared write ring of a
+ *stand-in stream buffer that is much smaller than the ring, so the
+ *write work keeps finding it full. A reader thread drains it in small
+ *steps and reports every read pointer advance with
+ *threadrw_notify_space(), which has to restart the waiting write work.
+ *Done buffers must come back in submit order and every byte has to
+ *arrive:
+ *	echo "threadrw_ring <bufs> <stream buffer size>" \
+ *		> /sys/class/codec_mm/selftest
+ */
+#define RING_TEST_BUFS 2000
+#define RING_TEST_BUF_NUM 8
+#define RING_TEST_BLOCK_SIZE (64 * SZ_1K)
+#define RING_TEST_STBUF_SIZE (16 * SZ_1K)
+#define RING_TEST_READ_SIZE (4 * SZ_1K)
+
+struct ring_test_s {
+	struct stream_buf_s stbuf;
+	spinlock_t lock;
+	u32 size;
+	u32 level;
+	u64 written;
+	u64 read;
+	u32 full;
+	int errors;
+};
+
+static ssize_t ring_test_write(struct file *file,
+	struct stream_buf_s *stbuf, const char __user *buf,
+	size_t count, int flags)
+{
+	struct ring_test_s *t = container_of(stbuf, struct ring_test_s, stbuf);
+	unsigned long irqflags;
+	u32 len;
+
+	spin_lock_irqsave(&t->lock, irqflags);
+	len = min_t(u32, count, t->size - t->level);
+	t->level += len;
+	t->written += len;
+	if (!len)
+		t->full++;
+	spin_unlock_irqrestore(&t->lock, irqflags);
+	return len ? len : -EAGAIN;
+}
+
+static int ring_test_read_thread(void *data)
+{
+	struct ring_test_s *t = data;
+	unsigned long flags;
+	u32 len;
+
+	while (!kthread_should_stop()) {
+		spin_lock_irqsave(&t->lock, flags);
+		len = min_t(u32, t->level, RING_TEST_READ_SIZE);
+		t->level -= len;
+		t->read += len;
+		spin_unlock_irqrestore(&t->lock, flags);
+		if (len)
+			threadrw_notify_space(&t->stbuf);
+		usleep_range(100, 200);
+	}
+	return 0;
+}
+
+/*takes the done buffers back, they have to come in submit order.*/
+static int ring_test_reap(struct ring_test_s *t, struct am_ring_s *ring,
+	u32 *done)
+{
+	u32 head = READ_ONCE(ring->done_head);
+	u32 idx;
+	int n = 0;
+
+	smp_rmb();
+	while (ring->done_tail != head) {
+		idx = ring->done[ring->done_tail % AM_RING_MAX_BUFS];
+		if (idx != *done % ring->buf_num) {
+			if (t->errors++ < 16)
+				pr_err("ring test: done %u is buf %u\n",
+					*done, idx);
+		}
+		(*done)++;
+		n++;
+		smp_mb();
+		WRITE_ONCE(ring->done_tail, ring->done_tail + 1);
+	}
+	return n;
+}
+
+static int threadrw_ring_test(int bufs, int stbuf_size)
+{
+	struct ring_test_s *t;
+	struct am_ring_s *ring;
+	struct task_struct *reader;
+	struct threadrw_stat stat;
+	u32 sub = 0, done = 0, idx, len;
+	u64 bytes = 0, start, ns;
+	int ret;
+
+	if (bufs <= 0)
+		bufs = RING_TEST_BUFS;
+	if (stbuf_size < RING_TEST_READ_SIZE ||
+		stbuf_size >= RING_TEST_BLOCK_SIZE)
+		stbuf_size = RING_TEST_STBUF_SIZE;
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	spin_lock_init(&t->lock);
+	t->size = stbuf_size;
+	t->stbuf.write_thread = threadrw_alloc(RING_TEST_BUF_NUM,
+		RING_TEST_BLOCK_SIZE, ring_test_write, 0);
+	if (!t->stbuf.write_thread) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	ret = threadrw_ring_setup(NULL, &t->stbuf);
+	if (ret < 0) {
+		pr_err("ring test: ring setup failed %d\n", ret);
+		goto out;
+	}
+	ring = threadrw_ring(&t->stbuf);
+
+	reader = kthread_run(ring_test_read_thread, t, "threadrw_ring_test");
+	if (IS_ERR(reader)) {
+		ret = PTR_ERR(reader);
+		goto out;
+	}
+
+	start = ktime_get_ns();
+	while (done < bufs && !t->errors) {
+		if (sub < bufs && sub - done < ring->buf_num) {
+			/*free buffers come back in order, reuse round robin*/
+			idx = sub % ring->buf_num;
+			len = ring->buf_size[idx] - (sub % 7) * 512;
+			ring->sub[sub % AM_RING_MAX_BUFS].idx = idx;
+			ring->sub[sub % AM_RING_MAX_BUFS].len = len;
+			smp_wmb();
+			WRITE_ONCE(ring->sub_head, ++sub);
+			bytes += len;
+			ret = threadrw_ring_kick(&t->stbuf, 0);
+		} else {
+			ret = threadrw_ring_kick(&t->stbuf, 1);
+		}
+		if (ret < 0) {
+			pr_err("ring test: kick %u returned %d\n", sub, ret);
+			t->errors++;
+			break;
+		}
+		ring_test_reap(t, ring, &done);
+	}
+	ns = ktime_get_ns() - start;
+	kthread_stop(reader);
+
+	threadrw_get_stat(&t->stbuf, &stat);
+	if (t->written != bytes || t->read + t->level != bytes) {
+		t->errors++;
+		pr_err("ring test: %llu bytes submitted, %llu written, %llu read\n",
+			bytes, t->written, t->read + t->level);
+	}
+	if (!t->errors && (!t->full || !stat.notifies)) {
+		t->errors++;
+		pr_err("ring test: full %u times, %u notifies, wait path not taken\n",
+			t->full, stat.notifies);
+	}
+	pr_info("ring test: %u bufs %llu bytes in %llu ms, %d errors\n",
+		done, bytes, div_u64(ns, NSEC_PER_MSEC), t->errors);
+	pr_info("ring test: full %u, retries %u, notifies %u, wakeups %u, wake ave %llu us max %llu us\n",
+		t->full, stat.retries, stat.notifies, stat.wakeups,
+		stat.notifies ? div_u64(div_u64(stat.wake_total_ns,
+			stat.notifies), NSEC_PER_USEC) : 0,
+		div_u64(stat.wake_max_ns, NSEC_PER_USEC));
+	ret = t->errors ? -EINVAL : 0;
+out:
+	threadrw_release(&t->stbuf);
+out_free:
+	kfree(t);
+	return ret;
+}
+
+/*"<bufs> <stream buffer size>"*/
+static int threadrw_ring_selftest_run(const char *args)
+{
+	int bufs = 0, stbuf_size = 0;
+
+	sscanf(args, "%d %d", &bufs, &stbuf_size);
+	return threadrw_ring_test(bufs, stbuf_size);
+}
+
+struct codec_mm_selftest_s threadrw_ring_selftest = {
+	.name = "threadrw_ring",
+	.run = threadrw_ring_selftest_run,
+};
@@ -868,6 +868,10 @@ int dmx_init(struct aml_dmx *pdmx, struct dvb_adapter *dvb_adapter)
 		vfree(pdmx->ts_feed);
 		return -1;
 	}
+	/*dvr input may be 188, 192 or 204 byte packets.*/
+	if (pdmx->tsp)
+		swdmx_ts_parser_set_packet_size(pdmx->tsp,
+				SWDMX_TS_PACKET_SIZE_AUTO);
 	pdmx->buf_warning_level = 60;
 	pdmx->init = 1;
 //	dvb_net_init(dvb_adapter, &dmx->dvb_net, &pdmx->dmx);
@@ -566,6 +566,9 @@ static int aml_dvb_probe(struct platform_device *pdev)
 		if (!advb->tsp[i]) {
 			goto INIT_ERR;
 		}
+		/*188, 192 and 204 byte packets, locked on 2 sync bytes.*/
+		swdmx_ts_parser_set_packet_size(advb->tsp[i],
+				SWDMX_TS_PACKET_SIZE_AUTO);
 		hwdmx_set_cb(advb->hwdmx[i], hwdmx_cb, advb->tsp[i]);
 	}
 
@@ -610,6 +613,10 @@ static int aml_dvb_probe(struct platform_device *pdev)
 				advb->swdsc[i]);
 		swdmx_descrambler_add_ts_packet_cb(advb->swdsc[i],
 				swdmx_demux_ts_packet_cb,advb->swdmx[i]);
+		/*Descramble the packets of one parser run in batches.*/
+		swdmx_ts_parser_add_run_end_cb(advb->tsp[i],
+				swdmx_descrambler_run_end_cb,advb->swdsc[i]);
+		swdmx_descrambler_set_batch(advb->swdsc[i], SWDMX_DESC_BATCH_NUM);
 	}
 
 	if (class_register(&aml_dvb_class) < 0)
@@ -54,6 +54,8 @@ typedef uint8_t                          SWDMX_UInt8;
 typedef uint16_t                         SWDMX_UInt16;
 /**Unsigned 32 bits integer.*/
 typedef uint32_t                         SWDMX_UInt32;
+/**Unsigned 64 bits integer.*/
+typedef uint64_t                         SWDMX_UInt64;
 /**Generic pointer.*/
 typedef void*                            SWDMX_Ptr;
 /**Transport stream parser.*/
@@ -88,6 +90,15 @@ typedef SWDMX_Result (*SWDMX_DescAlgoDescFn) (
 			SWDMX_DescAlgo *algo,
 			SWDMX_TsPacket *pkt
 			);
+/**
+ * Batch descramble function. All the packets belong to one channel and
+ * have the scramble field set to 2 or 3.
+ */
+typedef SWDMX_Result (*SWDMX_DescAlgoBatchFn) (
+			SWDMX_DescAlgo  *algo,
+			SWDMX_TsPacket **pkts,
+			SWDMX_Int        num
+			);
 /**Descramble algorithm data free function.*/
 typedef void (*SWDMX_DescAlgoFreeFn) (
 			SWDMX_DescAlgo *algo
@@ -96,6 +107,9 @@ typedef void (*SWDMX_DescAlgoFreeFn) (
 typedef void (*SWDMX_TsPacketCb) (
 			SWDMX_TsPacket *pkt,
 			SWDMX_Ptr       udata);
+/**TS parser run end callback function.*/
+typedef void (*SWDMX_TsRunEndCb) (
+			SWDMX_Ptr       udata);
 /**Section data callback function.*/
 typedef void (*SWDMX_SecCb) (
 			SWDMX_UInt8  *data,
@@ -105,6 +119,12 @@ typedef void (*SWDMX_SecCb) (
 /**Length of the section filter.*/
 #define SWDMX_SEC_FILTER_LEN 16
 
+/**Default number of packets the descrambler queues in batch mode.*/
+#define SWDMX_DESC_BATCH_NUM 128
+
+/**Detect the TS packet size (188, 192 or 204) from the input.*/
+#define SWDMX_TS_PACKET_SIZE_AUTO 0
+
 /**TS packet filter's parameters.*/
 struct SWDMX_TsFilterParams_s {
 	SWDMX_UInt16 pid; /**< PID of the stream.*/
@@ -171,9 +191,9 @@ extern SWDMX_TsParser*
 swdmx_ts_parser_new (void);
 
 /**
- * Set the TS packet size.
+ * Set the TS packet size. A new parser uses 188 bytes packets.
  * \param tsp The TS parser.
- * \param size The packet size.
+ * \param size The packet size, or SWDMX_TS_PACKET_SIZE_AUTO.
  * \retval SWDMX_OK On success.
  * \retval SWDMX_ERR On error.
  */
@@ -210,6 +230,35 @@ swdmx_ts_parser_remove_ts_packet_cb (
 			SWDMX_TsPacketCb  cb,
 			SWDMX_Ptr         data);
 
+/**
+ * Add a callback invoked when swdmx_ts_parser_run returns. The packets
+ * passed to the TS packet callbacks are valid until then.
+ * \param tsp The TS parser.
+ * \param cb The callback function.
+ * \param data The user defined data used as the callback's parameter.
+ * \retval SWDMX_OK On success.
+ * \retval SWDMX_ERR On error.
+ */
+extern SWDMX_Result
+swdmx_ts_parser_add_run_end_cb (
+			SWDMX_TsParser   *tsp,
+			SWDMX_TsRunEndCb  cb,
+			SWDMX_Ptr         data);
+
+/**
+ * Remove a run end callback from the TS parser.
+ * \param tsp The TS parser.
+ * \param cb The callback function.
+ * \param data The user defined data used as the callback's parameter.
+ * \retval SWDMX_OK On success.
+ * \retval SWDMX_ERR On error.
+ */
+extern SWDMX_Result
+swdmx_ts_parser_remove_run_end_cb (
+			SWDMX_TsParser   *tsp,
+			SWDMX_TsRunEndCb  cb,
+			SWDMX_Ptr         data);
+
 /**
  * Parse TS data.
  * \param tsp The TS parser.
@@ -255,6 +304,30 @@ swdmx_descrambler_ts_packet_cb (
 			SWDMX_TsPacket *pkt,
 			SWDMX_Ptr       desc);
 
+/**
+ * The run end callback of the descrambler. Descrambles and outputs
+ * the packets queued in batch mode.
+ * \param desc The descrambler.
+ */
+extern void
+swdmx_descrambler_run_end_cb (SWDMX_Ptr desc);
+
+/**
+ * Set the descrambler's batch mode. With num > 0 the input packets are
+ * queued, the packets of each channel are descrambled together and
+ * all are output in input order when num packets are queued or on
+ * swdmx_descrambler_run_end_cb. The run end callback must be added to
+ * the TS parser feeding the descrambler.
+ * \param desc The descrambler.
+ * \param num Maximum queued packets, 0 disables batch mode.
+ * \retval SWDMX_OK On success.
+ * \retval SWDMX_ERR On error.
+ */
+extern SWDMX_Result
+swdmx_descrambler_set_batch (
+			SWDMX_Descrambler *desc,
+			SWDMX_Int          num);
+
 /**
  * Add a TS packet callback to the descrambler.
  * \param desc The descrambler.
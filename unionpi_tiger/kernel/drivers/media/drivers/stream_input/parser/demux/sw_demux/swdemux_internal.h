@@ -58,13 +58,21 @@ typedef struct {
 /**TS packet parser.*/
 struct SWDMX_TsParser_s {
 	SWDMX_Int  packet_size; /**< Packet size.*/
+	SWDMX_Bool auto_size;   /**< Detect the packet size.*/
+	SWDMX_Bool sync;        /**< Locked to the packet sync bytes.*/
 	SWDMX_List cb_list;     /**< Callback list.*/
+	SWDMX_List end_cb_list; /**< Run end callback list.*/
 };
 
 /**Descrambler.*/
 struct SWDMX_Descrambler_s {
-	SWDMX_List chan_list; /**< Descrambler channel list.*/
-	SWDMX_List cb_list;   /**< Callback list.*/
+	SWDMX_List          chan_list;  /**< Descrambler channel list.*/
+	SWDMX_List          cb_list;    /**< Callback list.*/
+	SWDMX_Int           batch_max;  /**< Queue size, 0 means no batch mode.*/
+	SWDMX_Int           batch_num;  /**< Queued packets.*/
+	SWDMX_TsPacket     *batch;      /**< Queued packets.*/
+	SWDMX_DescChannel **batch_chan; /**< Channel of each queued packet.*/
+	SWDMX_TsPacket    **batch_pkts; /**< Packets passed to batch_fn.*/
 };
 
 /**Descrambler channel.*/
@@ -77,14 +85,16 @@ struct SWDMX_DescChannel_s {
 
 /**Descrambler algorithm.*/
 struct SWDMX_DescAlgo_s {
-	SWDMX_DescAlgoSetFn  set_fn;  /**< Set parameter function.*/
-	SWDMX_DescAlgoDescFn desc_fn; /**< Descramble function.*/
-	SWDMX_DescAlgoFreeFn free_fn; /**< Free function.*/
+	SWDMX_DescAlgoSetFn   set_fn;   /**< Set parameter function.*/
+	SWDMX_DescAlgoDescFn  desc_fn;  /**< Descramble function.*/
+	SWDMX_DescAlgoFreeFn  free_fn;  /**< Free function.*/
+	SWDMX_DescAlgoBatchFn batch_fn; /**< Batch descramble function, optional.*/
 };
 
 /**Demux PID filter.*/
 typedef struct {
 	SWDMX_List      ln;              /**< List node data.*/
+	SWDMX_Demux    *dmx;             /**< The demux contains this PID filter.*/
 	SWDMX_UInt16    pid;             /**< PID.*/
 	SWDMX_List      ts_filter_list;  /**< TS filter list.*/
 	SWDMX_List      sec_filter_list; /**< Section filter list.*/
@@ -92,11 +102,17 @@ typedef struct {
 	SWDMX_Int       sec_recv;        /**< Section data received*/
 } SWDMX_PidFilter;
 
+/**Number of PIDs in a PID table page.*/
+#define SWDMX_PID_PAGE_SIZE 256
+/**Number of PID table pages.*/
+#define SWDMX_PID_PAGE_NUM  (8192 / SWDMX_PID_PAGE_SIZE)
+
 /**Demux.*/
 struct SWDMX_Demux_s {
-	SWDMX_List pid_filter_list; /**< PID filter list.*/
-	SWDMX_List ts_filter_list;  /**< TS filter list.*/
-	SWDMX_List sec_filter_list; /**< Section filter list.*/
+	SWDMX_List        pid_filter_list; /**< PID filter list.*/
+	SWDMX_List        ts_filter_list;  /**< TS filter list.*/
+	SWDMX_List        sec_filter_list; /**< Section filter list.*/
+	SWDMX_PidFilter **pid_table[SWDMX_PID_PAGE_NUM]; /**< PID to PID filter, pages allocated on demand.*/
 };
 
 /**Filter's state.*/
@@ -125,9 +141,9 @@ struct SWDMX_SecFilter_s {
 	SWDMX_PidFilter       *pid_filter; /**< The PID filter contains this section filter.*/
 	SWDMX_FilterState      state;      /**< State of the filter.*/
 	SWDMX_SecFilterParams  params;     /**< Parameters.*/
-	SWDMX_UInt8            value[SWDMX_SEC_FILTER_LEN + 2]; /**< Value array.*/
-	SWDMX_UInt8            mam[SWDMX_SEC_FILTER_LEN + 2];   /**< Mask & mode array.*/
-	SWDMX_UInt8            manm[SWDMX_SEC_FILTER_LEN + 2];  /**< Mask & ~mode array.*/
+	SWDMX_UInt64           value[2];   /**< Value of section byte 0 and 3 to 17.*/
+	SWDMX_UInt64           mam[2];     /**< Mask & mode.*/
+	SWDMX_UInt64           manm[2];    /**< Mask & ~mode.*/
 	SWDMX_List             cb_list;    /**< Callback list.*/
 };
 
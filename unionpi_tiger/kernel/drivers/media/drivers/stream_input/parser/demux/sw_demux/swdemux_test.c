@@ -16,16 +16,35 @@
 * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 *
 * Description:
+*
+*	swdemux_test file.ts ...
+*	swdemux_test -b [packets [rounds]]
+*	swdemux_test -p [packets [rounds]]
+*	swdemux_test -s [sections [rounds]]
+*
+* The first form descrambles the files in parallel threads. -b runs the
+* descrambler benchmark on synthetic scrambled TS for every algorithm,
+* unbatched and batched, checks the output against the plaintext and
+* reports Mbit/s per core. -p runs the parser and PID dispatch benchmark
+* with 1, 32 and 256 active PIDs, 192/204 bytes packets and noisy input,
+* checks every packet is delivered and reports packets/s per core. -s
+* cross-checks swdmx_crc32 and the section filters against byte by byte
+* reference implementations and reports the CRC32 MB/s and sections/s
+* with 1, 16 and 64 section filters on one PID.
 */
 
 
 #include "swdemux.h"
+#include "swdemux_internal.h"
+#include "dvbcsa2/dvbcsa/dvbcsa.h"
+#include "crypto/aes.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 
@@ -233,6 +252,843 @@ void thread_func(void *args)
 
 	total_ts_cnt = 0;
 }
+#define BENCH_PID        0x80
+#define BENCH_KEY_PERIOD 1024 /*Packets between parity changes.*/
+#define BENCH_CHUNK_PKTS 348  /*Packets given to one parser run.*/
+
+enum {
+	BENCH_DVBCSA2,
+	BENCH_AES_ECB,
+	BENCH_AES_CBC,
+	BENCH_ALGO_NUM
+};
+
+static const char *bench_algo_name[BENCH_ALGO_NUM] = {
+	"dvbcsa2", "aes-ecb", "aes-cbc"
+};
+
+struct bench_ctx {
+	uint8_t *plain;
+	int      pkt_num;
+	int      pkt_idx;
+	int      errors;
+};
+
+static const uint8_t bench_odd_key[16] = {0x79, 0x4B, 0x21, 0x80, 0x13, 0x71, 0x00, 0xFA, 0x1E, 0xBD, 0xCB, 0x13, 0xB0, 0x63, 0xE5, 0x28};
+static const uint8_t bench_even_key[16] = {0x32, 0x6C, 0xD4, 0xE9, 0xE0, 0xD6, 0x74, 0x81, 0x1A, 0x00, 0xF0, 0xCE, 0x1B, 0x50, 0xBC, 0xD8};
+static const uint8_t bench_iv[16] = {0x49, 0x72, 0x64, 0x65, 0x74, 0x6F, 0xA9, 0x43, 0x6F, 0x70, 0x79, 0x72, 0x69, 0x67, 0x68, 0x74};
+
+static uint64_t
+bench_cpu_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*Payload offset of a packet built by bench_make_ts.*/
+static int
+bench_payload (const uint8_t *pkt)
+{
+	return (pkt[3] & 0x20) ? 5 + pkt[4] : 4;
+}
+
+/*Clear packets on BENCH_PID, every 8th one carries an adaptation field.*/
+static void
+bench_make_ts (uint8_t *ts, int num)
+{
+	uint32_t seed = 0x12345678;
+	int      i, j;
+
+	for (i = 0; i < num; i ++) {
+		uint8_t *p = ts + i * 188;
+		int      off;
+
+		p[0] = 0x47;
+		p[1] = (BENCH_PID >> 8) & 0x1f;
+		p[2] = BENCH_PID & 0xff;
+		p[3] = 0x10 | (i & 0x0f);
+
+		if (!(i & 7)) {
+			p[3] |= 0x20;
+			p[4]  = 7 + (i & 8);
+			p[5]  = 0;
+			memset(p + 6, 0xff, p[4] - 1);
+		}
+
+		for (off = bench_payload(p), j = off; j < 188; j ++) {
+			seed = seed * 1103515245 + 12345;
+			p[j] = seed >> 16;
+		}
+	}
+}
+
+/*Scramble the payloads, the parity changes every BENCH_KEY_PERIOD packets.*/
+static void
+bench_scramble (int algo_id, uint8_t *ts, int num)
+{
+	struct dvbcsa_key_s *csa_key[2];
+	AES_KEY              aes_key[2];
+	int                  i;
+
+	csa_key[0] = dvbcsa_key_alloc();
+	csa_key[1] = dvbcsa_key_alloc();
+	dvbcsa_key_set(bench_even_key, csa_key[0]);
+	dvbcsa_key_set(bench_odd_key, csa_key[1]);
+	AES_set_encrypt_key(bench_even_key, 128, &aes_key[0]);
+	AES_set_encrypt_key(bench_odd_key, 128, &aes_key[1]);
+
+	for (i = 0; i < num; i ++) {
+		uint8_t *p      = ts + i * 188;
+		int      parity = (i / BENCH_KEY_PERIOD) & 1;
+		int      off    = bench_payload(p);
+		int      len    = 188 - off;
+		int      blen   = len & ~15;
+		uint8_t  iv[16];
+		int      j;
+
+		p[3] |= (2 + parity) << 6;
+
+		switch (algo_id) {
+		case BENCH_DVBCSA2:
+			dvbcsa_encrypt(csa_key[parity], p + off, len);
+			break;
+		case BENCH_AES_ECB:
+			for (j = 0; j < blen; j += 16)
+				AES_ecb_encrypt(p + off + j, p + off + j,
+						&aes_key[parity], AES_ENCRYPT);
+			break;
+		case BENCH_AES_CBC:
+			memcpy(iv, bench_iv, 16);
+			if (blen)
+				AES_cbc_encrypt(p + off, p + off, blen,
+						&aes_key[parity], iv, AES_ENCRYPT);
+			break;
+		}
+	}
+
+	dvbcsa_key_free(csa_key[0]);
+	dvbcsa_key_free(csa_key[1]);
+}
+
+static void
+bench_ts_cb (SWDMX_TsPacket *pkt, SWDMX_Ptr data)
+{
+	struct bench_ctx *ctx = data;
+	int               idx = ctx->pkt_idx ++ % ctx->pkt_num;
+
+	if (memcmp(pkt->packet, ctx->plain + idx * 188, 188))
+		ctx->errors ++;
+}
+
+static SWDMX_DescAlgo*
+bench_algo_new (int algo_id, SWDMX_DescChannel *dch)
+{
+	SWDMX_DescAlgo *algo = NULL;
+
+	switch (algo_id) {
+	case BENCH_DVBCSA2:
+		algo = swdmx_dvbcsa2_algo_new();
+		swdmx_desc_channel_set_algo(dch, algo);
+		swdmx_desc_channel_set_param(dch, SWDMX_DVBCSA2_PARAM_ODD_KEY, (SWDMX_Ptr)bench_odd_key);
+		swdmx_desc_channel_set_param(dch, SWDMX_DVBCSA2_PARAM_EVEN_KEY, (SWDMX_Ptr)bench_even_key);
+		break;
+	case BENCH_AES_ECB:
+		algo = swdmx_aes_ecb_algo_new();
+		swdmx_desc_channel_set_algo(dch, algo);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_ECB_PARAM_ALIGN, SWDMX_DESC_ALIGN_HEAD);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_ECB_PARAM_ODD_KEY, (SWDMX_Ptr)bench_odd_key);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_ECB_PARAM_EVEN_KEY, (SWDMX_Ptr)bench_even_key);
+		break;
+	case BENCH_AES_CBC:
+		algo = swdmx_aes_cbc_algo_new();
+		swdmx_desc_channel_set_algo(dch, algo);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_CBC_PARAM_ALIGN, SWDMX_DESC_ALIGN_HEAD);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_CBC_PARAM_ODD_KEY, (SWDMX_Ptr)bench_odd_key);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_CBC_PARAM_EVEN_KEY, (SWDMX_Ptr)bench_even_key);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_CBC_PARAM_ODD_IV, (SWDMX_Ptr)bench_iv);
+		swdmx_desc_channel_set_param(dch, SWDMX_AES_CBC_PARAM_EVEN_IV, (SWDMX_Ptr)bench_iv);
+		break;
+	}
+
+	return algo;
+}
+
+/*Descramble rounds copies of the scrambled stream, return Mbit/s.*/
+static double
+bench_run (int algo_id, int batch, const uint8_t *scrambled, uint8_t *buf,
+		struct bench_ctx *ctx, int rounds)
+{
+	SWDMX_TsParser       *tsp;
+	SWDMX_Descrambler    *desc;
+	SWDMX_Demux          *dmx;
+	SWDMX_DescChannel    *dch;
+	SWDMX_DescAlgo       *algo;
+	SWDMX_TsFilter       *tsf;
+	SWDMX_TsFilterParams  tsfp;
+	int                   size = ctx->pkt_num * 188;
+	uint64_t              ns = 0, start;
+	int                   r, off;
+
+	tsp  = swdmx_ts_parser_new();
+	desc = swdmx_descrambler_new();
+	dmx  = swdmx_demux_new();
+
+	swdmx_ts_parser_add_ts_packet_cb(tsp,
+				swdmx_descrambler_ts_packet_cb,
+				desc);
+	swdmx_ts_parser_add_run_end_cb(tsp,
+				swdmx_descrambler_run_end_cb,
+				desc);
+	swdmx_descrambler_add_ts_packet_cb(desc,
+				swdmx_demux_ts_packet_cb,
+				dmx);
+	swdmx_descrambler_set_batch(desc, batch);
+
+	dch  = swdmx_descrambler_alloc_channel(desc);
+	algo = bench_algo_new(algo_id, dch);
+	swdmx_desc_channel_set_pid(dch, BENCH_PID);
+	swdmx_desc_channel_enable(dch);
+
+	tsf = swdmx_demux_alloc_ts_filter(dmx);
+	tsfp.pid = BENCH_PID;
+	swdmx_ts_filter_set_params(tsf, &tsfp);
+	swdmx_ts_filter_add_ts_packet_cb(tsf, bench_ts_cb, ctx);
+	swdmx_ts_filter_enable(tsf);
+
+	ctx->pkt_idx = 0;
+	ctx->errors  = 0;
+
+	for (r = 0; r < rounds; r ++) {
+		memcpy(buf, scrambled, size);
+
+		start = bench_cpu_ns();
+		for (off = 0; off < size; off += BENCH_CHUNK_PKTS * 188) {
+			int len = size - off;
+
+			if (len > BENCH_CHUNK_PKTS * 188)
+				len = BENCH_CHUNK_PKTS * 188;
+
+			swdmx_ts_parser_run(tsp, buf + off, len);
+		}
+		ns += bench_cpu_ns() - start;
+	}
+
+	if (ctx->pkt_idx != ctx->pkt_num * rounds)
+		ctx->errors += abs(ctx->pkt_num * rounds - ctx->pkt_idx);
+
+	swdmx_ts_parser_free(tsp);
+	swdmx_descrambler_free(desc);
+	swdmx_demux_free(dmx);
+	(void)algo;
+
+	return ns ? (double)size * rounds * 8 * 1000 / ns : 0;
+}
+
+static int
+bench_main (int argc, char **argv)
+{
+	struct bench_ctx ctx;
+	uint8_t         *scrambled, *buf;
+	int              rounds  = 10;
+	int              batch[] = {0, SWDMX_DESC_BATCH_NUM};
+	int              algo_id, i, failed = 0;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.pkt_num = 20000;
+
+	if (argc > 0)
+		ctx.pkt_num = atoi(argv[0]);
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if ((ctx.pkt_num <= 0) || (rounds <= 0)) {
+		fprintf(stderr, "illegal packet number or rounds\n");
+		return 1;
+	}
+
+	ctx.plain = malloc(ctx.pkt_num * 188);
+	scrambled = malloc(ctx.pkt_num * 188);
+	buf       = malloc(ctx.pkt_num * 188);
+	if (!ctx.plain || !scrambled || !buf) {
+		fprintf(stderr, "no memory\n");
+		return 1;
+	}
+
+	bench_make_ts(ctx.plain, ctx.pkt_num);
+
+	printf("%d packets x %d rounds, parity change every %d packets\n",
+			ctx.pkt_num, rounds, BENCH_KEY_PERIOD);
+	printf("%-8s %6s %12s %8s\n", "algo", "batch", "Mbit/s/core", "errors");
+
+	for (algo_id = 0; algo_id < BENCH_ALGO_NUM; algo_id ++) {
+		memcpy(scrambled, ctx.plain, ctx.pkt_num * 188);
+		bench_scramble(algo_id, scrambled, ctx.pkt_num);
+
+		for (i = 0; i < (int)(sizeof(batch) / sizeof(batch[0])); i ++) {
+			double mbps;
+
+			mbps = bench_run(algo_id, batch[i], scrambled, buf, &ctx, rounds);
+			printf("%-8s %6d %12.1f %8d\n", bench_algo_name[algo_id],
+					batch[i], mbps, ctx.errors);
+			if (ctx.errors)
+				failed = 1;
+		}
+	}
+
+	free(ctx.plain);
+	free(scrambled);
+	free(buf);
+
+	return failed;
+}
+
+#define PIDS_BENCH_NOISE_PERIOD 100 /*Packets between noise bursts.*/
+#define PIDS_BENCH_NOISE_LEN    61  /*Bytes of a noise burst.*/
+#define PIDS_BENCH_CHUNK        (64 * 1024)
+
+struct pids_bench_case {
+	int pid_num;
+	int packet_size;
+	int noise;
+};
+
+static const struct pids_bench_case pids_bench_cases[] = {
+	{1,   188, 0},
+	{32,  188, 0},
+	{256, 188, 0},
+	{256, 192, 0},
+	{256, 204, 0},
+	{256, 188, 1}
+};
+
+/*
+ *Packets on PIDs 0x100 to 0x100 + pid_num - 1 in turn. 192 bytes packets
+ *get a 4 bytes header before the sync byte, 204 bytes packets 16 bytes of
+ *parity after the packet. With noise, a burst of garbage containing sync
+ *bytes follows every PIDS_BENCH_NOISE_PERIOD packets.
+ */
+static int
+pids_make_ts (uint8_t *ts, int pkt_num, const struct pids_bench_case *c)
+{
+	uint32_t seed = 0x87654321;
+	uint8_t *p    = ts;
+	int      i, j;
+
+	for (i = 0; i < pkt_num; i ++) {
+		int      pid = 0x100 + (i % c->pid_num);
+		uint8_t *pkt;
+
+		/*No sync byte in the payload, so only the noise can false lock.*/
+		for (j = 0; j < c->packet_size; j ++) {
+			seed = seed * 1103515245 + 12345;
+			p[j] = seed >> 16;
+			if (p[j] == 0x47)
+				p[j] = 0x46;
+		}
+
+		pkt = (c->packet_size == 192) ? p + 4 : p;
+		pkt[0] = 0x47;
+		pkt[1] = (pid >> 8) & 0x1f;
+		pkt[2] = pid & 0xff;
+		pkt[3] = 0x10 | (i & 0x0f);
+		p += c->packet_size;
+
+		if (c->noise && ((i % PIDS_BENCH_NOISE_PERIOD) == PIDS_BENCH_NOISE_PERIOD - 1)) {
+			for (j = 0; j < PIDS_BENCH_NOISE_LEN; j ++) {
+				seed = seed * 1103515245 + 12345;
+				p[j] = seed >> 16;
+			}
+			p[0]  = 0;
+			p[17] = 0x47;
+			p[40] = 0x47;
+			p += PIDS_BENCH_NOISE_LEN;
+		}
+	}
+
+	/*The header of the next 192 bytes packet.*/
+	if (c->packet_size == 192) {
+		memset(p, 0, 4);
+		p += 4;
+	}
+
+	return p - ts;
+}
+
+static void
+pids_ts_cb (SWDMX_TsPacket *pkt, SWDMX_Ptr data)
+{
+	int *cnt = data;
+
+	(*cnt) ++;
+}
+
+/*Parse rounds times the stream with all the PIDs filtered, return packets/s.*/
+static double
+pids_bench_run (const struct pids_bench_case *c, const uint8_t *ts, int size,
+		int rounds, int *cnt)
+{
+	SWDMX_TsParser       *tsp;
+	SWDMX_Demux          *dmx;
+	SWDMX_TsFilter       *tsf;
+	SWDMX_TsFilterParams  tsfp;
+	uint64_t              ns = 0, start;
+	int                   r, i, off;
+
+	tsp = swdmx_ts_parser_new();
+	dmx = swdmx_demux_new();
+
+	if (c->packet_size != 188)
+		swdmx_ts_parser_set_packet_size(tsp, SWDMX_TS_PACKET_SIZE_AUTO);
+
+	swdmx_ts_parser_add_ts_packet_cb(tsp,
+				swdmx_demux_ts_packet_cb,
+				dmx);
+
+	for (i = 0; i < c->pid_num; i ++) {
+		tsf = swdmx_demux_alloc_ts_filter(dmx);
+		tsfp.pid = 0x100 + i;
+		swdmx_ts_filter_set_params(tsf, &tsfp);
+		swdmx_ts_filter_add_ts_packet_cb(tsf, pids_ts_cb, cnt);
+		swdmx_ts_filter_enable(tsf);
+	}
+
+	*cnt = 0;
+
+	for (r = 0; r < rounds; r ++) {
+		start = bench_cpu_ns();
+		for (off = 0; off < size; ) {
+			int len = size - off;
+			int n;
+
+			if (len > PIDS_BENCH_CHUNK)
+				len = PIDS_BENCH_CHUNK;
+
+			n = swdmx_ts_parser_run(tsp, (SWDMX_UInt8*)ts + off, len);
+			if (!n)
+				break;
+
+			off += n;
+		}
+		ns += bench_cpu_ns() - start;
+	}
+
+	swdmx_ts_parser_free(tsp);
+	swdmx_demux_free(dmx);
+
+	return ns ? (double)*cnt * 1000000000 / ns : 0;
+}
+
+static int
+pids_bench_main (int argc, char **argv)
+{
+	int      pkt_num = 100000;
+	int      rounds  = 10;
+	int      i, failed = 0;
+	uint8_t *ts;
+
+	if (argc > 0)
+		pkt_num = atoi(argv[0]);
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if ((pkt_num <= 0) || (rounds <= 0)) {
+		fprintf(stderr, "illegal packet number or rounds\n");
+		return 1;
+	}
+
+	ts = malloc(pkt_num * 204 + (pkt_num / PIDS_BENCH_NOISE_PERIOD + 1) * PIDS_BENCH_NOISE_LEN);
+	if (!ts) {
+		fprintf(stderr, "no memory\n");
+		return 1;
+	}
+
+	printf("%d packets x %d rounds\n", pkt_num, rounds);
+	printf("%4s %5s %6s %12s %8s\n", "pids", "size", "noise", "packets/s", "errors");
+
+	for (i = 0; i < (int)(sizeof(pids_bench_cases) / sizeof(pids_bench_cases[0])); i ++) {
+		const struct pids_bench_case *c = &pids_bench_cases[i];
+		double pps;
+		int    size, cnt, errors;
+
+		size   = pids_make_ts(ts, pkt_num, c);
+		pps    = pids_bench_run(c, ts, size, rounds, &cnt);
+		errors = abs(pkt_num * rounds - cnt);
+
+		printf("%4d %5d %6s %12.0f %8d\n", c->pid_num, c->packet_size,
+				c->noise ? "yes" : "no", pps, errors);
+		if (errors)
+			failed = 1;
+	}
+
+	free(ts);
+
+	return failed;
+}
+
+#define SEC_BENCH_PID      0x12
+#define SEC_BENCH_CRC_SIZE (64 * 1024 * 1024)
+
+struct sec_bench_stat {
+	int      cnt;  /*Sections received.*/
+	uint32_t hash; /*Sum of the CRC fields of the sections received.*/
+};
+
+/*The byte by byte MPEG-2 CRC32 swdmx_crc32 had before slicing by 8.*/
+static uint32_t sec_ref_crc32_table[256];
+
+static uint32_t
+sec_ref_crc32 (const uint8_t *p, int len)
+{
+	uint32_t crc = 0xffffffff;
+
+	while (len --)
+		crc = (crc << 8) ^ sec_ref_crc32_table[(crc >> 24) ^ *p ++];
+
+	return crc;
+}
+
+static void
+sec_ref_crc32_init (void)
+{
+	uint32_t i, j, k;
+
+	for (i = 0; i < 256; i++) {
+		k = 0;
+		for (j = (i << 24) | 0x800000; j != 0x80000000; j <<= 1)
+			k = (k << 1) ^ (((k ^ j) & 0x80000000) ? 0x04c11db7 : 0);
+		sec_ref_crc32_table[i] = k;
+	}
+}
+
+/*Section filter semantics, byte i of the filter checks section byte 0
+ *for i == 0, else byte i + 2. Bytes after the section end are 0.*/
+static int
+sec_ref_match (const uint8_t *sec, int len, const SWDMX_SecFilterParams *f)
+{
+	uint8_t n = 0, has_n = 0;
+	int     i;
+
+	for (i = 0; i < SWDMX_SEC_FILTER_LEN; i ++) {
+		int     j  = i ? i + 2 : 0;
+		uint8_t d  = (j < len) ? sec[j] : 0;
+		uint8_t eq = f->mask[i] & ~f->mode[i];
+		uint8_t ne = f->mask[i] & f->mode[i];
+
+		if ((d ^ f->value[i]) & eq)
+			return 0;
+
+		n     |= (d ^ f->value[i]) & ne;
+		has_n |= ne;
+	}
+
+	return !has_n || n;
+}
+
+static uint32_t
+sec_rand (uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+/*Compare swdmx_crc32 with the reference and measure both.*/
+static int
+sec_crc_check (void)
+{
+	static const uint8_t check[] = "123456789";
+	uint8_t  *buf;
+	uint32_t  seed = 1;
+	uint64_t  start, ref_ns, ns;
+	int       i, errors = 0;
+
+	buf = malloc(SEC_BENCH_CRC_SIZE);
+	if (!buf)
+		return 1;
+
+	for (i = 0; i < SEC_BENCH_CRC_SIZE; i ++)
+		buf[i] = sec_rand(&seed);
+
+	if (swdmx_crc32(check, 9) != 0x0376e6e7)
+		errors ++;
+
+	/*All the lengths up to 4096 at every alignment.*/
+	for (i = 0; i <= 4096; i ++) {
+		int off = i & 7;
+
+		if (swdmx_crc32(buf + off, i) != sec_ref_crc32(buf + off, i))
+			errors ++;
+	}
+
+	start  = bench_cpu_ns();
+	seed   = sec_ref_crc32(buf, SEC_BENCH_CRC_SIZE);
+	ref_ns = bench_cpu_ns() - start;
+
+	start = bench_cpu_ns();
+	if (swdmx_crc32(buf, SEC_BENCH_CRC_SIZE) != seed)
+		errors ++;
+	ns = bench_cpu_ns() - start;
+
+	printf("crc32 byte by byte %8.1f MB/s\n", (double)SEC_BENCH_CRC_SIZE * 1000 / ref_ns);
+	printf("crc32 slicing by 8 %8.1f MB/s, errors %d\n",
+			(double)SEC_BENCH_CRC_SIZE * 1000 / ns, errors);
+
+	free(buf);
+
+	return errors;
+}
+
+/*
+ *EIT like sections of 8 to 300 bytes with table_id 0x4e to 0x51, the
+ *other bytes have few values so that the filters match often. One
+ *section in 16 has a wrong CRC. Return the size of the sections.
+ */
+static int
+sec_make_sections (uint8_t *buf, int *offs, int sec_num, uint32_t *seed)
+{
+	int i, j, off = 0;
+
+	for (i = 0; i < sec_num; i ++) {
+		uint8_t  *sec = buf + off;
+		int       len = 8 + sec_rand(seed) % 293;
+		uint32_t  crc;
+
+		sec[0] = 0x4e + sec_rand(seed) % 4;
+		sec[1] = 0xb0 | (((len - 3) >> 8) & 0x0f);
+		sec[2] = (len - 3) & 0xff;
+		for (j = 3; j < len - 4; j ++)
+			sec[j] = sec_rand(seed) & 0x03;
+
+		crc = swdmx_crc32(sec, len - 4);
+		if (!(sec_rand(seed) & 15))
+			crc ^= 1;
+
+		sec[len - 4] = crc >> 24;
+		sec[len - 3] = crc >> 16;
+		sec[len - 2] = crc >> 8;
+		sec[len - 1] = crc;
+
+		offs[i] = off;
+		off    += len;
+	}
+
+	offs[sec_num] = off;
+
+	return off;
+}
+
+/*Put the sections in TS packets, return the TS size.*/
+static int
+sec_make_ts (uint8_t *ts, const uint8_t *secs, const int *offs, int sec_num)
+{
+	int pos = 0, size = offs[sec_num], next = 0, cc = 0;
+	int ts_len = 0;
+
+	while (pos < size) {
+		uint8_t *p     = ts + ts_len;
+		uint8_t *pl    = p + 4;
+		int      space = 184;
+		int      n;
+
+		while ((next < sec_num) && (offs[next] < pos))
+			next ++;
+
+		p[0] = 0x47;
+		p[1] = (SEC_BENCH_PID >> 8) & 0x1f;
+		p[2] = SEC_BENCH_PID & 0xff;
+		p[3] = 0x10 | (cc ++ & 0x0f);
+
+		if ((next < sec_num) && (offs[next] < pos + 183)) {
+			p[1] |= 0x40;
+			*pl ++ = offs[next] - pos;
+			space --;
+		}
+
+		n = SWDMX_MIN(space, size - pos);
+		memcpy(pl, secs + pos, n);
+		memset(pl + n, 0xff, space - n);
+
+		pos    += n;
+		ts_len += 188;
+	}
+
+	return ts_len;
+}
+
+/*Random filters on table_id, some with bytes 3, 5 (not equal mode) and
+ *16 of the section.*/
+static void
+sec_make_filter (SWDMX_SecFilterParams *f, uint32_t *seed)
+{
+	memset(f, 0, sizeof(*f));
+
+	f->pid   = SEC_BENCH_PID;
+	f->crc32 = SWDMX_TRUE;
+
+	f->value[0] = 0x4e + sec_rand(seed) % 4;
+	f->mask[0]  = 0xff;
+
+	if (sec_rand(seed) & 1) {
+		f->value[1] = sec_rand(seed) & 0x03;
+		f->mask[1]  = 0x03;
+	}
+
+	if (sec_rand(seed) & 1) {
+		f->value[3] = sec_rand(seed) & 0x03;
+		f->mask[3]  = 0x03;
+		f->mode[3]  = 0xff;
+	}
+
+	if (sec_rand(seed) & 1) {
+		f->value[14] = sec_rand(seed) & 0x03;
+		f->mask[14]  = 0x01;
+	}
+}
+
+static void
+sec_bench_cb (SWDMX_UInt8 *sec, SWDMX_Int len, SWDMX_Ptr data)
+{
+	struct sec_bench_stat *st = data;
+
+	st->cnt  ++;
+	st->hash += ((uint32_t)sec[len - 4] << 24) | (sec[len - 3] << 16)
+			| (sec[len - 2] << 8) | sec[len - 1];
+}
+
+/*Run the sections through filter_num filters, return sections/s.*/
+static double
+sec_bench_run (int filter_num, const uint8_t *secs, const int *offs, int sec_num,
+		const uint8_t *ts, int ts_len, int rounds, int *errors)
+{
+	SWDMX_TsParser        *tsp;
+	SWDMX_Demux           *dmx;
+	SWDMX_SecFilter       *secf;
+	SWDMX_SecFilterParams *params;
+	struct sec_bench_stat *stat, ref;
+	uint32_t               seed = filter_num;
+	uint64_t               ns = 0, start;
+	int                    i, j, r, off;
+
+	params = malloc(sizeof(*params) * filter_num);
+	stat   = calloc(filter_num, sizeof(*stat));
+
+	tsp = swdmx_ts_parser_new();
+	dmx = swdmx_demux_new();
+
+	swdmx_ts_parser_add_ts_packet_cb(tsp,
+				swdmx_demux_ts_packet_cb,
+				dmx);
+
+	for (i = 0; i < filter_num; i ++) {
+		sec_make_filter(&params[i], &seed);
+
+		secf = swdmx_demux_alloc_sec_filter(dmx);
+		swdmx_sec_filter_set_params(secf, &params[i]);
+		swdmx_sec_filter_add_section_cb(secf, sec_bench_cb, &stat[i]);
+		swdmx_sec_filter_enable(secf);
+	}
+
+	for (r = 0; r < rounds; r ++) {
+		start = bench_cpu_ns();
+		for (off = 0; off < ts_len; ) {
+			int len = SWDMX_MIN(PIDS_BENCH_CHUNK, ts_len - off);
+			int n;
+
+			n = swdmx_ts_parser_run(tsp, (SWDMX_UInt8*)ts + off, len);
+			if (!n)
+				break;
+
+			off += n;
+		}
+		ns += bench_cpu_ns() - start;
+	}
+
+	*errors = 0;
+	for (i = 0; i < filter_num; i ++) {
+		memset(&ref, 0, sizeof(ref));
+
+		for (j = 0; j < sec_num; j ++) {
+			const uint8_t *sec = secs + offs[j];
+			int            len = offs[j + 1] - offs[j];
+
+			if (sec_ref_crc32(sec, len))
+				continue;
+			if (!sec_ref_match(sec, len, &params[i]))
+				continue;
+
+			ref.cnt  += rounds;
+			ref.hash += rounds * (((uint32_t)sec[len - 4] << 24) | (sec[len - 3] << 16)
+					| (sec[len - 2] << 8) | sec[len - 1]);
+		}
+
+		if ((ref.cnt != stat[i].cnt) || (ref.hash != stat[i].hash))
+			(*errors) ++;
+	}
+
+	swdmx_ts_parser_free(tsp);
+	swdmx_demux_free(dmx);
+	free(params);
+	free(stat);
+
+	return ns ? (double)sec_num * rounds * 1000000000 / ns : 0;
+}
+
+static int
+sec_bench_main (int argc, char **argv)
+{
+	static const int filter_nums[] = {1, 16, 64};
+	int      sec_num = 50000;
+	int      rounds  = 10;
+	int      i, size, ts_len, failed = 0;
+	int     *offs;
+	uint8_t *secs, *ts;
+	uint32_t seed = 0x5ec710;
+
+	if (argc > 0)
+		sec_num = atoi(argv[0]);
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if ((sec_num <= 0) || (rounds <= 0)) {
+		fprintf(stderr, "illegal section number or rounds\n");
+		return 1;
+	}
+
+	sec_ref_crc32_init();
+
+	if (sec_crc_check())
+		failed = 1;
+
+	offs = malloc(sizeof(int) * (sec_num + 1));
+	secs = malloc(sec_num * 300);
+	ts   = malloc((sec_num * 300 / 183 + 1) * 188);
+	if (!offs || !secs || !ts) {
+		fprintf(stderr, "no memory\n");
+		return 1;
+	}
+
+	size   = sec_make_sections(secs, offs, sec_num, &seed);
+	ts_len = sec_make_ts(ts, secs, offs, sec_num);
+
+	printf("%d sections, %d bytes x %d rounds\n", sec_num, size, rounds);
+	printf("%7s %12s %8s\n", "filters", "sections/s", "errors");
+
+	for (i = 0; i < (int)(sizeof(filter_nums) / sizeof(filter_nums[0])); i ++) {
+		double sps;
+		int    errors;
+
+		sps = sec_bench_run(filter_nums[i], secs, offs, sec_num, ts, ts_len,
+				rounds, &errors);
+		printf("%7d %12.0f %8d\n", filter_nums[i], sps, errors);
+		if (errors)
+			failed = 1;
+	}
+
+	free(offs);
+	free(secs);
+	free(ts);
+
+	return failed;
+}
+
 int main (int argc, char **argv)
 {
 	char  buf[64*1024];
@@ -248,6 +1104,13 @@ int main (int argc, char **argv)
 		return 1;
 	}
 
+	if (!strcmp(argv[1], "-b"))
+		return bench_main(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "-p"))
+		return pids_bench_main(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "-s"))
+		return sec_bench_main(argc - 2, argv + 2);
+
 	ts_num = argc - 1;
 	printf("Decrypt %d ts\n", ts_num);
 
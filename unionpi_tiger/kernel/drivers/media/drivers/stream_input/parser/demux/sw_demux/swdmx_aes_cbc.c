@@ -22,7 +22,7 @@
 #include "swdemux_internal.h"
 #ifdef __KERNEL__
 #include <linux/scatterlist.h>
-#include <linux/crypto.h>
+#include <crypto/skcipher.h>
 #else
 #include <crypto/aes.h>
 #endif
@@ -31,7 +31,8 @@ typedef struct {
 	SWDMX_DescAlgo algo;
 	SWDMX_Int      align;
 #ifdef __KERNEL__
-	struct blkcipher_desc desc;
+	struct crypto_sync_skcipher *tfm;
+	SWDMX_Int   key_type; /**< Key set to tfm, -1 if none.*/
 	SWDMX_UInt8 odd_key[16];
 	SWDMX_UInt8 even_key[16];
 #else
@@ -55,6 +56,7 @@ aes_cbc_set (SWDMX_DescAlgo *p, SWDMX_Int type, SWDMX_Ptr param)
 		r   = SWDMX_OK;
 #ifdef __KERNEL__
 		memcpy(algo->odd_key,key,16);
+		algo->key_type = -1;
 #else
 		AES_set_decrypt_key(key, 128, &algo->odd);
 #endif
@@ -64,6 +66,7 @@ aes_cbc_set (SWDMX_DescAlgo *p, SWDMX_Int type, SWDMX_Ptr param)
 		r   = SWDMX_OK;
 #ifdef __KERNEL__
 		memcpy(algo->even_key,key,16);
+		algo->key_type = -1;
 #else
 		AES_set_decrypt_key(key, 128, &algo->even);
 #endif
@@ -91,21 +94,36 @@ aes_cbc_set (SWDMX_DescAlgo *p, SWDMX_Int type, SWDMX_Ptr param)
 	return r;
 }
 
+#ifdef __KERNEL__
+//key_type:
+//0:even_key
+//1:odd_key
+//Only expand the key when the parity changes.
+static void
+aes_cbc_set_key (SWDMX_AesCbcAlgo *algo, SWDMX_Int key_type)
+{
+	if (algo->key_type == key_type)
+		return;
+
+	crypto_sync_skcipher_setkey(algo->tfm,
+			key_type ? algo->odd_key : algo->even_key, 16);
+	algo->key_type = key_type;
+}
+#endif
+
 static void
 aes_cbc_desc_pkt (SWDMX_AesCbcAlgo *algo, SWDMX_Int key_type, SWDMX_UInt8 *iv, SWDMX_TsPacket *pkt, SWDMX_Int align)
 {
 	SWDMX_UInt8 *p    = pkt->payload;
 	SWDMX_Int    left = pkt->payload_len, len;
-	SWDMX_UInt8  obuf[184];
 	SWDMX_UInt8  ivbuf[16];
 	SWDMX_UInt8 *in;
-	SWDMX_UInt8 *out  = obuf;
 #ifdef __KERNEL__
-	struct scatterlist dst[1];
-	struct scatterlist src[1];
-
-	u8 *key = NULL;
+	struct scatterlist sg;
+	SYNC_SKCIPHER_REQUEST_ON_STACK(req, algo->tfm);
 #else
+	SWDMX_UInt8  obuf[184];
+	SWDMX_UInt8 *out  = obuf;
 	AES_KEY *key = NULL;
 #endif
 
@@ -119,20 +137,9 @@ aes_cbc_desc_pkt (SWDMX_AesCbcAlgo *algo, SWDMX_Int key_type, SWDMX_UInt8 *iv, S
 
 		left -= tail;
 	}
-#ifdef __KERNEL__
-	if (key_type == 0) {
-		key = (u8*)&algo->even_key;
-	}else{
-		key = (u8*)&algo->odd_key;
-	}
-	crypto_blkcipher_setkey(algo->desc.tfm,key, 16);
-#else
-	if (key_type == 0) {
-		key = &algo->even;
-	}else{
-		key = &algo->odd;
-	}
-#endif
+
+	if (!left)
+		return;
 
 	memcpy(ivbuf, iv, 16);
 
@@ -140,17 +147,25 @@ aes_cbc_desc_pkt (SWDMX_AesCbcAlgo *algo, SWDMX_Int key_type, SWDMX_UInt8 *iv, S
 	len = left;
 
 #ifdef __KERNEL__
-	crypto_blkcipher_set_iv(algo->desc.tfm,ivbuf,16);
+	aes_cbc_set_key(algo, key_type);
 
-	sg_init_table(dst,1);
-	sg_init_table(src,1);
-	sg_set_buf(dst,out,len);
-	sg_set_buf(src,in,len);
-	crypto_blkcipher_decrypt(&algo->desc,dst,src,len);
+	/*Decrypt in place, the IV restarts on every packet.*/
+	sg_init_one(&sg, in, len);
+	skcipher_request_set_sync_tfm(req, algo->tfm);
+	skcipher_request_set_callback(req, 0, NULL, NULL);
+	skcipher_request_set_crypt(req, &sg, &sg, len, ivbuf);
+	crypto_skcipher_decrypt(req);
+	skcipher_request_zero(req);
 #else
+	if (key_type == 0) {
+		key = &algo->even;
+	}else{
+		key = &algo->odd;
+	}
+
 	AES_cbc_encrypt(in, out, len, key, ivbuf, 0);
-#endif
 	memcpy(in, out, len);
+#endif
 }
 
 static SWDMX_Result
@@ -170,11 +185,43 @@ aes_cbc_desc (SWDMX_DescAlgo *p, SWDMX_TsPacket *pkt)
 	return SWDMX_OK;
 }
 
+/*
+ * CBC chains restart on every packet, so a batch cannot be one request.
+ * Descramble the even packets, then the odd ones, so the key is set at
+ * most twice per batch instead of for every packet.
+ */
+static SWDMX_Result
+aes_cbc_desc_batch (SWDMX_DescAlgo *p, SWDMX_TsPacket **pkts, SWDMX_Int num)
+{
+	SWDMX_AesCbcAlgo *algo = (SWDMX_AesCbcAlgo*)p;
+	SWDMX_Int         i, odd = 0;
+
+	for (i = 0; i < num; i ++) {
+		if (pkts[i]->scramble == 2)
+			aes_cbc_desc_pkt(algo, 0, algo->even_iv, pkts[i], algo->align);
+		else
+			odd ++;
+	}
+
+	for (i = 0; odd && (i < num); i ++) {
+		if (pkts[i]->scramble == 3) {
+			aes_cbc_desc_pkt(algo, 1, algo->odd_iv, pkts[i], algo->align);
+			odd --;
+		}
+	}
+
+	return SWDMX_OK;
+}
+
 static void
 aes_cbc_free (SWDMX_DescAlgo *p)
 {
 	SWDMX_AesCbcAlgo *algo = (SWDMX_AesCbcAlgo*)p;
 
+#ifdef __KERNEL__
+	if (!IS_ERR_OR_NULL(algo->tfm))
+		crypto_free_sync_skcipher(algo->tfm);
+#endif
 	swdmx_free(algo);
 }
 
@@ -187,17 +234,23 @@ swdmx_aes_cbc_algo_new (void)
 	algo = swdmx_malloc(sizeof(SWDMX_AesCbcAlgo));
 	SWDMX_ASSERT(algo);
 
-	algo->algo.set_fn  = aes_cbc_set;
-	algo->algo.desc_fn = aes_cbc_desc;
-	algo->algo.free_fn = aes_cbc_free;
-	algo->align        = SWDMX_DESC_ALIGN_HEAD;
+	algo->algo.set_fn   = aes_cbc_set;
+	algo->algo.desc_fn  = aes_cbc_desc;
+	algo->algo.free_fn  = aes_cbc_free;
+	algo->algo.batch_fn = aes_cbc_desc_batch;
+	algo->align         = SWDMX_DESC_ALIGN_HEAD;
 
 	memset(key,0,sizeof(key));
 #ifdef __KERNEL__
-	algo->desc.tfm = crypto_alloc_blkcipher("cbc(aes)", 0, CRYPTO_ALG_ASYNC);
-	algo->desc.flags = 0;
-	algo->desc.info = 0;
-	crypto_blkcipher_setkey(algo->desc.tfm,key, sizeof(key));
+	algo->tfm = crypto_alloc_sync_skcipher("cbc(aes)", 0, 0);
+	if (IS_ERR(algo->tfm)) {
+		swdmx_log("cannot allocate cbc(aes)");
+		swdmx_free(algo);
+		return NULL;
+	}
+	memcpy(algo->odd_key, key, 16);
+	memcpy(algo->even_key, key, 16);
+	algo->key_type = -1;
 #else
 	AES_set_decrypt_key(key, 128, &algo->odd);
 	AES_set_decrypt_key(key, 128, &algo->even);
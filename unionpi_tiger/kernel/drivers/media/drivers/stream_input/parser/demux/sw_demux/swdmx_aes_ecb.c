@@ -20,18 +20,24 @@
 
 #include "swdemux_internal.h"
 #ifdef __KERNEL__
-#include <linux/crypto.h>
+#include <linux/scatterlist.h>
+#include <crypto/skcipher.h>
 #else
 #include "crypto/aes.h"
 #endif
 
+/*Packets decrypted by one ECB request.*/
+#define AES_ECB_BATCH_NUM 32
+
 typedef struct {
 	SWDMX_DescAlgo algo;
 	SWDMX_Int      align;
 #ifdef __KERNEL__
-	struct crypto_cipher *tfm;
+	struct crypto_sync_skcipher *tfm;
+	SWDMX_Int   key_type; /**< Key set to tfm, -1 if none.*/
 	SWDMX_UInt8 odd_key[16];
 	SWDMX_UInt8 even_key[16];
+	struct scatterlist sg[AES_ECB_BATCH_NUM];
 #else
 	AES_KEY        odd;
 	AES_KEY        even;
@@ -51,6 +57,7 @@ aes_ecb_set (SWDMX_DescAlgo *p, SWDMX_Int type, SWDMX_Ptr param)
 		r   = SWDMX_OK;
 #ifdef __KERNEL__
 		memcpy(&algo->odd_key,key,16);
+		algo->key_type = -1;
 #else
 		AES_set_decrypt_key(key, 128, &algo->odd);
 #endif
@@ -60,6 +67,7 @@ aes_ecb_set (SWDMX_DescAlgo *p, SWDMX_Int type, SWDMX_Ptr param)
 		r   = SWDMX_OK;
 #ifdef __KERNEL__
 		memcpy(&algo->even_key,key,16);
+		algo->key_type = -1;
 #else
 		AES_set_decrypt_key(key, 128, &algo->even);
 #endif
@@ -77,22 +85,12 @@ aes_ecb_set (SWDMX_DescAlgo *p, SWDMX_Int type, SWDMX_Ptr param)
 	return r;
 }
 
-//key_type:
-//0:even_key
-//1:odd_key
-static void
-aes_ecb_desc_pkt (SWDMX_AesEcbAlgo *algo, SWDMX_Int key_type, SWDMX_TsPacket *pkt, SWDMX_Int align)
+/*Get the part of the payload made of whole AES blocks.*/
+static SWDMX_Int
+aes_ecb_blocks (SWDMX_TsPacket *pkt, SWDMX_Int align, SWDMX_UInt8 **data)
 {
 	SWDMX_UInt8 *p    = pkt->payload;
-	SWDMX_Int    left = pkt->payload_len, len;
-	SWDMX_UInt8  obuf[184];
-	SWDMX_UInt8 *in;
-	SWDMX_UInt8 *out  = obuf;
-#ifdef __KERNEL__
-	u8 *key = NULL;
-#else
-	AES_KEY *key = NULL;
-#endif
+	SWDMX_Int    left = pkt->payload_len;
 
 	if (align == SWDMX_DESC_ALIGN_TAIL) {
 		SWDMX_Int head = left & 15;
@@ -104,35 +102,87 @@ aes_ecb_desc_pkt (SWDMX_AesEcbAlgo *algo, SWDMX_Int key_type, SWDMX_TsPacket *pk
 
 		left -= tail;
 	}
+
+	*data = p;
+	return left;
+}
+
 #ifdef __KERNEL__
-	if (key_type == 0) {
-		key = (u8*)&algo->even_key;
-	}else{
-		key = (u8*)&algo->odd_key;
-	}
-	crypto_cipher_setkey(algo->tfm,key, 16);
+//key_type:
+//0:even_key
+//1:odd_key
+//Only expand the key when the parity changes.
+static void
+aes_ecb_set_key (SWDMX_AesEcbAlgo *algo, SWDMX_Int key_type)
+{
+	if (algo->key_type == key_type)
+		return;
+
+	crypto_sync_skcipher_setkey(algo->tfm,
+			key_type ? algo->odd_key : algo->even_key, 16);
+	algo->key_type = key_type;
+}
+
+/*Decrypt the first num entries of algo->sg in place.*/
+static void
+aes_ecb_run (SWDMX_AesEcbAlgo *algo, SWDMX_Int num, SWDMX_Int len)
+{
+	SYNC_SKCIPHER_REQUEST_ON_STACK(req, algo->tfm);
+
+	sg_mark_end(&algo->sg[num - 1]);
+
+	skcipher_request_set_sync_tfm(req, algo->tfm);
+	skcipher_request_set_callback(req, 0, NULL, NULL);
+	skcipher_request_set_crypt(req, algo->sg, algo->sg, len, NULL);
+	crypto_skcipher_decrypt(req);
+	skcipher_request_zero(req);
+}
+#endif
+
+//key_type:
+//0:even_key
+//1:odd_key
+static void
+aes_ecb_desc_pkt (SWDMX_AesEcbAlgo *algo, SWDMX_Int key_type, SWDMX_TsPacket *pkt, SWDMX_Int align)
+{
+	SWDMX_UInt8 *p;
+	SWDMX_Int    left;
+#ifndef __KERNEL__
+	SWDMX_UInt8  obuf[184];
+	SWDMX_UInt8 *in;
+	SWDMX_UInt8 *out  = obuf;
+	SWDMX_Int    len;
+	AES_KEY     *key  = NULL;
+#endif
+
+	left = aes_ecb_blocks(pkt, align, &p);
+	if (!left)
+		return;
+
+#ifdef __KERNEL__
+	aes_ecb_set_key(algo, key_type);
+
+	sg_init_table(algo->sg, 1);
+	sg_set_buf(&algo->sg[0], p, left);
+	aes_ecb_run(algo, 1, left);
 #else
 	if (key_type == 0) {
 		key = &algo->even;
 	}else{
 		key = &algo->odd;
 	}
-#endif
 	in  = p;
 	len = left;
 
 	while (left >= 16) {
-#ifdef __KERNEL__
-		crypto_cipher_decrypt_one(algo->tfm,out, p);
-#else
 		AES_ecb_encrypt(p, out, key, 0);
-#endif
 		p    += 16;
 		out  += 16;
 		left -= 16;
 	}
 
-	memcpy(in, out, len);
+	memcpy(in, obuf, len);
+#endif
 }
 
 static SWDMX_Result
@@ -152,11 +202,69 @@ aes_ecb_desc (SWDMX_DescAlgo *p, SWDMX_TsPacket *pkt)
 	return SWDMX_OK;
 }
 
+/*
+ * ECB blocks are independent, so the kernel path decrypts up to
+ * AES_ECB_BATCH_NUM packets of one parity with a single request.
+ */
+static SWDMX_Result
+aes_ecb_desc_batch (SWDMX_DescAlgo *p, SWDMX_TsPacket **pkts, SWDMX_Int num)
+{
+	SWDMX_AesEcbAlgo *algo = (SWDMX_AesEcbAlgo*)p;
+	SWDMX_Int         key_type, i;
+
+	for (key_type = 0; key_type < 2; key_type ++) {
+#ifdef __KERNEL__
+		SWDMX_Int n = 0, total = 0;
+
+		for (i = 0; i < num; i ++) {
+			SWDMX_UInt8 *data;
+			SWDMX_Int    len;
+
+			if (pkts[i]->scramble != 2 + key_type)
+				continue;
+
+			len = aes_ecb_blocks(pkts[i], algo->align, &data);
+			if (!len)
+				continue;
+
+			if (!n)
+				sg_init_table(algo->sg, AES_ECB_BATCH_NUM);
+
+			sg_set_buf(&algo->sg[n ++], data, len);
+			total += len;
+
+			if (n == AES_ECB_BATCH_NUM) {
+				aes_ecb_set_key(algo, key_type);
+				aes_ecb_run(algo, n, total);
+				n     = 0;
+				total = 0;
+			}
+		}
+
+		if (n) {
+			aes_ecb_set_key(algo, key_type);
+			aes_ecb_run(algo, n, total);
+		}
+#else
+		for (i = 0; i < num; i ++) {
+			if (pkts[i]->scramble == 2 + key_type)
+				aes_ecb_desc_pkt(algo, key_type, pkts[i], algo->align);
+		}
+#endif
+	}
+
+	return SWDMX_OK;
+}
+
 static void
 aes_ecb_free (SWDMX_DescAlgo *p)
 {
 	SWDMX_AesEcbAlgo *algo = (SWDMX_AesEcbAlgo*)p;
 
+#ifdef __KERNEL__
+	if (!IS_ERR_OR_NULL(algo->tfm))
+		crypto_free_sync_skcipher(algo->tfm);
+#endif
 	swdmx_free(algo);
 }
 
@@ -169,20 +277,27 @@ swdmx_aes_ecb_algo_new (void)
 	algo = swdmx_malloc(sizeof(SWDMX_AesEcbAlgo));
 	SWDMX_ASSERT(algo);
 
-	algo->algo.set_fn  = aes_ecb_set;
-	algo->algo.desc_fn = aes_ecb_desc;
-	algo->algo.free_fn = aes_ecb_free;
-	algo->align        = SWDMX_DESC_ALIGN_HEAD;
+	algo->algo.set_fn   = aes_ecb_set;
+	algo->algo.desc_fn  = aes_ecb_desc;
+	algo->algo.free_fn  = aes_ecb_free;
+	algo->algo.batch_fn = aes_ecb_desc_batch;
+	algo->align         = SWDMX_DESC_ALIGN_HEAD;
 
 	memset(key,0,sizeof(key));
 
 #ifdef __KERNEL__
-	algo->tfm = crypto_alloc_cipher("ecb(aes)", 0, CRYPTO_ALG_ASYNC);
-	crypto_cipher_setkey(algo->tfm,key, sizeof(key));
+	algo->tfm = crypto_alloc_sync_skcipher("ecb(aes)", 0, 0);
+	if (IS_ERR(algo->tfm)) {
+		swdmx_log("cannot allocate ecb(aes)");
+		swdmx_free(algo);
+		return NULL;
+	}
+	memcpy(algo->odd_key, key, 16);
+	memcpy(algo->even_key, key, 16);
+	algo->key_type = -1;
 #else
 	AES_set_decrypt_key(key, 128, &algo->odd);
 	AES_set_decrypt_key(key, 128, &algo->even);
 #endif
 	return (SWDMX_DescAlgo*)algo;
 }
-
@@ -21,20 +21,39 @@
 
 #include "swdemux_internal.h"
 
+/*Look up the PID filter in the PID table.*/
+static inline SWDMX_PidFilter*
+pid_filter_lookup (SWDMX_Demux *dmx, SWDMX_UInt16 pid)
+{
+	SWDMX_PidFilter **page = dmx->pid_table[pid / SWDMX_PID_PAGE_SIZE];
+
+	return page ? page[pid % SWDMX_PID_PAGE_SIZE] : NULL;
+}
+
 /*Get the PID filter with the PID.*/
 static SWDMX_PidFilter*
 pid_filter_get (SWDMX_Demux *dmx, SWDMX_UInt16 pid)
 {
-	SWDMX_PidFilter *f;
+	SWDMX_PidFilter **page;
+	SWDMX_PidFilter  *f;
 
-	SWDMX_LIST_FOR_EACH(f, &dmx->pid_filter_list, ln) {
-		if (f->pid == pid)
-			return f;
+	f = pid_filter_lookup(dmx, pid);
+	if (f)
+		return f;
+
+	page = dmx->pid_table[pid / SWDMX_PID_PAGE_SIZE];
+	if (!page) {
+		page = swdmx_malloc(sizeof(SWDMX_PidFilter*) * SWDMX_PID_PAGE_SIZE);
+		SWDMX_ASSERT(page);
+
+		memset(page, 0, sizeof(SWDMX_PidFilter*) * SWDMX_PID_PAGE_SIZE);
+		dmx->pid_table[pid / SWDMX_PID_PAGE_SIZE] = page;
 	}
 
 	f = swdmx_malloc(sizeof(SWDMX_PidFilter));
 	SWDMX_ASSERT(f);
 
+	f->dmx      = dmx;
 	f->pid      = pid;
 	f->sec_data = NULL;
 	f->sec_recv = 0;
@@ -43,6 +62,7 @@ pid_filter_get (SWDMX_Demux *dmx, SWDMX_UInt16 pid)
 	swdmx_list_init(&f->ts_filter_list);
 
 	swdmx_list_append(&dmx->pid_filter_list, &f->ln);
+	page[pid % SWDMX_PID_PAGE_SIZE] = f;
 
 	return f;
 }
@@ -56,6 +76,7 @@ pid_filter_remove (SWDMX_PidFilter *f)
 		return;
 
 	swdmx_list_remove(&f->ln);
+	f->dmx->pid_table[f->pid / SWDMX_PID_PAGE_SIZE][f->pid % SWDMX_PID_PAGE_SIZE] = NULL;
 
 	if (f->sec_data)
 		swdmx_free(f->sec_data);
@@ -63,32 +84,35 @@ pid_filter_remove (SWDMX_PidFilter *f)
 	swdmx_free(f);
 }
 
-/*Section filter match test.*/
-static SWDMX_Bool
-sec_filter_match (SWDMX_UInt8 *data, SWDMX_Int len, SWDMX_SecFilter *f)
+/*Get the filtered section bytes, byte 0 and 3 to 17, as 128 bits.
+ *The section length is not filtered, bytes after the section end are 0.*/
+static void
+sec_filter_key (SWDMX_UInt8 *data, SWDMX_Int len, SWDMX_UInt64 *key)
 {
-	SWDMX_Int   i;
-	SWDMX_UInt8 m = 0, n = 0;
-	SWDMX_UInt8 has_n = 0;
+	SWDMX_UInt8 buf[SWDMX_SEC_FILTER_LEN];
+	SWDMX_Int   n = SWDMX_MIN(len - 3, SWDMX_SEC_FILTER_LEN - 1);
 
-	for (i = 0; i < SWDMX_SEC_FILTER_LEN; i ++) {
-		SWDMX_UInt8 d, v;
+	memset(buf, 0, sizeof(buf));
 
-		d = data[i] & f->mam[i];
-		v = f->value[i] & f->mam[i];
-		m |= d ^ v;
+	buf[0] = data[0];
+	if (n > 0)
+		memcpy(buf + 1, data + 3, n);
 
-		d = data[i] & f->manm[i];
-		v = f->value[i] & f->manm[i];
-		n |= d ^ v;
+	memcpy(key, buf, sizeof(buf));
+}
 
-		has_n |= f->manm[i];
-	}
+/*Section filter match test.*/
+static inline SWDMX_Bool
+sec_filter_match (const SWDMX_UInt64 *key, SWDMX_SecFilter *f)
+{
+	SWDMX_UInt64 d0 = key[0] ^ f->value[0];
+	SWDMX_UInt64 d1 = key[1] ^ f->value[1];
 
-	if (m)
+	if ((d0 & f->mam[0]) | (d1 & f->mam[1]))
 		return SWDMX_FALSE;
 
-	if (has_n && !n)
+	if ((f->manm[0] | f->manm[1])
+			&& !((d0 & f->manm[0]) | (d1 & f->manm[1])))
 		return SWDMX_FALSE;
 
 	return SWDMX_TRUE;
@@ -102,8 +126,6 @@ sec_data (SWDMX_PidFilter *pid_filter, SWDMX_UInt8 *p, SWDMX_Int len)
 	SWDMX_UInt8 *sec = pid_filter->sec_data;
 	SWDMX_Bool   crc = SWDMX_FALSE;
 
-	swdmx_log("%s enter\n",__FUNCTION__);
-
 	if (pid_filter->sec_recv < 3) {
 		n = SWDMX_MIN(left, 3 - pid_filter->sec_recv);
 
@@ -136,6 +158,9 @@ sec_data (SWDMX_PidFilter *pid_filter, SWDMX_UInt8 *p, SWDMX_Int len)
 	if (pid_filter->sec_recv == sec_len) {
 		SWDMX_SecFilter *sec_filter, *n_sec_filter;
 		SWDMX_CbEntry   *ce, *nce;
+		SWDMX_UInt64     key[2];
+
+		sec_filter_key(pid_filter->sec_data, pid_filter->sec_recv, key);
 
 		SWDMX_LIST_FOR_EACH_SAFE(sec_filter,
 					n_sec_filter,
@@ -154,12 +179,8 @@ sec_data (SWDMX_PidFilter *pid_filter, SWDMX_UInt8 *p, SWDMX_Int len)
 				}
 			}
 
-			if (!sec_filter_match(pid_filter->sec_data,
-						pid_filter->sec_recv,
-						sec_filter)) {
-				  swdmx_log("not sec_filter_match\n");
-			      continue;
-			}
+			if (!sec_filter_match(key, sec_filter))
+				continue;
 
 			SWDMX_LIST_FOR_EACH_SAFE(ce, nce, &sec_filter->cb_list,
 						ln) {
@@ -203,8 +224,6 @@ pid_filter_data (SWDMX_PidFilter *pid_filter, SWDMX_TsPacket *pkt)
 	if (!pkt->payload || pkt->scramble)
 		return;
 
-	swdmx_log("%s handle section \n",__FUNCTION__);
-
 	/*Solve section data.*/
 	if (!pid_filter->sec_data) {
 		pid_filter->sec_data = swdmx_malloc(4096 + 3);
@@ -260,6 +279,8 @@ swdmx_demux_new (void)
 	swdmx_list_init(&dmx->ts_filter_list);
 	swdmx_list_init(&dmx->sec_filter_list);
 
+	memset(dmx->pid_table, 0, sizeof(dmx->pid_table));
+
 	return dmx;
 }
 
@@ -314,17 +335,16 @@ swdmx_demux_ts_packet_cb (
 
 	SWDMX_ASSERT(pkt && dmx);
 
-	SWDMX_LIST_FOR_EACH(pid_filter, &dmx->pid_filter_list, ln) {
-		if (pkt->pid == pid_filter->pid) {
-			pid_filter_data(pid_filter, pkt);
-			break;
-		}
-	}
+	pid_filter = pid_filter_lookup(dmx, pkt->pid);
+	if (pid_filter)
+		pid_filter_data(pid_filter, pkt);
 }
 
 void
 swdmx_demux_free (SWDMX_Demux *dmx)
 {
+	SWDMX_Int i;
+
 	SWDMX_ASSERT(dmx);
 
 	while (!swdmx_list_is_empty(&dmx->ts_filter_list)) {
@@ -351,6 +371,11 @@ swdmx_demux_free (SWDMX_Demux *dmx)
 		pid_filter_remove(f);
 	}
 
+	for (i = 0; i < SWDMX_PID_PAGE_NUM; i ++) {
+		if (dmx->pid_table[i])
+			swdmx_free(dmx->pid_table[i]);
+	}
+
 	swdmx_free(dmx);
 }
 
@@ -480,7 +505,10 @@ swdmx_sec_filter_set_params (
 			SWDMX_SecFilter       *filter,
 			SWDMX_SecFilterParams *params)
 {
-	SWDMX_Int i;
+	SWDMX_UInt8 value[SWDMX_SEC_FILTER_LEN];
+	SWDMX_UInt8 mam[SWDMX_SEC_FILTER_LEN];
+	SWDMX_UInt8 manm[SWDMX_SEC_FILTER_LEN];
+	SWDMX_Int   i;
 
 	SWDMX_ASSERT(filter && params);
 
@@ -502,25 +530,23 @@ swdmx_sec_filter_set_params (
 
 	filter->params = *params;
 
+	/*Byte i of the filter matches byte 0 of the section for i == 0,
+	 *else byte i + 2, the same layout as sec_filter_key.*/
 	for (i = 0; i < SWDMX_SEC_FILTER_LEN; i ++) {
-		SWDMX_Int   j = i ? i + 2 : i;
 		SWDMX_UInt8 v, mask, mode;
 
 		v    = params->value[i];
 		mask = params->mask[i];
 		mode = ~params->mode[i];
 
-		filter->value[j] = v;
-		filter->mam[j]   = mask & mode;
-		filter->manm[j]  = mask & ~mode;
+		value[i] = v;
+		mam[i]   = mask & mode;
+		manm[i]  = mask & ~mode;
 	}
 
-	filter->value[1] = 0;
-	filter->mam[1]   = 0;
-	filter->manm[1]  = 0;
-	filter->value[2] = 0;
-	filter->mam[2]   = 0;
-	filter->manm[2]  = 0;
+	memcpy(filter->value, value, sizeof(value));
+	memcpy(filter->mam, mam, sizeof(mam));
+	memcpy(filter->manm, manm, sizeof(manm));
 
 	if (filter->state == SWDMX_FILTER_STATE_INIT)
 		filter->state = SWDMX_FILTER_STATE_SET;
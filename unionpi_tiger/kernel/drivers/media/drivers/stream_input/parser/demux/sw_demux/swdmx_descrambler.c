@@ -31,6 +31,12 @@ swdmx_descrambler_new (void)
 	swdmx_list_init(&desc->chan_list);
 	swdmx_list_init(&desc->cb_list);
 
+	desc->batch_max  = 0;
+	desc->batch_num  = 0;
+	desc->batch      = NULL;
+	desc->batch_chan = NULL;
+	desc->batch_pkts = NULL;
+
 	return desc;
 }
 
@@ -53,37 +59,174 @@ swdmx_descrambler_alloc_channel (SWDMX_Descrambler *desc)
 	return chan;
 }
 
+/*Get the enabled channel descrambling the packet.*/
+static SWDMX_DescChannel*
+desc_get_channel (SWDMX_Descrambler *desc, SWDMX_TsPacket *pkt)
+{
+	SWDMX_DescChannel *ch;
+
+	if (!pkt->scramble || !pkt->payload)
+		return NULL;
+
+	SWDMX_LIST_FOR_EACH(ch, &desc->chan_list, ln) {
+		if ((ch->enable) && (ch->pid == pkt->pid))
+			return ch;
+	}
+
+	return NULL;
+}
+
+/*Mark the packet as descrambled.*/
+static inline void
+desc_clear_scramble (SWDMX_TsPacket *pkt)
+{
+	pkt->scramble   = 0;
+	pkt->packet[3] &= 0x3f;
+}
+
+/*Output the packet to the callbacks.*/
+static void
+desc_output (SWDMX_Descrambler *desc, SWDMX_TsPacket *pkt)
+{
+	SWDMX_CbEntry *ce, *nce;
+
+	SWDMX_LIST_FOR_EACH_SAFE(ce, nce, &desc->cb_list, ln) {
+		SWDMX_TsPacketCb cb = ce->cb;
+		cb(pkt, ce->data);
+	}
+}
+
+/*Descramble the queued packets channel by channel and output them.*/
+static void
+desc_flush (SWDMX_Descrambler *desc)
+{
+	SWDMX_Int i, j, n;
+
+	for (i = 0; i < desc->batch_num; i ++) {
+		SWDMX_DescChannel *ch = desc->batch_chan[i];
+		SWDMX_DescAlgo    *algo;
+
+		if (!ch)
+			continue;
+
+		algo = ch->algo;
+		n    = 0;
+
+		for (j = i; j < desc->batch_num; j ++) {
+			SWDMX_TsPacket *pkt = &desc->batch[j];
+
+			if (desc->batch_chan[j] != ch)
+				continue;
+
+			desc->batch_chan[j] = NULL;
+
+			if (algo->batch_fn && (pkt->scramble & 2)) {
+				desc->batch_pkts[n ++] = pkt;
+			} else if (algo->desc_fn(algo, pkt) == SWDMX_OK) {
+				desc_clear_scramble(pkt);
+			}
+		}
+
+		if (n && (algo->batch_fn(algo, desc->batch_pkts, n) == SWDMX_OK)) {
+			for (j = 0; j < n; j ++)
+				desc_clear_scramble(desc->batch_pkts[j]);
+		}
+	}
+
+	for (i = 0; i < desc->batch_num; i ++)
+		desc_output(desc, &desc->batch[i]);
+
+	desc->batch_num = 0;
+}
+
 void
 swdmx_descrambler_ts_packet_cb (
 			SWDMX_TsPacket *pkt,
 			SWDMX_Ptr       data)
 {
 	SWDMX_Descrambler *desc = (SWDMX_Descrambler*)data;
-	SWDMX_DescChannel *ch, *nch;
-	SWDMX_CbEntry     *ce, *nce;
+	SWDMX_DescChannel *ch;
 
 	SWDMX_ASSERT(pkt && desc);
 
-	if (pkt->scramble && pkt->payload) {
-		SWDMX_LIST_FOR_EACH_SAFE(ch, nch, &desc->chan_list, ln) {
-			if ((ch->enable) && (ch->pid == pkt->pid)) {
-				SWDMX_Result r;
+	ch = desc_get_channel(desc, pkt);
 
-				r = ch->algo->desc_fn(ch->algo, pkt);
-				if (r == SWDMX_OK) {
-					pkt->scramble   = 0;
-					pkt->packet[3] &= 0x3f;
-				}
+	if (desc->batch_max) {
+		desc->batch[desc->batch_num]      = *pkt;
+		desc->batch_chan[desc->batch_num] = ch;
 
-				break;
-			}
-		}
+		if (++ desc->batch_num == desc->batch_max)
+			desc_flush(desc);
+		return;
 	}
 
-	SWDMX_LIST_FOR_EACH_SAFE(ce, nce, &desc->cb_list, ln) {
-		SWDMX_TsPacketCb cb = ce->cb;
-		cb(pkt, ce->data);
+	if (ch) {
+		if (ch->algo->desc_fn(ch->algo, pkt) == SWDMX_OK)
+			desc_clear_scramble(pkt);
 	}
+
+	desc_output(desc, pkt);
+}
+
+void
+swdmx_descrambler_run_end_cb (SWDMX_Ptr data)
+{
+	SWDMX_Descrambler *desc = (SWDMX_Descrambler*)data;
+
+	SWDMX_ASSERT(desc);
+
+	if (desc->batch_num)
+		desc_flush(desc);
+}
+
+/*Free the batch queue.*/
+static void
+desc_batch_free (SWDMX_Descrambler *desc)
+{
+	if (desc->batch_num)
+		desc_flush(desc);
+
+	if (desc->batch)
+		swdmx_free(desc->batch);
+	if (desc->batch_chan)
+		swdmx_free(desc->batch_chan);
+	if (desc->batch_pkts)
+		swdmx_free(desc->batch_pkts);
+
+	desc->batch_max  = 0;
+	desc->batch      = NULL;
+	desc->batch_chan = NULL;
+	desc->batch_pkts = NULL;
+}
+
+SWDMX_Result
+swdmx_descrambler_set_batch (
+			SWDMX_Descrambler *desc,
+			SWDMX_Int          num)
+{
+	SWDMX_ASSERT(desc);
+
+	if (num < 0) {
+		swdmx_log("illegal batch size %d", num);
+		return SWDMX_ERR;
+	}
+
+	desc_batch_free(desc);
+
+	if (!num)
+		return SWDMX_OK;
+
+	desc->batch      = swdmx_malloc(sizeof(SWDMX_TsPacket) * num);
+	desc->batch_chan = swdmx_malloc(sizeof(SWDMX_DescChannel*) * num);
+	desc->batch_pkts = swdmx_malloc(sizeof(SWDMX_TsPacket*) * num);
+	if (!desc->batch || !desc->batch_chan || !desc->batch_pkts) {
+		desc_batch_free(desc);
+		return SWDMX_ERR;
+	}
+
+	desc->batch_max = num;
+
+	return SWDMX_OK;
 }
 
 SWDMX_Result
@@ -117,6 +260,8 @@ swdmx_descrambler_free (SWDMX_Descrambler *desc)
 {
 	SWDMX_ASSERT(desc);
 
+	desc_batch_free(desc);
+
 	while (!swdmx_list_is_empty(&desc->chan_list)) {
 		SWDMX_DescChannel *chan;
 
@@ -23,9 +23,14 @@
 #include "dvbcsa2/dvbcsa/dvbcsa.h"
 
 typedef struct {
-	SWDMX_DescAlgo  algo;
-	dvbcsa_key_t   *odd_key;
-	dvbcsa_key_t   *even_key;
+	SWDMX_DescAlgo            algo;
+	dvbcsa_key_t             *odd_key;
+	dvbcsa_key_t             *even_key;
+	dvbcsa_bs_key_t          *odd_bs_key;
+	dvbcsa_bs_key_t          *even_bs_key;
+	SWDMX_Int                 bs_size;    /**< Bitslice batch size.*/
+	struct dvbcsa_bs_batch_s *odd_batch;  /**< bs_size + 1 entries.*/
+	struct dvbcsa_bs_batch_s *even_batch; /**< bs_size + 1 entries.*/
 } SWDMX_DvbCsa2Algo;
 
 static SWDMX_Result
@@ -40,11 +45,13 @@ dvbcsa2_set (SWDMX_DescAlgo *p, SWDMX_Int type, SWDMX_Ptr param)
 		key = param;
 		r   = SWDMX_OK;
 		dvbcsa_key_set(key, algo->odd_key);
+		dvbcsa_bs_key_set(key, algo->odd_bs_key);
 		break;
 	case SWDMX_DVBCSA2_PARAM_EVEN_KEY:
 		key = param;
 		r   = SWDMX_OK;
 		dvbcsa_key_set(key, algo->even_key);
+		dvbcsa_bs_key_set(key, algo->even_bs_key);
 		break;
 	default:
 		swdmx_log("illegal DVBCSA2 parameter");
@@ -72,6 +79,59 @@ dvbcsa2_desc (SWDMX_DescAlgo *p, SWDMX_TsPacket *pkt)
 	return SWDMX_OK;
 }
 
+/*Run the bitslice engine on num packets of the batch.*/
+static void
+dvbcsa2_bs_run (dvbcsa_bs_key_t *key, struct dvbcsa_bs_batch_s *batch,
+			SWDMX_Int num)
+{
+	batch[num].data = NULL;
+	batch[num].len  = 0;
+
+	dvbcsa_bs_decrypt(key, batch, 184);
+}
+
+static SWDMX_Result
+dvbcsa2_desc_batch (SWDMX_DescAlgo *p, SWDMX_TsPacket **pkts, SWDMX_Int num)
+{
+	SWDMX_DvbCsa2Algo *algo = (SWDMX_DvbCsa2Algo*)p;
+	SWDMX_Int          odd  = 0, even = 0, i;
+	SWDMX_Result       r    = SWDMX_OK;
+
+	for (i = 0; i < num; i ++) {
+		SWDMX_TsPacket           *pkt = pkts[i];
+		struct dvbcsa_bs_batch_s *b;
+
+		if (pkt->scramble == 2) {
+			b = &algo->even_batch[even ++];
+		} else if (pkt->scramble == 3) {
+			b = &algo->odd_batch[odd ++];
+		} else {
+			swdmx_log("illegal scramble control field");
+			r = SWDMX_ERR;
+			continue;
+		}
+
+		b->data = pkt->payload;
+		b->len  = pkt->payload_len;
+
+		if (even == algo->bs_size) {
+			dvbcsa2_bs_run(algo->even_bs_key, algo->even_batch, even);
+			even = 0;
+		}
+		if (odd == algo->bs_size) {
+			dvbcsa2_bs_run(algo->odd_bs_key, algo->odd_batch, odd);
+			odd = 0;
+		}
+	}
+
+	if (even)
+		dvbcsa2_bs_run(algo->even_bs_key, algo->even_batch, even);
+	if (odd)
+		dvbcsa2_bs_run(algo->odd_bs_key, algo->odd_batch, odd);
+
+	return r;
+}
+
 static void
 dvbcsa2_free (SWDMX_DescAlgo *p)
 {
@@ -79,6 +139,10 @@ dvbcsa2_free (SWDMX_DescAlgo *p)
 
 	dvbcsa_key_free(algo->odd_key);
 	dvbcsa_key_free(algo->even_key);
+	dvbcsa_bs_key_free(algo->odd_bs_key);
+	dvbcsa_bs_key_free(algo->even_bs_key);
+	swdmx_free(algo->odd_batch);
+	swdmx_free(algo->even_batch);
 
 	swdmx_free(algo);
 }
@@ -94,7 +158,8 @@ swdmx_dvbcsa2_algo_new (void)
 
 	algo->algo.set_fn  = dvbcsa2_set;
 	algo->algo.desc_fn = dvbcsa2_desc;
-	algo->algo.free_fn = dvbcsa2_free;
+	algo->algo.free_fn  = dvbcsa2_free;
+	algo->algo.batch_fn = dvbcsa2_desc_batch;
 
 	algo->odd_key  = dvbcsa_key_alloc();
 	algo->even_key = dvbcsa_key_alloc();
@@ -102,6 +167,22 @@ swdmx_dvbcsa2_algo_new (void)
 	dvbcsa_key_set(key, algo->odd_key);
 	dvbcsa_key_set(key, algo->even_key);
 
+	algo->odd_bs_key  = dvbcsa_bs_key_alloc();
+	algo->even_bs_key = dvbcsa_bs_key_alloc();
+	SWDMX_ASSERT(algo->odd_bs_key);
+	SWDMX_ASSERT(algo->even_bs_key);
+
+	dvbcsa_bs_key_set(key, algo->odd_bs_key);
+	dvbcsa_bs_key_set(key, algo->even_bs_key);
+
+	algo->bs_size    = dvbcsa_bs_batch_size();
+	algo->odd_batch  = swdmx_malloc(sizeof(struct dvbcsa_bs_batch_s) *
+				(algo->bs_size + 1));
+	algo->even_batch = swdmx_malloc(sizeof(struct dvbcsa_bs_batch_s) *
+				(algo->bs_size + 1));
+	SWDMX_ASSERT(algo->odd_batch);
+	SWDMX_ASSERT(algo->even_batch);
+
 	return (SWDMX_DescAlgo*)algo;
 }
 
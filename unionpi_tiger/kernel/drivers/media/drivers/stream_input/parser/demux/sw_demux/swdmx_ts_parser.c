@@ -30,8 +30,11 @@ swdmx_ts_parser_new (void)
 	SWDMX_ASSERT(tsp);
 
 	tsp->packet_size = 188;
+	tsp->auto_size   = SWDMX_FALSE;
+	tsp->sync        = SWDMX_FALSE;
 
 	swdmx_list_init(&tsp->cb_list);
+	swdmx_list_init(&tsp->end_cb_list);
 
 	return tsp;
 }
@@ -43,12 +46,20 @@ swdmx_ts_parser_set_packet_size (
 {
 	SWDMX_ASSERT(tsp);
 
+	if (size == SWDMX_TS_PACKET_SIZE_AUTO) {
+		tsp->auto_size = SWDMX_TRUE;
+		tsp->sync      = SWDMX_FALSE;
+		return SWDMX_OK;
+	}
+
 	if (size < 188) {
 		swdmx_log("packet size should >= 188");
 		return SWDMX_ERR;
 	}
 
 	tsp->packet_size = size;
+	tsp->auto_size   = SWDMX_FALSE;
+	tsp->sync        = SWDMX_FALSE;
 
 	return SWDMX_OK;
 }
@@ -78,6 +89,32 @@ swdmx_ts_parser_remove_ts_packet_cb (
 
 	return SWDMX_OK;
 }
+
+SWDMX_Result
+swdmx_ts_parser_add_run_end_cb (
+			SWDMX_TsParser   *tsp,
+			SWDMX_TsRunEndCb  cb,
+			SWDMX_Ptr         data)
+{
+	SWDMX_ASSERT(tsp && cb);
+
+	swdmx_cb_list_add(&tsp->end_cb_list, cb, data);
+
+	return SWDMX_OK;
+}
+
+SWDMX_Result
+swdmx_ts_parser_remove_run_end_cb (
+			SWDMX_TsParser   *tsp,
+			SWDMX_TsRunEndCb  cb,
+			SWDMX_Ptr         data)
+{
+	SWDMX_ASSERT(tsp && cb);
+
+	swdmx_cb_list_remove(&tsp->end_cb_list, cb, data);
+
+	return SWDMX_OK;
+}
 /*Parse the TS packet.*/
 static void
 ts_packet (SWDMX_TsParser *tsp, SWDMX_UInt8 *data)
@@ -139,6 +176,53 @@ ts_packet (SWDMX_TsParser *tsp, SWDMX_UInt8 *data)
 	}
 }
 
+/*Check the sync bytes of the num packets following p.
+ *Return 1 if they are all present, 0 if not, -1 if more data is needed.*/
+static SWDMX_Int
+ts_sync_check (SWDMX_UInt8 *p, SWDMX_Int left, SWDMX_Int size, SWDMX_Int num)
+{
+	SWDMX_Int i;
+
+	if (left <= size * num)
+		return -1;
+
+	for (i = 1; i <= num; i ++) {
+		if (p[size * i] != 0x47)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*Try to lock to the packet starting at p.
+ *The next packet must also start with a sync byte. When detecting the
+ *packet size, 2 following sync bytes are needed to pick the size.*/
+static SWDMX_Int
+ts_sync_lock (SWDMX_TsParser *tsp, SWDMX_UInt8 *p, SWDMX_Int left)
+{
+	static const SWDMX_Int sizes[] = {188, 192, 204};
+	SWDMX_Int i, r, ret = 0;
+
+	if (!tsp->auto_size)
+		return ts_sync_check(p, left, tsp->packet_size, 1);
+
+	for (i = 0; i < (SWDMX_Int)(sizeof(sizes) / sizeof(sizes[0])); i ++) {
+		r = ts_sync_check(p, left, sizes[i], 2);
+		if (r > 0) {
+			if (tsp->packet_size != sizes[i])
+				swdmx_log("TS packet size %d\n", sizes[i]);
+
+			tsp->packet_size = sizes[i];
+			return 1;
+		}
+
+		if (r < 0)
+			ret = -1;
+	}
+
+	return ret;
+}
+
 SWDMX_Int
 swdmx_ts_parser_run (
 			SWDMX_TsParser *tsp,
@@ -147,19 +231,56 @@ swdmx_ts_parser_run (
 {
 	SWDMX_UInt8    *p    = data;
 	SWDMX_Int       left = len;
+	SWDMX_CbEntry  *e, *ne;
 
 	SWDMX_ASSERT(tsp && data);
 
 	while (left >= tsp->packet_size) {
-		if (*p == 0x47) {
-			ts_packet(tsp, p);
-
-			p    += tsp->packet_size;
-			left -= tsp->packet_size;
-		} else {
-			p    ++;
-			left --;
+		if (*p != 0x47) {
+			SWDMX_UInt8 *q;
+
+			tsp->sync = SWDMX_FALSE;
+
+			q = memchr(p + 1, 0x47, left - 1);
+			if (!q) {
+				p    += left;
+				left  = 0;
+				break;
+			}
+
+			left -= q - p;
+			p     = q;
+			continue;
+		}
+
+		if (!tsp->sync) {
+			SWDMX_Int r = ts_sync_lock(tsp, p, left);
+
+			if (r == 0) {
+				p    ++;
+				left --;
+				continue;
+			}
+
+			/*
+			 *The caller keeps less than a packet for the next run,
+			 *so a packet too close to the end to be confirmed is
+			 *parsed without locking.
+			 */
+			if (r > 0)
+				tsp->sync = SWDMX_TRUE;
 		}
+
+		ts_packet(tsp, p);
+
+		p    += tsp->packet_size;
+		left -= tsp->packet_size;
+	}
+
+	SWDMX_LIST_FOR_EACH_SAFE(e, ne, &tsp->end_cb_list, ln) {
+		SWDMX_TsRunEndCb cb = e->cb;
+
+		cb(e->data);
 	}
 
 	return len - left;
@@ -171,6 +292,7 @@ swdmx_ts_parser_free (SWDMX_TsParser *tsp)
 	SWDMX_ASSERT(tsp);
 
 	swdmx_cb_list_clear(&tsp->cb_list);
+	swdmx_cb_list_clear(&tsp->end_cb_list);
 	swdmx_free(tsp);
 }
 
@@ -25,6 +25,7 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-buf.h>
 #include <linux/amlogic/media/frame_sync/ptsserv.h>
 
 #include <linux/uaccess.h>
@@ -153,96 +154,97 @@ static inline u32 buf_wp(u32 type)
 	return wp;
 }
 
-static int esparser_stbuf_write(struct stream_buf_s *stbuf, const u8 *buf, u32 count)
-{
-	size_t r = count;
-	const char __user *p = buf;
+static struct stbuf_fetch_stat_s fetch_stat;
 
-	u32 len = 0;
+struct esparser_fetch_s {
+	struct stream_buf_s *stbuf;
 	u32 parser_type;
-	int ret;
 	u32 wp;
-	dma_addr_t dma_addr = 0;
-	u32 type = stbuf->type;
-
-	VDEC_PRINT_FUN_LINENO(__func__, __LINE__);
-	if (type == BUF_TYPE_HEVC)
-		parser_type = PARSER_VIDEO;
-	else if (type == BUF_TYPE_VIDEO)
-		parser_type = PARSER_VIDEO;
-	else if (type == BUF_TYPE_AUDIO)
-		parser_type = PARSER_AUDIO;
-	else
-		parser_type = PARSER_SUBPIC;
+};
 
-	wp = buf_wp(type);
+static void esparser_fetch_start(void *priv, dma_addr_t addr, u32 len)
+{
+	struct esparser_fetch_s *f = priv;
+	struct stream_buf_s *stbuf = f->stbuf;
+
+	f->wp = buf_wp(stbuf->type);
+
+	/* wmb(); don't need */
+	/* reset the Write and read pointer to zero again */
+	WRITE_PARSER_REG(PFIFO_RD_PTR, 0);
+	WRITE_PARSER_REG(PFIFO_WR_PTR, 0);
+
+	WRITE_PARSER_REG_BITS(PARSER_CONTROL, len, ES_PACK_SIZE_BIT,
+						ES_PACK_SIZE_WID);
+	WRITE_PARSER_REG_BITS(PARSER_CONTROL,
+			f->parser_type | PARSER_WRITE |
+			PARSER_AUTOSEARCH, ES_CTRL_BIT,
+			ES_CTRL_WID);
+
+	WRITE_PARSER_REG(PARSER_FETCH_ADDR, (u32)addr);
+
+	search_done = 0;
+	if (!(stbuf->drm_flag & TYPE_PATTERN)) {
+		WRITE_PARSER_REG(PARSER_FETCH_CMD,
+			(7 << FETCH_ENDIAN) | len);
+		WRITE_PARSER_REG(PARSER_FETCH_ADDR, search_pattern_map);
+		WRITE_PARSER_REG(PARSER_FETCH_CMD,
+			(7 << FETCH_ENDIAN) | SEARCH_PATTERN_LEN);
+	} else {
+		WRITE_PARSER_REG(PARSER_FETCH_CMD,
+			(7 << FETCH_ENDIAN) | (len + 512));
+	}
+}
 
-	if (r > 0) {
-		if (stbuf->is_phybuf)
-			len = count;
-		else {
-			len = min_t(size_t, r, (size_t) FETCHBUF_SIZE);
+static int esparser_fetch_wait(void *priv)
+{
+	struct esparser_fetch_s *f = priv;
+	u32 type = f->stbuf->type;
+	int ret;
 
-			if (copy_from_user(fetchbuf, p, len))
-				return -EFAULT;
-			dma_addr = dma_map_single(
-					amports_get_dma_device(), fetchbuf,
-					FETCHBUF_SIZE, DMA_TO_DEVICE);
-			if (dma_mapping_error(amports_get_dma_device(),
-						(dma_addr_t) dma_addr))
-				return -EFAULT;
+	ret = wait_event_interruptible_timeout(wq, search_done != 0,
+		HZ / 5);
+	if (ret == 0) {
+		WRITE_PARSER_REG(PARSER_FETCH_CMD, 0);
 
+		if (f->wp == buf_wp(type)) {
+			/*no data fetched */
+			return -EAGAIN;
+		} else {
+			pr_info("W Timeout, but fetch ok,");
+			pr_info("type %d wpdiff=%d, isphy %x\n",
+			 type, f->wp - buf_wp(type), f->stbuf->is_phybuf);
 		}
+	} else if (ret < 0)
+		return -ERESTARTSYS;
 
-		/* wmb(); don't need */
-		/* reset the Write and read pointer to zero again */
-		WRITE_PARSER_REG(PFIFO_RD_PTR, 0);
-		WRITE_PARSER_REG(PFIFO_WR_PTR, 0);
-
-		WRITE_PARSER_REG_BITS(PARSER_CONTROL, len, ES_PACK_SIZE_BIT,
-							ES_PACK_SIZE_WID);
-		WRITE_PARSER_REG_BITS(PARSER_CONTROL,
-				parser_type | PARSER_WRITE |
-				PARSER_AUTOSEARCH, ES_CTRL_BIT,
-				ES_CTRL_WID);
+	return 0;
+}
 
-		if (stbuf->is_phybuf) {
-			u32 buf_32 = (unsigned long)buf & 0xffffffff;
-			WRITE_PARSER_REG(PARSER_FETCH_ADDR, buf_32);
-		} else {
-			WRITE_PARSER_REG(PARSER_FETCH_ADDR, dma_addr);
-			dma_unmap_single(amports_get_dma_device(), dma_addr,
-					FETCHBUF_SIZE, DMA_TO_DEVICE);
-		}
+static const struct stbuf_fetch_ops esparser_fetch_ops = {
+	.start = esparser_fetch_start,
+	.wait = esparser_fetch_wait,
+};
 
-		search_done = 0;
-		if (!(stbuf->drm_flag & TYPE_PATTERN)) {
-			WRITE_PARSER_REG(PARSER_FETCH_CMD,
-				(7 << FETCH_ENDIAN) | len);
-			WRITE_PARSER_REG(PARSER_FETCH_ADDR, search_pattern_map);
-			WRITE_PARSER_REG(PARSER_FETCH_CMD,
-				(7 << FETCH_ENDIAN) | SEARCH_PATTERN_LEN);
-		} else {
-			WRITE_PARSER_REG(PARSER_FETCH_CMD,
-				(7 << FETCH_ENDIAN) | (len + 512));
-		}
+static void esparser_fetch_init(struct esparser_fetch_s *f,
+	struct stream_buf_s *stbuf)
+{
+	u32 type = stbuf->type;
 
-		ret = wait_event_interruptible_timeout(wq, search_done != 0,
-			HZ / 5);
-		if (ret == 0) {
-			WRITE_PARSER_REG(PARSER_FETCH_CMD, 0);
+	f->stbuf = stbuf;
+	if (type == BUF_TYPE_HEVC)
+		f->parser_type = PARSER_VIDEO;
+	else if (type == BUF_TYPE_VIDEO)
+		f->parser_type = PARSER_VIDEO;
+	else if (type == BUF_TYPE_AUDIO)
+		f->parser_type = PARSER_AUDIO;
+	else
+		f->parser_type = PARSER_SUBPIC;
+}
 
-			if (wp == buf_wp(type)) {
-				/*no data fetched */
-				return -EAGAIN;
-			} else {
-				pr_info("W Timeout, but fetch ok,");
-				pr_info("type %d len=%d,wpdiff=%d, isphy %x\n",
-				 type, len, wp - buf_wp(type), stbuf->is_phybuf);
-			}
-		} else if (ret < 0)
-			return -ERESTARTSYS;
-	}
+static void esparser_data_parsed(struct stream_buf_s *stbuf, u32 len)
+{
+	u32 type = stbuf->type;
 
 	if ((type == BUF_TYPE_VIDEO)
 		|| (has_hevc_vdec() && (type == BUF_TYPE_HEVC)))
@@ -251,6 +253,35 @@ static int esparser_stbuf_write(struct stream_buf_s *stbuf, const u8 *buf, u32 c
 		audio_data_parsed += len;
 
 	threadrw_update_buffer_level(stbuf, len);
+}
+
+static int esparser_stbuf_write(struct stream_buf_s *stbuf, const u8 *buf, u32 count)
+{
+	struct esparser_fetch_s f;
+	ssize_t len;
+	int ret;
+
+	VDEC_PRINT_FUN_LINENO(__func__, __LINE__);
+	if (count == 0)
+		return 0;
+
+	esparser_fetch_init(&f, stbuf);
+
+	if (stbuf->is_phybuf) {
+		esparser_fetch_start(&f, (unsigned long)buf & 0xffffffff,
+				count);
+		ret = esparser_fetch_wait(&f);
+		if (ret < 0)
+			return ret;
+		len = count;
+	} else {
+		len = stbuf_fetch_write((const char __user *)buf, count,
+				&esparser_fetch_ops, &f, &fetch_stat);
+		if (len < 0)
+			return len;
+	}
+
+	esparser_data_parsed(stbuf, len);
 	VDEC_PRINT_FUN_LINENO(__func__, __LINE__);
 
 	return len;
@@ -980,6 +1011,86 @@ ssize_t esparser_write(struct file *file,
 }
 EXPORT_SYMBOL(esparser_write);
 
+/*
+ *Parse es data already in a dma-buf, the parser fetches it in place.
+ *Returns the bytes taken from [offset, offset + count).
+ */
+ssize_t esparser_write_dmabuf(struct file *file,
+			struct stream_buf_s *stbuf,
+			int fd, u32 offset, u32 count)
+{
+	struct esparser_fetch_s f;
+	struct stbuf_dmabuf_s d;
+	ssize_t r;
+	u32 len = count;
+
+	/*audio is copied by cpu into the aiu fifo, no fetch to skip*/
+	if (count == 0 || stbuf->type == BUF_TYPE_AUDIO)
+		return -EINVAL;
+
+	if (stbuf->write_thread) {
+		/*keep the order of data queued to the write thread*/
+		r = threadrw_flush_buffers(stbuf);
+		if (r < 0)
+			return r;
+	}
+
+	r = stbuf_dmabuf_import(fd, &d);
+	if (r < 0)
+		return r;
+
+	if (offset > d.dbuf->size || count > d.dbuf->size - offset) {
+		r = -EINVAL;
+		goto out;
+	}
+
+	if (stbuf->type != BUF_TYPE_SUBTITLE && stbuf_space(stbuf) < count) {
+		if (file && (file->f_flags & O_NONBLOCK)) {
+			len = stbuf_space(stbuf);
+			if (len < 256) {
+				r = -EAGAIN;
+				goto out;
+			}
+		} else {
+			len = min(stbuf_canusesize(stbuf) / 8, len);
+			if (stbuf_space(stbuf) < len) {
+				r = stbuf_wait_space(stbuf, len);
+				if (r < 0)
+					goto out;
+			}
+		}
+	}
+
+	stbuf->last_write_jiffies64 = jiffies_64;
+
+	mutex_lock(&esparser_mutex);
+
+	esparser_fetch_init(&f, stbuf);
+	stbuf->is_phybuf = false;
+	r = stbuf_fetch_write_dmabuf(&d, offset, len,
+			&esparser_fetch_ops, &f, &fetch_stat);
+	if (r > 0)
+		esparser_data_parsed(stbuf, r);
+
+	mutex_unlock(&esparser_mutex);
+out:
+	stbuf_dmabuf_release(&d);
+	return r;
+}
+EXPORT_SYMBOL(esparser_write_dmabuf);
+
+ssize_t esparser_fetch_stat_show(char *buf)
+{
+	return stbuf_fetch_stat_show(&fetch_stat, buf);
+}
+EXPORT_SYMBOL(esparser_fetch_stat_show);
+
+void esparser_fetch_stat_clear(void)
+{
+	memset(&fetch_stat, 0, sizeof(fetch_stat));
+}
+EXPORT_SYMBOL(esparser_fetch_stat_clear);
+
 void esparser_sub_reset(void)
 {
 	ulong flags;
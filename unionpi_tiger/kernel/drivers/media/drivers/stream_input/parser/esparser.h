@@ -34,6 +34,11 @@ extern ssize_t esparser_write_ex(struct file *file,
 			struct stream_buf_s *stbuf,
 			const char __user *buf, size_t count,
 			int is_phy);
+extern ssize_t esparser_write_dmabuf(struct file *file,
+			struct stream_buf_s *stbuf,
+			int fd, u32 offset, u32 count);
+extern ssize_t esparser_fetch_stat_show(char *buf);
+extern void esparser_fetch_stat_clear(void);
 
 extern s32 es_vpts_checkin_us64(struct stream_buf_s *buf, u64 us64);
 
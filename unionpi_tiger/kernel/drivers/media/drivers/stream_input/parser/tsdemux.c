@@ -23,6 +23,7 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-buf.h>
 #include <linux/amlogic/media/frame_sync/ptsserv.h>
 #include <linux/amlogic/media/frame_sync/tsync.h>
 #include <linux/amlogic/media/utils/amstream.h>
@@ -336,65 +337,56 @@ static irqreturn_t parser_isr(int irq, void *dev_id)
 	return IRQ_HANDLED;
 }
 
-static ssize_t _tsdemux_write(const char __user *buf, size_t count,
-							  int isphybuf)
-{
-	size_t r = count;
-	const char __user *p = buf;
-	u32 len;
-	int ret;
-	dma_addr_t dma_addr = 0;
+static struct stbuf_fetch_stat_s fetch_stat;
 
-	if (r > 0) {
-		if (isphybuf)
-			len = count;
-		else {
-			len = min_t(size_t, r, FETCHBUF_SIZE);
-			if (copy_from_user(fetchbuf, p, len))
-				return -EFAULT;
+static void tsdemux_fetch_start(void *priv, dma_addr_t addr, u32 len)
+{
+	fetch_done = 0;
 
-			dma_addr =
-				dma_map_single(amports_get_dma_device(),
-						fetchbuf,
-						FETCHBUF_SIZE, DMA_TO_DEVICE);
-			if (dma_mapping_error(amports_get_dma_device(),
-						dma_addr))
-				return -EFAULT;
+	wmb();		/* Ensure fetchbuf  contents visible */
 
+	WRITE_PARSER_REG(PARSER_FETCH_ADDR, (u32)addr);
+	WRITE_PARSER_REG(PARSER_FETCH_CMD, (7 << FETCH_ENDIAN) | len);
+}
 
-		}
+static int tsdemux_fetch_wait(void *priv)
+{
+	int ret;
 
-		fetch_done = 0;
+	ret = wait_event_interruptible_timeout(wq, fetch_done != 0, HZ / 2);
+	if (ret == 0) {
+		WRITE_PARSER_REG(PARSER_FETCH_CMD, 0);
+		pr_info("write timeout, retry\n");
+		return -EAGAIN;
+	} else if (ret < 0)
+		return -ERESTARTSYS;
 
-		wmb();		/* Ensure fetchbuf  contents visible */
+	return 0;
+}
 
-		if (isphybuf) {
-			u32 buf_32 = (unsigned long)buf & 0xffffffff;
-			WRITE_PARSER_REG(PARSER_FETCH_ADDR, buf_32);
-		} else {
-			WRITE_PARSER_REG(PARSER_FETCH_ADDR, dma_addr);
-			dma_unmap_single(amports_get_dma_device(), dma_addr,
-					FETCHBUF_SIZE, DMA_TO_DEVICE);
-		}
+static const struct stbuf_fetch_ops tsdemux_fetch_ops = {
+	.start = tsdemux_fetch_start,
+	.wait = tsdemux_fetch_wait,
+};
 
-		WRITE_PARSER_REG(PARSER_FETCH_CMD, (7 << FETCH_ENDIAN) | len);
+static ssize_t _tsdemux_write(const char __user *buf, size_t count,
+							  int isphybuf)
+{
+	int ret;
 
+	if (count == 0)
+		return 0;
 
-		ret =
-			wait_event_interruptible_timeout(wq, fetch_done != 0,
-					HZ / 2);
-		if (ret == 0) {
-			WRITE_PARSER_REG(PARSER_FETCH_CMD, 0);
-			pr_info("write timeout, retry\n");
-			return -EAGAIN;
-		} else if (ret < 0)
-			return -ERESTARTSYS;
+	if (!isphybuf)
+		return stbuf_fetch_write(buf, count, &tsdemux_fetch_ops,
+				NULL, &fetch_stat);
 
-		p += len;
-		r -= len;
-	}
+	tsdemux_fetch_start(NULL, (unsigned long)buf & 0xffffffff, count);
+	ret = tsdemux_fetch_wait(NULL);
+	if (ret < 0)
+		return ret;
 
-	return count - r;
+	return count;
 }
 
 #define PCR_EN                     12
@@ -953,10 +945,10 @@ ssize_t drm_tswrite(struct file *file,
 	return re_count;
 }
 
-ssize_t tsdemux_write(struct file *file,
-					  struct stream_buf_s *vbuf,
-					  struct stream_buf_s *abuf,
-					  const char __user *buf, size_t count)
+/* wait for stream buffer space, returns how much may be written now */
+static ssize_t tsdemux_write_size(struct file *file,
+		struct stream_buf_s *vbuf,
+		struct stream_buf_s *abuf, size_t count)
 {
 	s32 r;
 	struct port_priv_s *priv = (struct port_priv_s *)file->private_data;
@@ -1003,13 +995,62 @@ ssize_t tsdemux_write(struct file *file,
 	}
 	vbuf->last_write_jiffies64 = jiffies_64;
 	abuf->last_write_jiffies64 = jiffies_64;
-	write_size = limited_delay_check(file, vbuf, abuf, buf, count);
+	write_size = limited_delay_check(file, vbuf, abuf, NULL, count);
 	if (write_size > 0)
-		return _tsdemux_write(buf, write_size, 0);
+		return write_size;
 	else
 		return -EAGAIN;
 }
 
+ssize_t tsdemux_write(struct file *file,
+					  struct stream_buf_s *vbuf,
+					  struct stream_buf_s *abuf,
+					  const char __user *buf, size_t count)
+{
+	ssize_t write_size;
+
+	write_size = tsdemux_write_size(file, vbuf, abuf, count);
+	if (write_size < 0)
+		return write_size;
+
+	return _tsdemux_write(buf, write_size, 0);
+}
+
+/*
+ *Demux ts data already in a dma-buf, the parser fetches it in place.
+ *Returns the bytes taken from [offset, offset + count).
+ */
+ssize_t tsdemux_write_dmabuf(struct file *file,
+		struct stream_buf_s *vbuf,
+		struct stream_buf_s *abuf,
+		int fd, u32 offset, u32 count)
+{
+	struct stbuf_dmabuf_s d;
+	ssize_t write_size;
+	int ret;
+
+	if (count == 0)
+		return -EINVAL;
+
+	ret = stbuf_dmabuf_import(fd, &d);
+	if (ret < 0)
+		return ret;
+
+	if (offset > d.dbuf->size || count > d.dbuf->size - offset) {
+		stbuf_dmabuf_release(&d);
+		return -EINVAL;
+	}
+
+	write_size = tsdemux_write_size(file, vbuf, abuf, count);
+	if (write_size > 0)
+		write_size = stbuf_fetch_write_dmabuf(&d, offset, write_size,
+				&tsdemux_fetch_ops, NULL, &fetch_stat);
+
+	stbuf_dmabuf_release(&d);
+
+	return write_size;
+}
+
 int get_discontinue_counter(void)
 {
 	return discontinued_counter;
@@ -1022,8 +1063,25 @@ static ssize_t show_discontinue_counter(struct class *class,
 	return sprintf(buf, "%d\n", discontinued_counter);
 }
 
+static ssize_t show_fetch_stat(struct class *class,
+		struct class_attribute *attr, char *buf)
+{
+	return stbuf_fetch_stat_show(&fetch_stat, buf);
+}
+
+/* echo anything to clear */
+static ssize_t store_fetch_stat(struct class *class,
+		struct class_attribute *attr,
+		const char *buf, size_t size)
+{
+	memset(&fetch_stat, 0, sizeof(fetch_stat));
+	return size;
+}
+
 static struct class_attribute tsdemux_class_attrs[] = {
 	__ATTR(discontinue_counter, S_IRUGO, show_discontinue_counter, NULL),
+	__ATTR(fetch_stat, S_IRUGO | S_IWUSR | S_IWGRP,
+	show_fetch_stat, store_fetch_stat),
 	__ATTR_NULL
 };
 
@@ -81,6 +81,11 @@ extern ssize_t tsdemux_write(struct file *file,
 		struct stream_buf_s *abuf,
 		const char __user *buf, size_t count);
 
+extern ssize_t tsdemux_write_dmabuf(struct file *file,
+		struct stream_buf_s *vbuf,
+		struct stream_buf_s *abuf,
+		int fd, u32 offset, u32 count);
+
 extern u32 tsdemux_pcrscr_get(void);
 extern u8 tsdemux_pcrscr_valid(void);
 extern u8 tsdemux_pcraudio_valid(void);